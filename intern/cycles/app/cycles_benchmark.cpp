@@ -0,0 +1,647 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Benchmark of the CPU device on a fixed suite of generated XML scenes.
+ *
+ * Every scene is written to an XML file, read back with the XML reader and
+ * rendered headless. Scene loading, scene device update, BVH build and
+ * rendering are timed separately, and written as JSON together with the
+ * kernel counters and peak memory, to track regressions across builds. */
+
+#include <stdio.h>
+
+#include "buffers.h"
+#include "camera.h"
+#include "device.h"
+#include "light.h"
+#include "mesh.h"
+#include "object.h"
+#include "scene.h"
+#include "session.h"
+
+#include "util_args.h"
+#include "util_foreach.h"
+#include "util_logging.h"
+#include "util_math.h"
+#include "util_path.h"
+#include "util_progress.h"
+#include "util_string.h"
+#include "util_system.h"
+#include "util_time.h"
+
+#include "cycles_xml.h"
+
+CCL_NAMESPACE_BEGIN
+
+struct Options {
+	string scenes_path;
+	string output_path;
+	string filter;
+	int scale;
+	int samples;
+	int width, height;
+	int threads;
+	string bvh_layout;
+	bool camera_packets;
+} options;
+
+/* Random numbers with a fixed sequence, so every build renders the same
+ * scenes. */
+
+static float benchmark_random(uint *state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+static float benchmark_random_range(uint *state, float min, float max)
+{
+	return min + (max - min) * benchmark_random(state);
+}
+
+/* XML Writing */
+
+static string xml_float3(float3 v)
+{
+	return string_printf("%g %g %g", (double)v.x, (double)v.y, (double)v.z);
+}
+
+/* Camera looking down at the ground plane along +Z, a background, a diffuse
+ * shader and the ground plane itself. */
+static void xml_scene_begin(string& xml)
+{
+	xml += "<cycles>\n";
+	xml += "<transform translate=\"0 3 0\" rotate=\"20 1 0 0\">\n";
+	xml += string_printf("\t<camera type=\"perspective\" fov=\"60\" width=\"%d\" height=\"%d\" />\n",
+	                     options.width, options.height);
+	xml += "</transform>\n";
+	xml += "<integrator max_bounce=\"4\" transparent_max_bounce=\"8\" />\n";
+
+	xml += "<background>\n"
+	       "\t<background name=\"bg\" color=\"0.4 0.5 0.6\" strength=\"0.5\" />\n"
+	       "\t<connect from=\"bg background\" to=\"output surface\" />\n"
+	       "</background>\n";
+
+	xml += "<shader name=\"diffuse\">\n"
+	       "\t<diffuse_bsdf name=\"bsdf\" color=\"0.8 0.8 0.8\" />\n"
+	       "\t<connect from=\"bsdf bsdf\" to=\"output surface\" />\n"
+	       "</shader>\n";
+
+	xml += "<state shader=\"diffuse\">\n"
+	       "\t<mesh P=\"-50 -1 -10  50 -1 -10  50 -1 90  -50 -1 90\" nverts=\"4\" verts=\"0 1 2 3\" />\n"
+	       "</state>\n";
+}
+
+static void xml_sun(string& xml)
+{
+	xml += "<shader name=\"sun\">\n"
+	       "\t<emission name=\"emit\" color=\"1 0.95 0.9\" strength=\"3\" />\n"
+	       "\t<connect from=\"emit emission\" to=\"output surface\" />\n"
+	       "</shader>\n"
+	       "<state shader=\"sun\">\n"
+	       "\t<light type=\"1\" dir=\"-0.3 -1 0.4\" size=\"0.02\" />\n"
+	       "</state>\n";
+}
+
+static void xml_scene_end(string& xml)
+{
+	xml += "</cycles>\n";
+}
+
+/* UV sphere centered at the origin. */
+static void xml_sphere(string& xml, const char *name, float radius, int segments, const char *attributes = "")
+{
+	const int rings = segments / 2;
+	string P, nverts, verts;
+
+	for(int j = 0; j <= rings; j++) {
+		float theta = M_PI_F * j / rings;
+
+		for(int i = 0; i < segments; i++) {
+			float phi = M_2PI_F * i / segments;
+			float3 co = radius * make_float3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+			P += xml_float3(co) + " ";
+		}
+	}
+
+	for(int j = 0; j < rings; j++) {
+		for(int i = 0; i < segments; i++) {
+			int i1 = (i + 1) % segments;
+			nverts += "4 ";
+			verts += string_printf("%d %d %d %d ",
+			                       j * segments + i, j * segments + i1,
+			                       (j + 1) * segments + i1, (j + 1) * segments + i);
+		}
+	}
+
+	xml += string_printf("<mesh name=\"%s\" %s P=\"%s\" nverts=\"%s\" verts=\"%s\" />\n",
+	                     name, attributes, P.c_str(), nverts.c_str(), verts.c_str());
+}
+
+/* Scenes
+ *
+ * The scale option multiplies the number of instances, hair curves, lights
+ * and the geometric detail of each scene. */
+
+static string scene_instancing(int scale)
+{
+	string xml;
+	xml_scene_begin(xml);
+
+	/* one high resolution rock, instanced all over the ground */
+	uint rng = 1;
+	int num_instances = 2000 * scale;
+
+	xml += "<state shader=\"diffuse\" interpolation=\"smooth\">\n";
+	xml += "<transform translate=\"0 -0.5 6\">\n";
+	xml_sphere(xml, "rock", 0.5f, 64);
+	xml += "</transform>\n";
+
+	for(int i = 1; i < num_instances; i++) {
+		float3 co = make_float3(benchmark_random_range(&rng, -25.0f, 25.0f),
+		                        -1.0f,
+		                        benchmark_random_range(&rng, 4.0f, 80.0f));
+		float size = benchmark_random_range(&rng, 0.2f, 1.5f);
+		float angle = benchmark_random_range(&rng, 0.0f, 360.0f);
+
+		xml += string_printf("<transform translate=\"%s\" rotate=\"%g 0 1 0\" scale=\"%g %g %g\"><object mesh=\"rock\" /></transform>\n",
+		                     xml_float3(co).c_str(), (double)angle, (double)size, (double)(size * 0.6f), (double)size);
+	}
+
+	xml += "</state>\n";
+	xml_sun(xml);
+
+	xml_scene_end(xml);
+	return xml;
+}
+
+static string scene_hair(int scale)
+{
+	string xml;
+	xml_scene_begin(xml);
+
+	xml += "<shader name=\"hair\">\n"
+	       "\t<hair_bsdf name=\"bsdf\" color=\"0.6 0.4 0.2\" roughnessu=\"0.2\" roughnessv=\"0.4\" />\n"
+	       "\t<connect from=\"bsdf bsdf\" to=\"output surface\" />\n"
+	       "</shader>\n";
+
+	xml += "<transform translate=\"0 1 8\">\n";
+	xml += "<state shader=\"diffuse\" interpolation=\"smooth\">\n";
+	xml_sphere(xml, "head", 2.0f, 32);
+	xml += "</state>\n";
+
+	/* curves growing out of the head along the normal, drooping down */
+	uint rng = 2;
+	int num_curves = 20000 * scale;
+	const int num_keys = 5;
+	string P, nkeys;
+
+	for(int i = 0; i < num_curves; i++) {
+		float3 N = normalize(make_float3(benchmark_random_range(&rng, -1.0f, 1.0f),
+		                                 benchmark_random_range(&rng, -0.2f, 1.0f),
+		                                 benchmark_random_range(&rng, -1.0f, 1.0f)));
+		float length = benchmark_random_range(&rng, 0.8f, 1.6f);
+
+		for(int k = 0; k < num_keys; k++) {
+			float t = length * k / (num_keys - 1);
+			float3 co = N * (2.0f + t) - make_float3(0.0f, 0.3f * t * t, 0.0f);
+			P += xml_float3(co) + " ";
+		}
+
+		nkeys += string_printf("%d ", num_keys);
+	}
+
+	xml += string_printf("<state shader=\"hair\">\n<curves name=\"hair\" P=\"%s\" nkeys=\"%s\" radius=\"0.01\" />\n</state>\n",
+	                     P.c_str(), nkeys.c_str());
+	xml += "</transform>\n";
+	xml_sun(xml);
+
+	xml_scene_end(xml);
+	return xml;
+}
+
+static string scene_volume(int scale)
+{
+	string xml;
+	xml_scene_begin(xml);
+
+	/* heterogeneous smoke in a box, with a few spheres inside */
+	xml += string_printf("<integrator volume_step_size=\"%g\" volume_max_steps=\"1024\" />\n",
+	                     (double)(0.1f / scale));
+
+	xml += "<shader name=\"smoke\" heterogeneous_volume=\"true\">\n"
+	       "\t<texture_coordinate name=\"texco\" />\n"
+	       "\t<noise_texture name=\"noise\" scale=\"2\" detail=\"4\" />\n"
+	       "\t<math name=\"density\" type=\"Multiply\" value2=\"4\" use_clamp=\"false\" />\n"
+	       "\t<scatter_volume name=\"scatter\" color=\"0.8 0.8 0.8\" anisotropy=\"0.3\" />\n"
+	       "\t<connect from=\"texco object\" to=\"noise vector\" />\n"
+	       "\t<connect from=\"noise fac\" to=\"density value1\" />\n"
+	       "\t<connect from=\"density value\" to=\"scatter density\" />\n"
+	       "\t<connect from=\"scatter volume\" to=\"output volume\" />\n"
+	       "</shader>\n";
+
+	xml += "<state shader=\"smoke\">\n"
+	       "\t<transform translate=\"0 1 8\" scale=\"3 2 3\">\n"
+	       "\t\t<mesh P=\"-1 -1 -1  1 -1 -1  1 1 -1  -1 1 -1  -1 -1 1  1 -1 1  1 1 1  -1 1 1\"\n"
+	       "\t\t      nverts=\"4 4 4 4 4 4\"\n"
+	       "\t\t      verts=\"0 3 2 1  4 5 6 7  0 1 5 4  2 3 7 6  0 4 7 3  1 2 6 5\" />\n"
+	       "\t</transform>\n"
+	       "</state>\n";
+
+	xml += "<state shader=\"diffuse\" interpolation=\"smooth\">\n";
+	for(int i = 0; i < 3; i++) {
+		xml += string_printf("<transform translate=\"%d 0 8\">\n", (i - 1) * 2);
+		xml_sphere(xml, string_printf("sphere%d", i).c_str(), 0.6f, 32);
+		xml += "</transform>\n";
+	}
+	xml += "</state>\n";
+
+	xml += "<shader name=\"lamp\">\n"
+	       "\t<emission name=\"emit\" color=\"1 0.9 0.8\" strength=\"200\" />\n"
+	       "\t<connect from=\"emit emission\" to=\"output surface\" />\n"
+	       "</shader>\n";
+	xml += "<state shader=\"lamp\">\n"
+	       "\t<light type=\"0\" P=\"2 4 6\" size=\"0.2\" />\n"
+	       "</state>\n";
+
+	xml_scene_end(xml);
+	return xml;
+}
+
+static string scene_lights(int scale)
+{
+	string xml;
+	xml_scene_begin(xml);
+
+	/* small lamps scattered over the ground, between some spheres */
+	xml += "<state shader=\"diffuse\" interpolation=\"smooth\">\n";
+	for(int i = 0; i < 16; i++) {
+		xml += string_printf("<transform translate=\"%d 0 %d\">\n", (i % 4 - 2) * 4 + 2, (i / 4) * 4 + 6);
+		xml_sphere(xml, string_printf("sphere%d", i).c_str(), 1.0f, 32);
+		xml += "</transform>\n";
+	}
+	xml += "</state>\n";
+
+	xml += "<shader name=\"lamp\">\n"
+	       "\t<emission name=\"emit\" color=\"1 0.9 0.8\" strength=\"20\" />\n"
+	       "\t<connect from=\"emit emission\" to=\"output surface\" />\n"
+	       "</shader>\n";
+
+	uint rng = 3;
+	int num_lights = 256 * scale;
+
+	xml += "<state shader=\"lamp\">\n";
+	for(int i = 0; i < num_lights; i++) {
+		float3 co = make_float3(benchmark_random_range(&rng, -12.0f, 12.0f),
+		                        benchmark_random_range(&rng, -0.8f, 2.0f),
+		                        benchmark_random_range(&rng, 3.0f, 24.0f));
+		xml += string_printf("<light type=\"0\" P=\"%s\" size=\"0.05\" />\n", xml_float3(co).c_str());
+	}
+	xml += "</state>\n";
+
+	xml_scene_end(xml);
+	return xml;
+}
+
+static string scene_displacement(int scale)
+{
+	string xml;
+	xml_scene_begin(xml);
+
+	xml += "<shader name=\"rocks\">\n"
+	       "\t<diffuse_bsdf name=\"bsdf\" color=\"0.6 0.5 0.4\" />\n"
+	       "\t<texture_coordinate name=\"texco\" />\n"
+	       "\t<noise_texture name=\"noise\" scale=\"0.5\" detail=\"6\" />\n"
+	       "\t<connect from=\"texco object\" to=\"noise vector\" />\n"
+	       "\t<connect from=\"noise fac\" to=\"output displacement\" />\n"
+	       "\t<connect from=\"bsdf bsdf\" to=\"output surface\" />\n"
+	       "</shader>\n";
+
+	/* subdivided grid, diced and displaced when loading and syncing */
+	const int size = 8;
+	string P, nverts, verts;
+
+	for(int j = 0; j <= size; j++)
+		for(int i = 0; i <= size; i++)
+			P += string_printf("%d 0 %d ", (i - size / 2) * 3, j * 3);
+
+	for(int j = 0; j < size; j++) {
+		for(int i = 0; i < size; i++) {
+			nverts += "4 ";
+			verts += string_printf("%d %d %d %d ",
+			                       j * (size + 1) + i, j * (size + 1) + i + 1,
+			                       (j + 1) * (size + 1) + i + 1, (j + 1) * (size + 1) + i);
+		}
+	}
+
+	xml += "<state shader=\"rocks\" displacement_method=\"true\" interpolation=\"smooth\">\n";
+	xml += "<transform translate=\"0 -1.5 2\">\n";
+	xml += string_printf("<mesh subdivision=\"catmull-clark\" dicing_rate=\"%g\" P=\"%s\" nverts=\"%s\" verts=\"%s\" />\n",
+	                     (double)(0.1f / scale), P.c_str(), nverts.c_str(), verts.c_str());
+	xml += "</transform>\n";
+	xml += "</state>\n";
+	xml_sun(xml);
+
+	xml_scene_end(xml);
+	return xml;
+}
+
+struct BenchmarkScene {
+	const char *name;
+	string (*generate)(int scale);
+};
+
+static const BenchmarkScene benchmark_scenes[] = {
+	{"instancing", scene_instancing},
+	{"hair", scene_hair},
+	{"volume", scene_volume},
+	{"lights", scene_lights},
+	{"displacement", scene_displacement},
+};
+
+/* Benchmark */
+
+static bool benchmark_run(const BenchmarkScene& bscene, const DeviceInfo& device_info, string& result)
+{
+	string filepath = path_join(options.scenes_path, string(bscene.name) + ".xml");
+	string xml = bscene.generate(options.scale);
+
+	if(!path_write_text(filepath, xml)) {
+		fprintf(stderr, "Failed to write scene %s\n", filepath.c_str());
+		return false;
+	}
+
+	fprintf(stderr, "Rendering %s\n", bscene.name);
+
+	/* read scene */
+	double load_start = time_dt();
+
+	SceneParams scene_params;
+	scene_params.use_qbvh = (options.bvh_layout != "binary");
+	scene_params.use_obvh = (options.bvh_layout == "obvh");
+	Scene *scene = new Scene(scene_params, device_info);
+	xml_read_file(scene, filepath.c_str());
+
+	scene->camera->width = options.width;
+	scene->camera->height = options.height;
+	scene->camera->compute_auto_viewplane();
+
+	double load_time = time_dt() - load_start;
+
+	/* render, the session takes ownership of the scene */
+	SessionParams session_params;
+	session_params.device = device_info;
+	session_params.background = true;
+	session_params.samples = options.samples;
+	session_params.threads = options.threads;
+	session_params.use_camera_packets = options.camera_packets;
+
+	BufferParams buffer_params;
+	buffer_params.width = options.width;
+	buffer_params.height = options.height;
+	buffer_params.full_width = options.width;
+	buffer_params.full_height = options.height;
+
+	Session *session = new Session(session_params);
+	session->scene = scene;
+	session->reset(buffer_params, options.samples);
+
+	double session_start = time_dt();
+	session->start();
+	session->wait();
+	double session_time = time_dt() - session_start;
+
+	if(session->progress.get_error()) {
+		fprintf(stderr, "Failed to render %s: %s\n", bscene.name, session->progress.get_error_message().c_str());
+		delete session;
+		return false;
+	}
+
+	/* gather statistics */
+	const double sync_time = scene->update_stats.get_total_time();
+	const double render_time = max(session_time - sync_time, 1e-6);
+	const MeshManager::BuildStats& build_stats = scene->mesh_manager->build_stats;
+
+	size_t num_triangles = 0, num_curves = 0;
+	foreach(Mesh *mesh, scene->meshes) {
+		num_triangles += mesh->triangles.size();
+		num_curves += mesh->curves.size();
+	}
+
+	KernelCounters counters;
+	{
+		thread_scoped_lock lock(session->stats.kernel_mutex);
+		counters = session->stats.kernel_counters;
+	}
+
+	/* Devices without kernel counters leave them all at zero, every render
+	 * traces camera rays otherwise. Report null rather than misleading zeros. */
+	const bool counters_available = (counters.total_rays() > 0);
+	string rays = "null", bvh_nodes = "null", shader_evals = "null", rays_per_second = "null";
+
+	if(counters_available) {
+		rays = string_printf("%llu", (unsigned long long)counters.total_rays());
+		bvh_nodes = string_printf("%llu", (unsigned long long)counters.bvh_nodes);
+		shader_evals = string_printf("%llu", (unsigned long long)counters.shader_evals);
+		rays_per_second = string_printf("%f", counters.total_rays() / render_time);
+	}
+
+	double num_samples = (double)options.width * options.height * options.samples;
+
+	result = string_printf(
+	        "    {\"name\": \"%s\", "
+	        "\"load_time\": %f, \"sync_time\": %f, \"bvh_time\": %f, \"displacement_time\": %f, "
+	        "\"render_time\": %f, "
+	        "\"objects\": %d, \"meshes\": %d, \"triangles\": %llu, \"curves\": %llu, \"lights\": %d, "
+	        "\"counters_available\": %s, "
+	        "\"rays\": %s, \"bvh_nodes\": %s, \"shader_evals\": %s, "
+	        "\"rays_per_second\": %s, \"samples_per_second\": %f, "
+	        "\"device_mem_peak\": %llu, \"process_mem_peak\": %llu}",
+	        bscene.name,
+	        load_time, sync_time, build_stats.bvh_time, build_stats.displacement_time,
+	        render_time,
+	        (int)scene->objects.size(), (int)scene->meshes.size(),
+	        (unsigned long long)num_triangles, (unsigned long long)num_curves,
+	        (int)scene->lights.size(),
+	        (counters_available)? "true": "false",
+	        rays.c_str(),
+	        bvh_nodes.c_str(),
+	        shader_evals.c_str(),
+	        rays_per_second.c_str(),
+	        num_samples / render_time,
+	        (unsigned long long)session->stats.mem_peak,
+	        (unsigned long long)system_process_peak_memory());
+
+	delete session;
+
+	return true;
+}
+
+static void options_parse(int argc, const char **argv)
+{
+	options.scenes_path = ".";
+	options.output_path = "";
+	options.filter = "";
+	options.scale = 1;
+	options.samples = 16;
+	options.width = 640;
+	options.height = 360;
+	options.threads = 0;
+	options.bvh_layout = "qbvh";
+	options.camera_packets = false;
+
+	ArgParse ap;
+	bool help = false, list = false, debug = false;
+	int verbosity = 1;
+
+	ap.options ("Usage: cycles_benchmark [options]",
+		"--scenes %s", &options.scenes_path, "Directory to write the generated XML scenes to",
+		"--output %s", &options.output_path, "File path to write the JSON results to, instead of the standard output",
+		"--filter %s", &options.filter, "Only run scenes with this text in their name",
+		"--scale %d", &options.scale, "Multiply instances, hair curves, lights and geometric detail",
+		"--samples %d", &options.samples, "Number of samples to render",
+		"--width %d", &options.width, "Image width in pixels",
+		"--height %d", &options.height, "Image height in pixels",
+		"--threads %d", &options.threads, "CPU Rendering Threads",
+		"--bvh %s", &options.bvh_layout, "BVH layout to render with: binary, qbvh or obvh (AVX2 only)",
+		"--camera-packets", &options.camera_packets, "Trace camera rays as packets",
+		"--list", &list, "List the benchmark scenes",
+#ifdef WITH_CYCLES_LOGGING
+		"--debug", &debug, "Enable debug logging",
+		"--verbose %d", &verbosity, "Set verbosity of the logger",
+#endif
+		"--help", &help, "Print help message",
+		NULL);
+
+	if(ap.parse(argc, argv) < 0) {
+		fprintf(stderr, "%s\n", ap.geterror().c_str());
+		ap.usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if(debug) {
+		util_logging_start();
+		util_logging_verbosity_set(verbosity);
+	}
+
+	if(help) {
+		ap.usage();
+		exit(EXIT_SUCCESS);
+	}
+	else if(list) {
+		for(size_t i = 0; i < sizeof(benchmark_scenes) / sizeof(*benchmark_scenes); i++)
+			printf("%s\n", benchmark_scenes[i].name);
+		exit(EXIT_SUCCESS);
+	}
+	else if(options.scale < 1 || options.samples < 1 || options.width < 1 || options.height < 1) {
+		fprintf(stderr, "Invalid scale, samples or image size\n");
+		exit(EXIT_FAILURE);
+	}
+	else if(options.bvh_layout != "binary" && options.bvh_layout != "qbvh" && options.bvh_layout != "obvh") {
+		fprintf(stderr, "Unknown BVH layout %s\n", options.bvh_layout.c_str());
+		exit(EXIT_FAILURE);
+	}
+
+	/* OBVH traversal is only compiled into the AVX2 kernel */
+	if(options.bvh_layout == "obvh") {
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
+		bool use_obvh = system_cpu_support_avx2();
+#else
+		bool use_obvh = false;
+#endif
+		if(!use_obvh) {
+			fprintf(stderr, "OBVH requires the AVX2 kernel and a CPU supporting it\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static int benchmark_main(int argc, const char **argv)
+{
+	options_parse(argc, argv);
+
+	/* always the CPU device, to compare builds on the same machine */
+	DeviceInfo device_info;
+	bool device_available = false;
+
+	foreach(DeviceInfo& info, Device::available_devices()) {
+		if(info.type == DEVICE_CPU) {
+			device_info = info;
+			device_available = true;
+			break;
+		}
+	}
+
+	if(!device_available) {
+		fprintf(stderr, "CPU device not available\n");
+		return EXIT_FAILURE;
+	}
+
+	string json = string_printf(
+	        "{\n  \"cpu\": \"%s\",\n  \"threads\": %d,\n  \"bvh\": \"%s\",\n  \"camera_packets\": %s,\n  \"scale\": %d,\n"
+	        "  \"samples\": %d,\n  \"width\": %d,\n  \"height\": %d,\n  \"scenes\": [",
+	        system_cpu_brand_string().c_str(),
+	        (options.threads)? options.threads: system_cpu_thread_count(),
+	        options.bvh_layout.c_str(),
+	        (options.camera_packets)? "true": "false",
+	        options.scale, options.samples, options.width, options.height);
+
+	bool first = true;
+	bool success = true;
+
+	for(size_t i = 0; i < sizeof(benchmark_scenes) / sizeof(*benchmark_scenes); i++) {
+		const BenchmarkScene& bscene = benchmark_scenes[i];
+		string result;
+
+		if(options.filter != "" && string(bscene.name).find(options.filter) == string::npos)
+			continue;
+
+		if(!benchmark_run(bscene, device_info, result)) {
+			success = false;
+			continue;
+		}
+
+		json += (first)? "\n": ",\n";
+		json += result;
+		first = false;
+	}
+
+	json += "\n  ]\n}\n";
+
+	if(options.output_path != "") {
+		if(!path_write_text(options.output_path, json)) {
+			fprintf(stderr, "Failed to write %s\n", options.output_path.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+	else {
+		printf("%s", json.c_str());
+	}
+
+	return (success)? EXIT_SUCCESS: EXIT_FAILURE;
+}
+
+CCL_NAMESPACE_END
+
+using namespace ccl;
+
+int main(int argc, const char **argv)
+{
+	util_logging_init(argv[0]);
+	path_init();
+
+	return benchmark_main(argc, argv);
+}
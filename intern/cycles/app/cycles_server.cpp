@@ -37,7 +37,7 @@ int main(int argc, const char **argv)
 	string devicelist = "";
 	string devicename = "cpu";
 	bool list = false, debug = false;
-	int threads = 0, verbosity = 1;
+	int threads = 0, verbosity = 1, port = 0;
 
 	vector<DeviceType>& types = Device::available_types();
 
@@ -55,6 +55,7 @@ int main(int argc, const char **argv)
 		"--device %s", &devicename, ("Devices to use: " + devicelist).c_str(),
 		"--list-devices", &list, "List information about all available devices",
 		"--threads %d", &threads, "Number of threads to use for CPU device",
+		"--port %d", &port, "Port to listen on, to run multiple servers on one machine (default 5120)",
 #ifdef WITH_CYCLES_LOGGING
 		"--debug", &debug, "Enable debug logging",
 		"--verbose %d", &verbosity, "Set verbosity of the logger",
@@ -104,7 +105,7 @@ int main(int argc, const char **argv)
 		Stats stats;
 		Device *device = Device::create(device_info, stats, true);
 		printf("Cycles Server with device: %s\n", device->info.description.c_str());
-		device->server_run();
+		device->server_run(port);
 		delete device;
 	}
 
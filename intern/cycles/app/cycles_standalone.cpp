@@ -47,6 +47,7 @@ struct Options {
 	int width, height;
 	SceneParams scene_params;
 	SessionParams session_params;
+	string kernel_stats_path;
 	bool quiet;
 	bool show_help, interactive, pause;
 } options;
@@ -103,6 +104,7 @@ static void session_init()
 	options.session = new Session(options.session_params);
 	options.session->reset(session_buffer_params(), options.session_params.samples);
 	options.session->scene = options.scene;
+	options.session->stats.kernel_record_tiles = !options.kernel_stats_path.empty();
 
 	if(options.session_params.background && !options.quiet)
 		options.session->progress.set_update_callback(function_bind(&session_print_status));
@@ -139,6 +141,13 @@ static void scene_init()
 
 static void session_exit()
 {
+	if(options.session && !options.kernel_stats_path.empty()) {
+		int tile;
+		double total_time, render_time, tile_time;
+		options.session->progress.get_tile(tile, total_time, render_time, tile_time);
+		options.session->write_kernel_stats(options.kernel_stats_path, 0, total_time);
+	}
+
 	if(options.session) {
 		delete options.session;
 		options.session = NULL;
@@ -311,6 +320,7 @@ static void options_parse(int argc, const char **argv)
 	options.height = 0;
 	options.filepath = "";
 	options.session = NULL;
+	options.kernel_stats_path = "";
 	options.quiet = false;
 
 	/* device names */
@@ -349,8 +359,10 @@ static void options_parse(int argc, const char **argv)
 		"--background", &options.session_params.background, "Render in background, without user interface",
 		"--quiet", &options.quiet, "In background mode, don't print progress messages",
 		"--samples %d", &options.session_params.samples, "Number of samples to render",
-		"--output %s", &options.session_params.output_path, "File path to write output image",
+		"--output %s", &options.session_params.output_path, "File path to write output image, .exr files are written tile by tile with all passes",
 		"--threads %d", &options.session_params.threads, "CPU Rendering Threads",
+		"--camera-packets", &options.session_params.use_camera_packets, "Trace camera rays as packets on the CPU",
+		"--kernel-stats %s", &options.kernel_stats_path, "File path to write rays, BVH nodes, shader evaluations and bounces per tile as JSON",
 		"--width  %d", &options.width, "Window width in pixel",
 		"--height %d", &options.height, "Window height in pixel",
 		"--list-devices", &list, "List information about all available devices",
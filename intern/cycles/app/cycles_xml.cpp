@@ -866,6 +866,11 @@ static void xml_read_mesh(const XMLReadState& state, pugi::xml_node node)
 	Mesh *mesh = xml_add_mesh(state.scene, state.tfm);
 	mesh->used_shaders.push_back(state.shader);
 
+	/* name for instancing with object nodes */
+	string name;
+	if(xml_read_string(&name, node, "name"))
+		mesh->name = ustring(name);
+
 	/* read state */
 	int shader = state.shader;
 	bool smooth = state.smooth;
@@ -951,6 +956,72 @@ static void xml_read_mesh(const XMLReadState& state, pugi::xml_node node)
 	mesh->attributes.remove(ATTR_STD_VERTEX_NORMAL);
 }
 
+/* Curves */
+
+static void xml_read_curves(const XMLReadState& state, pugi::xml_node node)
+{
+	/* add mesh */
+	Mesh *mesh = xml_add_mesh(state.scene, state.tfm);
+	mesh->used_shaders.push_back(state.shader);
+
+	string name;
+	if(xml_read_string(&name, node, "name"))
+		mesh->name = ustring(name);
+
+	/* read keys and the number of keys of each curve, radius is given per
+	 * key or once for all keys */
+	vector<float3> P;
+	vector<int> nkeys;
+	vector<float> radius;
+
+	xml_read_float3_array(P, node, "P");
+	xml_read_int_array(nkeys, node, "nkeys");
+	xml_read_float_array(radius, node, "radius");
+
+	if(radius.size() != 1 && radius.size() != P.size()) {
+		fprintf(stderr, "Invalid number of curve radii.\n");
+		return;
+	}
+
+	for(size_t i = 0; i < P.size(); i++)
+		mesh->add_curve_key(P[i], (radius.size() == 1)? radius[0]: radius[i]);
+
+	int first_key = 0;
+
+	for(size_t i = 0; i < nkeys.size(); i++) {
+		if(nkeys[i] < 2 || first_key + nkeys[i] > (int)P.size()) {
+			fprintf(stderr, "Invalid number of curve keys.\n");
+			break;
+		}
+
+		mesh->add_curve(first_key, nkeys[i], state.shader);
+		first_key += nkeys[i];
+	}
+}
+
+/* Object */
+
+static void xml_read_object(const XMLReadState& state, pugi::xml_node node)
+{
+	/* instance of a named mesh or curves node read before */
+	string name;
+	xml_read_string(&name, node, "mesh");
+
+	ustring mesh_name(name);
+
+	foreach(Mesh *mesh, state.scene->meshes) {
+		if(mesh->name == mesh_name) {
+			Object *object = new Object();
+			object->mesh = mesh;
+			object->tfm = state.tfm;
+			state.scene->objects.push_back(object);
+			return;
+		}
+	}
+
+	fprintf(stderr, "Unknown mesh \"%s\".\n", name.c_str());
+}
+
 /* Patch */
 
 static void xml_read_patch(const XMLReadState& state, pugi::xml_node node)
@@ -1155,6 +1226,12 @@ static void xml_read_scene(const XMLReadState& state, pugi::xml_node scene_node)
 		else if(string_iequals(node.name(), "mesh")) {
 			xml_read_mesh(state, node);
 		}
+		else if(string_iequals(node.name(), "curves")) {
+			xml_read_curves(state, node);
+		}
+		else if(string_iequals(node.name(), "object")) {
+			xml_read_object(state, node);
+		}
 		else if(string_iequals(node.name(), "patch")) {
 			xml_read_patch(state, node);
 		}
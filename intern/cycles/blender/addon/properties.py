@@ -21,7 +21,8 @@ from bpy.props import (BoolProperty,
                        EnumProperty,
                        FloatProperty,
                        IntProperty,
-                       PointerProperty)
+                       PointerProperty,
+                       StringProperty)
 
 # enums
 
@@ -265,6 +266,13 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 default=True,
                 )
 
+        cls.use_light_tree = BoolProperty(
+                name="Light Tree",
+                description="Pick lamps and emissive meshes based on their distance and orientation, "
+                            "reducing noise in scenes with many lights (path tracing only)",
+                default=False,
+                )
+
         cls.caustics_reflective = BoolProperty(
                 name="Reflective Caustics",
                 description="Use reflective caustics, resulting in a brighter image (more noise but added realism)",
@@ -418,6 +426,28 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 default=0.0,
                 )
 
+        cls.use_adaptive_sampling = BoolProperty(
+                name="Adaptive Sampling",
+                description="Stop sampling pixels and tiles once their noise is below the threshold, "
+                            "only for final renders on the CPU without progressive refine",
+                default=False,
+                )
+        cls.adaptive_threshold = FloatProperty(
+                name="Adaptive Threshold",
+                description="Noise level at which a pixel stops being sampled, "
+                            "lower values give less noise at the cost of render time",
+                min=0.0001, max=1.0,
+                default=0.01,
+                precision=4,
+                )
+        cls.adaptive_min_samples = IntProperty(
+                name="Adaptive Min Samples",
+                description="Number of samples to render before pixels may stop, "
+                            "automatic from the threshold if 0",
+                min=0, max=4096,
+                default=0,
+                )
+
         cls.debug_tile_size = IntProperty(
                 name="Tile Size",
                 description="",
@@ -463,9 +493,87 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                 description="Use BVH spatial splits: longer builder time, faster render",
                 default=False,
                 )
+        cls.debug_use_obvh = BoolProperty(
+                name="Use 8-wide BVH",
+                description="Use 8 wide BVH nodes on CPUs supporting AVX2, instead of the 4 wide BVH",
+                default=False,
+                )
+        cls.debug_use_bvh_time_bounds = BoolProperty(
+                name="Use Motion BVH Bounds",
+                description="Store BVH bounds that move with deformation motion blur, instead of only "
+                            "bounding all motion steps: faster render of deforming meshes, more memory",
+                default=True,
+                )
+        cls.debug_use_bvh_curve_splits = BoolProperty(
+                name="Use Hair BVH Splits",
+                description="Split long hair segments into pieces with tighter BVH bounds: "
+                            "faster render of hair, longer build time and more memory "
+                            "(not used with a hair minimum width)",
+                default=True,
+                )
+        cls.debug_use_volume_grid = BoolProperty(
+                name="Use Volume Grid",
+                description="Skip empty space of smoke simulations using a coarse grid built from the voxel data. "
+                            "Only used for volume shaders whose density and emission depend on the voxel "
+                            "attributes alone, disable to step through all volumes",
+                default=True,
+                )
+        cls.debug_use_cpu_camera_packets = BoolProperty(
+                name="Use Camera Ray Packets",
+                description="Trace camera rays of neighboring pixels together as packets on the CPU, "
+                            "shadow and indirect rays are traced per path. "
+                            "Scenes with motion blur or hair minimum width trace camera rays per path too",
+                default=False,
+                )
+        cls.debug_use_mesh_bulk_sync = BoolProperty(
+                name="Bulk Mesh Sync",
+                description="Read mesh data directly from the derived mesh arrays, "
+                            "disable to read it element by element through RNA as a reference",
+                default=True,
+                )
+        cls.debug_use_shader_optimization = BoolProperty(
+                name="Optimize Shaders",
+                description="Fold constant nodes, merge duplicate nodes and fuse chains of math nodes "
+                            "when compiling SVM shaders, disable to compare against the unoptimized program",
+                default=True,
+                )
+        cls.debug_kernel_stats_path = StringProperty(
+                name="Kernel Stats",
+                description="Write rays, BVH nodes, shader evaluations and bounces counted by the CPU kernels "
+                            "for every rendered frame and tile to this JSON file, # characters are replaced "
+                            "by the frame number",
+                subtype='FILE_PATH',
+                default="",
+                )
         cls.use_cache = BoolProperty(
                 name="Cache BVH",
-                description="Cache last built BVH to disk for faster re-render if no geometry changed",
+                description="Cache built BVHs to disk for faster re-render if no geometry changed",
+                default=True,
+                )
+        cls.cache_size = IntProperty(
+                name="Cache Size",
+                description="Maximum size of the BVH disk cache in megabytes, least recently used "
+                            "BVHs are removed first (0 for unlimited)",
+                min=0, max=1024 * 1024,
+                default=4096,
+                )
+        cls.use_texture_cache = BoolProperty(
+                name="Texture Cache",
+                description="Read image textures in tiles when they are first used instead of loading "
+                            "them fully, to reduce memory usage with many large images (CPU only)",
+                default=False,
+                )
+        cls.texture_cache_size = IntProperty(
+                name="Texture Cache Size",
+                description="Maximum memory used by the texture cache in megabytes, least recently "
+                            "used tiles are freed first",
+                min=1, max=1024 * 1024,
+                default=4096,
+                )
+        cls.use_bvh_reuse = BoolProperty(
+                name="Reuse Object BVH",
+                description="Keep object BVHs between frames with persistent data, only rebuilding "
+                            "the top level BVH when objects did not change or deform",
                 default=False,
                 )
         cls.tile_order = EnumProperty(
@@ -483,6 +591,13 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
                             "but time can be saved by manually stopping the render when the noise is low enough)",
                 default=False,
                 )
+        cls.use_work_stealing = BoolProperty(
+                name="Work Stealing",
+                description="When no tiles are left, split the remaining samples of the slowest tiles "
+                            "between idle threads, so all threads stay busy until the end of the render "
+                            "(CPU final renders only, not used with adaptive sampling or progressive refine)",
+                default=False,
+                )
 
         cls.bake_type = EnumProperty(
             name="Bake Type",
@@ -848,7 +963,7 @@ class CyclesMeshSettings(bpy.types.PropertyGroup):
                 )
         cls.dicing_rate = FloatProperty(
                 name="Dicing Rate",
-                description="",
+                description="Size of a micropolygon in pixels, patches are diced finer closer to the camera",
                 min=0.001, max=1000.0,
                 default=1.0,
                 )
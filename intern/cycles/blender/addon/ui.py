@@ -154,6 +154,8 @@ class CyclesRender_PT_sampling(CyclesButtonsPanel, Panel):
             sub.label(text="Samples:")
             sub.prop(cscene, "samples", text="Render")
             sub.prop(cscene, "preview_samples", text="Preview")
+            sub.separator()
+            sub.prop(cscene, "use_light_tree")
         else:
             sub.label(text="AA Samples:")
             sub.prop(cscene, "aa_samples", text="Render")
@@ -176,6 +178,14 @@ class CyclesRender_PT_sampling(CyclesButtonsPanel, Panel):
         if use_cpu(context) or cscene.feature_set == 'EXPERIMENTAL':
             layout.row().prop(cscene, "sampling_pattern", text="Pattern")
 
+        if use_cpu(context):
+            row = layout.row(align=True)
+            row.prop(cscene, "use_adaptive_sampling", text="Adaptive")
+            sub = row.row(align=True)
+            sub.active = cscene.use_adaptive_sampling
+            sub.prop(cscene, "adaptive_threshold", text="Threshold")
+            sub.prop(cscene, "adaptive_min_samples", text="Min Samples")
+
         for rl in scene.render.layers:
             if rl.samples > 0:
                 layout.separator()
@@ -316,7 +326,12 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
         sub.prop(rd, "tile_x", text="X")
         sub.prop(rd, "tile_y", text="Y")
 
-        sub.prop(cscene, "use_progressive_refine")
+        subsub = sub.column(align=True)
+        subsub.active = not rd.use_save_buffers
+        subsub.prop(cscene, "use_progressive_refine")
+        subsub = sub.column(align=True)
+        subsub.active = not cscene.use_progressive_refine
+        subsub.prop(cscene, "use_work_stealing")
 
         subsub = sub.column(align=True)
         subsub.enabled = not rd.use_border
@@ -333,12 +348,42 @@ class CyclesRender_PT_performance(CyclesButtonsPanel, Panel):
 
         col.label(text="Final Render:")
         col.prop(cscene, "use_cache")
+        sub = col.column()
+        sub.active = cscene.use_cache
+        sub.prop(cscene, "cache_size")
         col.prop(rd, "use_persistent_data", text="Persistent Images")
+        sub = col.column()
+        sub.active = rd.use_persistent_data
+        sub.prop(cscene, "use_bvh_reuse")
+        col.prop(cscene, "use_texture_cache")
+        sub = col.column()
+        sub.active = cscene.use_texture_cache
+        sub.prop(cscene, "texture_cache_size")
 
         col.separator()
 
         col.label(text="Acceleration structure:")
         col.prop(cscene, "debug_use_spatial_splits")
+        col.prop(cscene, "debug_use_obvh")
+        col.prop(cscene, "debug_use_bvh_time_bounds")
+        col.prop(cscene, "debug_use_bvh_curve_splits")
+        col.prop(cscene, "debug_use_volume_grid")
+        col.prop(cscene, "debug_use_cpu_camera_packets")
+
+        col.separator()
+
+        col.label(text="Sync:")
+        col.prop(cscene, "debug_use_mesh_bulk_sync")
+
+        col.separator()
+
+        col.label(text="Shading:")
+        col.prop(cscene, "debug_use_shader_optimization")
+
+        col.separator()
+
+        col.label(text="Statistics:")
+        col.prop(cscene, "debug_kernel_stats_path", text="")
 
 
 class CyclesRender_PT_layer_options(CyclesButtonsPanel, Panel):
@@ -15,6 +15,11 @@
  */
 
  
+#include "DNA_customdata_types.h"
+#include "DNA_mesh_types.h"
+#include "DNA_meshdata_types.h"
+
+#include "camera.h"
 #include "mesh.h"
 #include "object.h"
 #include "scene.h"
@@ -30,84 +35,211 @@
 #include "util_foreach.h"
 #include "util_logging.h"
 #include "util_math.h"
+#include "util_task.h"
+#include "util_time.h"
 
 #include "mikktspace.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* Bulk Mesh Data
+ *
+ * Direct access to the arrays of the derived mesh. Reading them element by
+ * element through the C++ RNA API costs a few property lookups per vertex
+ * and face, which made syncing big meshes slower than building their BVH. */
+
+/* loops over more elements than this are split into tasks */
+#define MESH_SYNC_CHUNK_SIZE 65536
+
+static const void *mesh_layer_data(const CustomData *data, int type)
+{
+	for(int i = 0; i < data->totlayer; i++)
+		if(data->layers[i].type == type)
+			return data->layers[i].data;
+
+	return NULL;
+}
+
+static void mesh_layers(const CustomData *data, int type, vector<const CustomDataLayer*>& layers)
+{
+	for(int i = 0; i < data->totlayer; i++)
+		if(data->layers[i].type == type)
+			layers.push_back(&data->layers[i]);
+}
+
+static inline float3 mesh_short_normal(const short no[3])
+{
+	return make_float3(no[0] / 32767.0f, no[1] / 32767.0f, no[2] / 32767.0f);
+}
+
+struct BlenderMeshData {
+	explicit BlenderMeshData(BL::Mesh b_mesh)
+	{
+		const ::Mesh *me = (const ::Mesh*)b_mesh.ptr.data;
+
+		mvert = me->mvert;
+		medge = me->medge;
+		mface = me->mface;
+		totvert = me->totvert;
+		totedge = me->totedge;
+		totface = me->totface;
+
+		loop_normals = (const short(*)[4][3])mesh_layer_data(&me->fdata, CD_TESSLOOPNORMAL);
+		orco = (const float(*)[3])mesh_layer_data(&me->vdata, CD_ORCO);
+
+		mesh_layers(&me->fdata, CD_MTFACE, uv_layers);
+		mesh_layers(&me->fdata, CD_MCOL, color_layers);
+		uv_render_layer = (uv_layers.size())? uv_layers[0]->active_rnd: -1;
+
+		/* orco is normalized to the texture space, like undeformed_co in
+		 * RNA we apply the inverse mapping to match the vertex coordinates */
+		if(orco) {
+			BL::Mesh b_texco_mesh = b_mesh.texco_mesh();
+			BL::Mesh b_texspace_mesh = (b_texco_mesh)? b_texco_mesh: b_mesh;
+
+			orco_loc = get_float3(b_texspace_mesh.texspace_location());
+			orco_size = get_float3(b_texspace_mesh.texspace_size());
+		}
+	}
+
+	float3 co(int i) const
+	{
+		return make_float3(mvert[i].co[0], mvert[i].co[1], mvert[i].co[2]);
+	}
+
+	float3 undeformed_co(int i) const
+	{
+		if(orco)
+			return orco_loc + make_float3(orco[i][0], orco[i][1], orco[i][2])*orco_size;
+		else
+			return co(i);
+	}
+
+	int face_num_verts(int f) const
+	{
+		return (mface[f].v4 == 0)? 3: 4;
+	}
+
+	int face_vert(int f, int v) const
+	{
+		return (int)(&mface[f].v1)[v];
+	}
+
+	float3 face_normal(int f) const
+	{
+		const MFace *mf = &mface[f];
+		float3 N;
+
+		if(mf->v4)
+			N = cross(co(mf->v1) - co(mf->v3), co(mf->v2) - co(mf->v4));
+		else
+			N = cross(co(mf->v1) - co(mf->v2), co(mf->v2) - co(mf->v3));
+
+		return safe_normalize(N);
+	}
+
+	const MVert *mvert;
+	const MEdge *medge;
+	const MFace *mface;
+	int totvert;
+	int totedge;
+	int totface;
+
+	/* optional layers, NULL when the mesh does not have them */
+	const short (*loop_normals)[4][3];
+	const float (*orco)[3];
+	float3 orco_loc;
+	float3 orco_size;
+
+	/* tessellated face UV maps and vertex colors */
+	vector<const CustomDataLayer*> uv_layers;
+	vector<const CustomDataLayer*> color_layers;
+	int uv_render_layer;
+};
+
+/* Run func over the element range [0, num), split into tasks for big meshes.
+ * Ranges start at multiples of MESH_SYNC_CHUNK_SIZE. */
+static void mesh_parallel_for(int num, const function<void(int, int)>& func)
+{
+	if(num <= MESH_SYNC_CHUNK_SIZE) {
+		func(0, num);
+		return;
+	}
+
+	TaskPool pool;
+
+	for(int start = 0; start < num; start += MESH_SYNC_CHUNK_SIZE) {
+		int end = min(start + MESH_SYNC_CHUNK_SIZE, num);
+		pool.push(function_bind(func, start, end));
+	}
+
+	pool.wait_work();
+}
+
+static void mesh_fill_verts(const BlenderMeshData *data, float3 *P, float3 *N, int start, int end)
+{
+	for(int i = start; i < end; i++) {
+		P[i] = data->co(i);
+		if(N)
+			N[i] = mesh_short_normal(data->mvert[i].no);
+	}
+}
+
+static void mesh_fill_generated(const BlenderMeshData *data, const float3 *loc, const float3 *size, float3 *generated, int start, int end)
+{
+	for(int i = start; i < end; i++)
+		generated[i] = data->undeformed_co(i)*(*size) - *loc;
+}
+
 /* Tangent Space */
 
 struct MikkUserData {
-	MikkUserData(const BL::Mesh mesh_, BL::MeshTextureFaceLayer *layer_, int num_faces_)
-	: mesh(mesh_), layer(layer_), num_faces(num_faces_)
+	MikkUserData(const BlenderMeshData *data_, const MTFace *tface_)
+	: data(data_), tface(tface_)
 	{
-		tangent.resize(num_faces*4);
+		tangent.resize(data->totface*4);
 	}
 
-	BL::Mesh mesh;
-	BL::MeshTextureFaceLayer *layer;
-	int num_faces;
+	const BlenderMeshData *data;
+	const MTFace *tface;
 	vector<float4> tangent;
 };
 
 static int mikk_get_num_faces(const SMikkTSpaceContext *context)
 {
 	MikkUserData *userdata = (MikkUserData*)context->m_pUserData;
-	return userdata->num_faces;
+	return userdata->data->totface;
 }
 
 static int mikk_get_num_verts_of_face(const SMikkTSpaceContext *context, const int face_num)
 {
 	MikkUserData *userdata = (MikkUserData*)context->m_pUserData;
-	BL::MeshTessFace f = userdata->mesh.tessfaces[face_num];
-	int4 vi = get_int4(f.vertices_raw());
-
-	return (vi[3] == 0)? 3: 4;
+	return userdata->data->face_num_verts(face_num);
 }
 
 static void mikk_get_position(const SMikkTSpaceContext *context, float P[3], const int face_num, const int vert_num)
 {
 	MikkUserData *userdata = (MikkUserData*)context->m_pUserData;
-	BL::MeshTessFace f = userdata->mesh.tessfaces[face_num];
-	int4 vi = get_int4(f.vertices_raw());
-	BL::MeshVertex v = userdata->mesh.vertices[vi[vert_num]];
-	float3 vP = get_float3(v.co());
+	const MVert *v = &userdata->data->mvert[userdata->data->face_vert(face_num, vert_num)];
 
-	P[0] = vP.x;
-	P[1] = vP.y;
-	P[2] = vP.z;
+	P[0] = v->co[0];
+	P[1] = v->co[1];
+	P[2] = v->co[2];
 }
 
 static void mikk_get_texture_coordinate(const SMikkTSpaceContext *context, float uv[2], const int face_num, const int vert_num)
 {
 	MikkUserData *userdata = (MikkUserData*)context->m_pUserData;
-	if(userdata->layer != NULL) {
-		BL::MeshTextureFace tf = userdata->layer->data[face_num];
-		float3 tfuv;
+	if(userdata->tface != NULL) {
+		const MTFace *tf = &userdata->tface[face_num];
 
-		switch (vert_num) {
-			case 0:
-				tfuv = get_float3(tf.uv1());
-				break;
-			case 1:
-				tfuv = get_float3(tf.uv2());
-				break;
-			case 2:
-				tfuv = get_float3(tf.uv3());
-				break;
-			default:
-				tfuv = get_float3(tf.uv4());
-				break;
-		}
-
-		uv[0] = tfuv.x;
-		uv[1] = tfuv.y;
+		uv[0] = tf->uv[vert_num][0];
+		uv[1] = tf->uv[vert_num][1];
 	}
 	else {
-		int vert_idx = userdata->mesh.tessfaces[face_num].vertices()[vert_num];
-		float3 orco =
-			get_float3(userdata->mesh.vertices[vert_idx].undeformed_co());
-		float2 tmp = map_to_sphere(make_float3(orco[0], orco[1], orco[2]));
+		int vert_idx = userdata->data->face_vert(face_num, vert_num);
+		float3 orco = userdata->data->undeformed_co(vert_idx);
+		float2 tmp = map_to_sphere(orco);
 		uv[0] = tmp.x;
 		uv[1] = tmp.y;
 	}
@@ -116,16 +248,15 @@ static void mikk_get_texture_coordinate(const SMikkTSpaceContext *context, float
 static void mikk_get_normal(const SMikkTSpaceContext *context, float N[3], const int face_num, const int vert_num)
 {
 	MikkUserData *userdata = (MikkUserData*)context->m_pUserData;
-	BL::MeshTessFace f = userdata->mesh.tessfaces[face_num];
+	const BlenderMeshData *data = userdata->data;
 	float3 vN;
 
-	if(f.use_smooth()) {
-		int4 vi = get_int4(f.vertices_raw());
-		BL::MeshVertex v = userdata->mesh.vertices[vi[vert_num]];
-		vN = get_float3(v.normal());
+	if(data->mface[face_num].flag & ME_SMOOTH) {
+		const MVert *v = &data->mvert[data->face_vert(face_num, vert_num)];
+		vN = mesh_short_normal(v->no);
 	}
 	else {
-		vN = get_float3(f.normal());
+		vN = data->face_normal(face_num);
 	}
 
 	N[0] = vN.x;
@@ -140,10 +271,10 @@ static void mikk_set_tangent_space(const SMikkTSpaceContext *context, const floa
 	userdata->tangent[face*4 + vert] = make_float4(T[0], T[1], T[2], sign);
 }
 
-static void mikk_compute_tangents(BL::Mesh b_mesh, BL::MeshTextureFaceLayer *b_layer, Mesh *mesh, const vector<int>& nverts, bool need_sign, bool active_render)
+static void mikk_compute_tangents(const BlenderMeshData& data, const CustomDataLayer *layer, Mesh *mesh, bool need_sign, bool active_render)
 {
 	/* setup userdata */
-	MikkUserData userdata(b_mesh, b_layer, nverts.size());
+	MikkUserData userdata(&data, (layer)? (const MTFace*)layer->data: NULL);
 
 	/* setup interface */
 	SMikkTSpaceInterface sm_interface;
@@ -167,8 +298,8 @@ static void mikk_compute_tangents(BL::Mesh b_mesh, BL::MeshTextureFaceLayer *b_l
 	/* create tangent attributes */
 	Attribute *attr;
 	ustring name;
-	if(b_layer != NULL)
-		name = ustring((string(b_layer->name().c_str()) + ".tangent").c_str());
+	if(layer != NULL)
+		name = ustring((string(layer->name) + ".tangent").c_str());
 	else
 		name = ustring("orco.tangent");
 
@@ -185,8 +316,8 @@ static void mikk_compute_tangents(BL::Mesh b_mesh, BL::MeshTextureFaceLayer *b_l
 	if(need_sign) {
 		Attribute *attr_sign;
 		ustring name_sign;
-		if(b_layer != NULL)
-			name_sign = ustring((string(b_layer->name().c_str()) + ".tangent_sign").c_str());
+		if(layer != NULL)
+			name_sign = ustring((string(layer->name) + ".tangent_sign").c_str());
 		else
 			name_sign = ustring("orco.tangent_sign");
 
@@ -198,7 +329,7 @@ static void mikk_compute_tangents(BL::Mesh b_mesh, BL::MeshTextureFaceLayer *b_l
 		tangent_sign = attr_sign->data_float();
 	}
 
-	for(int i = 0; i < nverts.size(); i++) {
+	for(int i = 0; i < data.totface; i++) {
 		tangent[0] = float4_to_float3(userdata.tangent[i*4 + 0]);
 		tangent[1] = float4_to_float3(userdata.tangent[i*4 + 1]);
 		tangent[2] = float4_to_float3(userdata.tangent[i*4 + 2]);
@@ -211,7 +342,7 @@ static void mikk_compute_tangents(BL::Mesh b_mesh, BL::MeshTextureFaceLayer *b_l
 			tangent_sign += 3;
 		}
 
-		if(nverts[i] == 4) {
+		if(data.face_num_verts(i) == 4) {
 			tangent[0] = float4_to_float3(userdata.tangent[i*4 + 0]);
 			tangent[1] = float4_to_float3(userdata.tangent[i*4 + 2]);
 			tangent[2] = float4_to_float3(userdata.tangent[i*4 + 3]);
@@ -262,10 +393,502 @@ static void create_mesh_volume_attributes(Scene *scene, BL::Object b_ob, Mesh *m
 }
 
 /* Create vertex color attributes. */
+static inline uchar4 mesh_color_to_byte(const MCol& c)
+{
+	/* red and blue are swapped in tessellated face colors */
+	float3 color = make_float3((uchar)c.b / 255.0f, (uchar)c.g / 255.0f, (uchar)c.r / 255.0f);
+	return color_float_to_byte(color_srgb_to_scene_linear(color));
+}
+
+static void mesh_fill_vertex_color(const BlenderMeshData *data, const MCol *mcol, const int *chunk_tri, uchar4 *cdata, int start, int end)
+{
+	cdata += chunk_tri[start/MESH_SYNC_CHUNK_SIZE]*3;
+
+	for(int i = start; i < end; i++) {
+		const MCol *c = &mcol[i*4];
+
+		cdata[0] = mesh_color_to_byte(c[0]);
+		cdata[1] = mesh_color_to_byte(c[1]);
+		cdata[2] = mesh_color_to_byte(c[2]);
+
+		if(data->face_num_verts(i) == 4) {
+			cdata[3] = cdata[0];
+			cdata[4] = cdata[2];
+			cdata[5] = mesh_color_to_byte(c[3]);
+			cdata += 6;
+		}
+		else
+			cdata += 3;
+	}
+}
+
 static void attr_create_vertex_color(Scene *scene,
                                      Mesh *mesh,
-                                     BL::Mesh b_mesh,
-                                     const vector<int>& nverts)
+                                     const BlenderMeshData& data,
+                                     const vector<int>& chunk_tri)
+{
+	foreach(const CustomDataLayer *layer, data.color_layers) {
+		if(!mesh->need_attribute(scene, ustring(layer->name)))
+			continue;
+
+		Attribute *attr = mesh->attributes.add(
+			ustring(layer->name), TypeDesc::TypeColor, ATTR_ELEMENT_CORNER_BYTE);
+
+		mesh_parallel_for(data.totface, function_bind(&mesh_fill_vertex_color,
+		                                              &data,
+		                                              (const MCol*)layer->data,
+		                                              &chunk_tri[0],
+		                                              attr->data_uchar4(),
+		                                              _1, _2));
+	}
+}
+
+/* Create uv map attributes. */
+static void mesh_fill_uv_map(const BlenderMeshData *data, const MTFace *tface, const int *chunk_tri, float3 *fdata, int start, int end)
+{
+	fdata += chunk_tri[start/MESH_SYNC_CHUNK_SIZE]*3;
+
+	for(int i = start; i < end; i++) {
+		const MTFace *tf = &tface[i];
+
+		fdata[0] = make_float3(tf->uv[0][0], tf->uv[0][1], 0.0f);
+		fdata[1] = make_float3(tf->uv[1][0], tf->uv[1][1], 0.0f);
+		fdata[2] = make_float3(tf->uv[2][0], tf->uv[2][1], 0.0f);
+		fdata += 3;
+
+		if(data->face_num_verts(i) == 4) {
+			fdata[0] = make_float3(tf->uv[0][0], tf->uv[0][1], 0.0f);
+			fdata[1] = make_float3(tf->uv[2][0], tf->uv[2][1], 0.0f);
+			fdata[2] = make_float3(tf->uv[3][0], tf->uv[3][1], 0.0f);
+			fdata += 3;
+		}
+	}
+}
+
+static void attr_create_uv_map(Scene *scene,
+                               Mesh *mesh,
+                               const BlenderMeshData& data,
+                               const vector<int>& chunk_tri)
+{
+	if(data.uv_layers.size() != 0) {
+		for(size_t i = 0; i < data.uv_layers.size(); i++) {
+			const CustomDataLayer *layer = data.uv_layers[i];
+			bool active_render = ((int)i == data.uv_render_layer);
+			AttributeStandard std = (active_render)? ATTR_STD_UV: ATTR_STD_NONE;
+			ustring name = ustring(layer->name);
+
+			/* UV map */
+			if(mesh->need_attribute(scene, name) || mesh->need_attribute(scene, std)) {
+				Attribute *attr;
+
+				if(active_render)
+					attr = mesh->attributes.add(std, name);
+				else
+					attr = mesh->attributes.add(name, TypeDesc::TypePoint, ATTR_ELEMENT_CORNER);
+
+				mesh_parallel_for(data.totface, function_bind(&mesh_fill_uv_map,
+				                                              &data,
+				                                              (const MTFace*)layer->data,
+				                                              &chunk_tri[0],
+				                                              attr->data_float3(),
+				                                              _1, _2));
+			}
+
+			/* UV tangent */
+			std = (active_render)? ATTR_STD_UV_TANGENT: ATTR_STD_NONE;
+			name = ustring((string(layer->name) + ".tangent").c_str());
+
+			if(mesh->need_attribute(scene, name) || (active_render && mesh->need_attribute(scene, std))) {
+				std = (active_render)? ATTR_STD_UV_TANGENT_SIGN: ATTR_STD_NONE;
+				name = ustring((string(layer->name) + ".tangent_sign").c_str());
+				bool need_sign = (mesh->need_attribute(scene, name) || mesh->need_attribute(scene, std));
+
+				mikk_compute_tangents(data, layer, mesh, need_sign, active_render);
+			}
+		}
+	}
+	else if(mesh->need_attribute(scene, ATTR_STD_UV_TANGENT)) {
+		bool need_sign = mesh->need_attribute(scene, ATTR_STD_UV_TANGENT_SIGN);
+		mikk_compute_tangents(data, NULL, mesh, need_sign, true);
+	}
+}
+
+/* Create vertex pointiness attributes. */
+static void attr_create_pointiness(Scene *scene,
+                                   Mesh *mesh,
+                                   const BlenderMeshData& data)
+{
+	if(mesh->need_attribute(scene, ATTR_STD_POINTINESS)) {
+		const int numverts = data.totvert;
+		Attribute *attr = mesh->attributes.add(ATTR_STD_POINTINESS);
+		float *attr_data = attr->data_float();
+		int *counter = new int[numverts];
+		float *raw_data = new float[numverts];
+		float3 *edge_accum = new float3[numverts];
+
+		/* Calculate pointiness using single ring neighborhood. */
+		memset(counter, 0, sizeof(int) * numverts);
+		memset(raw_data, 0, sizeof(float) * numverts);
+		memset(edge_accum, 0, sizeof(float3) * numverts);
+		for(int i = 0; i < data.totedge; ++i) {
+			int v0 = data.medge[i].v1,
+			    v1 = data.medge[i].v2;
+			float3 co0 = data.co(v0),
+			       co1 = data.co(v1);
+			float3 edge = normalize(co1 - co0);
+			edge_accum[v0] += edge;
+			edge_accum[v1] += -edge;
+			++counter[v0];
+			++counter[v1];
+		}
+		for(int i = 0; i < numverts; ++i) {
+			if(counter[i] > 0) {
+				float3 normal = mesh_short_normal(data.mvert[i].no);
+				float angle = safe_acosf(dot(normal, edge_accum[i] / counter[i]));
+				raw_data[i] = angle * M_1_PI_F;
+			}
+			else {
+				raw_data[i] = 0.0f;
+			}
+		}
+
+		/* Blur vertices to approximate 2 ring neighborhood. */
+		memset(counter, 0, sizeof(int) * numverts);
+		memcpy(attr_data, raw_data, sizeof(float) * numverts);
+		for(int i = 0; i < data.totedge; ++i) {
+			int v0 = data.medge[i].v1,
+			    v1 = data.medge[i].v2;
+			attr_data[v0] += raw_data[v1];
+			attr_data[v1] += raw_data[v0];
+			++counter[v0];
+			++counter[v1];
+		}
+		for(int i = 0; i < numverts; ++i) {
+			attr_data[i] /= counter[i] + 1;
+		}
+
+		delete [] counter;
+		delete [] raw_data;
+		delete [] edge_accum;
+	}
+}
+
+/* Create Mesh */
+
+static void create_mesh(Scene *scene, Mesh *mesh, BL::Mesh b_mesh, const vector<uint>& used_shaders)
+{
+	BlenderMeshData data(b_mesh);
+
+	/* count vertices and faces */
+	int numverts = data.totvert;
+	int numfaces = data.totface;
+	int numtris = 0;
+	bool use_loop_normals = b_mesh.use_auto_smooth();
+
+	for(int fi = 0; fi < numfaces; fi++)
+		numtris += data.face_num_verts(fi) - 2;
+
+	/* reserve memory */
+	mesh->reserve(numverts, numtris, 0, 0);
+
+	/* create vertex coordinates and normals */
+	Attribute *attr_N = mesh->attributes.add(ATTR_STD_VERTEX_NORMAL);
+	float3 *P = (numverts)? &mesh->verts[0]: NULL;
+	float3 *N = attr_N->data_float3();
+
+	mesh_parallel_for(numverts, function_bind(&mesh_fill_verts, &data, P, N, _1, _2));
+
+	/* create generated coordinates from undeformed coordinates */
+	if(mesh->need_attribute(scene, ATTR_STD_GENERATED)) {
+		Attribute *attr = mesh->attributes.add(ATTR_STD_GENERATED);
+
+		float3 loc, size;
+		mesh_texture_space(b_mesh, loc, size);
+
+		mesh_parallel_for(numverts, function_bind(&mesh_fill_generated, &data, &loc, &size, attr->data_float3(), _1, _2));
+	}
+
+	/* Create needed vertex attributes. */
+	attr_create_pointiness(scene, mesh, data);
+
+	/* create faces, remembering the first triangle of every chunk of faces
+	 * so corner attributes can be filled in parallel afterwards */
+	vector<int> chunk_tri;
+	int ti = 0;
+
+	chunk_tri.reserve(numfaces/MESH_SYNC_CHUNK_SIZE + 1);
+
+	for(int fi = 0; fi < numfaces; fi++) {
+		const MFace *mf = &data.mface[fi];
+		int vi[4] = {(int)mf->v1, (int)mf->v2, (int)mf->v3, (int)mf->v4};
+		int n = data.face_num_verts(fi);
+		int mi = clamp(mf->mat_nr, 0, used_shaders.size()-1);
+		int shader = used_shaders[mi];
+		bool smooth = (mf->flag & ME_SMOOTH) || use_loop_normals;
+
+		if(fi % MESH_SYNC_CHUNK_SIZE == 0)
+			chunk_tri.push_back(ti);
+
+		/* split vertices if normal is different
+		 *
+		 * note all vertex attributes must have been set here so we can split
+		 * and copy attributes in split_vertex without remapping later */
+		if(use_loop_normals) {
+			for(int i = 0; i < n; i++) {
+				float3 loop_N = (data.loop_normals)? mesh_short_normal(data.loop_normals[fi][i]): make_float3(0.0f, 0.0f, 0.0f);
+
+				if(N[vi[i]] != loop_N) {
+					int new_vi = mesh->split_vertex(vi[i]);
+
+					/* set new normal and vertex index */
+					N = attr_N->data_float3();
+					N[new_vi] = loop_N;
+					vi[i] = new_vi;
+				}
+			}
+		}
+
+		/* create triangles */
+		if(n == 4) {
+			if(is_zero(cross(mesh->verts[vi[1]] - mesh->verts[vi[0]], mesh->verts[vi[2]] - mesh->verts[vi[0]])) ||
+			   is_zero(cross(mesh->verts[vi[2]] - mesh->verts[vi[0]], mesh->verts[vi[3]] - mesh->verts[vi[0]])))
+			{
+				mesh->set_triangle(ti++, vi[0], vi[1], vi[3], shader, smooth);
+				mesh->set_triangle(ti++, vi[2], vi[3], vi[1], shader, smooth);
+			}
+			else {
+				mesh->set_triangle(ti++, vi[0], vi[1], vi[2], shader, smooth);
+				mesh->set_triangle(ti++, vi[0], vi[2], vi[3], shader, smooth);
+			}
+		}
+		else
+			mesh->set_triangle(ti++, vi[0], vi[1], vi[2], shader, smooth);
+	}
+
+	/* Create all needed attributes.
+	 * The calculate functions will check whether they're needed or not.
+	 */
+	if(numfaces) {
+		attr_create_vertex_color(scene, mesh, data, chunk_tri);
+		attr_create_uv_map(scene, mesh, data, chunk_tri);
+	}
+
+	/* for volume objects, create a matrix to transform from object space to
+	 * mesh texture space. this does not work with deformations but that can
+	 * probably only be done well with a volume grid mapping of coordinates */
+	if(mesh->need_attribute(scene, ATTR_STD_GENERATED_TRANSFORM)) {
+		Attribute *attr = mesh->attributes.add(ATTR_STD_GENERATED_TRANSFORM);
+		Transform *tfm = attr->data_transform();
+
+		float3 loc, size;
+		mesh_texture_space(b_mesh, loc, size);
+
+		*tfm = transform_translate(-loc)*transform_scale(size);
+	}
+}
+
+/* RNA Mesh Data
+ *
+ * Reads the mesh element by element through the C++ RNA API, the way mesh
+ * sync worked before the bulk data access above. Kept as a reference to
+ * compare the bulk sync against, see debug_use_mesh_bulk_sync. */
+
+struct MikkRNAUserData {
+	MikkRNAUserData(const BL::Mesh mesh_, BL::MeshTextureFaceLayer *layer_, int num_faces_)
+	: mesh(mesh_), layer(layer_), num_faces(num_faces_)
+	{
+		tangent.resize(num_faces*4);
+	}
+
+	BL::Mesh mesh;
+	BL::MeshTextureFaceLayer *layer;
+	int num_faces;
+	vector<float4> tangent;
+};
+
+static int mikk_get_num_faces_rna(const SMikkTSpaceContext *context)
+{
+	MikkRNAUserData *userdata = (MikkRNAUserData*)context->m_pUserData;
+	return userdata->num_faces;
+}
+
+static int mikk_get_num_verts_of_face_rna(const SMikkTSpaceContext *context, const int face_num)
+{
+	MikkRNAUserData *userdata = (MikkRNAUserData*)context->m_pUserData;
+	BL::MeshTessFace f = userdata->mesh.tessfaces[face_num];
+	int4 vi = get_int4(f.vertices_raw());
+
+	return (vi[3] == 0)? 3: 4;
+}
+
+static void mikk_get_position_rna(const SMikkTSpaceContext *context, float P[3], const int face_num, const int vert_num)
+{
+	MikkRNAUserData *userdata = (MikkRNAUserData*)context->m_pUserData;
+	BL::MeshTessFace f = userdata->mesh.tessfaces[face_num];
+	int4 vi = get_int4(f.vertices_raw());
+	BL::MeshVertex v = userdata->mesh.vertices[vi[vert_num]];
+	float3 vP = get_float3(v.co());
+
+	P[0] = vP.x;
+	P[1] = vP.y;
+	P[2] = vP.z;
+}
+
+static void mikk_get_texture_coordinate_rna(const SMikkTSpaceContext *context, float uv[2], const int face_num, const int vert_num)
+{
+	MikkRNAUserData *userdata = (MikkRNAUserData*)context->m_pUserData;
+	if(userdata->layer != NULL) {
+		BL::MeshTextureFace tf = userdata->layer->data[face_num];
+		float3 tfuv;
+
+		switch (vert_num) {
+			case 0:
+				tfuv = get_float3(tf.uv1());
+				break;
+			case 1:
+				tfuv = get_float3(tf.uv2());
+				break;
+			case 2:
+				tfuv = get_float3(tf.uv3());
+				break;
+			default:
+				tfuv = get_float3(tf.uv4());
+				break;
+		}
+
+		uv[0] = tfuv.x;
+		uv[1] = tfuv.y;
+	}
+	else {
+		int vert_idx = userdata->mesh.tessfaces[face_num].vertices()[vert_num];
+		float3 orco =
+			get_float3(userdata->mesh.vertices[vert_idx].undeformed_co());
+		float2 tmp = map_to_sphere(make_float3(orco[0], orco[1], orco[2]));
+		uv[0] = tmp.x;
+		uv[1] = tmp.y;
+	}
+}
+
+static void mikk_get_normal_rna(const SMikkTSpaceContext *context, float N[3], const int face_num, const int vert_num)
+{
+	MikkRNAUserData *userdata = (MikkRNAUserData*)context->m_pUserData;
+	BL::MeshTessFace f = userdata->mesh.tessfaces[face_num];
+	float3 vN;
+
+	if(f.use_smooth()) {
+		int4 vi = get_int4(f.vertices_raw());
+		BL::MeshVertex v = userdata->mesh.vertices[vi[vert_num]];
+		vN = get_float3(v.normal());
+	}
+	else {
+		vN = get_float3(f.normal());
+	}
+
+	N[0] = vN.x;
+	N[1] = vN.y;
+	N[2] = vN.z;
+}
+
+static void mikk_set_tangent_space_rna(const SMikkTSpaceContext *context, const float T[], const float sign, const int face, const int vert)
+{
+	MikkRNAUserData *userdata = (MikkRNAUserData*)context->m_pUserData;
+
+	userdata->tangent[face*4 + vert] = make_float4(T[0], T[1], T[2], sign);
+}
+
+static void mikk_compute_tangents_rna(BL::Mesh b_mesh, BL::MeshTextureFaceLayer *b_layer, Mesh *mesh, const vector<int>& nverts, bool need_sign, bool active_render)
+{
+	/* setup userdata */
+	MikkRNAUserData userdata(b_mesh, b_layer, nverts.size());
+
+	/* setup interface */
+	SMikkTSpaceInterface sm_interface;
+	memset(&sm_interface, 0, sizeof(sm_interface));
+	sm_interface.m_getNumFaces = mikk_get_num_faces_rna;
+	sm_interface.m_getNumVerticesOfFace = mikk_get_num_verts_of_face_rna;
+	sm_interface.m_getPosition = mikk_get_position_rna;
+	sm_interface.m_getTexCoord = mikk_get_texture_coordinate_rna;
+	sm_interface.m_getNormal = mikk_get_normal_rna;
+	sm_interface.m_setTSpaceBasic = mikk_set_tangent_space_rna;
+
+	/* setup context */
+	SMikkTSpaceContext context;
+	memset(&context, 0, sizeof(context));
+	context.m_pUserData = &userdata;
+	context.m_pInterface = &sm_interface;
+
+	/* compute tangents */
+	genTangSpaceDefault(&context);
+
+	/* create tangent attributes */
+	Attribute *attr;
+	ustring name;
+	if(b_layer != NULL)
+		name = ustring((string(b_layer->name().c_str()) + ".tangent").c_str());
+	else
+		name = ustring("orco.tangent");
+
+	if(active_render)
+		attr = mesh->attributes.add(ATTR_STD_UV_TANGENT, name);
+	else
+		attr = mesh->attributes.add(name, TypeDesc::TypeVector, ATTR_ELEMENT_CORNER);
+
+	float3 *tangent = attr->data_float3();
+
+	/* create bitangent sign attribute */
+	float *tangent_sign = NULL;
+
+	if(need_sign) {
+		Attribute *attr_sign;
+		ustring name_sign;
+		if(b_layer != NULL)
+			name_sign = ustring((string(b_layer->name().c_str()) + ".tangent_sign").c_str());
+		else
+			name_sign = ustring("orco.tangent_sign");
+
+		if(active_render)
+			attr_sign = mesh->attributes.add(ATTR_STD_UV_TANGENT_SIGN, name_sign);
+		else
+			attr_sign = mesh->attributes.add(name_sign, TypeDesc::TypeFloat, ATTR_ELEMENT_CORNER);
+
+		tangent_sign = attr_sign->data_float();
+	}
+
+	for(int i = 0; i < nverts.size(); i++) {
+		tangent[0] = float4_to_float3(userdata.tangent[i*4 + 0]);
+		tangent[1] = float4_to_float3(userdata.tangent[i*4 + 1]);
+		tangent[2] = float4_to_float3(userdata.tangent[i*4 + 2]);
+		tangent += 3;
+
+		if(tangent_sign) {
+			tangent_sign[0] = userdata.tangent[i*4 + 0].w;
+			tangent_sign[1] = userdata.tangent[i*4 + 1].w;
+			tangent_sign[2] = userdata.tangent[i*4 + 2].w;
+			tangent_sign += 3;
+		}
+
+		if(nverts[i] == 4) {
+			tangent[0] = float4_to_float3(userdata.tangent[i*4 + 0]);
+			tangent[1] = float4_to_float3(userdata.tangent[i*4 + 2]);
+			tangent[2] = float4_to_float3(userdata.tangent[i*4 + 3]);
+			tangent += 3;
+
+			if(tangent_sign) {
+				tangent_sign[0] = userdata.tangent[i*4 + 0].w;
+				tangent_sign[1] = userdata.tangent[i*4 + 2].w;
+				tangent_sign[2] = userdata.tangent[i*4 + 3].w;
+				tangent_sign += 3;
+			}
+		}
+	}
+}
+
+
+/* Create vertex color attributes. */
+static void attr_create_vertex_color_rna(Scene *scene,
+                                         Mesh *mesh,
+                                         BL::Mesh b_mesh,
+                                         const vector<int>& nverts)
 {
 	BL::Mesh::tessface_vertex_colors_iterator l;
 	for(b_mesh.tessface_vertex_colors.begin(l); l != b_mesh.tessface_vertex_colors.end(); ++l) {
@@ -297,10 +920,10 @@ static void attr_create_vertex_color(Scene *scene,
 }
 
 /* Create uv map attributes. */
-static void attr_create_uv_map(Scene *scene,
-                               Mesh *mesh,
-                               BL::Mesh b_mesh,
-                               const vector<int>& nverts)
+static void attr_create_uv_map_rna(Scene *scene,
+                                   Mesh *mesh,
+                                   BL::Mesh b_mesh,
+                                   const vector<int>& nverts)
 {
 	if(b_mesh.tessface_uv_textures.length() != 0) {
 		BL::Mesh::tessface_uv_textures_iterator l;
@@ -347,20 +970,20 @@ static void attr_create_uv_map(Scene *scene,
 				name = ustring((string(l->name().c_str()) + ".tangent_sign").c_str());
 				bool need_sign = (mesh->need_attribute(scene, name) || mesh->need_attribute(scene, std));
 
-				mikk_compute_tangents(b_mesh, &(*l), mesh, nverts, need_sign, active_render);
+				mikk_compute_tangents_rna(b_mesh, &(*l), mesh, nverts, need_sign, active_render);
 			}
 		}
 	}
 	else if(mesh->need_attribute(scene, ATTR_STD_UV_TANGENT)) {
 		bool need_sign = mesh->need_attribute(scene, ATTR_STD_UV_TANGENT_SIGN);
-		mikk_compute_tangents(b_mesh, NULL, mesh, nverts, need_sign, true);
+		mikk_compute_tangents_rna(b_mesh, NULL, mesh, nverts, need_sign, true);
 	}
 }
 
 /* Create vertex pointiness attributes. */
-static void attr_create_pointiness(Scene *scene,
-                                   Mesh *mesh,
-                                   BL::Mesh b_mesh)
+static void attr_create_pointiness_rna(Scene *scene,
+                                       Mesh *mesh,
+                                       BL::Mesh b_mesh)
 {
 	if(mesh->need_attribute(scene, ATTR_STD_POINTINESS)) {
 		const int numverts = b_mesh.vertices.length();
@@ -422,9 +1045,7 @@ static void attr_create_pointiness(Scene *scene,
 	}
 }
 
-/* Create Mesh */
-
-static void create_mesh(Scene *scene, Mesh *mesh, BL::Mesh b_mesh, const vector<uint>& used_shaders)
+static void create_mesh_rna(Scene *scene, Mesh *mesh, BL::Mesh b_mesh, const vector<uint>& used_shaders)
 {
 	/* count vertices and faces */
 	int numverts = b_mesh.vertices.length();
@@ -470,7 +1091,7 @@ static void create_mesh(Scene *scene, Mesh *mesh, BL::Mesh b_mesh, const vector<
 	}
 
 	/* Create needed vertex attributes. */
-	attr_create_pointiness(scene, mesh, b_mesh);
+	attr_create_pointiness_rna(scene, mesh, b_mesh);
 
 	/* create faces */
 	vector<int> nverts(numfaces);
@@ -526,8 +1147,8 @@ static void create_mesh(Scene *scene, Mesh *mesh, BL::Mesh b_mesh, const vector<
 	/* Create all needed attributes.
 	 * The calculate functions will check whether they're needed or not.
 	 */
-	attr_create_vertex_color(scene, mesh, b_mesh, nverts);
-	attr_create_uv_map(scene, mesh, b_mesh, nverts);
+	attr_create_vertex_color_rna(scene, mesh, b_mesh, nverts);
+	attr_create_uv_map_rna(scene, mesh, b_mesh, nverts);
 
 	/* for volume objects, create a matrix to transform from object space to
 	 * mesh texture space. this does not work with deformations but that can
@@ -541,31 +1162,28 @@ static void create_mesh(Scene *scene, Mesh *mesh, BL::Mesh b_mesh, const vector<
 
 		*tfm = transform_translate(-loc)*transform_scale(size);
 	}
-}
 
-static void create_subd_mesh(Scene *scene, Mesh *mesh, BL::Mesh b_mesh, PointerRNA *cmesh, const vector<uint>& used_shaders)
+static void create_subd_mesh(Scene *scene, Mesh *mesh, BL::Object b_ob, BL::Mesh b_mesh, PointerRNA *cmesh, const vector<uint>& used_shaders)
 {
+	BlenderMeshData data(b_mesh);
+
 	/* create subd mesh */
 	SubdMesh sdmesh;
 
 	/* create vertices */
-	BL::Mesh::vertices_iterator v;
-
-	for(b_mesh.vertices.begin(v); v != b_mesh.vertices.end(); ++v)
-		sdmesh.add_vert(get_float3(v->co()));
+	for(int i = 0; i < data.totvert; i++)
+		sdmesh.add_vert(data.co(i));
 
 	/* create faces */
-	BL::Mesh::tessfaces_iterator f;
-
-	for(b_mesh.tessfaces.begin(f); f != b_mesh.tessfaces.end(); ++f) {
-		int4 vi = get_int4(f->vertices_raw());
-		int n = (vi[3] == 0) ? 3: 4;
-		//int shader = used_shaders[f->material_index()];
+	for(int fi = 0; fi < data.totface; fi++) {
+		const MFace *mf = &data.mface[fi];
+		int n = data.face_num_verts(fi);
+		//int shader = used_shaders[mf->mat_nr];
 
 		if(n == 4)
-			sdmesh.add_face(vi[0], vi[1], vi[2], vi[3]);
+			sdmesh.add_face(mf->v1, mf->v2, mf->v3, mf->v4);
 		else
-			sdmesh.add_face(vi[0], vi[1], vi[2]);
+			sdmesh.add_face(mf->v1, mf->v2, mf->v3);
 	}
 
 	/* finalize subd mesh */
@@ -577,8 +1195,12 @@ static void create_subd_mesh(Scene *scene, Mesh *mesh, BL::Mesh b_mesh, PointerR
 
 	SubdParams sdparams(mesh, used_shaders[0], true, need_ptex);
 	sdparams.dicing_rate = RNA_float_get(cmesh, "dicing_rate");
-	//scene->camera->update();
-	//sdparams.camera = scene->camera;
+
+	/* dice in screen space, every session syncs the camera or viewport before
+	 * objects. instances of the mesh use the dicing of this object */
+	scene->camera->update();
+	sdparams.camera = scene->camera;
+	sdparams.objecttoworld = get_transform(b_ob.matrix_world());
 
 	/* tesselate */
 	DiagSplit dsplit(sdparams);
@@ -681,14 +1303,25 @@ Mesh *BlenderSync::sync_mesh(BL::Object b_ob, bool object_updated, bool hide_tri
 			b_ob.update_from_editmode();
 
 		bool need_undeformed = mesh->need_attribute(scene, ATTR_STD_GENERATED);
+		double convert_start = time_dt();
 		BL::Mesh b_mesh = object_to_mesh(b_data, b_ob, b_scene, true, !preview, need_undeformed);
 
+		mesh_sync_stats.convert_time += time_dt() - convert_start;
+
 		if(b_mesh) {
 			if(render_layer.use_surfaces && !hide_tris) {
+				scoped_timer timer;
+
 				if(cmesh.data && experimental && RNA_boolean_get(&cmesh, "use_subdivision"))
-					create_subd_mesh(scene, mesh, b_mesh, &cmesh, used_shaders);
-				else
+					create_subd_mesh(scene, mesh, b_ob, b_mesh, &cmesh, used_shaders);
+				else if(use_mesh_bulk_sync)
 					create_mesh(scene, mesh, b_mesh, used_shaders);
+				else
+					create_mesh_rna(scene, mesh, b_mesh, used_shaders);
+
+				mesh_sync_stats.read_time += timer.get_time();
+				mesh_sync_stats.num_meshes++;
+				mesh_sync_stats.num_triangles += mesh->triangles.size();
 
 				create_mesh_volume_attributes(scene, b_ob, mesh, b_scene.frame_current());
 			}
@@ -800,7 +1433,9 @@ void BlenderSync::sync_mesh_motion(BL::Object b_ob, Object *object, float motion
 
 	if(ccl::BKE_object_is_deform_modified(b_ob, b_scene, preview)) {
 		/* get derived mesh */
+		double convert_start = time_dt();
 		b_mesh = object_to_mesh(b_data, b_ob, b_scene, true, !preview, false);
+		mesh_sync_stats.convert_time += time_dt() - convert_start;
 	}
 
 	if(!b_mesh) {
@@ -854,18 +1489,33 @@ void BlenderSync::sync_mesh_motion(BL::Object b_ob, Object *object, float motion
 		float3 *mP = attr_mP->data_float3() + time_index*numverts;
 		float3 *mN = (attr_mN)? attr_mN->data_float3() + time_index*numverts: NULL;
 
-		BL::Mesh::vertices_iterator v;
-		int i = 0;
+		scoped_timer timer;
+		int num_motion_verts;
 
-		for(b_mesh.vertices.begin(v); v != b_mesh.vertices.end() && i < numverts; ++v, ++i) {
-			mP[i] = get_float3(v->co());
-			if(mN)
-				mN[i] = get_float3(v->normal());
+		if(use_mesh_bulk_sync) {
+			BlenderMeshData data(b_mesh);
+			num_motion_verts = min(data.totvert, (int)numverts);
+
+			mesh_parallel_for(num_motion_verts, function_bind(&mesh_fill_verts, &data, mP, mN, _1, _2));
 		}
+		else {
+			BL::Mesh::vertices_iterator v;
+			int i = 0;
+
+			for(b_mesh.vertices.begin(v); v != b_mesh.vertices.end() && i < numverts; ++v, ++i) {
+				mP[i] = get_float3(v->co());
+				if(mN)
+					mN[i] = get_float3(v->normal());
+			}
+
+			num_motion_verts = i;
+		}
+
+		mesh_sync_stats.read_time += timer.get_time();
 
 		/* in case of new attribute, we verify if there really was any motion */
 		if(new_attribute) {
-			if(i != numverts || memcmp(mP, &mesh->verts[0], sizeof(float3)*numverts) == 0) {
+			if(num_motion_verts != numverts || memcmp(mP, &mesh->verts[0], sizeof(float3)*numverts) == 0) {
 				/* no motion, remove attributes again */
 				VLOG(1) << "No actual deformation motion for object " << b_ob.name();
 				mesh->attributes.remove(ATTR_STD_MOTION_VERTEX_POSITION);
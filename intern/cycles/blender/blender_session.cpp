@@ -98,6 +98,8 @@ void BlenderSession::create_session()
 	last_error = "";
 	last_progress = -1.0f;
 	start_resize_time = 0.0;
+	bake_synced = false;
+	bake_resync = false;
 
 	/* create scene */
 	scene = new Scene(scene_params, session_params.device);
@@ -160,7 +162,7 @@ void BlenderSession::reset_session(BL::BlendData b_data_, BL::Scene b_scene_)
 		 * them rather than trying to distinguish which settings need to be updated
 		 */
 
-		delete session;
+		free_session();
 
 		create_session();
 
@@ -178,6 +180,11 @@ void BlenderSession::reset_session(BL::BlendData b_data_, BL::Scene b_scene_)
 	session->stats.mem_peak = session->stats.mem_used;
 
 	/* sync object should be re-created */
+	if(sync)
+		delete sync;
+
+	bake_synced = false;
+	bake_resync = false;
 	sync = new BlenderSync(b_engine, b_data, b_scene, scene, !background, session->progress, is_cpu);
 
 	/* for final render we will do full data sync per render layer, only
@@ -413,6 +420,15 @@ void BlenderSession::render()
 	SessionParams session_params = BlenderSync::get_session_params(b_engine, b_userpref, b_scene, background);
 	BufferParams buffer_params = BlenderSync::get_buffer_params(b_render, b_v3d, b_rv3d, scene->camera, width, height);
 
+	PointerRNA cscene = RNA_pointer_get(&b_scene.ptr, "cycles");
+
+	/* kernel counters of all layers and views of the frame */
+	string kernel_stats_path = get_string(cscene, "debug_kernel_stats_path");
+	double render_start_time = time_dt();
+
+	session->stats.kernel_reset();
+	session->stats.kernel_record_tiles = !kernel_stats_path.empty();
+
 	/* render each layer */
 	BL::RenderSettings r = b_scene.render();
 	BL::RenderSettings::layers_iterator b_layer_iter;
@@ -457,6 +473,16 @@ void BlenderSession::render()
 			}
 		}
 
+		/* adaptive sampling stops converged tiles early, which does not work
+		 * with progressive refine revisiting every tile */
+		if(get_boolean(cscene, "use_adaptive_sampling") &&
+		   session_params.device.type == DEVICE_CPU &&
+		   !session_params.progressive_refine)
+		{
+			Pass::add(PASS_ADAPTIVE_AUX_BUFFER, passes);
+			Pass::add(PASS_SAMPLE_COUNT, passes);
+		}
+
 		buffer_params.passes = passes;
 		scene->film->pass_alpha_threshold = b_layer_iter->pass_alpha_threshold();
 		scene->film->tag_passes_update(scene, passes);
@@ -497,6 +523,20 @@ void BlenderSession::render()
 			break;
 	}
 
+	if(!kernel_stats_path.empty() && !session->progress.get_cancel()) {
+		int frame = b_scene.frame_current();
+		string filepath = blender_absolute_path(b_data, b_scene, kernel_stats_path);
+		size_t hash = filepath.find('#');
+
+		if(hash != string::npos) {
+			size_t digits = filepath.find_first_not_of('#', hash);
+			digits = (digits == string::npos)? filepath.size() - hash: digits - hash;
+			filepath.replace(hash, digits, string_printf("%0*d", (int)digits, frame));
+		}
+
+		session->write_kernel_stats(filepath, frame, time_dt() - render_start_time);
+	}
+
 	/* clear callback */
 	session->write_render_tile_cb = function_null;
 	session->update_render_tile_cb = function_null;
@@ -538,6 +578,8 @@ void BlenderSession::bake(BL::Object b_object, const string& pass_type, const in
 	if(session->progress.get_cancel())
 		return;
 
+	size_t num_passes = scene->film->passes.size();
+
 	if(shader_type == SHADER_EVAL_UV) {
 		/* force UV to be available */
 		Pass::add(PASS_UV, scene->film->passes);
@@ -548,35 +590,51 @@ void BlenderSession::bake(BL::Object b_object, const string& pass_type, const in
 		Pass::add(PASS_LIGHT, scene->film->passes);
 	}
 
-	/* create device and update scene */
-	scene->film->tag_update(scene);
-	scene->integrator->tag_update(scene);
+	if(!bake_synced || scene->film->passes.size() != num_passes) {
+		scene->film->tag_update(scene);
+		scene->integrator->tag_update(scene);
+	}
 
-	/* update scene */
-	sync->sync_camera(b_render, b_engine.camera_override(), width, height);
-	sync->sync_data(b_v3d, b_engine.camera_override(), &python_thread_state);
+	/* all objects and passes baked with this session share the scene, it is
+	 * synchronized and its BVH built only for the first one */
+	if(!bake_synced) {
+		sync->sync_camera(b_render, b_engine.camera_override(), width, height);
+		sync->sync_data(b_v3d, b_engine.camera_override(), &python_thread_state);
 
-	/* get buffer parameters */
-	SessionParams session_params = BlenderSync::get_session_params(b_engine, b_userpref, b_scene, background);
-	BufferParams buffer_params = BlenderSync::get_buffer_params(b_render, b_v3d, b_rv3d, scene->camera, width, height);
+		/* get buffer parameters */
+		SessionParams session_params = BlenderSync::get_session_params(b_engine, b_userpref, b_scene, background);
+		BufferParams buffer_params = BlenderSync::get_buffer_params(b_render, b_v3d, b_rv3d, scene->camera, width, height);
 
-	scene->bake_manager->set_shader_limit((size_t)b_engine.tile_x(), (size_t)b_engine.tile_y());
-	scene->bake_manager->set_baking(true);
+		scene->bake_manager->set_shader_limit((size_t)b_engine.tile_x(), (size_t)b_engine.tile_y());
 
-	/* set number of samples */
-	session->tile_manager.set_samples(session_params.samples);
-	session->reset(buffer_params, session_params.samples);
-	session->update_scene();
+		/* set number of samples */
+		session->tile_manager.set_samples(session_params.samples);
+		session->reset(buffer_params, session_params.samples);
+
+		bake_synced = true;
+	}
 
 	/* find object index. todo: is arbitrary - copied from mesh_displace.cpp */
-	for(size_t i = 0; i < scene->objects.size(); i++) {
-		if(strcmp(scene->objects[i]->name.c_str(), b_object.name().c_str()) == 0) {
-			object_index = i;
-			tri_offset = scene->objects[i]->mesh->tri_offset;
-			break;
-		}
+	object_index = find_bake_object(b_object);
+
+	/* objects hidden from rendering are only enabled while they are baked,
+	 * synchronize again to add them, and to remove them for the next bake */
+	bool object_hidden = (object_index == OBJECT_NONE);
+
+	if(object_hidden || bake_resync) {
+		sync->sync_data(b_v3d, b_engine.camera_override(), &python_thread_state);
+		object_index = find_bake_object(b_object);
 	}
 
+	bake_resync = object_hidden;
+
+	/* only updates what changed since the previous bake */
+	scene->bake_manager->set_baking(true);
+	session->update_scene();
+
+	if(object_index != OBJECT_NONE)
+		tri_offset = scene->objects[object_index]->mesh->tri_offset;
+
 	/* when used, non-instanced convention: object = ~object */
 	int object = ~object_index;
 
@@ -584,23 +642,23 @@ void BlenderSession::bake(BL::Object b_object, const string& pass_type, const in
 
 	populate_bake_data(bake_data, object_id, pixel_array, num_pixels);
 
-	/* set number of samples */
-	session->tile_manager.set_samples(session_params.samples);
-	session->reset(buffer_params, session_params.samples);
-	session->update_scene();
-
 	session->progress.set_update_callback(function_bind(&BlenderSession::update_bake_progress, this));
 
 	scene->bake_manager->bake(scene->device, &scene->dscene, scene, session->progress, shader_type, bake_data, result);
 
-	/* free all memory used (host and device), so we wouldn't leave render
-	 * engine with extra memory allocated
-	 */
+	/* scene and device memory are kept for the next object or pass, they
+	 * are freed along with the session when the bake is done */
+}
 
-	session->device_free();
+size_t BlenderSession::find_bake_object(BL::Object b_object)
+{
+	string name = b_object.name();
 
-	delete sync;
-	sync = NULL;
+	for(size_t i = 0; i < scene->objects.size(); i++)
+		if(scene->objects[i]->name == name)
+			return i;
+
+	return OBJECT_NONE;
 }
 
 void BlenderSession::do_write_update_render_result(BL::RenderResult b_rr, BL::RenderLayer b_rlay, RenderTile& rtile, bool do_update_only)
@@ -696,14 +754,15 @@ void BlenderSession::synchronize()
 		return;
 	}
 
-	/* data and camera synchronize */
-	sync->sync_data(b_v3d, b_engine.camera_override(), &python_thread_state);
-
+	/* camera and data synchronize, the camera goes first since adaptive
+	 * subdivision dices meshes in its screen space */
 	if(b_rv3d)
 		sync->sync_view(b_v3d, b_rv3d, width, height);
 	else
 		sync->sync_camera(b_render, b_engine.camera_override(), width, height);
 
+	sync->sync_data(b_v3d, b_engine.camera_override(), &python_thread_state);
+
 	/* unlock */
 	session->scene->mutex.unlock();
 
@@ -874,6 +933,15 @@ void BlenderSession::update_status_progress()
 
 	timestatus += string_printf("Mem:%.2fM, Peak:%.2fM", (double)mem_used, (double)mem_peak);
 
+	/* rays traced by the CPU kernels so far in a final render */
+	if(!b_v3d) {
+		thread_scoped_lock lock(session->stats.kernel_mutex);
+		uint64_t total_rays = session->stats.kernel_counters.total_rays();
+
+		if(total_rays)
+			timestatus += string_printf(" | Rays:%.2fM", (double)total_rays / 1000000.0);
+	}
+
 	if(status.size() > 0)
 		status = " | " + status;
 	if(substatus.size() > 0)
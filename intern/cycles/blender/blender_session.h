@@ -101,7 +101,13 @@ public:
 
 	void *python_thread_state;
 
+	/* scene was synchronized for baking, and is reused for further bakes */
+	bool bake_synced;
+	bool bake_resync;
+
 protected:
+	size_t find_bake_object(BL::Object b_object);
+
 	void do_write_update_render_result(BL::RenderResult b_rr, BL::RenderLayer b_rlay, RenderTile& rtile, bool do_update_only);
 	void do_write_update_render_tile(RenderTile& rtile, bool do_update_only);
 
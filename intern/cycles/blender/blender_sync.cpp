@@ -35,6 +35,7 @@
 
 #include "util_debug.h"
 #include "util_foreach.h"
+#include "util_logging.h"
 #include "util_opengl.h"
 #include "util_hash.h"
 
@@ -53,6 +54,7 @@ BlenderSync::BlenderSync(BL::RenderEngine b_engine_, BL::BlendData b_data_, BL::
   world_map(NULL),
   world_recalc(false),
   experimental(false),
+  use_mesh_bulk_sync(true),
   progress(progress_)
 {
 	scene = scene_;
@@ -155,11 +157,19 @@ void BlenderSync::sync_data(BL::SpaceView3D b_v3d, BL::Object b_override, void *
 	sync_curve_settings();
 
 	mesh_synced.clear(); /* use for objects and motion sync */
+	mesh_sync_stats.clear();
 
 	sync_objects(b_v3d);
 	sync_motion(b_v3d, b_override, python_thread_state);
 
 	mesh_synced.clear();
+
+	if(mesh_sync_stats.num_meshes) {
+		VLOG(1) << "Synchronized " << mesh_sync_stats.num_meshes << " meshes with "
+		        << mesh_sync_stats.num_triangles << " triangles, "
+		        << mesh_sync_stats.convert_time << "s converting, "
+		        << mesh_sync_stats.read_time << "s reading mesh data.";
+	}
 }
 
 /* Integrator */
@@ -172,6 +182,7 @@ void BlenderSync::sync_integrator()
 	PointerRNA cscene = RNA_pointer_get(&b_scene.ptr, "cycles");
 
 	experimental = (RNA_enum_get(&cscene, "feature_set") != 0);
+	use_mesh_bulk_sync = get_boolean(cscene, "debug_use_mesh_bulk_sync");
 
 	Integrator *integrator = scene->integrator;
 	Integrator previntegrator = *integrator;
@@ -205,6 +216,9 @@ void BlenderSync::sync_integrator()
 
 	integrator->sample_clamp_direct = get_float(cscene, "sample_clamp_direct");
 	integrator->sample_clamp_indirect = get_float(cscene, "sample_clamp_indirect");
+
+	integrator->adaptive_threshold = get_float(cscene, "adaptive_threshold");
+	integrator->adaptive_min_samples = get_int(cscene, "adaptive_min_samples");
 #ifdef __CAMERA_MOTION__
 	if(!preview) {
 		if(integrator->motion_blur != r.use_motion_blur()) {
@@ -221,6 +235,15 @@ void BlenderSync::sync_integrator()
 	integrator->sample_all_lights_direct = get_boolean(cscene, "sample_all_lights_direct");
 	integrator->sample_all_lights_indirect = get_boolean(cscene, "sample_all_lights_indirect");
 
+	integrator->use_light_tree = get_boolean(cscene, "use_light_tree");
+
+	/* light tree is built by the light manager */
+	if(integrator->use_light_tree != previntegrator.use_light_tree ||
+	   (integrator->use_light_tree && integrator->method != previntegrator.method))
+	{
+		scene->light_manager->tag_update(scene);
+	}
+
 	int diffuse_samples = get_int(cscene, "diffuse_samples");
 	int glossy_samples = get_int(cscene, "glossy_samples");
 	int transmission_samples = get_int(cscene, "transmission_samples");
@@ -418,13 +441,24 @@ SceneParams BlenderSync::get_scene_params(BL::Scene b_scene, bool background, bo
 		params.bvh_type = (SceneParams::BVHType)RNA_enum_get(&cscene, "debug_bvh_type");
 
 	params.use_bvh_spatial_split = RNA_boolean_get(&cscene, "debug_use_spatial_splits");
+	params.use_bvh_time_bounds = RNA_boolean_get(&cscene, "debug_use_bvh_time_bounds");
+	params.use_bvh_curve_split = RNA_boolean_get(&cscene, "debug_use_bvh_curve_splits");
+	params.use_volume_grid = RNA_boolean_get(&cscene, "debug_use_volume_grid");
+	params.use_shader_optimization = RNA_boolean_get(&cscene, "debug_use_shader_optimization");
 	params.use_bvh_cache = (background)? RNA_boolean_get(&cscene, "use_cache"): false;
+	params.bvh_cache_max_size = (uint64_t)RNA_int_get(&cscene, "cache_size") * 1024 * 1024;
 
 	if(background && params.shadingsystem != SHADINGSYSTEM_OSL)
 		params.persistent_data = r.use_persistent_data();
 	else
 		params.persistent_data = false;
 
+	params.use_texture_cache = is_cpu && RNA_boolean_get(&cscene, "use_texture_cache");
+	params.texture_cache_max_size = (uint64_t)RNA_int_get(&cscene, "texture_cache_size") * 1024 * 1024;
+
+	/* object BVH's can only be reused when the scene is kept between frames */
+	params.use_bvh_reuse = params.persistent_data && RNA_boolean_get(&cscene, "use_bvh_reuse");
+
 #if !(defined(__GNUC__) && (defined(i386) || defined(_M_IX86)))
 	if(is_cpu) {
 		params.use_qbvh = system_cpu_support_sse2();
@@ -435,6 +469,15 @@ SceneParams BlenderSync::get_scene_params(BL::Scene b_scene, bool background, bo
 		params.use_qbvh = false;
 	}
 
+	/* OBVH traversal is only compiled into the AVX2 kernel, so use it only
+	 * when that's the kernel the CPU device is going to pick. */
+#ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
+	params.use_obvh = is_cpu && params.use_qbvh && system_cpu_support_avx2() &&
+	                  RNA_boolean_get(&cscene, "debug_use_obvh");
+#else
+	params.use_obvh = false;
+#endif
+
 	return params;
 }
 
@@ -464,9 +507,10 @@ SessionParams BlenderSync::get_session_params(BL::RenderEngine b_engine,
 	params.device = devices[0];
 
 	if(RNA_enum_get(&cscene, "device") == 2) {
-		/* find network device */
+		/* find network device, or all network servers combined when
+		 * multiple servers are configured */
 		foreach(DeviceInfo& info, devices)
-			if(info.type == DEVICE_NETWORK)
+			if(info.type == DEVICE_NETWORK || info.id == "NETWORK_MULTI")
 				params.device = info;
 	}
 	else if(RNA_enum_get(&cscene, "device") == 1) {
@@ -558,7 +602,13 @@ SessionParams BlenderSync::get_session_params(BL::RenderEngine b_engine,
 	params.reset_timeout = get_float(cscene, "debug_reset_timeout");
 	params.text_timeout = get_float(cscene, "debug_text_timeout");
 
-	params.progressive_refine = get_boolean(cscene, "use_progressive_refine");
+	params.use_camera_packets = get_boolean(cscene, "debug_use_cpu_camera_packets");
+
+	/* progressive refine keeps all tiles in memory, which save buffers is
+	 * meant to avoid by writing finished tiles to disk */
+	params.progressive_refine = get_boolean(cscene, "use_progressive_refine") &&
+	                            !(background && b_scene.render().use_save_buffers());
+	params.use_work_stealing = get_boolean(cscene, "use_work_stealing");
 
 	if(background) {
 		if(params.progressive_refine)
@@ -120,9 +120,32 @@ private:
 	void *world_map;
 	bool world_recalc;
 
+	/* time spent getting mesh data from Blender during the last sync,
+	 * converting to a derived mesh and reading its arrays */
+	struct MeshSyncStats {
+		MeshSyncStats()
+		{
+			clear();
+		}
+
+		void clear()
+		{
+			num_meshes = 0;
+			num_triangles = 0;
+			convert_time = 0.0;
+			read_time = 0.0;
+		}
+
+		int num_meshes;
+		size_t num_triangles;
+		double convert_time;
+		double read_time;
+	} mesh_sync_stats;
+
 	Scene *scene;
 	bool preview;
 	bool experimental;
+	bool use_mesh_bulk_sync;
 	bool is_cpu;
 
 	struct RenderLayerInfo {
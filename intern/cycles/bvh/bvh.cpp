@@ -55,16 +55,34 @@ struct BVHStackEntry
 	}
 };
 
+/* Bounds of a node at ray time 0 and their change until ray time 1, nodes
+ * without time bounds don't move. */
+static void node_time_bounds(const BVHNode *node, BoundBox& bounds, BoundBox& delta)
+{
+	if(node->m_time_bounds) {
+		bounds = node->m_time_bounds[0];
+		delta = BoundBox(node->m_time_bounds[1].min - bounds.min,
+		                 node->m_time_bounds[1].max - bounds.max);
+	}
+	else {
+		bounds = node->m_bounds;
+		delta = BoundBox(make_float3(0.0f, 0.0f, 0.0f), make_float3(0.0f, 0.0f, 0.0f));
+	}
+}
+
 /* BVH */
 
 BVH::BVH(const BVHParams& params_, const vector<Object*>& objects_)
 : params(params_), objects(objects_)
 {
+	build_sah_cost = 0.0f;
 }
 
 BVH *BVH::create(const BVHParams& params, const vector<Object*>& objects)
 {
-	if(params.use_qbvh)
+	if(params.use_obvh)
+		return new OBVH(params, objects);
+	else if(params.use_qbvh)
 		return new QBVH(params, objects);
 	else
 		return new RegularBVH(params, objects);
@@ -74,12 +92,23 @@ BVH *BVH::create(const BVHParams& params, const vector<Object*>& objects)
 
 bool BVH::cache_read(CacheData& key)
 {
-	key.add(system_cpu_bits());
+	/* key only stores pointers, values must outlive it */
+	static const int cpu_bits = system_cpu_bits();
+	static const int version = BVH_CACHE_VERSION;
+
+	key.add(cpu_bits);
+	key.add(version);
 	key.add(&params, sizeof(params));
 
 	foreach(Object *ob, objects) {
 		Mesh *mesh = ob->mesh;
 
+		/* top level BVH stores primitive indices into global arrays */
+		if(params.top_level) {
+			key.add(mesh->tri_offset);
+			key.add(mesh->curve_offset);
+		}
+
 		key.add(mesh->verts);
 		key.add(mesh->triangles);
 		key.add(mesh->curve_keys);
@@ -88,6 +117,10 @@ bool BVH::cache_read(CacheData& key)
 		key.add(&ob->visibility, sizeof(ob->visibility));
 		key.add(&mesh->transform_applied, sizeof(bool));
 
+		/* time bounds of instances are in world space */
+		if(params.top_level && params.use_time_bounds)
+			key.add(&ob->tfm, sizeof(ob->tfm));
+
 		if(mesh->use_motion_blur) {
 			Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
 			if(attr)
@@ -108,6 +141,7 @@ bool BVH::cache_read(CacheData& key)
 		     value.read(pack.SAH) &&
 		     value.read(pack.nodes) &&
 		     value.read(pack.leaf_nodes) &&
+		     value.read(pack.time_nodes) &&
 		     value.read(pack.object_node) &&
 		     value.read(pack.tri_woop) &&
 		     value.read(pack.prim_type) &&
@@ -120,12 +154,17 @@ bool BVH::cache_read(CacheData& key)
 			pack.SAH = 0.0f;
 			pack.nodes.clear();
 			pack.leaf_nodes.clear();
+			pack.time_nodes.clear();
 			pack.object_node.clear();
 			pack.tri_woop.clear();
 			pack.prim_type.clear();
 			pack.prim_visibility.clear();
 			pack.prim_index.clear();
 			pack.prim_object.clear();
+
+			/* don't find the same unreadable file again */
+			Cache::global.remove(key, value);
+			cache_filename = "";
 			return false;
 		}
 		return true;
@@ -143,6 +182,7 @@ void BVH::cache_write(CacheData& key)
 
 	value.add(pack.nodes);
 	value.add(pack.leaf_nodes);
+	value.add(pack.time_nodes);
 	value.add(pack.object_node);
 	value.add(pack.tri_woop);
 	value.add(pack.prim_type);
@@ -155,24 +195,6 @@ void BVH::cache_write(CacheData& key)
 	cache_filename = key.get_filename();
 }
 
-void BVH::clear_cache_except()
-{
-	set<string> except;
-
-	if(!cache_filename.empty())
-		except.insert(cache_filename);
-
-	foreach(Object *ob, objects) {
-		Mesh *mesh = ob->mesh;
-		BVH *bvh = mesh->bvh;
-
-		if(bvh && !bvh->cache_filename.empty())
-			except.insert(bvh->cache_filename);
-	}
-
-	Cache::global.clear_except("bvh", except);
-}
-
 /* Building */
 
 void BVH::build(Progress& progress)
@@ -241,10 +263,6 @@ void BVH::build(Progress& progress)
 	if(params.use_cache) {
 		progress.set_substatus("Writing BVH cache");
 		cache_write(key);
-
-		/* clear other bvh files from cache */
-		if(params.top_level)
-			clear_cache_except();
 	}
 }
 
@@ -252,6 +270,10 @@ void BVH::build(Progress& progress)
 
 void BVH::refit(Progress& progress)
 {
+	/* remember cost of the nodes as they were built */
+	if(build_sah_cost == 0.0f)
+		build_sah_cost = packed_sah_cost();
+
 	progress.set_substatus("Packing BVH primitives");
 	pack_primitives();
 
@@ -261,6 +283,28 @@ void BVH::refit(Progress& progress)
 	refit_nodes();
 }
 
+float BVH::refit_cost_ratio()
+{
+	if(build_sah_cost == 0.0f)
+		return 1.0f;
+
+	return packed_sah_cost()/build_sah_cost;
+}
+
+/* Cost */
+
+float BVH::packed_sah_cost()
+{
+	assert(!params.top_level);
+
+	/* single leaf, refitting can't make it any worse */
+	if(pack.root_index == -1 || pack.nodes.size() == 0)
+		return 0.0f;
+
+	BoundBox bbox = BoundBox::empty;
+	return packed_sah_cost_node(0, false, bbox);
+}
+
 /* Triangles */
 
 void BVH::pack_triangle(int idx, float4 woop[3])
@@ -328,9 +372,12 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 	/* The BVH's for instances are built separately, but for traversal all
 	 * BVH's are stored in global arrays. This function merges them into the
 	 * top level BVH, adjusting indexes and offsets where appropriate. */
-	bool use_qbvh = params.use_qbvh;
-	size_t nsize = (use_qbvh)? BVH_QNODE_SIZE: BVH_NODE_SIZE;
-	size_t nsize_leaf = (use_qbvh)? BVH_QNODE_LEAF_SIZE: BVH_NODE_LEAF_SIZE;
+	bool use_obvh = params.use_obvh;
+	bool use_qbvh = params.use_qbvh && !use_obvh;
+	size_t nsize = (use_obvh)? BVH_ONODE_SIZE: (use_qbvh)? BVH_QNODE_SIZE: BVH_NODE_SIZE;
+	size_t nsize_leaf = (use_obvh)? BVH_ONODE_LEAF_SIZE: (use_qbvh)? BVH_QNODE_LEAF_SIZE: BVH_NODE_LEAF_SIZE;
+	size_t nsize_time = (use_obvh)? BVH_ONODE_TIME_SIZE: (use_qbvh)? BVH_QNODE_TIME_SIZE: BVH_NODE_TIME_SIZE;
+	bool use_time_bounds = params.use_time_bounds;
 
 	/* adjust primitive index to point to the triangle in the global array, for
 	 * meshes with transform applied and already in the top level BVH */
@@ -387,6 +434,7 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 	pack.tri_woop.resize(tri_woop_size);
 	pack.nodes.resize(nodes_size);
 	pack.leaf_nodes.resize(leaf_nodes_size);
+	pack.time_nodes.resize((use_time_bounds)? (nodes_size/nsize)*nsize_time: 0);
 	pack.object_node.resize(objects.size());
 
 	int *pack_prim_index = (pack.prim_index.size())? &pack.prim_index[0]: NULL;
@@ -396,6 +444,7 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 	float4 *pack_tri_woop = (pack.tri_woop.size())? &pack.tri_woop[0]: NULL;
 	int4 *pack_nodes = (pack.nodes.size())? &pack.nodes[0]: NULL;
 	int4 *pack_leaf_nodes = (pack.leaf_nodes.size())? &pack.leaf_nodes[0]: NULL;
+	float4 *pack_time_nodes = (pack.time_nodes.size())? &pack.time_nodes[0]: NULL;
 
 	/* merge */
 	foreach(Object *ob, objects) {
@@ -474,10 +523,12 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 		}
 
 		if(bvh->pack.nodes.size()) {
-			/* For QBVH we're packing a child bbox into 6 float4,
-			 * and for regular BVH they're packed into 3 float4.
+			/* For OBVH we're packing a child bbox into 12 float4,
+			 * for QBVH into 6 float4 and for regular BVH they're
+			 * packed into 3 float4. OBVH child indexes take two int4.
 			 */
-			size_t nsize_bbox = (use_qbvh)? 6: 3;
+			size_t nsize_bbox = (use_obvh)? 12: (use_qbvh)? 6: 3;
+			size_t nsize_child = (use_obvh)? 2: 1;
 			int4 *bvh_nodes = &bvh->pack.nodes[0];
 			size_t bvh_nodes_size = bvh->pack.nodes.size(); 
 
@@ -485,24 +536,40 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 				memcpy(pack_nodes + pack_nodes_offset, bvh_nodes + i, nsize_bbox*sizeof(int4));
 
 				/* modify offsets into arrays */
-				int4 data = bvh_nodes[i + nsize_bbox];
+				for(size_t k = 0; k < nsize_child; k++) {
+					int4 data = bvh_nodes[i + nsize_bbox + k];
 
-				data.x += (data.x < 0)? -noffset_leaf: noffset;
-				data.y += (data.y < 0)? -noffset_leaf: noffset;
+					data.x += (data.x < 0)? -noffset_leaf: noffset;
+					data.y += (data.y < 0)? -noffset_leaf: noffset;
 
-				if(use_qbvh) {
-					data.z += (data.z < 0)? -noffset_leaf: noffset;
-					data.w += (data.w < 0)? -noffset_leaf: noffset;
-				}
+					if(use_qbvh || use_obvh) {
+						data.z += (data.z < 0)? -noffset_leaf: noffset;
+						data.w += (data.w < 0)? -noffset_leaf: noffset;
+					}
 
-				pack_nodes[pack_nodes_offset + nsize_bbox] = data;
+					pack_nodes[pack_nodes_offset + nsize_bbox + k] = data;
+				}
 
 				/* Usually this copies nothing, but we better
 				 * be prepared for possible node size extension.
 				 */
-				memcpy(&pack_nodes[pack_nodes_offset + nsize_bbox+1],
-				       &bvh_nodes[i + nsize_bbox+1],
-				       sizeof(int4) * (nsize - (nsize_bbox+1)));
+				memcpy(&pack_nodes[pack_nodes_offset + nsize_bbox+nsize_child],
+				       &bvh_nodes[i + nsize_bbox+nsize_child],
+				       sizeof(int4) * (nsize - (nsize_bbox+nsize_child)));
+
+				/* time bounds, BVH's without them don't move so use the node
+				 * bounds at all times */
+				if(pack_time_nodes) {
+					float4 *time_node = pack_time_nodes + (pack_nodes_offset/nsize)*nsize_time;
+
+					if(bvh->pack.time_nodes.size()) {
+						memcpy(time_node, &bvh->pack.time_nodes[j*nsize_time], sizeof(float4)*nsize_time);
+					}
+					else {
+						memcpy(time_node, bvh_nodes + i, sizeof(float4)*nsize_bbox);
+						memset(time_node + nsize_bbox, 0, sizeof(float4)*(nsize_time - nsize_bbox));
+					}
+				}
 
 				pack_nodes_offset += nsize;
 			}
@@ -514,6 +581,75 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
 	}
 }
 
+/* Refit */
+
+void BVH::refit_primitives(int start, int end, BoundBox& bbox, uint& visibility)
+{
+	for(int prim = start; prim < end; prim++) {
+		int pidx = pack.prim_index[prim];
+		int tob = pack.prim_object[prim];
+		Object *ob = objects[tob];
+
+		if(pidx == -1) {
+			/* object instance */
+			bbox.grow(ob->bounds);
+		}
+		else {
+			/* primitives */
+			const Mesh *mesh = ob->mesh;
+
+			if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
+				/* curves */
+				int str_offset = (params.top_level)? mesh->curve_offset: 0;
+				const Mesh::Curve& curve = mesh->curves[pidx - str_offset];
+				int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
+
+				curve.bounds_grow(k, &mesh->curve_keys[0], bbox);
+
+				visibility |= PATH_RAY_CURVE;
+
+				/* motion curves */
+				if(mesh->use_motion_blur) {
+					Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+
+					if(attr) {
+						size_t mesh_size = mesh->curve_keys.size();
+						size_t steps = mesh->motion_steps - 1;
+						float4 *key_steps = attr->data_float4();
+
+						for(size_t i = 0; i < steps; i++)
+							curve.bounds_grow(k, key_steps + i*mesh_size, bbox);
+					}
+				}
+			}
+			else {
+				/* triangles */
+				int tri_offset = (params.top_level)? mesh->tri_offset: 0;
+				const Mesh::Triangle& triangle = mesh->triangles[pidx - tri_offset];
+				const float3 *vpos = &mesh->verts[0];
+
+				triangle.bounds_grow(vpos, bbox);
+
+				/* motion triangles */
+				if(mesh->use_motion_blur) {
+					Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+
+					if(attr) {
+						size_t mesh_size = mesh->verts.size();
+						size_t steps = mesh->motion_steps - 1;
+						float3 *vert_steps = attr->data_float3();
+
+						for(size_t i = 0; i < steps; i++)
+							triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
+					}
+				}
+			}
+		}
+
+		visibility |= ob->visibility;
+	}
+}
+
 /* Regular BVH */
 
 RegularBVH::RegularBVH(const BVHParams& params_, const vector<Object*>& objects_)
@@ -546,6 +682,28 @@ void RegularBVH::pack_leaf(const BVHStackEntry& e, const LeafNode *leaf)
 void RegularBVH::pack_inner(const BVHStackEntry& e, const BVHStackEntry& e0, const BVHStackEntry& e1)
 {
 	pack_node(e.idx, e0.node->m_bounds, e1.node->m_bounds, e0.encodeIdx(), e1.encodeIdx(), e0.node->m_visibility, e1.node->m_visibility);
+
+	if(params.use_time_bounds)
+		pack_time_node(e.idx, e0.node, e1.node);
+}
+
+void RegularBVH::pack_time_node(int idx, const BVHNode *n0, const BVHNode *n1)
+{
+	BoundBox b0, b1, d0, d1;
+	node_time_bounds(n0, b0, d0);
+	node_time_bounds(n1, b1, d1);
+
+	float4 data[BVH_NODE_TIME_SIZE] =
+	{
+		make_float4(b0.min.x, b1.min.x, b0.max.x, b1.max.x),
+		make_float4(b0.min.y, b1.min.y, b0.max.y, b1.max.y),
+		make_float4(b0.min.z, b1.min.z, b0.max.z, b1.max.z),
+		make_float4(d0.min.x, d1.min.x, d0.max.x, d1.max.x),
+		make_float4(d0.min.y, d1.min.y, d0.max.y, d1.max.y),
+		make_float4(d0.min.z, d1.min.z, d0.max.z, d1.max.z)
+	};
+
+	memcpy(&pack.time_nodes[idx * BVH_NODE_TIME_SIZE], data, sizeof(float4)*BVH_NODE_TIME_SIZE);
 }
 
 void RegularBVH::pack_node(int idx, const BoundBox& b0, const BoundBox& b1, int c0, int c1, uint visibility0, uint visibility1)
@@ -578,6 +736,7 @@ void RegularBVH::pack_nodes(const BVHNode *root)
 	else {
 		pack.nodes.resize(node_size*BVH_NODE_SIZE);
 		pack.leaf_nodes.resize(leaf_node_size*BVH_NODE_LEAF_SIZE);
+		pack.time_nodes.resize((params.use_time_bounds)? node_size*BVH_NODE_TIME_SIZE: 0);
 	}
 
 	int nextNodeIdx = 0, nextLeafNodeIdx = 0;
@@ -629,69 +788,7 @@ void RegularBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility
 		int c0 = data[0].x;
 		int c1 = data[0].y;
 		/* refit leaf node */
-		for(int prim = c0; prim < c1; prim++) {
-			int pidx = pack.prim_index[prim];
-			int tob = pack.prim_object[prim];
-			Object *ob = objects[tob];
-
-			if(pidx == -1) {
-				/* object instance */
-				bbox.grow(ob->bounds);
-			}
-			else {
-				/* primitives */
-				const Mesh *mesh = ob->mesh;
-
-				if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
-					/* curves */
-					int str_offset = (params.top_level)? mesh->curve_offset: 0;
-					const Mesh::Curve& curve = mesh->curves[pidx - str_offset];
-					int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
-
-					curve.bounds_grow(k, &mesh->curve_keys[0], bbox);
-
-					visibility |= PATH_RAY_CURVE;
-
-					/* motion curves */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->curve_keys.size();
-							size_t steps = mesh->motion_steps - 1;
-							float4 *key_steps = attr->data_float4();
-
-							for(size_t i = 0; i < steps; i++)
-								curve.bounds_grow(k, key_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-				else {
-					/* triangles */
-					int tri_offset = (params.top_level)? mesh->tri_offset: 0;
-					const Mesh::Triangle& triangle = mesh->triangles[pidx - tri_offset];
-					const float3 *vpos = &mesh->verts[0];
-
-					triangle.bounds_grow(vpos, bbox);
-
-					/* motion triangles */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->verts.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *vert_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-			}
-
-			visibility |= ob->visibility;
-		}
+		refit_primitives(c0, c1, bbox, visibility);
 
 		/* TODO(sergey): De-duplicate with pack_leaf(). */
 		float4 leaf_data[BVH_NODE_LEAF_SIZE];
@@ -722,6 +819,40 @@ void RegularBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility
 	}
 }
 
+float RegularBVH::packed_sah_cost_node(int idx, bool leaf, const BoundBox& bbox)
+{
+	if(leaf) {
+		int4 *data = &pack.leaf_nodes[idx*BVH_NODE_LEAF_SIZE];
+		return bbox.safe_area() * params.primitive_cost(max(data[0].y - data[0].x, 1));
+	}
+
+	int4 *data = &pack.nodes[idx*BVH_NODE_SIZE];
+	int c0 = data[3].x;
+	int c1 = data[3].y;
+
+	BoundBox bbox0(make_float3(__int_as_float(data[0].x), __int_as_float(data[1].x), __int_as_float(data[2].x)),
+	               make_float3(__int_as_float(data[0].z), __int_as_float(data[1].z), __int_as_float(data[2].z)));
+	BoundBox bbox1(make_float3(__int_as_float(data[0].y), __int_as_float(data[1].y), __int_as_float(data[2].y)),
+	               make_float3(__int_as_float(data[0].w), __int_as_float(data[1].w), __int_as_float(data[2].w)));
+
+	/* root node has no parent to give us its bounds */
+	BoundBox node_bbox = bbox;
+	if(idx == 0) {
+		node_bbox = bbox0;
+		node_bbox.grow(bbox1);
+	}
+
+	float cost = node_bbox.safe_area() * params.node_cost(2);
+	cost += packed_sah_cost_node((c0 < 0)? -c0-1: c0, (c0 < 0), bbox0);
+	cost += packed_sah_cost_node((c1 < 0)? -c1-1: c1, (c1 < 0), bbox1);
+
+	/* normalize by root area, to get the expected cost of a ray */
+	if(idx == 0)
+		cost /= max(node_bbox.safe_area(), 1e-12f);
+
+	return cost;
+}
+
 /* QBVH */
 
 QBVH::QBVH(const BVHParams& params_, const vector<Object*>& objects_)
@@ -787,6 +918,40 @@ void QBVH::pack_inner(const BVHStackEntry& e, const BVHStackEntry *en, int num)
 	}
 
 	memcpy(&pack.nodes[e.idx * BVH_QNODE_SIZE], data, sizeof(float4)*BVH_QNODE_SIZE);
+
+	if(!params.use_time_bounds)
+		return;
+
+	/* time bounds, rows 0-5 at time 0 and rows 6-11 their change */
+	float4 time_data[BVH_QNODE_TIME_SIZE];
+
+	for(int i = 0; i < 4; i++) {
+		BoundBox bounds, delta;
+
+		if(i < num) {
+			node_time_bounds(en[i].node, bounds, delta);
+		}
+		else {
+			bounds = BoundBox(make_float3(FLT_MAX, FLT_MAX, FLT_MAX), make_float3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+			delta = BoundBox(make_float3(0.0f, 0.0f, 0.0f), make_float3(0.0f, 0.0f, 0.0f));
+		}
+
+		time_data[0][i] = bounds.min.x;
+		time_data[1][i] = bounds.max.x;
+		time_data[2][i] = bounds.min.y;
+		time_data[3][i] = bounds.max.y;
+		time_data[4][i] = bounds.min.z;
+		time_data[5][i] = bounds.max.z;
+
+		time_data[6][i] = delta.min.x;
+		time_data[7][i] = delta.max.x;
+		time_data[8][i] = delta.min.y;
+		time_data[9][i] = delta.max.y;
+		time_data[10][i] = delta.min.z;
+		time_data[11][i] = delta.max.z;
+	}
+
+	memcpy(&pack.time_nodes[e.idx * BVH_QNODE_TIME_SIZE], time_data, sizeof(float4)*BVH_QNODE_TIME_SIZE);
 }
 
 /* Quad SIMD Nodes */
@@ -809,6 +974,7 @@ void QBVH::pack_nodes(const BVHNode *root)
 	else {
 		pack.nodes.resize(node_size*BVH_QNODE_SIZE);
 		pack.leaf_nodes.resize(leaf_node_size*BVH_QNODE_LEAF_SIZE);
+		pack.time_nodes.resize((params.use_time_bounds)? node_size*BVH_QNODE_TIME_SIZE: 0);
 	}
 
 	int nextNodeIdx = 0, nextLeafNodeIdx = 0;
@@ -893,69 +1059,7 @@ void QBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 		int4 *data = &pack.leaf_nodes[idx*BVH_QNODE_LEAF_SIZE];
 		int4 c = data[0];
 		/* Refit leaf node. */
-		for(int prim = c.x; prim < c.y; prim++) {
-			int pidx = pack.prim_index[prim];
-			int tob = pack.prim_object[prim];
-			Object *ob = objects[tob];
-
-			if(pidx == -1) {
-				/* Object instance. */
-				bbox.grow(ob->bounds);
-			}
-			else {
-				/* Primitives. */
-				const Mesh *mesh = ob->mesh;
-
-				if(pack.prim_type[prim] & PRIMITIVE_ALL_CURVE) {
-					/* Curves. */
-					int str_offset = (params.top_level)? mesh->curve_offset: 0;
-					const Mesh::Curve& curve = mesh->curves[pidx - str_offset];
-					int k = PRIMITIVE_UNPACK_SEGMENT(pack.prim_type[prim]);
-
-					curve.bounds_grow(k, &mesh->curve_keys[0], bbox);
-
-					visibility |= PATH_RAY_CURVE;
-
-					/* Motion curves. */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->curve_keys.size();
-							size_t steps = mesh->motion_steps - 1;
-							float4 *key_steps = attr->data_float4();
-
-							for(size_t i = 0; i < steps; i++)
-								curve.bounds_grow(k, key_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-				else {
-					/* Triangles. */
-					int tri_offset = (params.top_level)? mesh->tri_offset: 0;
-					const Mesh::Triangle& triangle = mesh->triangles[pidx - tri_offset];
-					const float3 *vpos = &mesh->verts[0];
-
-					triangle.bounds_grow(vpos, bbox);
-
-					/* Motion triangles. */
-					if(mesh->use_motion_blur) {
-						Attribute *attr = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-
-						if(attr) {
-							size_t mesh_size = mesh->verts.size();
-							size_t steps = mesh->motion_steps - 1;
-							float3 *vert_steps = attr->data_float3();
-
-							for(size_t i = 0; i < steps; i++)
-								triangle.bounds_grow(vert_steps + i*mesh_size, bbox);
-						}
-					}
-				}
-			}
-
-			visibility |= ob->visibility;
-		}
+		refit_primitives(c.x, c.y, bbox, visibility);
 
 		/* TODO(sergey): This is actually a copy of pack_leaf(),
 		 * but this chunk of code only knows actual data and has
@@ -1015,4 +1119,368 @@ void QBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
 	}
 }
 
+float QBVH::packed_sah_cost_node(int idx, bool leaf, const BoundBox& bbox)
+{
+	if(leaf) {
+		int4 *data = &pack.leaf_nodes[idx*BVH_QNODE_LEAF_SIZE];
+		return bbox.safe_area() * params.primitive_cost(max(data[0].y - data[0].x, 1));
+	}
+
+	float4 *data = (float4*)&pack.nodes[idx*BVH_QNODE_SIZE];
+	int c[4];
+
+	for(int i = 0; i < 4; ++i)
+		c[i] = __float_as_int(data[6][i]);
+
+	BoundBox child_bbox[4];
+	BoundBox node_bbox = BoundBox::empty;
+	int num_nodes = 0;
+
+	for(int i = 0; i < 4; ++i) {
+		if(c[i] != 0) {
+			child_bbox[i] = BoundBox(make_float3(data[0][i], data[2][i], data[4][i]),
+			                         make_float3(data[1][i], data[3][i], data[5][i]));
+			node_bbox.grow(child_bbox[i]);
+			++num_nodes;
+		}
+	}
+
+	/* root node has no parent to give us its bounds */
+	if(idx != 0)
+		node_bbox = bbox;
+
+	float cost = node_bbox.safe_area() * params.node_cost(num_nodes);
+
+	for(int i = 0; i < 4; ++i) {
+		if(c[i] != 0) {
+			cost += packed_sah_cost_node((c[i] < 0)? -c[i]-1: c[i], (c[i] < 0),
+			                             child_bbox[i]);
+		}
+	}
+
+	/* normalize by root area, to get the expected cost of a ray */
+	if(idx == 0)
+		cost /= max(node_bbox.safe_area(), 1e-12f);
+
+	return cost;
+}
+
+/* OBVH */
+
+OBVH::OBVH(const BVHParams& params_, const vector<Object*>& objects_)
+: BVH(params_, objects_)
+{
+	params.use_obvh = true;
+}
+
+void OBVH::pack_leaf(const BVHStackEntry& e, const LeafNode *leaf)
+{
+	float4 data[BVH_ONODE_LEAF_SIZE];
+	memset(data, 0, sizeof(data));
+	if(leaf->num_triangles() == 1 && pack.prim_index[leaf->m_lo] == -1) {
+		/* object */
+		data[0].x = __int_as_float(~(leaf->m_lo));
+		data[0].y = __int_as_float(0);
+	}
+	else {
+		/* triangle */
+		data[0].x = __int_as_float(leaf->m_lo);
+		data[0].y = __int_as_float(leaf->m_hi);
+	}
+	data[0].z = __uint_as_float(leaf->m_visibility);
+	if(leaf->num_triangles() != 0) {
+		data[0].w = __uint_as_float(pack.prim_type[leaf->m_lo]);
+	}
+
+	memcpy(&pack.leaf_nodes[e.idx * BVH_ONODE_LEAF_SIZE], data, sizeof(float4)*BVH_ONODE_LEAF_SIZE);
+}
+
+/* Every row of an OBVH node holds 8 values in two consecutive float4. */
+static void obvh_node_set(float4 *data, int row, int i, float value)
+{
+	data[row*2 + i/4][i%4] = value;
+}
+
+static float obvh_node_get(const float4 *data, int row, int i)
+{
+	return data[row*2 + i/4][i%4];
+}
+
+void OBVH::pack_inner(const BVHStackEntry& e, const BVHStackEntry *en, int num)
+{
+	float4 data[BVH_ONODE_SIZE];
+
+	for(int i = 0; i < num; i++) {
+		float3 bb_min = en[i].node->m_bounds.min;
+		float3 bb_max = en[i].node->m_bounds.max;
+
+		obvh_node_set(data, 0, i, bb_min.x);
+		obvh_node_set(data, 1, i, bb_max.x);
+		obvh_node_set(data, 2, i, bb_min.y);
+		obvh_node_set(data, 3, i, bb_max.y);
+		obvh_node_set(data, 4, i, bb_min.z);
+		obvh_node_set(data, 5, i, bb_max.z);
+
+		obvh_node_set(data, 6, i, __int_as_float(en[i].encodeIdx()));
+	}
+
+	for(int i = num; i < 8; i++) {
+		/* We store BB which would never be recorded as intersection
+		 * so kernel might safely assume there are always 8 child nodes.
+		 */
+		obvh_node_set(data, 0, i, FLT_MAX);
+		obvh_node_set(data, 1, i, -FLT_MAX);
+
+		obvh_node_set(data, 2, i, FLT_MAX);
+		obvh_node_set(data, 3, i, -FLT_MAX);
+
+		obvh_node_set(data, 4, i, FLT_MAX);
+		obvh_node_set(data, 5, i, -FLT_MAX);
+
+		obvh_node_set(data, 6, i, __int_as_float(0));
+	}
+
+	memcpy(&pack.nodes[e.idx * BVH_ONODE_SIZE], data, sizeof(float4)*BVH_ONODE_SIZE);
+
+	if(!params.use_time_bounds)
+		return;
+
+	/* time bounds, rows 0-5 at time 0 and rows 6-11 their change */
+	float4 time_data[BVH_ONODE_TIME_SIZE];
+
+	for(int i = 0; i < 8; i++) {
+		BoundBox bounds, delta;
+
+		if(i < num) {
+			node_time_bounds(en[i].node, bounds, delta);
+		}
+		else {
+			bounds = BoundBox(make_float3(FLT_MAX, FLT_MAX, FLT_MAX), make_float3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+			delta = BoundBox(make_float3(0.0f, 0.0f, 0.0f), make_float3(0.0f, 0.0f, 0.0f));
+		}
+
+		obvh_node_set(time_data, 0, i, bounds.min.x);
+		obvh_node_set(time_data, 1, i, bounds.max.x);
+		obvh_node_set(time_data, 2, i, bounds.min.y);
+		obvh_node_set(time_data, 3, i, bounds.max.y);
+		obvh_node_set(time_data, 4, i, bounds.min.z);
+		obvh_node_set(time_data, 5, i, bounds.max.z);
+
+		obvh_node_set(time_data, 6, i, delta.min.x);
+		obvh_node_set(time_data, 7, i, delta.max.x);
+		obvh_node_set(time_data, 8, i, delta.min.y);
+		obvh_node_set(time_data, 9, i, delta.max.y);
+		obvh_node_set(time_data, 10, i, delta.min.z);
+		obvh_node_set(time_data, 11, i, delta.max.z);
+	}
+
+	memcpy(&pack.time_nodes[e.idx * BVH_ONODE_TIME_SIZE], time_data, sizeof(float4)*BVH_ONODE_TIME_SIZE);
+}
+
+/* Octo SIMD Nodes */
+
+void OBVH::pack_nodes(const BVHNode *root)
+{
+	size_t tot_node_size = root->getSubtreeSize(BVH_STAT_ONODE_COUNT);
+	size_t leaf_node_size = root->getSubtreeSize(BVH_STAT_LEAF_COUNT);
+	size_t node_size = tot_node_size - leaf_node_size;
+
+	/* resize arrays */
+	pack.nodes.clear();
+	pack.leaf_nodes.clear();
+
+	/* for top level BVH, first merge existing BVH's so we know the offsets */
+	if(params.top_level) {
+		pack_instances(node_size*BVH_ONODE_SIZE,
+		               leaf_node_size*BVH_ONODE_LEAF_SIZE);
+	}
+	else {
+		pack.nodes.resize(node_size*BVH_ONODE_SIZE);
+		pack.leaf_nodes.resize(leaf_node_size*BVH_ONODE_LEAF_SIZE);
+		pack.time_nodes.resize((params.use_time_bounds)? node_size*BVH_ONODE_TIME_SIZE: 0);
+	}
+
+	int nextNodeIdx = 0, nextLeafNodeIdx = 0;
+
+	vector<BVHStackEntry> stack;
+	stack.reserve(BVHParams::MAX_DEPTH*8);
+	if(root->is_leaf()) {
+		stack.push_back(BVHStackEntry(root, nextLeafNodeIdx++));
+	}
+	else {
+		stack.push_back(BVHStackEntry(root, nextNodeIdx++));
+	}
+
+	while(stack.size()) {
+		BVHStackEntry e = stack.back();
+		stack.pop_back();
+
+		if(e.node->is_leaf()) {
+			/* leaf node */
+			const LeafNode* leaf = reinterpret_cast<const LeafNode*>(e.node);
+			pack_leaf(e, leaf);
+		}
+		else {
+			/* inner node, collect nodes down to three levels of the binary
+			 * tree, must match BVH_STAT_ONODE_COUNT */
+			const BVHNode *nodes[8];
+			int numnodes = 0;
+
+			for(int i = 0; i < 2; i++) {
+				const BVHNode *node_i = e.node->get_child(i);
+
+				if(node_i->is_leaf()) {
+					nodes[numnodes++] = node_i;
+					continue;
+				}
+
+				for(int j = 0; j < 2; j++) {
+					const BVHNode *node_j = node_i->get_child(j);
+
+					if(node_j->is_leaf()) {
+						nodes[numnodes++] = node_j;
+					}
+					else {
+						nodes[numnodes++] = node_j->get_child(0);
+						nodes[numnodes++] = node_j->get_child(1);
+					}
+				}
+			}
+
+			/* push entries on the stack */
+			for(int i = 0; i < numnodes; i++) {
+				int idx;
+				if(nodes[i]->is_leaf()) {
+					idx = nextLeafNodeIdx++;
+				}
+				else {
+					idx = nextNodeIdx++;
+				}
+				stack.push_back(BVHStackEntry(nodes[i], idx));
+			}
+
+			/* set node */
+			pack_inner(e, &stack[stack.size()-numnodes], numnodes);
+		}
+	}
+
+	/* root index to start traversal at, to handle case of single leaf node */
+	pack.root_index = (root->is_leaf())? -1: 0;
+}
+
+void OBVH::refit_nodes()
+{
+	assert(!params.top_level);
+
+	BoundBox bbox = BoundBox::empty;
+	uint visibility = 0;
+	refit_node(0, (pack.root_index == -1)? true: false, bbox, visibility);
+}
+
+void OBVH::refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility)
+{
+	if(leaf) {
+		int4 *data = &pack.leaf_nodes[idx*BVH_ONODE_LEAF_SIZE];
+		int4 c = data[0];
+		/* Refit leaf node. */
+		refit_primitives(c.x, c.y, bbox, visibility);
+
+		float4 leaf_data[BVH_ONODE_LEAF_SIZE];
+		leaf_data[0].x = __int_as_float(c.x);
+		leaf_data[0].y = __int_as_float(c.y);
+		leaf_data[0].z = __uint_as_float(visibility);
+		leaf_data[0].w = __uint_as_float(c.w);
+		memcpy(&pack.leaf_nodes[idx * BVH_ONODE_LEAF_SIZE],
+		       leaf_data,
+		       sizeof(float4)*BVH_ONODE_LEAF_SIZE);
+	}
+	else {
+		float4 *data = (float4*)&pack.nodes[idx*BVH_ONODE_SIZE];
+		int c[8];
+
+		for(int i = 0; i < 8; ++i)
+			c[i] = __float_as_int(obvh_node_get(data, 6, i));
+
+		/* Refit inner node, set bbox from children. */
+		BoundBox child_bbox[8];
+		uint child_visibility[8] = {0};
+
+		for(int i = 0; i < 8; ++i) {
+			child_bbox[i] = BoundBox::empty;
+			if(c[i] != 0) {
+				refit_node((c[i] < 0)? -c[i]-1: c[i], (c[i] < 0),
+				           child_bbox[i], child_visibility[i]);
+				bbox.grow(child_bbox[i]);
+				visibility |= child_visibility[i];
+			}
+		}
+
+		float4 inner_data[BVH_ONODE_SIZE];
+		for(int i = 0; i < 8; ++i) {
+			float3 bb_min = child_bbox[i].min;
+			float3 bb_max = child_bbox[i].max;
+			obvh_node_set(inner_data, 0, i, bb_min.x);
+			obvh_node_set(inner_data, 1, i, bb_max.x);
+			obvh_node_set(inner_data, 2, i, bb_min.y);
+			obvh_node_set(inner_data, 3, i, bb_max.y);
+			obvh_node_set(inner_data, 4, i, bb_min.z);
+			obvh_node_set(inner_data, 5, i, bb_max.z);
+			obvh_node_set(inner_data, 6, i, __int_as_float(c[i]));
+		}
+		memcpy(&pack.nodes[idx * BVH_ONODE_SIZE],
+		       inner_data,
+		       sizeof(float4)*BVH_ONODE_SIZE);
+	}
+}
+
+float OBVH::packed_sah_cost_node(int idx, bool leaf, const BoundBox& bbox)
+{
+	if(leaf) {
+		int4 *data = &pack.leaf_nodes[idx*BVH_ONODE_LEAF_SIZE];
+		return bbox.safe_area() * params.primitive_cost(max(data[0].y - data[0].x, 1));
+	}
+
+	float4 *data = (float4*)&pack.nodes[idx*BVH_ONODE_SIZE];
+	int c[8];
+
+	for(int i = 0; i < 8; ++i)
+		c[i] = __float_as_int(obvh_node_get(data, 6, i));
+
+	BoundBox child_bbox[8];
+	BoundBox node_bbox = BoundBox::empty;
+	int num_nodes = 0;
+
+	for(int i = 0; i < 8; ++i) {
+		if(c[i] != 0) {
+			child_bbox[i] = BoundBox(make_float3(obvh_node_get(data, 0, i),
+			                                     obvh_node_get(data, 2, i),
+			                                     obvh_node_get(data, 4, i)),
+			                         make_float3(obvh_node_get(data, 1, i),
+			                                     obvh_node_get(data, 3, i),
+			                                     obvh_node_get(data, 5, i)));
+			node_bbox.grow(child_bbox[i]);
+			++num_nodes;
+		}
+	}
+
+	/* root node has no parent to give us its bounds */
+	if(idx != 0)
+		node_bbox = bbox;
+
+	float cost = node_bbox.safe_area() * params.node_cost(num_nodes);
+
+	for(int i = 0; i < 8; ++i) {
+		if(c[i] != 0) {
+			cost += packed_sah_cost_node((c[i] < 0)? -c[i]-1: c[i], (c[i] < 0),
+			                             child_bbox[i]);
+		}
+	}
+
+	/* normalize by root area, to get the expected cost of a ray */
+	if(idx == 0)
+		cost /= max(node_bbox.safe_area(), 1e-12f);
+
+	return cost;
+}
+
 CCL_NAMESPACE_END
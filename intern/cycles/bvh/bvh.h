@@ -39,9 +39,17 @@ class Progress;
 #define BVH_NODE_LEAF_SIZE	1
 #define BVH_QNODE_SIZE	7
 #define BVH_QNODE_LEAF_SIZE	1
+#define BVH_ONODE_SIZE	14
+#define BVH_ONODE_LEAF_SIZE	1
+#define BVH_NODE_TIME_SIZE	6
+#define BVH_QNODE_TIME_SIZE	12
+#define BVH_ONODE_TIME_SIZE	24
 #define BVH_ALIGN		4096
 #define TRI_NODE_SIZE	3
 
+/* Increase when packed BVH layout changes, to invalidate disk cache. */
+#define BVH_CACHE_VERSION	2
+
 /* Packed BVH
  *
  * BVH stored as it will be used for traversal on the rendering device. */
@@ -52,6 +60,10 @@ struct PackedBVH {
 	array<int4> nodes;
 	/* BVH leaf nodes storage. */
 	array<int4> leaf_nodes;
+	/* child bounds of inner nodes at ray time 0 followed by their change until
+	 * ray time 1, in the same layout as the bounds in the nodes. Only used for
+	 * deformation motion blur, empty otherwise. */
+	array<float4> time_nodes;
 	/* object index to BVH node index mapping for instances */
 	array<int> object_node; 
 	/* precomputed triangle intersection data, one triangle is 4x float4 */
@@ -95,7 +107,9 @@ public:
 	void build(Progress& progress);
 	void refit(Progress& progress);
 
-	void clear_cache_except();
+	/* SAH cost of the refitted nodes relative to the cost of the nodes as
+	 * they were built, to detect when a rebuild is better than a refit */
+	float refit_cost_ratio();
 
 protected:
 	BVH(const BVHParams& params, const vector<Object*>& objects);
@@ -111,9 +125,19 @@ protected:
 	/* merge instance BVH's */
 	void pack_instances(size_t nodes_size, size_t leaf_nodes_size);
 
+	/* SAH cost of packed nodes */
+	float packed_sah_cost();
+
 	/* for subclasses to implement */
 	virtual void pack_nodes(const BVHNode *root) = 0;
 	virtual void refit_nodes() = 0;
+	virtual float packed_sah_cost_node(int idx, bool leaf, const BoundBox& bbox) = 0;
+
+	/* refit bounds and visibility of a range of packed primitives */
+	void refit_primitives(int start, int end, BoundBox& bbox, uint& visibility);
+
+	/* SAH cost of the packed nodes before the first refit */
+	float build_sah_cost;
 };
 
 /* Regular BVH
@@ -131,10 +155,14 @@ protected:
 	void pack_leaf(const BVHStackEntry& e, const LeafNode *leaf);
 	void pack_inner(const BVHStackEntry& e, const BVHStackEntry& e0, const BVHStackEntry& e1);
 	void pack_node(int idx, const BoundBox& b0, const BoundBox& b1, int c0, int c1, uint visibility0, uint visibility1);
+	void pack_time_node(int idx, const BVHNode *n0, const BVHNode *n1);
 
 	/* refit */
 	void refit_nodes();
 	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+
+	/* cost */
+	float packed_sah_cost_node(int idx, bool leaf, const BoundBox& bbox);
 };
 
 /* QBVH
@@ -155,6 +183,32 @@ protected:
 	/* refit */
 	void refit_nodes();
 	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+
+	/* cost */
+	float packed_sah_cost_node(int idx, bool leaf, const BoundBox& bbox);
+};
+
+/* OBVH
+ *
+ * Octo BVH, with each node having eight children, to use with AVX instructions. */
+
+class OBVH : public BVH {
+protected:
+	/* constructor */
+	friend class BVH;
+	OBVH(const BVHParams& params, const vector<Object*>& objects);
+
+	/* pack */
+	void pack_nodes(const BVHNode *root);
+	void pack_leaf(const BVHStackEntry& e, const LeafNode *leaf);
+	void pack_inner(const BVHStackEntry& e, const BVHStackEntry *en, int num);
+
+	/* refit */
+	void refit_nodes();
+	void refit_node(int idx, bool leaf, BoundBox& bbox, uint& visibility);
+
+	/* cost */
+	float packed_sah_cost_node(int idx, bool leaf, const BoundBox& bbox);
 };
 
 CCL_NAMESPACE_END
@@ -76,6 +76,7 @@ BVHBuild::BVHBuild(const vector<Object*>& objects_,
   progress_start_time(0.0)
 {
 	spatial_min_overlap = 0.0f;
+	num_curve_split_references = 0;
 }
 
 BVHBuild::~BVHBuild()
@@ -117,40 +118,91 @@ void BVHBuild::add_reference_mesh(BoundBox& root, BoundBox& center, Mesh *mesh,
 		}
 	}
 
-	Attribute *curve_attr_mP = NULL;
+	int curve_type = PRIMITIVE_CURVE;
 
-	if(mesh->has_motion_blur())
-		curve_attr_mP = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+	if(mesh->has_motion_blur() && mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION))
+		curve_type = PRIMITIVE_MOTION_CURVE;
 
 	for(uint j = 0; j < mesh->curves.size(); j++) {
 		Mesh::Curve curve = mesh->curves[j];
-		PrimitiveType type = PRIMITIVE_CURVE;
 
-		for(int k = 0; k < curve.num_keys - 1; k++) {
-			BoundBox bounds = BoundBox::empty;
-			curve.bounds_grow(k, &mesh->curve_keys[0], bounds);
+		for(int k = 0; k < curve.num_keys - 1; k++)
+			add_reference_curve_segment(root, center, mesh, j, i, PRIMITIVE_PACK_SEGMENT(curve_type, k));
+	}
+}
 
-			/* motion curve */
-			if(curve_attr_mP) {
-				size_t mesh_size = mesh->curve_keys.size();
-				size_t steps = mesh->motion_steps - 1;
-				float4 *key_steps = curve_attr_mP->data_float4();
+/* Curve segments are thin and often diagonal, so a single box around a
+ * segment is mostly empty space. When it pays off, the segment is split into
+ * pieces along the curve, each referencing the full segment but bounding only
+ * its own part. The kernel intersects cardinal curves as chords between
+ * 2^subdivisions points, the split levels are limited so that every chord
+ * lies within a single piece. */
 
-				for(size_t i = 0; i < steps; i++)
-					curve.bounds_grow(k, key_steps + i*mesh_size, bounds);
+void BVHBuild::curve_segment_bounds(const Mesh *mesh, int prim_index, int prim_type, float t0, float t1, BoundBox& bounds) const
+{
+	const Mesh::Curve& curve = mesh->curves[prim_index];
+	int segment = PRIMITIVE_UNPACK_SEGMENT(prim_type);
 
-				type = PRIMITIVE_MOTION_CURVE;
-			}
+	curve.bounds_grow(segment, &mesh->curve_keys[0], t0, t1, bounds);
 
-			if(bounds.valid()) {
-				int packed_type = PRIMITIVE_PACK_SEGMENT(type, k);
-				
-				references.push_back(BVHReference(bounds, j, i, packed_type));
-				root.grow(bounds);
-				center.grow(bounds.center2());
-			}
+	/* motion curve */
+	if(prim_type & PRIMITIVE_MOTION_CURVE) {
+		const Attribute *attr_mP = mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+		size_t mesh_size = mesh->curve_keys.size();
+		size_t steps = mesh->motion_steps - 1;
+		const float4 *key_steps = attr_mP->data_float4();
+
+		for(size_t i = 0; i < steps; i++)
+			curve.bounds_grow(segment, key_steps + i*mesh_size, t0, t1, bounds);
+	}
+}
+
+void BVHBuild::add_reference_curve_segment(BoundBox& root, BoundBox& center, Mesh *mesh, int j, int i, int type)
+{
+	BoundBox bounds = BoundBox::empty;
+	curve_segment_bounds(mesh, j, type, 0.0f, 1.0f, bounds);
+
+	if(!bounds.valid())
+		return;
+
+	/* find the number of pieces, halving them for as long as the area shrinks */
+	BoundBox pieces[1 << BVHParams::MAX_CURVE_SPLIT_LEVELS];
+	BoundBox split_pieces[1 << BVHParams::MAX_CURVE_SPLIT_LEVELS];
+	int num_pieces = 1;
+	float area = bounds.safe_area();
+
+	pieces[0] = bounds;
+
+	for(int level = 1; level <= min(params.curve_split_levels, (int)BVHParams::MAX_CURVE_SPLIT_LEVELS); level++) {
+		int num_split_pieces = 1 << level;
+		float split_area = 0.0f;
+
+		for(int p = 0; p < num_split_pieces; p++) {
+			split_pieces[p] = BoundBox::empty;
+			curve_segment_bounds(mesh, j, type,
+			                     (float)p / num_split_pieces,
+			                     (float)(p + 1) / num_split_pieces,
+			                     split_pieces[p]);
+			split_area += split_pieces[p].safe_area();
 		}
+
+		if(split_area > area * params.curve_split_area_ratio)
+			break;
+
+		for(int p = 0; p < num_split_pieces; p++)
+			pieces[p] = split_pieces[p];
+
+		num_pieces = num_split_pieces;
+		area = split_area;
 	}
+
+	for(int p = 0; p < num_pieces; p++) {
+		references.push_back(BVHReference(pieces[p], j, i, type));
+		center.grow(pieces[p].center2());
+	}
+
+	root.grow(bounds);
+	num_curve_split_references += num_pieces - 1;
 }
 
 void BVHBuild::add_reference_object(BoundBox& root, BoundBox& center, Object *ob, int i)
@@ -230,6 +282,11 @@ BVHNode* BVHBuild::run()
 	if(progress.get_cancel())
 		return NULL;
 
+	if(num_curve_split_references) {
+		VLOG(1) << "Added " << num_curve_split_references
+		        << " references for curve segments split into pieces.";
+	}
+
 	/* init spatial splits */
 	if(params.top_level) /* todo: get rid of this */
 		params.use_spatial_split = false;
@@ -270,17 +327,22 @@ BVHNode* BVHBuild::run()
 			rootnode = NULL;
 			VLOG(1) << "BVH build cancelled.";
 		}
-		else if(!params.use_spatial_split) {
-			/*rotate(rootnode, 4, 5);*/
-			rootnode->update_visibility();
-			VLOG(1) << "BVH build statistics:\n"
-			        << "  Build time: " << time_dt() - build_start_time << "\n"
-			        << "  Total number of nodes: "
-			        << rootnode->getSubtreeSize(BVH_STAT_NODE_COUNT) << "\n"
-			        << "  Number of inner nodes: "
-			        << rootnode->getSubtreeSize(BVH_STAT_INNER_COUNT)  << "\n"
-			        << "  Number of leaf nodes: "
-			        << rootnode->getSubtreeSize(BVH_STAT_LEAF_COUNT)  << "\n";
+		else {
+			if(!params.use_spatial_split) {
+				/*rotate(rootnode, 4, 5);*/
+				rootnode->update_visibility();
+				VLOG(1) << "BVH build statistics:\n"
+				        << "  Build time: " << time_dt() - build_start_time << "\n"
+				        << "  Total number of nodes: "
+				        << rootnode->getSubtreeSize(BVH_STAT_NODE_COUNT) << "\n"
+				        << "  Number of inner nodes: "
+				        << rootnode->getSubtreeSize(BVH_STAT_INNER_COUNT)  << "\n"
+				        << "  Number of leaf nodes: "
+				        << rootnode->getSubtreeSize(BVH_STAT_LEAF_COUNT)  << "\n";
+			}
+
+			if(params.use_time_bounds)
+				build_time_bounds(rootnode);
 		}
 	}
 
@@ -288,6 +350,186 @@ BVHNode* BVHBuild::run()
 	return rootnode;
 }
 
+/* Time Bounds
+ *
+ * The build uses the union of the bounds over all motion steps, which for
+ * fast deformation makes nodes overlap a lot. For traversal we additionally
+ * store bounds at ray time 0 and 1 and interpolate them linearly, fitted to
+ * contain the primitive at every motion step. Vertices move linearly between
+ * steps, so bounds containing all steps contain the primitive at all times.
+ *
+ * Spatial splits clip references, but the bounds of the full primitive are
+ * still conservative so they are not clipped here. */
+
+static void time_bounds_fit(const BoundBox *steps, int num_steps, BoundBox bounds[2])
+{
+	float3 min0 = steps[0].min, min1 = steps[num_steps-1].min;
+	float3 max0 = steps[0].max, max1 = steps[num_steps-1].max;
+	float3 dmin = make_float3(0.0f, 0.0f, 0.0f);
+	float3 dmax = make_float3(0.0f, 0.0f, 0.0f);
+
+	/* offset the line through the first and last step to contain all steps */
+	for(int k = 1; k < num_steps-1; k++) {
+		float t = (float)k/(float)(num_steps-1);
+		dmin = max(dmin, (1.0f - t)*min0 + t*min1 - steps[k].min);
+		dmax = max(dmax, steps[k].max - ((1.0f - t)*max0 + t*max1));
+	}
+
+	bounds[0] = BoundBox(min0 - dmin, max0 + dmax);
+	bounds[1] = BoundBox(min1 - dmin, max1 + dmax);
+}
+
+static void time_bounds_grow(BoundBox bounds[2], const BoundBox other[2])
+{
+	bounds[0].grow(other[0]);
+	bounds[1].grow(other[1]);
+}
+
+bool BVHBuild::primitive_time_bounds(int type, int index, Mesh *mesh, BoundBox bounds[2])
+{
+	bool moving = (type & (PRIMITIVE_MOTION_TRIANGLE|PRIMITIVE_MOTION_CURVE)) != 0;
+
+	/* the center step is the regular mesh data, others are stored in the
+	 * motion attribute, same as in the kernel */
+	int num_steps = (moving)? mesh->motion_steps: 1;
+	int center_step = (num_steps - 1)/2;
+
+	time_steps.resize(num_steps);
+
+	if(type & PRIMITIVE_ALL_TRIANGLE) {
+		Attribute *attr_mP = (moving)? mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION): NULL;
+		const Mesh::Triangle& t = mesh->triangles[index];
+		size_t mesh_size = mesh->verts.size();
+
+		for(int k = 0; k < num_steps; k++) {
+			const float3 *verts = (k == center_step)? &mesh->verts[0]:
+				attr_mP->data_float3() + ((k > center_step)? k-1: k)*mesh_size;
+
+			time_steps[k] = BoundBox::empty;
+			t.bounds_grow(verts, time_steps[k]);
+		}
+	}
+	else {
+		Attribute *attr_mP = (moving)? mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION): NULL;
+		const Mesh::Curve& curve = mesh->curves[index];
+		int segment = PRIMITIVE_UNPACK_SEGMENT(type);
+		size_t mesh_size = mesh->curve_keys.size();
+
+		for(int k = 0; k < num_steps; k++) {
+			const float4 *keys = (k == center_step)? &mesh->curve_keys[0]:
+				attr_mP->data_float4() + ((k > center_step)? k-1: k)*mesh_size;
+
+			time_steps[k] = BoundBox::empty;
+			curve.bounds_grow(segment, keys, time_steps[k]);
+		}
+	}
+
+	time_bounds_fit(&time_steps[0], num_steps, bounds);
+
+	return moving;
+}
+
+bool BVHBuild::mesh_time_bounds(Mesh *mesh, BoundBox bounds[2])
+{
+	map<Mesh*, MeshTimeBounds>::iterator it = mesh_time_bounds_map.find(mesh);
+
+	if(it == mesh_time_bounds_map.end()) {
+		MeshTimeBounds mesh_bounds;
+		mesh_bounds.bounds[0] = BoundBox::empty;
+		mesh_bounds.bounds[1] = BoundBox::empty;
+		mesh_bounds.moving = false;
+
+		if(mesh->has_motion_blur()) {
+			int triangle_type = (mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION))?
+				PRIMITIVE_MOTION_TRIANGLE: PRIMITIVE_TRIANGLE;
+			int curve_type = (mesh->curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION))?
+				PRIMITIVE_MOTION_CURVE: PRIMITIVE_CURVE;
+			BoundBox prim_bounds[2];
+
+			for(size_t j = 0; j < mesh->triangles.size(); j++) {
+				mesh_bounds.moving |= primitive_time_bounds(triangle_type, j, mesh, prim_bounds);
+				time_bounds_grow(mesh_bounds.bounds, prim_bounds);
+			}
+
+			for(size_t j = 0; j < mesh->curves.size(); j++) {
+				for(int k = 0; k < mesh->curves[j].num_keys - 1; k++) {
+					int type = PRIMITIVE_PACK_SEGMENT(curve_type, k);
+					mesh_bounds.moving |= primitive_time_bounds(type, j, mesh, prim_bounds);
+					time_bounds_grow(mesh_bounds.bounds, prim_bounds);
+				}
+			}
+
+			mesh_bounds.moving &= mesh_bounds.bounds[0].valid() && mesh_bounds.bounds[1].valid();
+		}
+
+		it = mesh_time_bounds_map.insert(std::make_pair(mesh, mesh_bounds)).first;
+	}
+
+	if(!it->second.moving)
+		return false;
+
+	bounds[0] = it->second.bounds[0];
+	bounds[1] = it->second.bounds[1];
+
+	return true;
+}
+
+bool BVHBuild::object_time_bounds(Object *ob, BoundBox bounds[2])
+{
+	/* object motion is not linear in time, keep the union of all steps */
+	if(ob->use_motion || !mesh_time_bounds(ob->mesh, bounds)) {
+		bounds[0] = bounds[1] = ob->bounds;
+		return false;
+	}
+
+	/* the transformed corners move linearly, so their bounds are conservative */
+	bounds[0] = bounds[0].transformed(&ob->tfm);
+	bounds[1] = bounds[1].transformed(&ob->tfm);
+
+	return true;
+}
+
+void BVHBuild::build_time_bounds(BVHNode *node)
+{
+	BoundBox bounds[2] = {BoundBox::empty, BoundBox::empty};
+	bool moving = false;
+
+	if(node->is_leaf()) {
+		LeafNode *leaf = (LeafNode*)node;
+
+		for(int i = leaf->m_lo; i < leaf->m_hi; i++) {
+			Object *ob = objects[prim_object[i]];
+			BoundBox prim_bounds[2];
+
+			if(prim_index[i] == -1)
+				moving |= object_time_bounds(ob, prim_bounds);
+			else
+				moving |= primitive_time_bounds(prim_type[i], prim_index[i], ob->mesh, prim_bounds);
+
+			time_bounds_grow(bounds, prim_bounds);
+		}
+	}
+	else {
+		for(int i = 0; i < node->num_children(); i++) {
+			BVHNode *child = node->get_child(i);
+
+			build_time_bounds(child);
+
+			if(child->m_time_bounds) {
+				time_bounds_grow(bounds, child->m_time_bounds);
+				moving = true;
+			}
+			else {
+				bounds[0].grow(child->m_bounds);
+				bounds[1].grow(child->m_bounds);
+			}
+		}
+	}
+
+	if(moving && bounds[0].valid() && bounds[1].valid())
+		node->set_time_bounds(bounds[0], bounds[1]);
+}
+
 void BVHBuild::progress_update()
 {
 	if(time_dt() - progress_start_time < 0.25)
@@ -24,6 +24,7 @@
 #include "bvh_binning.h"
 
 #include "util_boundbox.h"
+#include "util_map.h"
 #include "util_task.h"
 #include "util_vector.h"
 
@@ -62,8 +63,12 @@ protected:
 	/* adding references */
 	void add_reference_mesh(BoundBox& root, BoundBox& center, Mesh *mesh, int i);
 	void add_reference_object(BoundBox& root, BoundBox& center, Object *ob, int i);
+	void add_reference_curve_segment(BoundBox& root, BoundBox& center, Mesh *mesh, int j, int i, int type);
 	void add_references(BVHRange& root);
 
+	/* bounds of part of a curve segment, over all motion steps */
+	void curve_segment_bounds(const Mesh *mesh, int prim_index, int prim_type, float t0, float t1, BoundBox& bounds) const;
+
 	/* building */
 	BVHNode *build_node(const BVHRange& range, int level);
 	BVHNode *build_node(const BVHObjectBinning& range, int level);
@@ -89,6 +94,12 @@ protected:
 	/* progress */
 	void progress_update();
 
+	/* time bounds for deformation motion blur */
+	void build_time_bounds(BVHNode *node);
+	bool primitive_time_bounds(int prim_type, int prim_index, Mesh *mesh, BoundBox bounds[2]);
+	bool mesh_time_bounds(Mesh *mesh, BoundBox bounds[2]);
+	bool object_time_bounds(Object *ob, BoundBox bounds[2]);
+
 	/* tree rotations */
 	void rotate(BVHNode *node, int max_depth);
 	void rotate(BVHNode *node, int max_depth, int iterations);
@@ -97,6 +108,7 @@ protected:
 	vector<Object*> objects;
 	vector<BVHReference> references;
 	int num_original_references;
+	size_t num_curve_split_references;
 
 	/* output primitive indexes and objects */
 	vector<int>& prim_type;
@@ -120,6 +132,14 @@ protected:
 
 	/* threads */
 	TaskPool task_pool;
+
+	/* time bounds of instanced meshes, in object space */
+	struct MeshTimeBounds {
+		BoundBox bounds[2];
+		bool moving;
+	};
+	map<Mesh*, MeshTimeBounds> mesh_time_bounds_map;
+	vector<BoundBox> time_steps;
 };
 
 CCL_NAMESPACE_END
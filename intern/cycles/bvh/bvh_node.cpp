@@ -61,6 +61,26 @@ int BVHNode::getSubtreeSize(BVH_STAT stat) const
 				}
 			}
 			return cnt;
+		case BVH_STAT_ONODE_COUNT:
+			cnt = 1;
+			for(int i = 0; i < num_children(); i++) {
+				BVHNode *node = get_child(i);
+				if(node->is_leaf()) {
+					cnt += 1;
+					continue;
+				}
+				for(int j = 0; j < node->num_children(); j++) {
+					BVHNode *node_j = node->get_child(j);
+					if(node_j->is_leaf()) {
+						cnt += 1;
+						continue;
+					}
+					for(int k = 0; k < node_j->num_children(); k++) {
+						cnt += node_j->get_child(k)->getSubtreeSize(stat);
+					}
+				}
+			}
+			return cnt;
 		default:
 			assert(0); /* unknown mode */
 	}
@@ -93,6 +113,15 @@ float BVHNode::computeSubtreeSAHCost(const BVHParams& p, float probability) cons
 	return SAH;
 }
 
+void BVHNode::set_time_bounds(const BoundBox& bounds0, const BoundBox& bounds1)
+{
+	if(!m_time_bounds)
+		m_time_bounds = new BoundBox[2];
+
+	m_time_bounds[0] = bounds0;
+	m_time_bounds[1] = bounds1;
+}
+
 uint BVHNode::update_visibility()
 {
 	if(!is_leaf() && m_visibility == 0) {
@@ -31,6 +31,7 @@ enum BVH_STAT {
 	BVH_STAT_TRIANGLE_COUNT,
 	BVH_STAT_CHILDNODE_COUNT,
 	BVH_STAT_QNODE_COUNT,
+	BVH_STAT_ONODE_COUNT,
 };
 
 class BVHParams;
@@ -39,10 +40,11 @@ class BVHNode
 {
 public:
 	BVHNode()
+	: m_time_bounds(NULL)
 	{
 	}
 
-	virtual ~BVHNode() {}
+	virtual ~BVHNode() { delete [] m_time_bounds; }
 	virtual bool is_leaf() const = 0;
 	virtual int num_children() const = 0;
 	virtual BVHNode *get_child(int i) const = 0;
@@ -52,6 +54,12 @@ public:
 	BoundBox m_bounds;
 	uint m_visibility;
 
+	/* bounds at ray time 0 and 1 for deformation motion blur, the bounds at
+	 * other times are linearly interpolated. NULL if not moving. */
+	BoundBox *m_time_bounds;
+
+	void set_time_bounds(const BoundBox& bounds0, const BoundBox& bounds1);
+
 	// Subtree functions
 	int getSubtreeSize(BVH_STAT stat=BVH_STAT_NODE_COUNT) const;
 	float computeSubtreeSAHCost(const BVHParams& p, float probability = 1.0f) const;
@@ -105,7 +113,13 @@ public:
 	LeafNode(const LeafNode& s)
 	: BVHNode()
 	{
-		*this = s;
+		m_bounds = s.m_bounds;
+		m_visibility = s.m_visibility;
+		m_lo = s.m_lo;
+		m_hi = s.m_hi;
+
+		if(s.m_time_bounds)
+			set_time_bounds(s.m_time_bounds[0], s.m_time_bounds[1]);
 	}
 
 	bool is_leaf() const { return true; }
@@ -49,11 +49,27 @@ public:
 	/* QBVH */
 	bool use_qbvh;
 
+	/* OBVH, takes precedence over QBVH */
+	bool use_obvh;
+
+	/* node bounds linear in ray time for deformation motion blur, in
+	 * addition to the union over all motion steps */
+	bool use_time_bounds;
+
+	/* rebuild instead of refit when the SAH cost grew by this factor */
+	float max_refit_cost_ratio;
+
+	/* split curve segments into up to 2^levels pieces along the curve, when
+	 * that shrinks the total area of their bounds below this ratio */
+	int curve_split_levels;
+	float curve_split_area_ratio;
+
 	/* fixed parameters */
 	enum {
 		MAX_DEPTH = 64,
 		MAX_SPATIAL_DEPTH = 48,
-		NUM_SPATIAL_BINS = 32
+		NUM_SPATIAL_BINS = 32,
+		MAX_CURVE_SPLIT_LEVELS = 3
 	};
 
 	BVHParams()
@@ -73,6 +89,13 @@ public:
 		top_level = false;
 		use_cache = false;
 		use_qbvh = false;
+		use_obvh = false;
+		use_time_bounds = false;
+
+		max_refit_cost_ratio = 1.5f;
+
+		curve_split_levels = 0;
+		curve_split_area_ratio = 0.7f;
 	}
 
 	/* SAH costs */
@@ -281,35 +281,30 @@ void BVHSpatialSplit::split_reference(BVHBuild *builder, BVHReference& left, BVH
 		}
 	}
 	else {
-		/* curve split: NOTE - Currently ignores curve width and needs to be fixed.*/
-		const int k0 = mesh->curves[ref.prim_index()].first_key + PRIMITIVE_UNPACK_SEGMENT(ref.prim_type());
-		const int k1 = k0 + 1;
-		const float4 key0 = mesh->curve_keys[k0];
-		const float4 key1 = mesh->curve_keys[k1];
-		const float3 v0 = float4_to_float3(key0);
-		const float3 v1 = float4_to_float3(key1);
-
-		float v0p = v0[dim];
-		float v1p = v1[dim];
-
-		/* insert vertex to the boxes it belongs to. */
-		if(v0p <= pos)
-			left_bounds.grow(v0);
-
-		if(v0p >= pos)
-			right_bounds.grow(v0);
-
-		if(v1p <= pos)
-			left_bounds.grow(v1);
-
-		if(v1p >= pos)
-			right_bounds.grow(v1);
-
-		/* edge intersects the plane => insert intersection to both boxes. */
-		if((v0p < pos && v1p > pos) || (v0p > pos && v1p < pos)) {
-			float3 t = lerp(v0, v1, clamp((pos - v0p) / (v1p - v0p), 0.0f, 1.0f));
-			left_bounds.grow(t);
-			right_bounds.grow(t);
+		/* curve split: the segment is bounded in pieces along the curve,
+		 * including width and motion, and every piece is clipped to the
+		 * sides of the plane it overlaps. pieces contain whole chords of the
+		 * kernel intersection, same as for splitting curve references. */
+		const int num_pieces = 1 << min(builder->params.curve_split_levels, (int)BVHParams::MAX_CURVE_SPLIT_LEVELS);
+
+		for(int i = 0; i < num_pieces; i++) {
+			BoundBox piece = BoundBox::empty;
+			builder->curve_segment_bounds(mesh, ref.prim_index(), ref.prim_type(),
+			                              (float)i / num_pieces,
+			                              (float)(i + 1) / num_pieces,
+			                              piece);
+
+			if(piece.min[dim] <= pos) {
+				BoundBox left_piece = piece;
+				left_piece.max[dim] = min(left_piece.max[dim], pos);
+				left_bounds.grow(left_piece);
+			}
+
+			if(piece.max[dim] >= pos) {
+				BoundBox right_piece = piece;
+				right_piece.min[dim] = max(right_piece.min[dim], pos);
+				right_bounds.grow(right_piece);
+			}
 		}
 	}
 
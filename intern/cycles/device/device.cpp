@@ -202,8 +202,16 @@ Device *Device::create(DeviceInfo& info, Stats &stats, bool background)
 #endif
 #ifdef WITH_NETWORK
 		case DEVICE_NETWORK:
-			device = device_network_create(info, stats, "127.0.0.1");
+		{
+			/* server address is stored in the id, local server by default */
+			string address = "127.0.0.1";
+
+			if(info.id.compare(0, 8, "NETWORK_") == 0)
+				address = info.id.substr(8);
+
+			device = device_network_create(info, stats, address.c_str());
 			break;
+		}
 #endif
 #ifdef WITH_OPENCL
 		case DEVICE_OPENCL:
@@ -33,6 +33,8 @@ CCL_NAMESPACE_BEGIN
 
 class Progress;
 class RenderTile;
+class TextureCache;
+struct TextureCacheHandle;
 
 /* Device Types */
 
@@ -160,6 +162,17 @@ public:
 	};
 	virtual void tex_free(device_memory& /*mem*/) {};
 
+	/* texture cache, images are read on demand instead of being allocated,
+	 * returns false if the device does not support this */
+	virtual bool tex_cache_alloc(const char * /*name*/,
+	                             TextureCache * /*cache*/,
+	                             TextureCacheHandle * /*handle*/,
+	                             InterpolationType /*interpolation*/)
+	{
+		return false;
+	}
+	virtual void tex_cache_free(const char * /*name*/) {};
+
 	/* pixel memory */
 	virtual void pixels_alloc(device_memory& mem);
 	virtual void pixels_copy_from(device_memory& mem, int y, int w, int h);
@@ -185,8 +198,8 @@ public:
 		const DeviceDrawParams &draw_params);
 
 #ifdef WITH_NETWORK
-	/* networking */
-	void server_run();
+	/* networking, port 0 uses the default port */
+	void server_run(int port = 0);
 #endif
 
 	/* multi device */
@@ -52,6 +52,7 @@
 #include "util_progress.h"
 #include "util_system.h"
 #include "util_thread.h"
+#include "util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -132,6 +133,18 @@ public:
 		stats.mem_alloc(mem.device_size);
 	}
 
+	bool tex_cache_alloc(const char *name, TextureCache *cache, TextureCacheHandle *handle, InterpolationType interpolation)
+	{
+		VLOG(1) << "Texture cache allocate: " << name << ".";
+		kernel_tex_cache_set(&kernel_globals, name, cache, handle, interpolation);
+		return true;
+	}
+
+	void tex_cache_free(const char *name)
+	{
+		kernel_tex_cache_set(&kernel_globals, name, NULL, NULL);
+	}
+
 	void tex_free(device_memory& mem)
 	{
 		if(mem.device_pointer) {
@@ -185,39 +198,63 @@ public:
 		RenderTile tile;
 
 		void(*path_trace_kernel)(KernelGlobals*, float*, unsigned int*, int, int, int, int, int);
+		void(*path_trace_camera_packet_kernel)(KernelGlobals*, float*, unsigned int*, int, int, int, int, int, int, int);
 
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX2
-		if(system_cpu_support_avx2())
+		if(system_cpu_support_avx2()) {
 			path_trace_kernel = kernel_cpu_avx2_path_trace;
+			path_trace_camera_packet_kernel = kernel_cpu_avx2_path_trace_camera_packet;
+		}
 		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_AVX
-		if(system_cpu_support_avx())
+		if(system_cpu_support_avx()) {
 			path_trace_kernel = kernel_cpu_avx_path_trace;
+			path_trace_camera_packet_kernel = kernel_cpu_avx_path_trace_camera_packet;
+		}
 		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE41
-		if(system_cpu_support_sse41())
+		if(system_cpu_support_sse41()) {
 			path_trace_kernel = kernel_cpu_sse41_path_trace;
+			path_trace_camera_packet_kernel = kernel_cpu_sse41_path_trace_camera_packet;
+		}
 		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE3
-		if(system_cpu_support_sse3())
+		if(system_cpu_support_sse3()) {
 			path_trace_kernel = kernel_cpu_sse3_path_trace;
+			path_trace_camera_packet_kernel = kernel_cpu_sse3_path_trace_camera_packet;
+		}
 		else
 #endif
 #ifdef WITH_CYCLES_OPTIMIZED_KERNEL_SSE2
-		if(system_cpu_support_sse2())
+		if(system_cpu_support_sse2()) {
 			path_trace_kernel = kernel_cpu_sse2_path_trace;
+			path_trace_camera_packet_kernel = kernel_cpu_sse2_path_trace_camera_packet;
+		}
 		else
 #endif
+		{
 			path_trace_kernel = kernel_cpu_path_trace;
+			path_trace_camera_packet_kernel = kernel_cpu_path_trace_camera_packet;
+		}
 		
+		/* adaptive sampling is enabled by the render buffer passes */
+		const bool use_adaptive_sampling = (kg.__data.film.pass_flag & PASS_ADAPTIVE_AUX_BUFFER) != 0;
+		const int adaptive_min_samples = kg.__data.integrator.adaptive_min_samples;
+		const int adaptive_step = kg.__data.integrator.adaptive_step;
+
+		double render_time = 0.0;
+
 		while(task.acquire_tile(this, tile)) {
+			double tile_start_time = time_dt();
+			KernelCounters tile_start_counters = kg.counters;
 			float *render_buffer = (float*)tile.buffer;
 			uint *rng_state = (uint*)tile.rng_state;
 			int start_sample = tile.start_sample;
 			int end_sample = tile.start_sample + tile.num_samples;
+			bool tile_converged = false;
 
 			for(int sample = start_sample; sample < end_sample; sample++) {
 				if(task.get_cancel() || task_pool.canceled()) {
@@ -225,18 +262,72 @@ public:
 						break;
 				}
 
-				for(int y = tile.y; y < tile.y + tile.h; y++) {
-					for(int x = tile.x; x < tile.x + tile.w; x++) {
-						path_trace_kernel(&kg, render_buffer, rng_state,
-						                  sample, x, y, tile.offset, tile.stride);
+				/* remaining samples may have been stolen by another thread */
+				if(task.acquire_tile_sample && !task.acquire_tile_sample(tile, sample))
+					break;
+
+				/* remaining samples of a converged tile still count for progress */
+				if(!tile_converged) {
+					if(task.use_camera_packets) {
+						/* trace 2x2 pixel blocks as coherent ray packets */
+						for(int y = tile.y; y < tile.y + tile.h; y += 2) {
+							for(int x = tile.x; x < tile.x + tile.w; x += 2) {
+								path_trace_camera_packet_kernel(&kg, render_buffer, rng_state,
+								                         sample, x, y,
+								                         min(2, tile.x + tile.w - x),
+								                         min(2, tile.y + tile.h - y),
+								                         tile.offset, tile.stride);
+							}
+						}
+					}
+					else {
+						for(int y = tile.y; y < tile.y + tile.h; y++) {
+							for(int x = tile.x; x < tile.x + tile.w; x++) {
+								path_trace_kernel(&kg, render_buffer, rng_state,
+								                  sample, x, y, tile.offset, tile.stride);
+							}
+						}
 					}
 				}
 
 				tile.sample = sample + 1;
 
 				task.update_progress(&tile);
+
+				if(use_adaptive_sampling && !tile_converged &&
+				   tile.sample >= adaptive_min_samples &&
+				   tile.sample % adaptive_step == 0)
+				{
+					tile_converged = !kernel_cpu_adaptive_sampling_filter(&kg, render_buffer,
+					                                                      tile.x, tile.y, tile.w, tile.h,
+					                                                      tile.offset, tile.stride);
+				}
+			}
+
+			if(use_adaptive_sampling) {
+				/* scale pixels which stopped early up to the samples of the tile */
+				uint64_t skipped_samples = kernel_cpu_adaptive_sampling_post_adjust(&kg, render_buffer, tile.sample,
+				                                                                    tile.x, tile.y, tile.w, tile.h,
+				                                                                    tile.offset, tile.stride);
+
+				if(skipped_samples && task.add_skipped_samples)
+					task.add_skipped_samples(skipped_samples);
 			}
 
+			double tile_time = time_dt() - tile_start_time;
+			render_time += tile_time;
+
+			TileCounters tile_counters;
+			tile_counters.x = tile.x;
+			tile_counters.y = tile.y;
+			tile_counters.w = tile.w;
+			tile_counters.h = tile.h;
+			tile_counters.num_samples = tile.sample - start_sample;
+			tile_counters.time = tile_time;
+			tile_counters.counters = kg.counters;
+			tile_counters.counters.sub(tile_start_counters);
+			stats.kernel_tile_done(tile_counters);
+
 			task.release_tile(tile);
 
 			if(task_pool.canceled()) {
@@ -245,6 +336,9 @@ public:
 			}
 		}
 
+		if(task.add_render_time)
+			task.add_render_time(task.subtask_index, render_time);
+
 #ifdef WITH_OSL
 		OSLShader::thread_free(&kg);
 #endif
@@ -150,6 +150,11 @@ template<> struct device_type_traits<float4> {
 	static const int num_elements = 4;
 };
 
+template<> struct device_type_traits<half> {
+	static const DataType data_type = TYPE_HALF;
+	static const int num_elements = 1;
+};
+
 template<> struct device_type_traits<half4> {
 	static const DataType data_type = TYPE_HALF;
 	static const int num_elements = 4;
@@ -255,6 +260,14 @@ public:
 		data_size = 0;
 	}
 
+	/* move host data to another array without copying, the vector is
+	 * empty afterwards */
+	void steal_data(array<T>& to)
+	{
+		data.swap(to);
+		clear();
+	}
+
 	size_t size()
 	{
 		return data.size();
@@ -56,16 +56,30 @@ public:
 		}
 
 #ifdef WITH_NETWORK
-		/* try to add network devices */
-		ServerDiscovery discovery(true);
-		time_sleep(1.0);
+		/* try to add network devices, unless the servers were specified */
+		bool have_network_devices = false;
 
-		vector<string> servers = discovery.get_server_list();
+		foreach(DeviceInfo& subinfo, info.multi_devices)
+			if(subinfo.type == DEVICE_NETWORK)
+				have_network_devices = true;
 
-		foreach(string& server, servers) {
-			device = device_network_create(info, stats, server.c_str());
-			if(device)
-				devices.push_back(SubDevice(device));
+		if(!have_network_devices) {
+			ServerDiscovery discovery(true);
+			time_sleep(1.0);
+
+			vector<string> servers = discovery.get_server_list();
+
+			foreach(string& server, servers) {
+				DeviceInfo network_info;
+
+				network_info.type = DEVICE_NETWORK;
+				network_info.description = "Network Device (" + server + ")";
+				network_info.id = "NETWORK_" + server;
+
+				device = device_network_create(network_info, stats, server.c_str());
+				if(device)
+					devices.push_back(SubDevice(device));
+			}
 		}
 #endif
 	}
@@ -78,8 +92,19 @@ public:
 
 	const string& error_message()
 	{
+		/* lost network servers are not fatal, their tiles are rendered
+		 * by the remaining devices */
+		bool have_working_device = false;
+
+		foreach(SubDevice& sub, devices)
+			if(sub.device->error_message() == "")
+				have_working_device = true;
+
 		foreach(SubDevice& sub, devices) {
 			if(sub.device->error_message() != "") {
+				if(sub.device->info.type == DEVICE_NETWORK && have_working_device)
+					continue;
+
 				if(error_msg == "")
 					error_msg = sub.device->error_message();
 				break;
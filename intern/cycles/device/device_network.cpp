@@ -27,6 +27,7 @@ CCL_NAMESPACE_BEGIN
 typedef map<device_ptr, device_ptr> PtrMap;
 typedef vector<uint8_t> DataVector;
 typedef map<device_ptr, DataVector> DataMap;
+typedef map<string, DataVector> DataCacheMap;
 
 /* tile list */
 typedef vector<RenderTile> TileList;
@@ -40,6 +41,20 @@ static TileList::iterator tile_list_find(TileList& tile_list, RenderTile& tile)
 	return tile_list.end();
 }
 
+/* split "host:port" address, port is optional */
+static void network_parse_address(const string& address, string& host, int& port)
+{
+	size_t pos = address.rfind(':');
+
+	host = address;
+	port = SERVER_PORT;
+
+	if(pos != string::npos) {
+		host = address.substr(0, pos);
+		port = atoi(address.c_str() + pos + 1);
+	}
+}
+
 class NetworkDevice : public Device
 {
 public:
@@ -50,16 +65,21 @@ public:
 
 	thread_mutex rpc_lock;
 
-	NetworkDevice(DeviceInfo& info, Stats &stats, const char *address)
-	: Device(info, stats, true), socket(io_service)
+	NetworkDevice(DeviceInfo& info, Stats &stats, const char *address_)
+	: Device(info, stats, true), socket(io_service), mem_counter(0), address(address_),
+	  send_queue(NULL), task_thread(NULL), server_cache_size(0)
 	{
-		error_func = NetworkError();
+		string host;
+		int port;
+		network_parse_address(address, host, port);
+
 		stringstream portstr;
-		portstr << SERVER_PORT;
+		portstr << port;
 
 		tcp::resolver resolver(io_service);
-		tcp::resolver::query query(address, portstr.str());
-		tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+		tcp::resolver::query query(host, portstr.str());
+		boost::system::error_code resolve_error;
+		tcp::resolver::iterator endpoint_iterator = resolver.resolve(query, resolve_error);
 		tcp::resolver::iterator end;
 
 		boost::system::error_code error = boost::asio::error::host_not_found;
@@ -69,16 +89,43 @@ public:
 			socket.connect(*endpoint_iterator++, error);
 		}
 
-		if(error)
+		if(error) {
 			error_func.network_error(error.message());
+			error_msg = "Failed to connect to network render server " + address + ": " + error.message();
+			return;
+		}
 
-		mem_counter = 0;
+		/* small RPC calls should not wait for more data, and dead servers
+		 * should be detected while waiting for tiles */
+		socket.set_option(tcp::no_delay(true));
+		socket.set_option(boost::asio::socket_base::keep_alive(true));
+
+		send_queue = new RPCSendQueue(socket, &error_func);
 	}
 
 	~NetworkDevice()
 	{
-		RPCSend snd(socket, &error_func, "stop");
-		snd.write();
+		task_thread_join();
+
+		if(send_queue) {
+			RPCSend snd(socket, &error_func, "stop", send_queue);
+			snd.write();
+
+			delete send_queue;
+		}
+	}
+
+	bool lost_connection()
+	{
+		if(!error_func.have_error())
+			return false;
+
+		if(error_msg.empty()) {
+			error_msg = "Lost connection to network render server " + address + ": " + error_func.message();
+			VLOG(1) << error_msg;
+		}
+
+		return true;
 	}
 
 	void mem_alloc(device_memory& mem, MemoryType type)
@@ -87,7 +134,15 @@ public:
 
 		mem.device_pointer = ++mem_counter;
 
-		RPCSend snd(socket, &error_func, "mem_alloc");
+		if(lost_connection())
+			return;
+
+		/* read only memory is not changed by the device, so its contents
+		 * can be deduplicated */
+		if(type == MEM_READ_ONLY)
+			mem_hash[mem.device_pointer] = "";
+
+		RPCSend snd(socket, &error_func, "mem_alloc", send_queue);
 
 		snd.add(mem);
 		snd.add(type);
@@ -98,20 +153,49 @@ public:
 	{
 		thread_scoped_lock lock(rpc_lock);
 
-		RPCSend snd(socket, &error_func, "mem_copy_to");
+		if(lost_connection())
+			return;
+
+		string hash;
+		map<device_ptr, string>::iterator it = mem_hash.find(mem.device_pointer);
+
+		if(it != mem_hash.end()) {
+			hash = network_data_hash((void*)mem.data_pointer, mem.memory_size());
+
+			/* unchanged since the last upload */
+			if(it->second == hash)
+				return;
+
+			it->second = hash;
+
+			if(server_cache_use(hash, mem.memory_size())) {
+				RPCSend snd(socket, &error_func, "mem_copy_to_cached", send_queue);
+
+				snd.add(mem);
+				snd.add(hash);
+				snd.write();
+				return;
+			}
+		}
+
+		RPCSend snd(socket, &error_func, "mem_copy_to", send_queue);
 
 		snd.add(mem);
+		snd.add(hash);
 		snd.write();
-		snd.write_buffer((void*)mem.data_pointer, mem.memory_size());
+		snd.write_buffer_compressed((void*)mem.data_pointer, mem.memory_size());
 	}
 
 	void mem_copy_from(device_memory& mem, int y, int w, int h, int elem)
 	{
 		thread_scoped_lock lock(rpc_lock);
 
+		if(lost_connection())
+			return;
+
 		size_t data_size = mem.memory_size();
 
-		RPCSend snd(socket, &error_func, "mem_copy_from");
+		RPCSend snd(socket, &error_func, "mem_copy_from", send_queue);
 
 		snd.add(mem);
 		snd.add(y);
@@ -121,14 +205,21 @@ public:
 		snd.write();
 
 		RPCReceive rcv(socket, &error_func);
-		rcv.read_buffer((void*)mem.data_pointer, data_size);
+		rcv.read_buffer_compressed((void*)mem.data_pointer, data_size);
 	}
 
 	void mem_zero(device_memory& mem)
 	{
 		thread_scoped_lock lock(rpc_lock);
 
-		RPCSend snd(socket, &error_func, "mem_zero");
+		if(lost_connection())
+			return;
+
+		map<device_ptr, string>::iterator it = mem_hash.find(mem.device_pointer);
+		if(it != mem_hash.end())
+			it->second = "";
+
+		RPCSend snd(socket, &error_func, "mem_zero", send_queue);
 
 		snd.add(mem);
 		snd.write();
@@ -139,10 +230,14 @@ public:
 		if(mem.device_pointer) {
 			thread_scoped_lock lock(rpc_lock);
 
-			RPCSend snd(socket, &error_func, "mem_free");
+			if(!lost_connection()) {
+				RPCSend snd(socket, &error_func, "mem_free", send_queue);
 
-			snd.add(mem);
-			snd.write();
+				snd.add(mem);
+				snd.write();
+
+				server_cache_add(mem);
+			}
 
 			mem.device_pointer = 0;
 		}
@@ -152,7 +247,10 @@ public:
 	{
 		thread_scoped_lock lock(rpc_lock);
 
-		RPCSend snd(socket, &error_func, "const_copy_to");
+		if(lost_connection())
+			return;
+
+		RPCSend snd(socket, &error_func, "const_copy_to", send_queue);
 
 		string name_string(name);
 
@@ -170,7 +268,15 @@ public:
 
 		mem.device_pointer = ++mem_counter;
 
-		RPCSend snd(socket, &error_func, "tex_alloc");
+		if(lost_connection())
+			return;
+
+		string hash = network_data_hash((void*)mem.data_pointer, mem.memory_size());
+		bool cached = server_cache_use(hash, mem.memory_size());
+
+		mem_hash[mem.device_pointer] = hash;
+
+		RPCSend snd(socket, &error_func, (cached)? "tex_alloc_cached": "tex_alloc", send_queue);
 
 		string name_string(name);
 
@@ -178,8 +284,11 @@ public:
 		snd.add(mem);
 		snd.add(interpolation);
 		snd.add(periodic);
+		snd.add(hash);
 		snd.write();
-		snd.write_buffer((void*)mem.data_pointer, mem.memory_size());
+
+		if(!cached)
+			snd.write_buffer_compressed((void*)mem.data_pointer, mem.memory_size());
 	}
 
 	void tex_free(device_memory& mem)
@@ -187,10 +296,14 @@ public:
 		if(mem.device_pointer) {
 			thread_scoped_lock lock(rpc_lock);
 
-			RPCSend snd(socket, &error_func, "tex_free");
+			if(!lost_connection()) {
+				RPCSend snd(socket, &error_func, "tex_free", send_queue);
 
-			snd.add(mem);
-			snd.write();
+				snd.add(mem);
+				snd.write();
+
+				server_cache_add(mem);
+			}
 
 			mem.device_pointer = 0;
 		}
@@ -198,48 +311,80 @@ public:
 
 	bool load_kernels(const DeviceRequestedFeatures& requested_features)
 	{
-		if(error_func.have_error())
+		if(lost_connection())
 			return false;
 
 		thread_scoped_lock lock(rpc_lock);
 
-		RPCSend snd(socket, &error_func, "load_kernels");
+		RPCSend snd(socket, &error_func, "load_kernels", send_queue);
 		snd.add(requested_features.experimental);
 		snd.add(requested_features.max_closure);
 		snd.add(requested_features.max_nodes_group);
 		snd.add(requested_features.nodes_features);
 		snd.write();
 
-		bool result;
+		bool result = false;
 		RPCReceive rcv(socket, &error_func);
-		rcv.read(result);
+
+		if(!error_func.have_error())
+			rcv.read(result);
 
 		return result;
 	}
 
 	void task_add(DeviceTask& task)
 	{
+		/* one task at a time */
+		task_thread_join();
+
+		if(lost_connection())
+			return;
+
 		thread_scoped_lock lock(rpc_lock);
 
 		the_task = task;
 
-		RPCSend snd(socket, &error_func, "task_add");
+		RPCSend snd(socket, &error_func, "task_add", send_queue);
 		snd.add(task);
 		snd.write();
+
+		/* the server starts waiting right away, tiles are handed out from
+		 * a thread so multiple network devices render at the same time */
+		RPCSend snd_wait(socket, &error_func, "task_wait", send_queue);
+		snd_wait.write();
+
+		task_thread = new thread(function_bind(&NetworkDevice::task_run, this));
 	}
 
 	void task_wait()
+	{
+		task_thread_join();
+	}
+
+	void task_cancel()
 	{
 		thread_scoped_lock lock(rpc_lock);
 
-		RPCSend snd(socket, &error_func, "task_wait");
+		if(lost_connection())
+			return;
+
+		RPCSend snd(socket, &error_func, "task_cancel", send_queue);
 		snd.write();
+	}
 
-		lock.unlock();
+	int get_split_task_count(DeviceTask& task)
+	{
+		return 1;
+	}
 
+protected:
+	void task_run()
+	{
 		TileList the_tiles;
 
-		/* todo: run this threaded for connecting to multiple clients */
+		thread_scoped_lock lock(rpc_lock);
+		lock.unlock();
+
 		for(;;) {
 			if(error_func.have_error())
 				break;
@@ -249,6 +394,11 @@ public:
 			lock.lock();
 			RPCReceive rcv(socket, &error_func);
 
+			if(error_func.have_error()) {
+				lock.unlock();
+				break;
+			}
+
 			if(rcv.name == "acquire_tile") {
 				lock.unlock();
 
@@ -257,14 +407,14 @@ public:
 					the_tiles.push_back(tile);
 
 					lock.lock();
-					RPCSend snd(socket, &error_func, "acquire_tile");
+					RPCSend snd(socket, &error_func, "acquire_tile", send_queue);
 					snd.add(tile);
 					snd.write();
 					lock.unlock();
 				}
 				else {
 					lock.lock();
-					RPCSend snd(socket, &error_func, "acquire_tile_none");
+					RPCSend snd(socket, &error_func, "acquire_tile_none", send_queue);
 					snd.write();
 					lock.unlock();
 				}
@@ -276,6 +426,7 @@ public:
 				TileList::iterator it = tile_list_find(the_tiles, tile);
 				if(it != the_tiles.end()) {
 					tile.buffers = it->buffers;
+					tile.tile_index = it->tile_index;
 					the_tiles.erase(it);
 				}
 
@@ -284,7 +435,7 @@ public:
 				the_task.release_tile(tile);
 
 				lock.lock();
-				RPCSend snd(socket, &error_func, "release_tile");
+				RPCSend snd(socket, &error_func, "release_tile", send_queue);
 				snd.write();
 				lock.unlock();
 			}
@@ -295,20 +446,79 @@ public:
 			else
 				lock.unlock();
 		}
+
+		/* the server died, hand its tiles back so other devices render them */
+		if(lost_connection()) {
+			foreach(RenderTile& tile, the_tiles) {
+				if(the_task.requeue_tile)
+					the_task.requeue_tile(tile);
+			}
+		}
 	}
 
-	void task_cancel()
+	void task_thread_join()
 	{
-		thread_scoped_lock lock(rpc_lock);
-		RPCSend snd(socket, &error_func, "task_cancel");
-		snd.write();
+		if(task_thread) {
+			task_thread->join();
+			delete task_thread;
+			task_thread = NULL;
+		}
 	}
 
-	int get_split_task_count(DeviceTask& task)
+	/* Server cache
+	 *
+	 * Read only buffers and textures freed on the server are kept there by
+	 * content digest, and reused when the same data with the same size is
+	 * uploaded again, which happens for every scene update. The client
+	 * mirrors the cache contents, so no round trip is needed to check for
+	 * cached data. */
+	void server_cache_add(device_memory& mem)
 	{
-		return 1;
+		map<device_ptr, string>::iterator it = mem_hash.find(mem.device_pointer);
+
+		if(it == mem_hash.end())
+			return;
+
+		string hash = it->second;
+		mem_hash.erase(it);
+
+		if(hash.empty() || server_cache.count(hash))
+			return;
+
+		server_cache[hash] = mem.memory_size();
+		server_cache_size += mem.memory_size();
+
+		if(server_cache_size > SERVER_CACHE_MAX_SIZE) {
+			RPCSend snd(socket, &error_func, "cache_clear", send_queue);
+			snd.write();
+
+			server_cache.clear();
+			server_cache_size = 0;
+		}
 	}
 
+	bool server_cache_use(const string& hash, size_t size)
+	{
+		map<string, size_t>::iterator it = server_cache.find(hash);
+
+		if(it == server_cache.end() || it->second != size)
+			return false;
+
+		/* cached data is moved out of the cache on the server */
+		server_cache.erase(it);
+
+		server_cache_size = (size < server_cache_size)? server_cache_size - size: 0;
+		return true;
+	}
+
+	string address;
+	RPCSendQueue *send_queue;
+	thread *task_thread;
+
+	map<device_ptr, string> mem_hash;
+	map<string, size_t> server_cache;
+	size_t server_cache_size;
+
 private:
 	NetworkError error_func;
 };
@@ -329,7 +539,39 @@ void device_network_info(vector<DeviceInfo>& devices)
 	info.advanced_shading = true; /* todo: get this info from device */
 	info.pack_images = false;
 
-	devices.push_back(info);
+	/* comma separated list of "host:port" servers to render with, by default
+	 * a server on the local machine is used */
+	vector<string> servers;
+	const char *servers_env = getenv("CYCLES_NETWORK_SERVERS");
+
+	if(servers_env)
+		string_split(servers, servers_env, ", ");
+
+	if(servers.empty()) {
+		devices.push_back(info);
+		return;
+	}
+
+	DeviceInfo multi_info;
+
+	multi_info.type = DEVICE_MULTI;
+	multi_info.description = string_printf("Network Devices (%dx)", (int)servers.size());
+	multi_info.id = "NETWORK_MULTI";
+	multi_info.num = 0;
+	multi_info.advanced_shading = true;
+	multi_info.pack_images = false;
+
+	foreach(string& server, servers) {
+		/* the address is stored in the id, see Device::create */
+		info.description = "Network Device (" + server + ")";
+		info.id = "NETWORK_" + server;
+
+		devices.push_back(info);
+		multi_info.multi_devices.push_back(info);
+	}
+
+	if(servers.size() > 1)
+		devices.push_back(multi_info);
 }
 
 class DeviceServer {
@@ -345,7 +587,6 @@ public:
 	DeviceServer(Device *device_, tcp::socket& socket_)
 	: device(device_), socket(socket_), stop(false), blocked_waiting(false)
 	{
-		error_func = NetworkError();
 	}
 
 	void listen()
@@ -356,7 +597,17 @@ public:
 
 			if(stop)
 				break;
+
+			/* client disconnected or sent invalid data */
+			if(have_error()) {
+				printf("Network error: %s\n", error_func.message().c_str());
+				break;
+			}
 		}
+
+		/* don't leave a task running for a client that is gone */
+		device->task_cancel();
+		device->task_wait();
 	}
 
 protected:
@@ -397,6 +648,41 @@ protected:
 		return i->second;
 	}
 
+	/* keep data of a freed buffer with known contents, in case the client
+	 * uploads the same data again */
+	void data_cache_add(device_ptr client_pointer)
+	{
+		map<device_ptr, string>::iterator it = mem_hash.find(client_pointer);
+
+		if(it == mem_hash.end())
+			return;
+
+		if(!it->second.empty() && !data_cache.count(it->second))
+			data_cache[it->second].swap(data_vector_find(client_pointer));
+
+		mem_hash.erase(it);
+	}
+
+	bool data_cache_find(const string& hash, DataVector &data_v)
+	{
+		DataCacheMap::iterator it = data_cache.find(hash);
+
+		if(it == data_cache.end()) {
+			network_error("Network error: data missing from server cache");
+			return false;
+		}
+
+		if(it->second.size() != data_v.size()) {
+			network_error("Network error: cached data size doesn't match");
+			return false;
+		}
+
+		data_v.swap(it->second);
+		data_cache.erase(it);
+
+		return true;
+	}
+
 	/* setup mapping and reverse mapping of client_pointer<->real_pointer */
 	void pointer_mapping_insert(device_ptr client_pointer, device_ptr real_pointer)
 	{
@@ -475,10 +761,12 @@ protected:
 			/* store a mapping to/from client_pointer and real device pointer */
 			pointer_mapping_insert(client_pointer, mem.device_pointer);
 		}
-		else if(rcv.name == "mem_copy_to") {
+		else if(rcv.name == "mem_copy_to" || rcv.name == "mem_copy_to_cached") {
 			network_device_memory mem;
+			string hash;
 
 			rcv.read(mem);
+			rcv.read(hash);
 			lock.unlock();
 
 			device_ptr client_pointer = mem.device_pointer;
@@ -490,8 +778,21 @@ protected:
 			/* get pointer to memory buffer	for device buffer */
 			mem.data_pointer = (device_ptr)&data_v[0];
 
-			/* copy data from network into memory buffer */
-			rcv.read_buffer((uint8_t*)mem.data_pointer, data_size);
+			if(rcv.name == "mem_copy_to_cached") {
+				/* the buffer may already be used as device memory, so the
+				 * cached data is copied rather than swapped in */
+				DataVector cached_v(data_size);
+
+				if(data_cache_find(hash, cached_v))
+					memcpy((uint8_t*)mem.data_pointer, &cached_v[0], data_size);
+			}
+			else {
+				/* copy data from network into memory buffer */
+				rcv.read_buffer_compressed((uint8_t*)mem.data_pointer, data_size);
+			}
+
+			if(!hash.empty())
+				mem_hash[client_pointer] = hash;
 
 			/* translate the client pointer to a real device pointer */
 			mem.device_pointer = device_ptr_from_client_pointer(client_pointer);
@@ -522,7 +823,7 @@ protected:
 
 			RPCSend snd(socket, &error_func, "mem_copy_from");
 			snd.write();
-			snd.write_buffer((uint8_t*)mem.data_pointer, data_size);
+			snd.write_buffer_compressed((uint8_t*)mem.data_pointer, data_size);
 			lock.unlock();
 		}
 		else if(rcv.name == "mem_zero") {
@@ -538,6 +839,9 @@ protected:
 
 			mem.data_pointer = (device_ptr)&(data_v[0]);
 
+			if(mem_hash.count(client_pointer))
+				mem_hash[client_pointer] = "";
+
 			device->mem_zero(mem);
 		}
 		else if(rcv.name == "mem_free") {
@@ -549,6 +853,8 @@ protected:
 
 			client_pointer = mem.device_pointer;
 
+			data_cache_add(client_pointer);
+
 			mem.device_pointer = device_ptr_from_client_pointer_erase(client_pointer);
 
 			device->mem_free(mem);
@@ -566,17 +872,19 @@ protected:
 
 			device->const_copy_to(name_string.c_str(), &host_vector[0], size);
 		}
-		else if(rcv.name == "tex_alloc") {
+		else if(rcv.name == "tex_alloc" || rcv.name == "tex_alloc_cached") {
 			network_device_memory mem;
 			string name;
 			InterpolationType interpolation;
 			bool periodic;
+			string hash;
 			device_ptr client_pointer;
 
 			rcv.read(name);
 			rcv.read(mem);
 			rcv.read(interpolation);
 			rcv.read(periodic);
+			rcv.read(hash);
 			lock.unlock();
 
 			client_pointer = mem.device_pointer;
@@ -585,12 +893,17 @@ protected:
 
 			DataVector &data_v = data_vector_insert(client_pointer, data_size);
 
+			if(rcv.name == "tex_alloc_cached")
+				data_cache_find(hash, data_v);
+			else if(data_size)
+				rcv.read_buffer_compressed(&data_v[0], data_size);
+
 			if(data_size)
 				mem.data_pointer = (device_ptr)&(data_v[0]);
 			else
 				mem.data_pointer = 0;
 
-			rcv.read_buffer((uint8_t*)mem.data_pointer, data_size);
+			mem_hash[client_pointer] = hash;
 
 			device->tex_alloc(name.c_str(), mem, interpolation, periodic);
 
@@ -605,10 +918,17 @@ protected:
 
 			client_pointer = mem.device_pointer;
 
+			data_cache_add(client_pointer);
+
 			mem.device_pointer = device_ptr_from_client_pointer_erase(client_pointer);
 
 			device->tex_free(mem);
 		}
+		else if(rcv.name == "cache_clear") {
+			lock.unlock();
+
+			data_cache.clear();
+		}
 		else if(rcv.name == "load_kernels") {
 			DeviceRequestedFeatures requested_features;
 			rcv.read(requested_features.experimental);
@@ -779,12 +1099,13 @@ protected:
 					cout << "Error: unexpected release RPC receive call \"" + entry.name + "\"\n";
 				}
 			}
-		} while(acquire_queue.empty() && !stop);
+		} while(acquire_queue.empty() && !stop && !have_error());
 	}
 
 	bool task_get_cancel()
 	{
-		return false;
+		/* stop rendering when the client is gone */
+		return have_error();
 	}
 
 	/* properties */
@@ -796,6 +1117,10 @@ protected:
 	PtrMap ptr_imap;
 	DataMap mem_data;
 
+	/* content digest of read only buffers, and data of freed buffers by digest */
+	map<device_ptr, string> mem_hash;
+	DataCacheMap data_cache;
+
 	struct AcquireEntry {
 		string name;
 		RenderTile tile;
@@ -813,20 +1138,26 @@ private:
 
 };
 
-void Device::server_run()
+void Device::server_run(int port)
 {
+	if(port == 0)
+		port = SERVER_PORT;
+
 	try {
 		/* starts thread that responds to discovery requests */
-		ServerDiscovery discovery;
+		ServerDiscovery discovery(false, port);
 
 		for(;;) {
 			/* accept connection */
 			boost::asio::io_service io_service;
-			tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), SERVER_PORT));
+			tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), port));
 
 			tcp::socket socket(io_service);
 			acceptor.accept(socket);
 
+			socket.set_option(tcp::no_delay(true));
+			socket.set_option(boost::asio::socket_base::keep_alive(true));
+
 			string remote_address = socket.remote_endpoint().address().to_string();
 			printf("Connected to remote client at: %s\n", remote_address.c_str());
 
@@ -33,12 +33,17 @@
 #include <sstream>
 #include <deque>
 
+#include <zlib.h>
+
 #include "buffers.h"
 
 #include "util_foreach.h"
 #include "util_list.h"
+#include "util_logging.h"
 #include "util_map.h"
+#include "util_md5.h"
 #include "util_string.h"
+#include "util_thread.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -55,6 +60,13 @@ static const int DISCOVER_PORT = 5121;
 static const string DISCOVER_REQUEST_MSG = "REQUEST_RENDER_SERVER_IP";
 static const string DISCOVER_REPLY_MSG = "REPLY_RENDER_SERVER_IP";
 
+/* buffers smaller than this are sent uncompressed */
+static const size_t COMPRESS_MIN_SIZE = 4096;
+/* maximum size of RPC data waiting to be sent, before the sender blocks */
+static const size_t SEND_QUEUE_MAX_SIZE = 256*1024*1024;
+/* maximum size of freed buffers a server keeps to deduplicate uploads */
+static const size_t SERVER_CACHE_MAX_SIZE = 512*1024*1024;
+
 #if 0
 typedef boost::archive::text_oarchive o_archive;
 typedef boost::archive::text_iarchive i_archive;
@@ -85,7 +97,9 @@ public:
 	~NetworkError() {}
 
 	void network_error(const string& message) {
-		error = message;
+		thread_scoped_lock lock(mutex);
+		if(error_count == 0)
+			error = message;
 		error_count += 1;
 	}
 
@@ -93,9 +107,139 @@ public:
 		return true ? error_count > 0 : false;
 	}
 
+	string message() {
+		thread_scoped_lock lock(mutex);
+		return error;
+	}
+
 private:
+	thread_mutex mutex;
 	string error;
-	int error_count;
+	volatile int error_count;
+};
+
+/* Digest of buffer contents, to skip uploads of data the server already has.
+ * Buffers with the same digest are not compared, so a cryptographic digest
+ * is used rather than a fast hash. Empty means no digest. */
+
+static inline string network_data_hash(const void *data, size_t size)
+{
+	MD5Hash md5;
+	const uint8_t *bytes = (const uint8_t*)data;
+
+	/* append in chunks, the size is an int */
+	while(size) {
+		int chunk = (size < (1 << 30))? (int)size: (1 << 30);
+		md5.append(bytes, chunk);
+		bytes += chunk;
+		size -= chunk;
+	}
+
+	return md5.get_hex();
+}
+
+/* Send Queue
+ *
+ * RPC calls from the client are queued and written to the socket by a
+ * separate thread, so the caller can continue with the next call while the
+ * data is being sent. Calls are sent in order, so replies to a call can be
+ * read from the socket directly after queueing it. */
+
+class RPCSendQueue {
+public:
+	RPCSendQueue(tcp::socket& socket_, NetworkError *e)
+	: socket(socket_), error_func(e), queue_size(0), sending(false), stop(false)
+	{
+		send_thread = new thread(function_bind(&RPCSendQueue::run, this));
+	}
+
+	~RPCSendQueue()
+	{
+		flush();
+
+		{
+			thread_scoped_lock lock(mutex);
+			stop = true;
+		}
+		queue_cond.notify_all();
+
+		send_thread->join();
+		delete send_thread;
+	}
+
+	void push(const string& data)
+	{
+		thread_scoped_lock lock(mutex);
+
+		/* don't let the queue grow without bounds on slow connections */
+		while(queue_size > SEND_QUEUE_MAX_SIZE && !error_func->have_error())
+			done_cond.wait(lock);
+
+		queue.push_back(data);
+		queue_size += data.size();
+
+		queue_cond.notify_all();
+	}
+
+	/* wait until all queued data was sent */
+	void flush()
+	{
+		thread_scoped_lock lock(mutex);
+
+		while((queue.size() || sending) && !error_func->have_error())
+			done_cond.wait(lock);
+	}
+
+protected:
+	void run()
+	{
+		thread_scoped_lock lock(mutex);
+
+		for(;;) {
+			while(queue.empty() && !stop)
+				queue_cond.wait(lock);
+
+			if(queue.empty() && stop)
+				break;
+
+			string data;
+			data.swap(queue.front());
+			queue.pop_front();
+			sending = true;
+
+			lock.unlock();
+
+			if(!error_func->have_error()) {
+				boost::system::error_code error;
+
+				boost::asio::write(socket,
+					boost::asio::buffer(data),
+					boost::asio::transfer_all(), error);
+
+				if(error.value())
+					error_func->network_error(error.message());
+			}
+
+			lock.lock();
+
+			sending = false;
+			queue_size -= data.size();
+			done_cond.notify_all();
+		}
+	}
+
+	tcp::socket& socket;
+	NetworkError *error_func;
+
+	thread *send_thread;
+	thread_mutex mutex;
+	thread_condition_variable queue_cond;
+	thread_condition_variable done_cond;
+
+	std::deque<string> queue;
+	size_t queue_size;
+	bool sending;
+	bool stop;
 };
 
 
@@ -103,12 +247,12 @@ private:
 
 class RPCSend {
 public:
-	RPCSend(tcp::socket& socket_, NetworkError* e, const string& name_ = "")
-	: name(name_), socket(socket_), archive(archive_stream), sent(false)
+	RPCSend(tcp::socket& socket_, NetworkError* e, const string& name_ = "", RPCSendQueue *queue_ = NULL)
+	: name(name_), socket(socket_), queue(queue_), archive(archive_stream), sent(false)
 	{
 		archive & name_;
 		error_func = e;
-		fprintf(stderr, "rpc send %s\n", name.c_str());
+		VLOG(4) << "RPC send " << name;
 	}
 
 	~RPCSend()
@@ -157,6 +301,12 @@ public:
 		header_stream << setw(8) << hex << archive_str.size();
 		string header_str = header_stream.str();
 
+		if(queue) {
+			queue->push(header_str + archive_str);
+			sent = true;
+			return;
+		}
+
 		boost::asio::write(socket,
 			boost::asio::buffer(header_str),
 			boost::asio::transfer_all(), error);
@@ -179,6 +329,13 @@ public:
 	{
 		boost::system::error_code error;
 
+		if(queue) {
+			/* copy, the caller may change the buffer before it is sent */
+			if(size)
+				queue->push(string((const char*)buffer, size));
+			return;
+		}
+
 		boost::asio::write(socket,
 			boost::asio::buffer(buffer, size),
 			boost::asio::transfer_all(), error);
@@ -187,9 +344,42 @@ public:
 			error_func->network_error(error.message());
 	}
 
+	/* write buffer compressed with zlib, preceded by a header with the
+	 * compressed size, or zero if sending it uncompressed was smaller */
+	void write_buffer_compressed(void *buffer, size_t size)
+	{
+		string data;
+
+		if(size >= COMPRESS_MIN_SIZE) {
+			uLongf compressed_size = compressBound(size);
+			data.resize(compressed_size);
+
+			if(compress2((Bytef*)&data[0], &compressed_size,
+			             (const Bytef*)buffer, size, Z_BEST_SPEED) == Z_OK &&
+			   compressed_size < size)
+			{
+				data.resize(compressed_size);
+			}
+			else
+				data.clear();
+		}
+
+		ostringstream header_stream;
+		header_stream << setw(16) << hex << data.size();
+		string header_str = header_stream.str();
+
+		write_buffer((void*)header_str.data(), header_str.size());
+
+		if(data.size())
+			write_buffer((void*)data.data(), data.size());
+		else
+			write_buffer(buffer, size);
+	}
+
 protected:
 	string name;
 	tcp::socket& socket;
+	RPCSendQueue *queue;
 	ostringstream archive_stream;
 	o_archive archive;
 	bool sent;
@@ -237,7 +427,7 @@ public:
 					archive = new i_archive(*archive_stream);
 
 					*archive & name;
-					fprintf(stderr, "rpc receive %s\n", name.c_str());
+					VLOG(4) << "RPC receive " << name;
 				}
 				else {
 					error_func->network_error("Network receive error: data size doesn't match header");
@@ -281,7 +471,37 @@ public:
 		}
 
 		if(len != size)
-			cout << "Network receive error: buffer size doesn't match expected size\n";
+			error_func->network_error("Network receive error: buffer size doesn't match expected size");
+	}
+
+	void read_buffer_compressed(void *buffer, size_t size)
+	{
+		char header[16];
+		read_buffer(header, sizeof(header));
+
+		size_t compressed_size;
+		istringstream header_stream(string(header, sizeof(header)));
+
+		if(!(header_stream >> hex >> compressed_size)) {
+			error_func->network_error("Network receive error: can't decode compressed size");
+			return;
+		}
+
+		if(compressed_size == 0) {
+			read_buffer(buffer, size);
+			return;
+		}
+
+		vector<char> data(compressed_size);
+		read_buffer(&data[0], compressed_size);
+
+		uLongf uncompressed_size = size;
+
+		if(uncompress((Bytef*)buffer, &uncompressed_size, (const Bytef*)&data[0], compressed_size) != Z_OK ||
+		   uncompressed_size != size)
+		{
+			error_func->network_error("Network receive error: failed to decompress buffer");
+		}
 	}
 
 	void read(DeviceTask& task)
@@ -322,8 +542,8 @@ protected:
 
 class ServerDiscovery {
 public:
-	ServerDiscovery(bool discover = false)
-	: listen_socket(io_service), collect_servers(false)
+	ServerDiscovery(bool discover = false, int server_port_ = SERVER_PORT)
+	: listen_socket(io_service), collect_servers(false), server_port(server_port_)
 	{
 		/* setup listen socket */
 		listen_endpoint.address(boost::asio::ip::address_v4::any());
@@ -384,8 +604,14 @@ private:
 
 			/* handle incoming message */
 			if(collect_servers) {
-				if(msg == DISCOVER_REPLY_MSG) {
+				/* reply is followed by the port, multiple servers can run
+				 * on one machine */
+				if(msg.compare(0, DISCOVER_REPLY_MSG.size(), DISCOVER_REPLY_MSG) == 0) {
 					string address = receive_endpoint.address().to_string();
+					string port = msg.substr(DISCOVER_REPLY_MSG.size());
+
+					if(port.size() > 1 && port[0] == ':')
+						address += port;
 
 					mutex.lock();
 
@@ -402,7 +628,7 @@ private:
 			else {
 				/* reply to request */
 				if(msg == DISCOVER_REQUEST_MSG)
-					broadcast_message(DISCOVER_REPLY_MSG);
+					broadcast_message(string_printf("%s:%d", DISCOVER_REPLY_MSG.c_str(), server_port));
 			}
 		}
 
@@ -462,6 +688,9 @@ private:
 	/* collection of server addresses in list */
 	bool collect_servers;
 	vector<string> servers;
+
+	/* port this server listens on */
+	int server_port;
 };
 
 CCL_NAMESPACE_END
@@ -30,7 +30,8 @@ DeviceTask::DeviceTask(Type type_)
 : type(type_), x(0), y(0), w(0), h(0), rgba_byte(0), rgba_half(0), buffer(0),
   sample(0), num_samples(1),
   shader_input(0), shader_output(0),
-  shader_eval_type(0), shader_x(0), shader_w(0)
+  shader_eval_type(0), shader_x(0), shader_w(0),
+  subtask_index(0), use_camera_packets(false)
 {
 	last_update_time = time_dt();
 }
@@ -81,8 +82,13 @@ void DeviceTask::split(list<DeviceTask>& tasks, int num, int max_size)
 		}
 	}
 	else if(type == PATH_TRACE) {
-		for(int i = 0; i < num; i++)
-			tasks.push_back(*this);
+		for(int i = 0; i < num; i++) {
+			DeviceTask task = *this;
+
+			task.subtask_index = i;
+
+			tasks.push_back(task);
+		}
 	}
 	else {
 		for(int i = 0; i < num; i++) {
@@ -61,10 +61,23 @@ public:
 	function<void(void)> update_progress_sample;
 	function<void(RenderTile&)> update_tile_sample;
 	function<void(RenderTile&)> release_tile;
+	/* hand back a tile that could not be rendered, e.g. because a network
+	 * render server was lost, to render it on another device */
+	function<void(RenderTile&)> requeue_tile;
 	function<bool(void)> get_cancel;
+	function<void(uint64_t)> add_skipped_samples;
+
+	/* with work stealing, returns false if the sample of the tile was
+	 * taken by another thread and should not be rendered */
+	function<bool(RenderTile&, int)> acquire_tile_sample;
+
+	/* time spent rendering tiles by every subtask, for utilization stats */
+	function<void(int, double)> add_render_time;
+	int subtask_index;
 
 	bool need_finish_queue;
 	bool integrator_branched;
+	bool use_camera_packets;
 	int2 requested_tile_size;
 protected:
 	double last_update_time;
@@ -21,10 +21,16 @@
 /* 64 object BVH + 64 mesh BVH + 64 object node splitting */
 #define BVH_STACK_SIZE 192
 #define BVH_QSTACK_SIZE 384
+#define BVH_OSTACK_SIZE 768
 #define BVH_NODE_SIZE 4
 #define BVH_NODE_LEAF_SIZE 1
 #define BVH_QNODE_SIZE 7
 #define BVH_QNODE_LEAF_SIZE 1
+#define BVH_ONODE_SIZE 14
+#define BVH_ONODE_LEAF_SIZE 1
+#define BVH_NODE_TIME_SIZE 6
+#define BVH_QNODE_TIME_SIZE 12
+#define BVH_ONODE_TIME_SIZE 24
 #define TRI_NODE_SIZE 3
 
 /* silly workaround for float extended precision that happens when compiling
@@ -36,8 +42,8 @@
 #define NO_EXTENDED_PRECISION volatile
 #endif
 
-#include "geom_attribute.h"
 #include "geom_object.h"
+#include "geom_attribute.h"
 #include "geom_triangle.h"
 #include "geom_triangle_intersect.h"
 #include "geom_motion_triangle.h"
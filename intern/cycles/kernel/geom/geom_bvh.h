@@ -48,9 +48,77 @@ CCL_NAMESPACE_BEGIN
 
 #define BVH_FEATURE(f) (((BVH_FUNCTION_FEATURES) & (f)) != 0)
 
+/* BVH nodes and primitives visited by one traversal, counted in registers
+ * and added to the counters of the thread once when the traversal returns.
+ * Primitives are counted per leaf, so shadow rays terminating early in a
+ * leaf count all of its primitives. */
+#ifdef __KERNEL_CPU__
+struct BVHTraversalCounters {
+	BVHTraversalCounters(KernelGlobals *kg_)
+	: kg(kg_), nodes(0), primitives(0)
+	{
+	}
+
+	~BVHTraversalCounters()
+	{
+		kg->counters.bvh_nodes += nodes;
+		kg->counters.bvh_primitives += primitives;
+	}
+
+	KernelGlobals *kg;
+	uint nodes;
+	uint primitives;
+};
+
+#  define BVH_COUNTERS_BEGIN(kg) BVHTraversalCounters bvh_counters(kg)
+#  define BVH_COUNT_NODE() (bvh_counters.nodes++)
+#  define BVH_COUNT_PRIMITIVES(n) (bvh_counters.primitives += (n))
+#else
+#  define BVH_COUNTERS_BEGIN(kg)
+#  define BVH_COUNT_NODE() ((void)0)
+#  define BVH_COUNT_PRIMITIVES(n) ((void)0)
+#endif
+
+/* Child bounds of a node at the ray time for deformation motion blur. The
+ * bounds in __bvh_nodes contain all motion steps, __bvh_time_nodes stores
+ * the bounds at time 0 followed by their change until time 1, in the same
+ * layout. */
+ccl_device_inline void bvh_node_time_bounds(KernelGlobals *kg,
+                                            int nodeAddr,
+                                            float time,
+                                            float4 *node0,
+                                            float4 *node1,
+                                            float4 *node2)
+{
+	int offset = nodeAddr*BVH_NODE_TIME_SIZE;
+	*node0 = kernel_tex_fetch(__bvh_time_nodes, offset+0) + time*kernel_tex_fetch(__bvh_time_nodes, offset+3);
+	*node1 = kernel_tex_fetch(__bvh_time_nodes, offset+1) + time*kernel_tex_fetch(__bvh_time_nodes, offset+4);
+	*node2 = kernel_tex_fetch(__bvh_time_nodes, offset+2) + time*kernel_tex_fetch(__bvh_time_nodes, offset+5);
+}
+
+#ifdef __KERNEL_SSE2__
+ccl_device_inline void bvh_node_time_bounds(KernelGlobals *kg,
+                                            int nodeAddr,
+                                            float time,
+                                            ssef bounds[3])
+{
+	const ssef *data = (ssef*)kg->__bvh_time_nodes.data + nodeAddr*BVH_NODE_TIME_SIZE;
+	const ssef t(time);
+	bounds[0] = madd(data[3], t, data[0]);
+	bounds[1] = madd(data[4], t, data[1]);
+	bounds[2] = madd(data[5], t, data[2]);
+}
+#endif
+
 /* Common QBVH functions. */
 #ifdef __QBVH__
 #include "geom_qbvh.h"
+#include "geom_qbvh_packet.h"
+#endif
+
+/* Common OBVH functions. */
+#ifdef __OBVH__
+#include "geom_obvh.h"
 #endif
 
 /* Regular BVH traversal */
@@ -219,6 +287,11 @@ CCL_NAMESPACE_BEGIN
 ccl_device_intersect bool scene_intersect(KernelGlobals *kg, const Ray *ray, const uint visibility, Intersection *isect,
 					 uint *lcg_state, float difl, float extmax)
 {
+	if(visibility & PATH_RAY_SHADOW)
+		kernel_counter_add(kg, shadow_rays, 1);
+	else
+		kernel_counter_add(kg, intersect_rays, 1);
+
 #ifdef __OBJECT_MOTION__
 	if(kernel_data.bvh.have_motion) {
 #ifdef __HAIR__
@@ -257,6 +330,8 @@ ccl_device_intersect bool scene_intersect(KernelGlobals *kg, const Ray *ray, con
 #ifdef __SUBSURFACE__
 ccl_device_intersect uint scene_intersect_subsurface(KernelGlobals *kg, const Ray *ray, Intersection *isect, int subsurface_object, uint *lcg_state, int max_hits)
 {
+	kernel_counter_add(kg, subsurface_rays, 1);
+
 #ifdef __OBJECT_MOTION__
 	if(kernel_data.bvh.have_motion) {
 #ifdef __HAIR__
@@ -296,6 +371,8 @@ ccl_device_intersect uint scene_intersect_subsurface(KernelGlobals *kg, const Ra
 #ifdef __SHADOW_RECORD_ALL__
 ccl_device_intersect bool scene_intersect_shadow_all(KernelGlobals *kg, const Ray *ray, Intersection *isect, uint max_hits, uint *num_hits)
 {
+	kernel_counter_add(kg, shadow_rays, 1);
+
 #ifdef __OBJECT_MOTION__
 	if(kernel_data.bvh.have_motion) {
 #ifdef __HAIR__
@@ -326,6 +403,8 @@ ccl_device_intersect bool scene_intersect_volume(KernelGlobals *kg,
                             const Ray *ray,
                             Intersection *isect)
 {
+	kernel_counter_add(kg, volume_rays, 1);
+
 #ifdef __OBJECT_MOTION__
 	if(kernel_data.bvh.have_motion) {
 #ifdef __HAIR__
@@ -368,6 +447,8 @@ ccl_device_intersect uint scene_intersect_volume_all(KernelGlobals *kg,
                                                      Intersection *isect,
                                                      const uint max_hits)
 {
+	kernel_counter_add(kg, volume_rays, 1);
+
 #ifdef __OBJECT_MOTION__
 	if(kernel_data.bvh.have_motion) {
 #ifdef __HAIR__
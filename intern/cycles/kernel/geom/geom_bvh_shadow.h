@@ -21,6 +21,10 @@
 #include "geom_qbvh_shadow.h"
 #endif
 
+#ifdef __OBVH__
+#include "geom_obvh_shadow.h"
+#endif
+
 /* This is a template BVH traversal function, where various features can be
  * enabled/disabled. This way we can compile optimized versions for each case
  * without new features slowing things down.
@@ -42,6 +46,9 @@ ccl_device bool BVH_FUNCTION_FULL_NAME(BVH)(KernelGlobals *kg,
 	 * - test restrict attribute for pointers
 	 */
 	
+	/* Node and primitive visits counted in registers. */
+	BVH_COUNTERS_BEGIN(kg);
+
 	/* traversal stack in CUDA thread-local memory */
 	int traversalStack[BVH_STACK_SIZE];
 	traversalStack[0] = ENTRYPOINT_SENTINEL;
@@ -94,6 +101,8 @@ ccl_device bool BVH_FUNCTION_FULL_NAME(BVH)(KernelGlobals *kg,
 		do {
 			/* traverse internal nodes */
 			while(nodeAddr >= 0 && nodeAddr != ENTRYPOINT_SENTINEL) {
+				BVH_COUNT_NODE();
+
 				bool traverseChild0, traverseChild1;
 				int nodeAddrChild1;
 
@@ -106,6 +115,10 @@ ccl_device bool BVH_FUNCTION_FULL_NAME(BVH)(KernelGlobals *kg,
 				float4 node1 = kernel_tex_fetch(__bvh_nodes, nodeAddr*BVH_NODE_SIZE+1);
 				float4 node2 = kernel_tex_fetch(__bvh_nodes, nodeAddr*BVH_NODE_SIZE+2);
 				float4 cnodes = kernel_tex_fetch(__bvh_nodes, nodeAddr*BVH_NODE_SIZE+3);
+#if BVH_FEATURE(BVH_MOTION)
+				if(kernel_data.bvh.use_time_bounds)
+					bvh_node_time_bounds(kg, nodeAddr, ray->time, &node0, &node1, &node2);
+#endif
 
 				/* intersect ray against child nodes */
 				NO_EXTENDED_PRECISION float c0lox = (node0.x - P.x) * idir.x;
@@ -142,6 +155,13 @@ ccl_device bool BVH_FUNCTION_FULL_NAME(BVH)(KernelGlobals *kg,
 				/* fetch node data */
 				const ssef *bvh_nodes = (ssef*)kg->__bvh_nodes.data + nodeAddr*BVH_NODE_SIZE;
 				const float4 cnodes = ((float4*)bvh_nodes)[3];
+#if BVH_FEATURE(BVH_MOTION)
+				ssef time_nodes[3];
+				if(kernel_data.bvh.use_time_bounds) {
+					bvh_node_time_bounds(kg, nodeAddr, ray->time, time_nodes);
+					bvh_nodes = time_nodes;
+				}
+#endif
 
 				/* intersect ray against child nodes */
 				const ssef tminmaxx = (shuffle_swap(bvh_nodes[0], shufflexyz[0]) - Psplat[0]) * idirsplat[0];
@@ -207,6 +227,7 @@ ccl_device bool BVH_FUNCTION_FULL_NAME(BVH)(KernelGlobals *kg,
 				if(primAddr >= 0) {
 #endif
 					const int primAddr2 = __float_as_int(leaf.y);
+					BVH_COUNT_PRIMITIVES(primAddr2 - primAddr);
 					const uint type = __float_as_int(leaf.w);
 					const uint p_type = type & PRIMITIVE_ALL;
 
@@ -242,6 +263,10 @@ ccl_device bool BVH_FUNCTION_FULL_NAME(BVH)(KernelGlobals *kg,
 									hit = bvh_cardinal_curve_intersect(kg, isect_array, P, dir, PATH_RAY_SHADOW, object, primAddr, ray->time, type, NULL, 0, 0);
 								else
 									hit = bvh_curve_intersect(kg, isect_array, P, dir, PATH_RAY_SHADOW, object, primAddr, ray->time, type, NULL, 0, 0);
+								if(hit && bvh_curve_hit_recorded(kg, isect_array, *num_hits)) {
+									isect_array->t = isect_t;
+									hit = false;
+								}
 								break;
 							}
 #endif
@@ -388,6 +413,16 @@ ccl_device_inline bool BVH_FUNCTION_NAME(KernelGlobals *kg,
                                          const uint max_hits,
                                          uint *num_hits)
 {
+#ifdef __OBVH__
+	if(kernel_data.bvh.use_obvh) {
+		return BVH_FUNCTION_FULL_NAME(OBVH)(kg,
+		                                    ray,
+		                                    isect_array,
+		                                    max_hits,
+		                                    num_hits);
+	}
+	else
+#endif
 #ifdef __QBVH__
 	if(kernel_data.bvh.use_qbvh) {
 		return BVH_FUNCTION_FULL_NAME(QBVH)(kg,
@@ -400,6 +435,7 @@ ccl_device_inline bool BVH_FUNCTION_NAME(KernelGlobals *kg,
 #endif
 	{
 		kernel_assert(kernel_data.bvh.use_qbvh == false);
+		kernel_assert(kernel_data.bvh.use_obvh == false);
 		return BVH_FUNCTION_FULL_NAME(BVH)(kg,
 		                                   ray,
 		                                   isect_array,
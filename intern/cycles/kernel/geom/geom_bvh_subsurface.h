@@ -21,6 +21,10 @@
 #include "geom_qbvh_subsurface.h"
 #endif
 
+#ifdef __OBVH__
+#include "geom_obvh_subsurface.h"
+#endif
+
 /* This is a template BVH traversal function for subsurface scattering, where
  * various features can be enabled/disabled. This way we can compile optimized
  * versions for each case without new features slowing things down.
@@ -45,6 +49,9 @@ ccl_device uint BVH_FUNCTION_FULL_NAME(BVH)(KernelGlobals *kg,
 	 * - test restrict attribute for pointers
 	 */
 	
+	/* Node and primitive visits counted in registers. */
+	BVH_COUNTERS_BEGIN(kg);
+
 	/* traversal stack in CUDA thread-local memory */
 	int traversalStack[BVH_STACK_SIZE];
 	traversalStack[0] = ENTRYPOINT_SENTINEL;
@@ -93,6 +100,8 @@ ccl_device uint BVH_FUNCTION_FULL_NAME(BVH)(KernelGlobals *kg,
 			/* traverse internal nodes */
 			while(nodeAddr >= 0 && nodeAddr != ENTRYPOINT_SENTINEL)
 			{
+				BVH_COUNT_NODE();
+
 				bool traverseChild0, traverseChild1;
 				int nodeAddrChild1;
 
@@ -105,6 +114,10 @@ ccl_device uint BVH_FUNCTION_FULL_NAME(BVH)(KernelGlobals *kg,
 				float4 node1 = kernel_tex_fetch(__bvh_nodes, nodeAddr*BVH_NODE_SIZE+1);
 				float4 node2 = kernel_tex_fetch(__bvh_nodes, nodeAddr*BVH_NODE_SIZE+2);
 				float4 cnodes = kernel_tex_fetch(__bvh_nodes, nodeAddr*BVH_NODE_SIZE+3);
+#if BVH_FEATURE(BVH_MOTION)
+				if(kernel_data.bvh.use_time_bounds)
+					bvh_node_time_bounds(kg, nodeAddr, ray->time, &node0, &node1, &node2);
+#endif
 
 				/* intersect ray against child nodes */
 				NO_EXTENDED_PRECISION float c0lox = (node0.x - P.x) * idir.x;
@@ -135,6 +148,13 @@ ccl_device uint BVH_FUNCTION_FULL_NAME(BVH)(KernelGlobals *kg,
 				/* fetch node data */
 				const ssef *bvh_nodes = (ssef*)kg->__bvh_nodes.data + nodeAddr*BVH_NODE_SIZE;
 				const float4 cnodes = ((float4*)bvh_nodes)[3];
+#if BVH_FEATURE(BVH_MOTION)
+				ssef time_nodes[3];
+				if(kernel_data.bvh.use_time_bounds) {
+					bvh_node_time_bounds(kg, nodeAddr, ray->time, time_nodes);
+					bvh_nodes = time_nodes;
+				}
+#endif
 
 				/* intersect ray against child nodes */
 				const ssef tminmaxx = (shuffle_swap(bvh_nodes[0], shufflexyz[0]) - Psplat[0]) * idirsplat[0];
@@ -194,6 +214,7 @@ ccl_device uint BVH_FUNCTION_FULL_NAME(BVH)(KernelGlobals *kg,
 				if(primAddr >= 0) {
 #endif
 					const int primAddr2 = __float_as_int(leaf.y);
+					BVH_COUNT_PRIMITIVES(primAddr2 - primAddr);
 					const uint type = __float_as_int(leaf.w);
 
 					/* pop */
@@ -312,6 +333,17 @@ ccl_device_inline uint BVH_FUNCTION_NAME(KernelGlobals *kg,
                                          uint *lcg_state,
                                          int max_hits)
 {
+#ifdef __OBVH__
+	if(kernel_data.bvh.use_obvh) {
+		return BVH_FUNCTION_FULL_NAME(OBVH)(kg,
+		                                    ray,
+		                                    isect_array,
+		                                    subsurface_object,
+		                                    lcg_state,
+		                                    max_hits);
+	}
+	else
+#endif
 #ifdef __QBVH__
 	if(kernel_data.bvh.use_qbvh) {
 		return BVH_FUNCTION_FULL_NAME(QBVH)(kg,
@@ -325,6 +357,7 @@ ccl_device_inline uint BVH_FUNCTION_NAME(KernelGlobals *kg,
 #endif
 	{
 		kernel_assert(kernel_data.bvh.use_qbvh == false);
+		kernel_assert(kernel_data.bvh.use_obvh == false);
 		return BVH_FUNCTION_FULL_NAME(BVH)(kg,
 		                                   ray,
 		                                   isect_array,
@@ -856,6 +856,26 @@ ccl_device_inline bool bvh_curve_intersect(KernelGlobals *kg, Intersection *isec
 #endif
 }
 
+/* Curve segments can be referenced from multiple BVH leaves when they are
+ * split into pieces, so traversals recording all hits skip a hit on a segment
+ * that was already recorded. */
+ccl_device_inline bool bvh_curve_hit_recorded(KernelGlobals *kg, const Intersection *isect, uint num_hits)
+{
+	int prim = kernel_tex_fetch(__prim_index, isect->prim);
+
+	for(uint i = 1; i <= num_hits; i++) {
+		const Intersection *prev = isect - i;
+
+		if(prev->type == isect->type && prev->object == isect->object &&
+		   kernel_tex_fetch(__prim_index, prev->prim) == prim)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 ccl_device_inline float3 curvetangent(float t, float3 p0, float3 p1, float3 p2, float3 p3)
 {
 	float fc = 0.71f;
@@ -24,15 +24,20 @@
 
 CCL_NAMESPACE_BEGIN
 
-/* Object attributes, for now a fixed size and contents */
+/* Object attributes
+ *
+ * Every object has a compact record of OBJECT_SIZE float4, with its transform,
+ * inverse transform and properties. Attributes which only some objects need
+ * are stored after the object records and found through the extra index in
+ * the properties, which is -1 for most instances. The extra data starts with
+ * a header holding the offsets of the decomposed motion transform and the
+ * dupli coordinates, which are -1 if not stored, and the particle index. */
 
 enum ObjectTransform {
 	OBJECT_TRANSFORM = 0,
-	OBJECT_TRANSFORM_MOTION_PRE = 0,
+	OBJECT_PROPERTIES = 3,
 	OBJECT_INVERSE_TRANSFORM = 4,
-	OBJECT_TRANSFORM_MOTION_POST = 4,
-	OBJECT_PROPERTIES = 8,
-	OBJECT_DUPLI = 9
+	OBJECT_MESH_INFO = 7
 };
 
 enum ObjectVectorTransform {
@@ -40,6 +45,14 @@ enum ObjectVectorTransform {
 	OBJECT_VECTOR_MOTION_POST = 3
 };
 
+/* Header of the optional per object data, or -1 if the object has none */
+
+ccl_device_inline int object_extra_index(KernelGlobals *kg, int object)
+{
+	float4 f = kernel_tex_fetch(__objects, object*OBJECT_SIZE + OBJECT_PROPERTIES);
+	return __float_as_int(f.w);
+}
+
 /* Object to world space transformation */
 
 ccl_device_inline Transform object_fetch_transform(KernelGlobals *kg, int object, enum ObjectTransform type)
@@ -77,7 +90,10 @@ ccl_device_inline Transform object_fetch_transform_motion(KernelGlobals *kg, int
 {
 	DecompMotionTransform motion;
 
-	int offset = object*OBJECT_SIZE + (int)OBJECT_TRANSFORM_MOTION_PRE;
+	/* only called for objects with SD_OBJECT_MOTION, which always have the
+	 * decomposed transform in their extra data */
+	int extra = object_extra_index(kg, object);
+	int offset = __float_as_int(kernel_tex_fetch(__objects, extra).x);
 
 	motion.mid.x = kernel_tex_fetch(__objects, offset + 0);
 	motion.mid.y = kernel_tex_fetch(__objects, offset + 1);
@@ -245,9 +261,24 @@ ccl_device_inline int object_particle_id(KernelGlobals *kg, int object)
 	if(object == OBJECT_NONE)
 		return 0;
 
-	int offset = object*OBJECT_SIZE + OBJECT_PROPERTIES;
-	float4 f = kernel_tex_fetch(__objects, offset);
-	return __float_as_uint(f.w);
+	int extra = object_extra_index(kg, object);
+	if(extra == -1)
+		return 0;
+
+	float4 f = kernel_tex_fetch(__objects, extra);
+	return __float_as_uint(f.z);
+}
+
+/* Offset of dupli coordinates, only stored if shaders use them */
+
+ccl_device_inline int object_dupli_offset(KernelGlobals *kg, int object)
+{
+	int extra = object_extra_index(kg, object);
+	if(extra == -1)
+		return -1;
+
+	float4 f = kernel_tex_fetch(__objects, extra);
+	return __float_as_int(f.y);
 }
 
 /* Generated texture coordinate on surface from where object was instanced */
@@ -257,7 +288,10 @@ ccl_device_inline float3 object_dupli_generated(KernelGlobals *kg, int object)
 	if(object == OBJECT_NONE)
 		return make_float3(0.0f, 0.0f, 0.0f);
 
-	int offset = object*OBJECT_SIZE + OBJECT_DUPLI;
+	int offset = object_dupli_offset(kg, object);
+	if(offset == -1)
+		return make_float3(0.0f, 0.0f, 0.0f);
+
 	float4 f = kernel_tex_fetch(__objects, offset);
 	return make_float3(f.x, f.y, f.z);
 }
@@ -269,7 +303,10 @@ ccl_device_inline float3 object_dupli_uv(KernelGlobals *kg, int object)
 	if(object == OBJECT_NONE)
 		return make_float3(0.0f, 0.0f, 0.0f);
 
-	int offset = object*OBJECT_SIZE + OBJECT_DUPLI;
+	int offset = object_dupli_offset(kg, object);
+	if(offset == -1)
+		return make_float3(0.0f, 0.0f, 0.0f);
+
 	float4 f = kernel_tex_fetch(__objects, offset + 1);
 	return make_float3(f.x, f.y, 0.0f);
 }
@@ -278,20 +315,25 @@ ccl_device_inline float3 object_dupli_uv(KernelGlobals *kg, int object)
 
 ccl_device_inline void object_motion_info(KernelGlobals *kg, int object, int *numsteps, int *numverts, int *numkeys)
 {
-	int offset = object*OBJECT_SIZE + OBJECT_DUPLI;
-
-	if(numkeys) {
-		float4 f = kernel_tex_fetch(__objects, offset);
-		*numkeys = __float_as_int(f.w);
-	}
+	int offset = object*OBJECT_SIZE + OBJECT_MESH_INFO;
+	float4 f = kernel_tex_fetch(__objects, offset);
 
-	float4 f = kernel_tex_fetch(__objects, offset + 1);
+	if(numkeys)
+		*numkeys = __float_as_int(f.y);
 	if(numsteps)
 		*numsteps = __float_as_int(f.z);
 	if(numverts)
 		*numverts = __float_as_int(f.w);
 }
 
+/* Offset of the attribute map of the object mesh, shared by all instances */
+
+ccl_device_inline uint object_attribute_map_offset(KernelGlobals *kg, int object)
+{
+	float4 f = kernel_tex_fetch(__objects, object*OBJECT_SIZE + OBJECT_MESH_INFO);
+	return __float_as_uint(f.x)*kernel_data.bvh.attributes_map_stride;
+}
+
 /* Pass ID for shader */
 
 ccl_device int shader_pass_id(KernelGlobals *kg, const ShaderData *sd)
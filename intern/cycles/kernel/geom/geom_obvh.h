@@ -0,0 +1,219 @@
+/*
+ * Copyright 2011-2015, Blender Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* OBVH
+ *
+ * Octo BVH with each node having up to eight children, which are all tested
+ * at once using AVX instructions. Node layout is the same as for QBVH, but
+ * every row is 8 floats wide and takes two float4:
+ *
+ *   min.x, max.x, min.y, max.y, min.z, max.z, child index
+ *
+ * Traversal uses the same stack items as QBVH, see geom_qbvh.h. */
+
+/* Sort the last num items on the stack, so the closest child is on top. */
+ccl_device_inline void obvh_stack_sort(QBVHStackItem *__restrict s,
+                                       int num)
+{
+	for(int i = 1; i < num; i++) {
+		QBVHStackItem item = s[i];
+		int j = i - 1;
+		while(j >= 0 && s[j].dist < item.dist) {
+			s[j + 1] = s[j];
+			j--;
+		}
+		s[j + 1] = item;
+	}
+}
+
+ccl_device_inline int obvh_node_intersect(KernelGlobals *__restrict kg,
+                                          const avxf& tnear,
+                                          const avxf& tfar,
+                                          const avx3f& org_idir,
+                                          const avx3f& idir,
+                                          const int near_x,
+                                          const int near_y,
+                                          const int near_z,
+                                          const int far_x,
+                                          const int far_y,
+                                          const int far_z,
+                                          const int nodeAddr,
+                                          avxf *__restrict dist)
+{
+	const int offset = nodeAddr*BVH_ONODE_SIZE;
+	const avxf tnear_x = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+near_x*2), idir.x, org_idir.x);
+	const avxf tnear_y = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+near_y*2), idir.y, org_idir.y);
+	const avxf tnear_z = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+near_z*2), idir.z, org_idir.z);
+	const avxf tfar_x = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+far_x*2), idir.x, org_idir.x);
+	const avxf tfar_y = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+far_y*2), idir.y, org_idir.y);
+	const avxf tfar_z = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+far_z*2), idir.z, org_idir.z);
+
+	const avxf tNear = max4(tnear_x, tnear_y, tnear_z, tnear);
+	const avxf tFar = min4(tfar_x, tfar_y, tfar_z, tfar);
+	*dist = tNear;
+	return tNear <= tFar;
+}
+
+ccl_device_inline int obvh_node_intersect_robust(KernelGlobals *__restrict kg,
+                                                 const avxf& tnear,
+                                                 const avxf& tfar,
+                                                 const avx3f& P_idir,
+                                                 const avx3f& idir,
+                                                 const int near_x,
+                                                 const int near_y,
+                                                 const int near_z,
+                                                 const int far_x,
+                                                 const int far_y,
+                                                 const int far_z,
+                                                 const int nodeAddr,
+                                                 const float difl,
+                                                 avxf *__restrict dist)
+{
+	const int offset = nodeAddr*BVH_ONODE_SIZE;
+	const avxf tnear_x = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+near_x*2), idir.x, P_idir.x);
+	const avxf tnear_y = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+near_y*2), idir.y, P_idir.y);
+	const avxf tnear_z = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+near_z*2), idir.z, P_idir.z);
+	const avxf tfar_x = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+far_x*2), idir.x, P_idir.x);
+	const avxf tfar_y = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+far_y*2), idir.y, P_idir.y);
+	const avxf tfar_z = msub(kernel_tex_fetch_avxf(__bvh_nodes, offset+far_z*2), idir.z, P_idir.z);
+
+	const float round_down = 1.0f - difl;
+	const float round_up = 1.0f + difl;
+	const avxf tNear = max4(tnear_x, tnear_y, tnear_z, tnear);
+	const avxf tFar = min4(tfar_x, tfar_y, tfar_z, tfar);
+	*dist = tNear;
+	return round_down*tNear <= round_up*tFar;
+}
+
+/* Bounds row of a node at the ray time, for deformation motion blur. */
+ccl_device_inline avxf obvh_node_time_row(KernelGlobals *__restrict kg,
+                                          const int offset,
+                                          const int row,
+                                          const avxf& time)
+{
+	return madd(kernel_tex_fetch_avxf(__bvh_time_nodes, offset+(6+row)*2),
+	            time,
+	            kernel_tex_fetch_avxf(__bvh_time_nodes, offset+row*2));
+}
+
+/* Same as obvh_node_intersect_robust, but with the child bounds at the ray
+ * time instead of the bounds of all motion steps. difl is zero for regular
+ * intersection. */
+ccl_device_inline int obvh_node_intersect_motion(KernelGlobals *__restrict kg,
+                                                 const avxf& tnear,
+                                                 const avxf& tfar,
+                                                 const avx3f& P_idir,
+                                                 const avx3f& idir,
+                                                 const int near_x,
+                                                 const int near_y,
+                                                 const int near_z,
+                                                 const int far_x,
+                                                 const int far_y,
+                                                 const int far_z,
+                                                 const int nodeAddr,
+                                                 const float time,
+                                                 const float difl,
+                                                 avxf *__restrict dist)
+{
+	const int offset = nodeAddr*BVH_ONODE_TIME_SIZE;
+	const avxf t(time);
+	const avxf tnear_x = msub(obvh_node_time_row(kg, offset, near_x, t), idir.x, P_idir.x);
+	const avxf tnear_y = msub(obvh_node_time_row(kg, offset, near_y, t), idir.y, P_idir.y);
+	const avxf tnear_z = msub(obvh_node_time_row(kg, offset, near_z, t), idir.z, P_idir.z);
+	const avxf tfar_x = msub(obvh_node_time_row(kg, offset, far_x, t), idir.x, P_idir.x);
+	const avxf tfar_y = msub(obvh_node_time_row(kg, offset, far_y, t), idir.y, P_idir.y);
+	const avxf tfar_z = msub(obvh_node_time_row(kg, offset, far_z, t), idir.z, P_idir.z);
+
+	const float round_down = 1.0f - difl;
+	const float round_up = 1.0f + difl;
+	const avxf tNear = max4(tnear_x, tnear_y, tnear_z, tnear);
+	const avxf tFar = min4(tfar_x, tfar_y, tfar_z, tfar);
+	*dist = tNear;
+	return round_down*tNear <= round_up*tFar;
+}
+
+/* Push the children hit by the ray onto the stack and return the closest one
+ * to continue traversal with. child_mask must not be zero. nodeDist may be
+ * NULL for traversal variants which don't cull by distance. */
+ccl_device_inline int obvh_node_children_push(KernelGlobals *__restrict kg,
+                                              const int nodeAddr,
+                                              int child_mask,
+                                              const avxf& dist,
+                                              QBVHStackItem *__restrict traversalStack,
+                                              int *__restrict stackPtr,
+                                              float *__restrict nodeDist)
+{
+	const avxf cnodes = kernel_tex_fetch_avxf(__bvh_nodes, nodeAddr*BVH_ONODE_SIZE+12);
+
+	/* One child is hit, continue with that child. */
+	int r = __bscf(child_mask);
+	int c0 = __float_as_int(cnodes[r]);
+	float d0 = dist[r];
+	if(child_mask == 0) {
+		if(nodeDist)
+			*nodeDist = d0;
+		return c0;
+	}
+
+	/* Two children are hit, push far child, and continue with closer child. */
+	r = __bscf(child_mask);
+	int c1 = __float_as_int(cnodes[r]);
+	float d1 = dist[r];
+	if(child_mask == 0) {
+		++*stackPtr;
+		kernel_assert(*stackPtr < BVH_OSTACK_SIZE);
+		if(d1 < d0) {
+			traversalStack[*stackPtr].addr = c0;
+			traversalStack[*stackPtr].dist = d0;
+			if(nodeDist)
+				*nodeDist = d1;
+			return c1;
+		}
+		else {
+			traversalStack[*stackPtr].addr = c1;
+			traversalStack[*stackPtr].dist = d1;
+			if(nodeDist)
+				*nodeDist = d0;
+			return c0;
+		}
+	}
+
+	/* Three or more children are hit, push all of them onto the stack, sort
+	 * them and continue with the closest child. */
+	int first = *stackPtr + 1;
+
+	traversalStack[first].addr = c0;
+	traversalStack[first].dist = d0;
+	traversalStack[first + 1].addr = c1;
+	traversalStack[first + 1].dist = d1;
+	*stackPtr = first + 1;
+
+	do {
+		r = __bscf(child_mask);
+		++*stackPtr;
+		kernel_assert(*stackPtr < BVH_OSTACK_SIZE);
+		traversalStack[*stackPtr].addr = __float_as_int(cnodes[r]);
+		traversalStack[*stackPtr].dist = dist[r];
+	} while(child_mask != 0);
+
+	obvh_stack_sort(&traversalStack[first], *stackPtr - first + 1);
+
+	int addr = traversalStack[*stackPtr].addr;
+	if(nodeDist)
+		*nodeDist = traversalStack[*stackPtr].dist;
+	--*stackPtr;
+	return addr;
+}
@@ -101,6 +101,67 @@ ccl_device_inline int qbvh_node_intersect(KernelGlobals *__restrict kg,
 	return mask;
 }
 
+/* Bounds row of a node at the ray time, for deformation motion blur. */
+ccl_device_inline ssef qbvh_node_time_row(KernelGlobals *__restrict kg,
+                                          const int offset,
+                                          const int row,
+                                          const ssef& time)
+{
+	return madd(kernel_tex_fetch_ssef(__bvh_time_nodes, offset+6+row),
+	            time,
+	            kernel_tex_fetch_ssef(__bvh_time_nodes, offset+row));
+}
+
+/* Same as qbvh_node_intersect_robust, but with the child bounds at the ray
+ * time instead of the bounds of all motion steps. difl is zero for regular
+ * intersection. */
+ccl_device_inline int qbvh_node_intersect_motion(KernelGlobals *__restrict kg,
+                                                 const ssef& tnear,
+                                                 const ssef& tfar,
+#ifdef __KERNEL_AVX2__
+                                                 const sse3f& P_idir,
+#else
+                                                 const sse3f& P,
+#endif
+                                                 const sse3f& idir,
+                                                 const int near_x,
+                                                 const int near_y,
+                                                 const int near_z,
+                                                 const int far_x,
+                                                 const int far_y,
+                                                 const int far_z,
+                                                 const int nodeAddr,
+                                                 const float time,
+                                                 const float difl,
+                                                 ssef *__restrict dist)
+{
+	const int offset = nodeAddr*BVH_QNODE_TIME_SIZE;
+	const ssef t(time);
+#ifdef __KERNEL_AVX2__
+	const ssef tnear_x = msub(qbvh_node_time_row(kg, offset, near_x, t), idir.x, P_idir.x);
+	const ssef tnear_y = msub(qbvh_node_time_row(kg, offset, near_y, t), idir.y, P_idir.y);
+	const ssef tnear_z = msub(qbvh_node_time_row(kg, offset, near_z, t), idir.z, P_idir.z);
+	const ssef tfar_x = msub(qbvh_node_time_row(kg, offset, far_x, t), idir.x, P_idir.x);
+	const ssef tfar_y = msub(qbvh_node_time_row(kg, offset, far_y, t), idir.y, P_idir.y);
+	const ssef tfar_z = msub(qbvh_node_time_row(kg, offset, far_z, t), idir.z, P_idir.z);
+#else
+	const ssef tnear_x = (qbvh_node_time_row(kg, offset, near_x, t) - P.x) * idir.x;
+	const ssef tnear_y = (qbvh_node_time_row(kg, offset, near_y, t) - P.y) * idir.y;
+	const ssef tnear_z = (qbvh_node_time_row(kg, offset, near_z, t) - P.z) * idir.z;
+	const ssef tfar_x = (qbvh_node_time_row(kg, offset, far_x, t) - P.x) * idir.x;
+	const ssef tfar_y = (qbvh_node_time_row(kg, offset, far_y, t) - P.y) * idir.y;
+	const ssef tfar_z = (qbvh_node_time_row(kg, offset, far_z, t) - P.z) * idir.z;
+#endif
+
+	const float round_down = 1.0f - difl;
+	const float round_up = 1.0f + difl;
+	const ssef tNear = max4(tnear_x, tnear_y, tnear_z, tnear);
+	const ssef tFar = min4(tfar_x, tfar_y, tfar_z, tfar);
+	const sseb vmask = round_down*tNear <= round_up*tFar;
+	*dist = tNear;
+	return (int)movemask(vmask);
+}
+
 ccl_device_inline int qbvh_node_intersect_robust(KernelGlobals *__restrict kg,
                                                  const ssef& tnear,
                                                  const ssef& tfar,
@@ -0,0 +1,339 @@
+/*
+ * Copyright 2011-2015, Blender Foundation.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* QBVH packet traversal
+ *
+ * Traverses a packet of coherent rays together through the QBVH or OBVH, with
+ * one ray per SIMD lane. Node fetches and traversal decisions are shared by
+ * all rays of the packet, and a child is only visited with the rays which hit
+ * its bounds. Instances are entered with all rays of the packet which reach
+ * them, every ray being transformed into object space on its own.
+ *
+ * Motion blur and hair with minimum width are not supported, see
+ * scene_intersect_packet_supported(). */
+
+#define QBVH_PACKET_SIZE 4
+
+struct QBVHPacketStackItem {
+	int addr;
+	int mask;
+};
+
+ccl_device_inline bool scene_intersect_packet_supported(KernelGlobals *kg)
+{
+	return kernel_data.bvh.use_qbvh &&
+	       !kernel_data.bvh.have_motion &&
+	       !(kernel_data.bvh.have_curves && kernel_data.curve.minimum_width != 0.0f);
+}
+
+/* SIMD ray parameters of the packet, updated whenever rays enter or leave an
+ * instance. Lanes of the near and far side mask are set for rays with a
+ * positive direction. */
+ccl_device_inline void qbvh_packet_setup(const float3 *P,
+                                         const float3 *idir,
+                                         sse3f *org,
+                                         sse3f *idir4,
+                                         sseb positive[3])
+{
+	*org = sse3f(ssef(P[0].x, P[1].x, P[2].x, P[3].x),
+	             ssef(P[0].y, P[1].y, P[2].y, P[3].y),
+	             ssef(P[0].z, P[1].z, P[2].z, P[3].z));
+	*idir4 = sse3f(ssef(idir[0].x, idir[1].x, idir[2].x, idir[3].x),
+	               ssef(idir[0].y, idir[1].y, idir[2].y, idir[3].y),
+	               ssef(idir[0].z, idir[1].z, idir[2].z, idir[3].z));
+	positive[0] = (idir4->x >= ssef(0.0f));
+	positive[1] = (idir4->y >= ssef(0.0f));
+	positive[2] = (idir4->z >= ssef(0.0f));
+}
+
+/* Intersect num <= QBVH_PACKET_SIZE rays, rays with zero length are skipped.
+ * Returns a bit mask of the rays which hit something. */
+ccl_device int scene_intersect_packet(KernelGlobals *kg,
+                                      const Ray *ray,
+                                      Intersection *isect,
+                                      const int num,
+                                      const uint visibility)
+{
+	kernel_assert(num <= QBVH_PACKET_SIZE);
+	kernel_counter_add(kg, intersect_rays, num);
+
+	/* Node and primitive visits counted in registers. */
+	BVH_COUNTERS_BEGIN(kg);
+
+	/* Traversal stack in thread-local memory, every item stores which rays
+	 * of the packet are to traverse the node. Instance entry points store the
+	 * rays which entered the instance. */
+	QBVHPacketStackItem traversalStack[BVH_OSTACK_SIZE];
+	traversalStack[0].addr = ENTRYPOINT_SENTINEL;
+	traversalStack[0].mask = 0;
+
+	/* OBVH nodes have the same rows as QBVH nodes, two float4 wide. */
+#ifdef __OBVH__
+	const int row_size = (kernel_data.bvh.use_obvh)? 2: 1;
+#else
+	const int row_size = 1;
+#endif
+	const int node_size = (row_size == 2)? BVH_ONODE_SIZE: BVH_QNODE_SIZE;
+
+	/* Ray parameters, unused lanes are filled with the first ray. */
+	float3 P[QBVH_PACKET_SIZE];
+	float3 dir[QBVH_PACKET_SIZE];
+	float3 idir[QBVH_PACKET_SIZE];
+	IsectPrecalc isect_precalc[QBVH_PACKET_SIZE];
+	int object = OBJECT_NONE;
+	int active = 0;
+
+	for(int i = 0; i < QBVH_PACKET_SIZE; i++) {
+		const Ray *r = &ray[(i < num)? i: 0];
+
+		P[i] = r->P;
+		dir[i] = bvh_clamp_direction(r->D);
+		idir[i] = bvh_inverse_direction(dir[i]);
+		triangle_intersect_precalc(dir[i], &isect_precalc[i]);
+
+		if(i < num) {
+			isect[i].t = r->t;
+			isect[i].u = 0.0f;
+			isect[i].v = 0.0f;
+			isect[i].prim = PRIM_NONE;
+			isect[i].object = OBJECT_NONE;
+#if defined(__KERNEL_DEBUG__)
+			isect[i].num_traversal_steps = 0;
+#endif
+
+			if(r->t != 0.0f && isfinite(r->P.x))
+				active |= (1 << i);
+		}
+	}
+
+	sse3f org, idir4;
+	sseb positive[3];
+	qbvh_packet_setup(P, idir, &org, &idir4, positive);
+
+	ssef tfar(ray[0].t);
+	for(int i = 0; i < num; i++)
+		tfar[i] = ray[i].t;
+
+	/* Traversal variables in registers. */
+	int stackPtr = 0;
+	int nodeAddr = kernel_data.bvh.root;
+	int nodeMask = active;
+
+	if(nodeMask == 0)
+		return 0;
+
+	/* Traversal loop. */
+	do {
+		do {
+			/* Traverse internal nodes. */
+			while(nodeAddr >= 0 && nodeAddr != ENTRYPOINT_SENTINEL) {
+				BVH_COUNT_NODE();
+
+				const int offset = nodeAddr*node_size;
+				int child_addr[8], child_mask[8];
+				float child_dist[8];
+				int num_children = 0;
+
+				for(int group = 0; group < row_size; group++) {
+					const float4 bmin_x = kernel_tex_fetch(__bvh_nodes, offset + 0*row_size + group);
+					const float4 bmax_x = kernel_tex_fetch(__bvh_nodes, offset + 1*row_size + group);
+					const float4 bmin_y = kernel_tex_fetch(__bvh_nodes, offset + 2*row_size + group);
+					const float4 bmax_y = kernel_tex_fetch(__bvh_nodes, offset + 3*row_size + group);
+					const float4 bmin_z = kernel_tex_fetch(__bvh_nodes, offset + 4*row_size + group);
+					const float4 bmax_z = kernel_tex_fetch(__bvh_nodes, offset + 5*row_size + group);
+					const float4 cnodes = kernel_tex_fetch(__bvh_nodes, offset + 6*row_size + group);
+
+					/* Test every child against all rays of the packet at
+					 * once. Empty children have inverted bounds, so the near
+					 * and far planes are picked by the ray direction. */
+					for(int c = 0; c < 4; c++) {
+						const ssef tx0 = (ssef(bmin_x[c]) - org.x) * idir4.x;
+						const ssef tx1 = (ssef(bmax_x[c]) - org.x) * idir4.x;
+						const ssef ty0 = (ssef(bmin_y[c]) - org.y) * idir4.y;
+						const ssef ty1 = (ssef(bmax_y[c]) - org.y) * idir4.y;
+						const ssef tz0 = (ssef(bmin_z[c]) - org.z) * idir4.z;
+						const ssef tz1 = (ssef(bmax_z[c]) - org.z) * idir4.z;
+
+						const ssef tNear = max(max(select(positive[0], tx0, tx1), select(positive[1], ty0, ty1)),
+						                       max(select(positive[2], tz0, tz1), ssef(0.0f)));
+						const ssef tFar = min(min(select(positive[0], tx1, tx0), select(positive[1], ty1, ty0)),
+						                      min(select(positive[2], tz1, tz0), tfar));
+						const int mask = (int)movemask(tNear <= tFar) & nodeMask;
+
+						if(mask == 0)
+							continue;
+
+						/* Closest entry distance of the rays, for ordering. */
+						float dist = FLT_MAX;
+						int m = mask;
+						while(m) {
+							int i = __bscf(m);
+							dist = min(dist, tNear[i]);
+						}
+
+						/* Insertion sort, farthest child first. */
+						int j = num_children++;
+						while(j > 0 && child_dist[j - 1] < dist) {
+							child_addr[j] = child_addr[j - 1];
+							child_mask[j] = child_mask[j - 1];
+							child_dist[j] = child_dist[j - 1];
+							j--;
+						}
+						child_addr[j] = __float_as_int(cnodes[c]);
+						child_mask[j] = mask;
+						child_dist[j] = dist;
+					}
+				}
+
+#if defined(__KERNEL_DEBUG__)
+				for(int i = 0; i < num; i++)
+					if(nodeMask & (1 << i))
+						isect[i].num_traversal_steps++;
+#endif
+
+				if(num_children == 0) {
+					/* Pop. */
+					nodeAddr = traversalStack[stackPtr].addr;
+					nodeMask = traversalStack[stackPtr].mask;
+					--stackPtr;
+					continue;
+				}
+
+				/* Push far children, and continue with the closest one. */
+				for(int i = 0; i < num_children - 1; i++) {
+					++stackPtr;
+					kernel_assert(stackPtr < BVH_OSTACK_SIZE);
+					traversalStack[stackPtr].addr = child_addr[i];
+					traversalStack[stackPtr].mask = child_mask[i];
+				}
+
+				nodeAddr = child_addr[num_children - 1];
+				nodeMask = child_mask[num_children - 1];
+			}
+
+			/* If node is leaf, fetch primitive list. */
+			if(nodeAddr < 0) {
+				float4 leaf = kernel_tex_fetch(__bvh_leaf_nodes, (-nodeAddr-1)*BVH_QNODE_LEAF_SIZE);
+				int leafMask = nodeMask;
+
+#ifdef __VISIBILITY_FLAG__
+				if((__float_as_uint(leaf.z) & visibility) == 0) {
+					/* Pop. */
+					nodeAddr = traversalStack[stackPtr].addr;
+					nodeMask = traversalStack[stackPtr].mask;
+					--stackPtr;
+					continue;
+				}
+#endif
+
+				int primAddr = __float_as_int(leaf.x);
+
+				if(primAddr >= 0) {
+					/* Pop. */
+					nodeAddr = traversalStack[stackPtr].addr;
+					nodeMask = traversalStack[stackPtr].mask;
+					--stackPtr;
+
+					int primAddr2 = __float_as_int(leaf.y);
+					const uint type = __float_as_int(leaf.w);
+
+					/* Primitive intersection, ray by ray. */
+					BVH_COUNT_PRIMITIVES((primAddr2 - primAddr)*__popcnt(leafMask));
+					for(; primAddr < primAddr2; primAddr++) {
+						kernel_assert(kernel_tex_fetch(__prim_type, primAddr) == type);
+
+						int mask = leafMask;
+						while(mask) {
+							int i = __bscf(mask);
+							bool hit;
+#if defined(__KERNEL_DEBUG__)
+							isect[i].num_traversal_steps++;
+#endif
+#ifdef __HAIR__
+							if(type & PRIMITIVE_CURVE) {
+								/* no minimum width, so no stochastic coverage */
+								if(kernel_data.curve.curveflags & CURVE_KN_INTERPOLATE)
+									hit = bvh_cardinal_curve_intersect(kg, &isect[i], P[i], dir[i], visibility, object, primAddr, ray[i].time, type, NULL, 0.0f, 0.0f);
+								else
+									hit = bvh_curve_intersect(kg, &isect[i], P[i], dir[i], visibility, object, primAddr, ray[i].time, type, NULL, 0.0f, 0.0f);
+							}
+							else
+#endif
+							{
+								hit = triangle_intersect(kg, &isect_precalc[i], &isect[i], P[i], visibility, object, primAddr);
+							}
+
+							if(hit)
+								tfar[i] = isect[i].t;
+						}
+					}
+				}
+#ifdef __INSTANCING__
+				else {
+					/* Instance push, for the rays which reached the instance. */
+					object = kernel_tex_fetch(__prim_object, -primAddr-1);
+
+					int mask = leafMask;
+					while(mask) {
+						int i = __bscf(mask);
+						bvh_instance_push(kg, object, &ray[i], &P[i], &dir[i], &idir[i], &isect[i].t);
+						triangle_intersect_precalc(dir[i], &isect_precalc[i]);
+						tfar[i] = isect[i].t;
+					}
+
+					qbvh_packet_setup(P, idir, &org, &idir4, positive);
+
+					++stackPtr;
+					kernel_assert(stackPtr < BVH_OSTACK_SIZE);
+					traversalStack[stackPtr].addr = ENTRYPOINT_SENTINEL;
+					traversalStack[stackPtr].mask = leafMask;
+
+					nodeAddr = kernel_tex_fetch(__object_node, object);
+				}
+#endif  /* __INSTANCING__ */
+			}
+		} while(nodeAddr != ENTRYPOINT_SENTINEL);
+
+#ifdef __INSTANCING__
+		if(stackPtr >= 0) {
+			kernel_assert(object != OBJECT_NONE);
+
+			/* Instance pop, for the rays which entered the instance. */
+			int mask = nodeMask;
+			while(mask) {
+				int i = __bscf(mask);
+				bvh_instance_pop(kg, object, &ray[i], &P[i], &dir[i], &idir[i], &isect[i].t);
+				triangle_intersect_precalc(dir[i], &isect_precalc[i]);
+				tfar[i] = isect[i].t;
+			}
+
+			qbvh_packet_setup(P, idir, &org, &idir4, positive);
+
+			object = OBJECT_NONE;
+			nodeAddr = traversalStack[stackPtr].addr;
+			nodeMask = traversalStack[stackPtr].mask;
+			--stackPtr;
+		}
+#endif  /* __INSTANCING__ */
+	} while(nodeAddr != ENTRYPOINT_SENTINEL);
+
+	int hit = 0;
+	for(int i = 0; i < num; i++)
+		if(isect[i].prim != PRIM_NONE)
+			hit |= (1 << i);
+
+	return hit;
+}
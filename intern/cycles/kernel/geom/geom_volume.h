@@ -85,6 +85,99 @@ ccl_device float3 volume_attribute_float3(KernelGlobals *kg, const ShaderData *s
 	return float4_to_float3(r);
 }
 
+#ifdef __VOLUME_GRID__
+
+/* Acceleration Grid
+ *
+ * Coarse grid over the voxel attributes of an object, with the cells that
+ * voxel lookups find zero in marked empty. Walk the cells along the ray from
+ * distance t, returning the distance where cells change from empty to
+ * occupied or back, and if the volume is empty at t. Objects without a grid,
+ * and rays starting outside of the grid, are occupied up to t_max. */
+
+ccl_device float volume_grid_traverse(KernelGlobals *kg, int object, const Ray *ray, float t, float t_max, bool *is_empty)
+{
+	int offset = object*VOLUME_GRID_OBJECT_SIZE;
+	float4 info = kernel_tex_fetch(__volume_grid, offset + 3);
+	int cells = __float_as_int(info.w);
+
+	*is_empty = false;
+
+	if(cells == -1)
+		return t_max;
+
+	Transform tfm;
+	tfm.x = kernel_tex_fetch(__volume_grid, offset + 0);
+	tfm.y = kernel_tex_fetch(__volume_grid, offset + 1);
+	tfm.z = kernel_tex_fetch(__volume_grid, offset + 2);
+	tfm.w = make_float4(0.0f, 0.0f, 0.0f, 1.0f);
+
+	float3 gP = transform_point(&tfm, ray->P + ray->D*t);
+	float3 gD = transform_direction(&tfm, ray->D);
+
+	int res[3] = {__float_as_int(info.x), __float_as_int(info.y), __float_as_int(info.z)};
+	float P[3] = {gP.x, gP.y, gP.z};
+	float D[3] = {gD.x, gD.y, gD.z};
+	int cell[3], step[3];
+	float t_next[3], t_delta[3];
+
+	/* find the cell at t, points slightly outside the grid due to float
+	 * precision are clamped to the border cells */
+	const float eps = 1e-4f;
+
+	for(int i = 0; i < 3; i++) {
+		if(!(P[i] >= -eps && P[i] <= res[i] + eps))
+			return t_max;
+
+		cell[i] = clamp((int)floorf(P[i]), 0, res[i] - 1);
+
+		if(D[i] > 0.0f) {
+			step[i] = 1;
+			t_delta[i] = 1.0f/D[i];
+			t_next[i] = (cell[i] + 1 - P[i])*t_delta[i];
+		}
+		else if(D[i] < 0.0f) {
+			step[i] = -1;
+			t_delta[i] = -1.0f/D[i];
+			t_next[i] = (P[i] - cell[i])*t_delta[i];
+		}
+		else {
+			step[i] = 0;
+			t_delta[i] = FLT_MAX;
+			t_next[i] = FLT_MAX;
+		}
+	}
+
+	bool empty = (kernel_tex_fetch(__volume_grid_cells, cells + (cell[2]*res[1] + cell[1])*res[0] + cell[0]) == 0.0f);
+	float s_max = t_max - t;
+
+	*is_empty = empty;
+
+	/* every iteration moves one cell towards the grid exit */
+	for(;;) {
+		int axis = (t_next[0] < t_next[1])? ((t_next[0] < t_next[2])? 0: 2): ((t_next[1] < t_next[2])? 1: 2);
+		float s = t_next[axis];
+
+		if(s >= s_max)
+			return t_max;
+
+		cell[axis] += step[axis];
+
+		/* outside the grid the volume is occupied */
+		if(cell[axis] < 0 || cell[axis] >= res[axis])
+			return (empty)? t + s: t_max;
+
+		t_next[axis] += t_delta[axis];
+
+		bool cell_empty = (kernel_tex_fetch(__volume_grid_cells, cells + (cell[2]*res[1] + cell[1])*res[0] + cell[0]) == 0.0f);
+
+		if(cell_empty != empty)
+			return t + s;
+	}
+}
+
+#endif
+
 #endif
 
 CCL_NAMESPACE_END
@@ -0,0 +1,229 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Adaptive Sampling
+ *
+ * Besides the combined pass, every pixel accumulates its even samples a
+ * second time in the adaptive aux buffer, weighted by two so both estimates
+ * have the same scale. The difference between the two estimates gives the
+ * per pixel error, as in "A hierarchical automatic stopping condition for
+ * Monte Carlo global illumination" by Dammertz et al.
+ *
+ * Pixels with an error below the threshold are flagged as converged in the
+ * fourth component of the aux buffer and skipped by the path tracing
+ * kernels. The number of samples every pixel received is stored in the
+ * sample count pass, which is used to scale the pixel up to the full number
+ * of samples once the tile is done. */
+
+CCL_NAMESPACE_BEGIN
+
+ccl_device_inline bool kernel_adaptive_sampling_use(KernelGlobals *kg)
+{
+	return (kernel_data.film.pass_flag & PASS_ADAPTIVE_AUX_BUFFER) != 0;
+}
+
+/* Buffer points to the start of the pixel in the render buffer. The first
+ * sample always renders, which also resets the flag of a reused buffer. */
+ccl_device_inline bool kernel_adaptive_sampling_converged(KernelGlobals *kg,
+                                                          ccl_global float *buffer,
+                                                          int sample)
+{
+	return sample > 0 &&
+	       buffer[kernel_data.film.pass_adaptive_aux_buffer + 3] != 0.0f;
+}
+
+ccl_device_inline void kernel_write_adaptive_sampling_passes(KernelGlobals *kg,
+                                                             ccl_global float *buffer,
+                                                             int sample,
+                                                             float4 L)
+{
+	if((sample & 1) == 0) {
+		kernel_write_pass_float4(buffer + kernel_data.film.pass_adaptive_aux_buffer,
+		                         sample,
+		                         make_float4(L.x*2.0f, L.y*2.0f, L.z*2.0f, 0.0f));
+	}
+
+	kernel_write_pass_float(buffer + kernel_data.film.pass_sample_count, sample, 1.0f);
+}
+
+/* Flag the pixel as converged if its error is below the threshold. */
+ccl_device void kernel_adaptive_sampling_stop(KernelGlobals *kg, ccl_global float *buffer)
+{
+	ccl_global float4 *aux = (ccl_global float4*)(buffer + kernel_data.film.pass_adaptive_aux_buffer);
+
+	if(aux->w != 0.0f)
+		return;
+
+	float4 I = *((ccl_global float4*)buffer);
+	float4 A = *aux;
+	float num_samples = buffer[kernel_data.film.pass_sample_count];
+
+	/* I and A are sums over the samples, a small epsilon avoids division
+	 * by zero for black pixels */
+	float error = (fabsf(I.x - A.x) + fabsf(I.y - A.y) + fabsf(I.z - A.z)) /
+	              (num_samples*0.0001f + sqrtf(max(I.x + I.y + I.z, 0.0f)));
+
+	if(error < kernel_data.integrator.adaptive_threshold*num_samples)
+		aux->w = 1.0f;
+}
+
+#ifdef __KERNEL_CPU__
+/* Convergence tests run on the CPU after every few samples of a tile. */
+
+ccl_device_inline ccl_global float *kernel_adaptive_sampling_pixel(KernelGlobals *kg,
+                                                                   ccl_global float *buffer,
+                                                                   int x, int y,
+                                                                   int offset, int stride)
+{
+	return buffer + (offset + x + y*stride)*kernel_data.film.pass_stride;
+}
+
+/* Unflag converged pixels next to pixels which are not converged, so noise
+ * at the border of a converged region is not frozen by a single estimate
+ * that happens to be too low. */
+ccl_device void kernel_adaptive_sampling_filter_x(KernelGlobals *kg,
+                                                  ccl_global float *buffer,
+                                                  int y, int x0, int w,
+                                                  int offset, int stride)
+{
+	int aux_offset = kernel_data.film.pass_adaptive_aux_buffer + 3;
+	bool prev = false;
+
+	for(int x = x0; x < x0 + w; x++) {
+		ccl_global float *pixel = kernel_adaptive_sampling_pixel(kg, buffer, x, y, offset, stride);
+
+		if(pixel[aux_offset] == 0.0f) {
+			if(x > x0 && !prev)
+				kernel_adaptive_sampling_pixel(kg, buffer, x - 1, y, offset, stride)[aux_offset] = 0.0f;
+			prev = true;
+		}
+		else {
+			if(prev)
+				pixel[aux_offset] = 0.0f;
+			prev = false;
+		}
+	}
+}
+
+ccl_device void kernel_adaptive_sampling_filter_y(KernelGlobals *kg,
+                                                  ccl_global float *buffer,
+                                                  int x, int y0, int h,
+                                                  int offset, int stride)
+{
+	int aux_offset = kernel_data.film.pass_adaptive_aux_buffer + 3;
+	bool prev = false;
+
+	for(int y = y0; y < y0 + h; y++) {
+		ccl_global float *pixel = kernel_adaptive_sampling_pixel(kg, buffer, x, y, offset, stride);
+
+		if(pixel[aux_offset] == 0.0f) {
+			if(y > y0 && !prev)
+				kernel_adaptive_sampling_pixel(kg, buffer, x, y - 1, offset, stride)[aux_offset] = 0.0f;
+			prev = true;
+		}
+		else {
+			if(prev)
+				pixel[aux_offset] = 0.0f;
+			prev = false;
+		}
+	}
+}
+
+/* Update the converged flags of a tile, returns true if any pixel still
+ * needs more samples. */
+ccl_device bool kernel_adaptive_sampling_filter(KernelGlobals *kg,
+                                                ccl_global float *buffer,
+                                                int x, int y, int w, int h,
+                                                int offset, int stride)
+{
+	for(int py = y; py < y + h; py++)
+		for(int px = x; px < x + w; px++)
+			kernel_adaptive_sampling_stop(kg, kernel_adaptive_sampling_pixel(kg, buffer, px, py, offset, stride));
+
+	for(int py = y; py < y + h; py++)
+		kernel_adaptive_sampling_filter_x(kg, buffer, py, x, w, offset, stride);
+
+	for(int px = x; px < x + w; px++)
+		kernel_adaptive_sampling_filter_y(kg, buffer, px, y, h, offset, stride);
+
+	int aux_offset = kernel_data.film.pass_adaptive_aux_buffer + 3;
+
+	for(int py = y; py < y + h; py++)
+		for(int px = x; px < x + w; px++)
+			if(kernel_adaptive_sampling_pixel(kg, buffer, px, py, offset, stride)[aux_offset] == 0.0f)
+				return true;
+
+	return false;
+}
+
+/* Passes with filtering disabled in the film, like depth and IDs, are only
+ * written by the first sample and must not be scaled. */
+ccl_device_inline bool kernel_adaptive_sampling_pass_filtered(KernelGlobals *kg, int i)
+{
+	int flag = kernel_data.film.pass_flag;
+
+	if((flag & PASS_DEPTH) && i == kernel_data.film.pass_depth)
+		return false;
+	if((flag & PASS_OBJECT_ID) && i == kernel_data.film.pass_object_id)
+		return false;
+	if((flag & PASS_MATERIAL_ID) && i == kernel_data.film.pass_material_id)
+		return false;
+	if(i == kernel_data.film.pass_sample_count)
+		return false;
+	if(i >= kernel_data.film.pass_adaptive_aux_buffer && i < kernel_data.film.pass_adaptive_aux_buffer + 4)
+		return false;
+
+	return true;
+}
+
+/* Scale the filtered passes of pixels which stopped early, as if they
+ * received all samples of the tile. Returns the number of pixel samples that
+ * were skipped. */
+ccl_device uint64_t kernel_adaptive_sampling_post_adjust(KernelGlobals *kg,
+                                                         ccl_global float *buffer,
+                                                         int sample,
+                                                         int x, int y, int w, int h,
+                                                         int offset, int stride)
+{
+	int pass_stride = kernel_data.film.pass_stride;
+	int count_offset = kernel_data.film.pass_sample_count;
+	uint64_t skipped = 0;
+
+	for(int py = y; py < y + h; py++) {
+		for(int px = x; px < x + w; px++) {
+			ccl_global float *pixel = kernel_adaptive_sampling_pixel(kg, buffer, px, py, offset, stride);
+			float num_samples = pixel[count_offset];
+
+			if(num_samples <= 0.0f || num_samples >= (float)sample)
+				continue;
+
+			float scale = (float)sample/num_samples;
+
+			for(int i = 0; i < pass_stride; i++)
+				if(kernel_adaptive_sampling_pass_filtered(kg, i))
+					pixel[i] *= scale;
+
+			pixel[count_offset] = (float)sample;
+			skipped += (uint64_t)(sample - (int)num_samples);
+		}
+	}
+
+	return skipped;
+}
+#endif  /* __KERNEL_CPU__ */
+
+CCL_NAMESPACE_END
+
@@ -38,6 +38,7 @@
 #include "util_math.h"
 #include "util_simd.h"
 #include "util_half.h"
+#include "util_texture_cache.h"
 #include "util_types.h"
 
 #define ccl_addr_space
@@ -83,11 +84,29 @@ template<typename T> struct texture  {
 	}
 #endif
 
+#ifdef __KERNEL_AVX__
+	/* Fetch 8 consecutive floats, index is in units of float4. */
+	ccl_always_inline avxf fetch_avxf(int index)
+	{
+		kernel_assert(index >= 0 && index+1 < width);
+		return avxf::loadu((float*)(data + index));
+	}
+#endif
+
 	T *data;
 	int width;
 };
 
 template<typename T> struct texture_image  {
+	/* Images which were never allocated have no data and no texture cache
+	 * handle. */
+	texture_image()
+	: data(NULL), interpolation(INTERPOLATION_LINEAR),
+	  width(0), height(0), depth(0),
+	  cache(NULL), cache_handle(NULL)
+	{
+	}
+
 #define SET_CUBIC_SPLINE_WEIGHTS(u, t) \
 	{ \
 		u[0] = (((-1.0f/6.0f)* t + 0.5f) * t - 0.5f) * t + (1.0f/6.0f); \
@@ -107,6 +126,29 @@ template<typename T> struct texture_image  {
 		return make_float4(r.x*f, r.y*f, r.z*f, r.w*f);
 	}
 
+	ccl_always_inline float4 read(half4 r)
+	{
+		return make_float4(half_to_float(r.x), half_to_float(r.y), half_to_float(r.z), half_to_float(r.w));
+	}
+
+	/* single channel images are grayscale without alpha */
+	ccl_always_inline float4 read(float r)
+	{
+		return make_float4(r, r, r, 1.0f);
+	}
+
+	ccl_always_inline float4 read(uchar r)
+	{
+		float f = r*(1.0f/255.0f);
+		return make_float4(f, f, f, 1.0f);
+	}
+
+	ccl_always_inline float4 read(half r)
+	{
+		float f = half_to_float(r);
+		return make_float4(f, f, f, 1.0f);
+	}
+
 	ccl_always_inline int wrap_periodic(int x, int width)
 	{
 		x %= width;
@@ -129,8 +171,11 @@ template<typename T> struct texture_image  {
 
 	ccl_always_inline float4 interp(float x, float y, bool periodic = true)
 	{
-		if(UNLIKELY(!data))
+		if(UNLIKELY(!data)) {
+			if(cache_handle)
+				return cache->lookup(cache_handle, x, y, interpolation, periodic);
 			return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+		}
 
 		int ix, iy, nix, niy;
 
@@ -393,6 +438,10 @@ template<typename T> struct texture_image  {
 	T *data;
 	int interpolation;
 	int width, height, depth;
+
+	/* Image files not loaded into memory are looked up in the texture cache. */
+	TextureCache *cache;
+	TextureCacheHandle *cache_handle;
 #undef SET_CUBIC_SPLINE_WEIGHTS
 };
 
@@ -405,16 +454,21 @@ typedef texture<uint4> texture_uint4;
 typedef texture<uchar4> texture_uchar4;
 typedef texture_image<float4> texture_image_float4;
 typedef texture_image<uchar4> texture_image_uchar4;
+typedef texture_image<half4> texture_image_half4;
+typedef texture_image<float> texture_image_float;
+typedef texture_image<uchar> texture_image_uchar;
+typedef texture_image<half> texture_image_half;
 
 /* Macros to handle different memory storage on different devices */
 
 #define kernel_tex_fetch(tex, index) (kg->tex.fetch(index))
 #define kernel_tex_fetch_ssef(tex, index) (kg->tex.fetch_ssef(index))
 #define kernel_tex_fetch_ssei(tex, index) (kg->tex.fetch_ssei(index))
+#define kernel_tex_fetch_avxf(tex, index) (kg->tex.fetch_avxf(index))
 #define kernel_tex_lookup(tex, t, offset, size) (kg->tex.lookup(t, offset, size))
-#define kernel_tex_image_interp(tex, x, y) ((tex < MAX_FLOAT_IMAGES) ? kg->texture_float_images[tex].interp(x, y) : kg->texture_byte_images[tex - MAX_FLOAT_IMAGES].interp(x, y))
-#define kernel_tex_image_interp_3d(tex, x, y, z) ((tex < MAX_FLOAT_IMAGES) ? kg->texture_float_images[tex].interp_3d(x, y, z) : kg->texture_byte_images[tex - MAX_FLOAT_IMAGES].interp_3d(x, y, z))
-#define kernel_tex_image_interp_3d_ex(tex, x, y, z, interpolation) ((tex < MAX_FLOAT_IMAGES) ? kg->texture_float_images[tex].interp_3d_ex(x, y, z, interpolation) : kg->texture_byte_images[tex - MAX_FLOAT_IMAGES].interp_3d_ex(x, y, z, interpolation))
+#define kernel_tex_image_interp(tex, x, y) (kernel_tex_image_interp_cpu(kg, tex, x, y))
+#define kernel_tex_image_interp_3d(tex, x, y, z) (kernel_tex_image_interp_3d_cpu(kg, tex, x, y, z, -1))
+#define kernel_tex_image_interp_3d_ex(tex, x, y, z, interpolation) (kernel_tex_image_interp_3d_cpu(kg, tex, x, y, z, interpolation))
 
 #define kernel_data (kg->__data)
 
@@ -423,6 +477,10 @@ typedef vector3<sseb> sse3b;
 typedef vector3<ssef> sse3f;
 typedef vector3<ssei> sse3i;
 
+#ifdef __KERNEL_AVX__
+typedef vector3<avxf> avx3f;
+#endif
+
 ccl_device_inline void print_sse3b(const char *label, sse3b& a)
 {
 	print_sseb(label, a.x);
@@ -45,6 +45,20 @@ ccl_device uchar4 film_float_to_byte(float4 color)
 	return result;
 }
 
+/* With adaptive sampling, pixels which stopped early have fewer samples than
+ * the rest of the tile until it is finished. */
+ccl_device_inline float film_sample_scale(KernelGlobals *kg, ccl_global float *buffer, float sample_scale)
+{
+	if(kernel_data.film.pass_flag & PASS_SAMPLE_COUNT) {
+		float num_samples = buffer[kernel_data.film.pass_sample_count];
+
+		if(num_samples > 0.0f)
+			return 1.0f/num_samples;
+	}
+
+	return sample_scale;
+}
+
 ccl_device void kernel_film_convert_to_byte(KernelGlobals *kg,
 	ccl_global uchar4 *rgba, ccl_global float *buffer,
 	float sample_scale, int x, int y, int offset, int stride)
@@ -57,7 +71,7 @@ ccl_device void kernel_film_convert_to_byte(KernelGlobals *kg,
 
 	/* map colors */
 	float4 irradiance = *((ccl_global float4*)buffer);
-	float4 float_result = film_map(kg, irradiance, sample_scale);
+	float4 float_result = film_map(kg, irradiance, film_sample_scale(kg, buffer, sample_scale));
 	uchar4 byte_result = film_float_to_byte(float_result);
 
 	*rgba = byte_result;
@@ -83,7 +97,7 @@ ccl_device void kernel_film_convert_to_half_float(KernelGlobals *kg,
 		rgba_in.z *= exposure;
 	}
 
-	float4_store_half(out, rgba_in, sample_scale);
+	float4_store_half(out, rgba_in, film_sample_scale(kg, (ccl_global float*)in, sample_scale));
 }
 
 CCL_NAMESPACE_END
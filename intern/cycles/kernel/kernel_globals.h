@@ -16,6 +16,10 @@
 
 /* Constant Globals */
 
+#ifdef __KERNEL_CPU__
+#include "util_stats.h"
+#endif
+
 CCL_NAMESPACE_BEGIN
 
 /* On the CPU, we pass along the struct KernelGlobals to nearly everywhere in
@@ -31,13 +35,19 @@ struct OSLThreadData;
 struct OSLShadingSystem;
 #endif
 
-#define MAX_BYTE_IMAGES   1024
-#define MAX_FLOAT_IMAGES  1024
+#define MAX_BYTE_IMAGES   TEX_NUM_IMAGES_CPU
+#define MAX_FLOAT_IMAGES  TEX_NUM_IMAGES_CPU
 
 typedef struct KernelGlobals {
 	texture_image_uchar4 texture_byte_images[MAX_BYTE_IMAGES];
 	texture_image_float4 texture_float_images[MAX_FLOAT_IMAGES];
 
+	/* compact image types, one array per ImageDataType */
+	texture_image_half4 texture_half4_images[TEX_NUM_IMAGES_CPU];
+	texture_image_float texture_float1_images[TEX_NUM_IMAGES_CPU];
+	texture_image_uchar texture_byte1_images[TEX_NUM_IMAGES_CPU];
+	texture_image_half texture_half1_images[TEX_NUM_IMAGES_CPU];
+
 #define KERNEL_TEX(type, ttype, name) ttype name;
 #define KERNEL_IMAGE_TEX(type, ttype, name)
 #include "kernel_textures.h"
@@ -52,8 +62,65 @@ typedef struct KernelGlobals {
 	OSLThreadData *osl_tdata;
 #endif
 
+	/* Performance counters of this thread. */
+	KernelCounters counters;
 } KernelGlobals;
 
+/* Image slots are flattened over all data types, the type of an image is
+ * given by the range its slot is in. */
+
+ccl_device_inline float4 kernel_tex_image_interp_cpu(KernelGlobals *kg, int tex, float x, float y)
+{
+	const int index = tex % TEX_NUM_IMAGES_CPU;
+
+	switch(tex / TEX_NUM_IMAGES_CPU) {
+		case IMAGE_DATA_TYPE_FLOAT4:
+			return kg->texture_float_images[index].interp(x, y);
+		case IMAGE_DATA_TYPE_BYTE4:
+			return kg->texture_byte_images[index].interp(x, y);
+		case IMAGE_DATA_TYPE_HALF4:
+			return kg->texture_half4_images[index].interp(x, y);
+		case IMAGE_DATA_TYPE_FLOAT:
+			return kg->texture_float1_images[index].interp(x, y);
+		case IMAGE_DATA_TYPE_BYTE:
+			return kg->texture_byte1_images[index].interp(x, y);
+		case IMAGE_DATA_TYPE_HALF:
+			return kg->texture_half1_images[index].interp(x, y);
+		default:
+			return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+}
+
+/* Negative interpolation uses the interpolation of the image. */
+ccl_device_inline float4 kernel_tex_image_interp_3d_cpu(KernelGlobals *kg, int tex, float x, float y, float z, int interpolation)
+{
+	const int index = tex % TEX_NUM_IMAGES_CPU;
+
+#define IMAGE_INTERP_3D(images) \
+	((interpolation < 0)? \
+	    kg->images[index].interp_3d(x, y, z): \
+	    kg->images[index].interp_3d_ex(x, y, z, interpolation))
+
+	switch(tex / TEX_NUM_IMAGES_CPU) {
+		case IMAGE_DATA_TYPE_FLOAT4:
+			return IMAGE_INTERP_3D(texture_float_images);
+		case IMAGE_DATA_TYPE_BYTE4:
+			return IMAGE_INTERP_3D(texture_byte_images);
+		case IMAGE_DATA_TYPE_HALF4:
+			return IMAGE_INTERP_3D(texture_half4_images);
+		case IMAGE_DATA_TYPE_FLOAT:
+			return IMAGE_INTERP_3D(texture_float1_images);
+		case IMAGE_DATA_TYPE_BYTE:
+			return IMAGE_INTERP_3D(texture_byte1_images);
+		case IMAGE_DATA_TYPE_HALF:
+			return IMAGE_INTERP_3D(texture_half1_images);
+		default:
+			return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+
+#undef IMAGE_INTERP_3D
+}
+
 #endif
 
 /* For CUDA, constant memory textures must be globals, so we can't put them
@@ -90,6 +157,16 @@ typedef ccl_addr_space struct KernelGlobals {
 
 #endif
 
+/* Performance counters, only kept on the CPU where every thread has its own
+ * KernelGlobals. On the GPU they would need atomics. BVH traversal counts
+ * in locals and adds once per ray, see BVH_COUNTERS_BEGIN. */
+
+#ifdef __KERNEL_CPU__
+#  define kernel_counter_add(kg, counter, n) ((kg)->counters.counter += (n))
+#else
+#  define kernel_counter_add(kg, counter, n) ((void)0)
+#endif
+
 /* Interpolated lookup table access */
 
 ccl_device float lookup_table_read(KernelGlobals *kg, float x, int offset, int size)
@@ -791,10 +791,9 @@ ccl_device void triangle_light_sample(KernelGlobals *kg, int prim, int object,
 	object_transform_light_sample(kg, ls, object, time);
 }
 
-ccl_device float triangle_light_pdf(KernelGlobals *kg,
-	const float3 Ng, const float3 I, float t)
+ccl_device float triangle_light_pdf_area(KernelGlobals *kg,
+	const float3 Ng, const float3 I, float t, float pdf)
 {
-	float pdf = kernel_data.integrator.pdf_triangles;
 	float cos_pi = fabsf(dot(Ng, I));
 
 	if(cos_pi == 0.0f)
@@ -803,6 +802,12 @@ ccl_device float triangle_light_pdf(KernelGlobals *kg,
 	return t*t*pdf/cos_pi;
 }
 
+ccl_device float triangle_light_pdf(KernelGlobals *kg,
+	const float3 Ng, const float3 I, float t)
+{
+	return triangle_light_pdf_area(kg, Ng, I, t, kernel_data.integrator.pdf_triangles);
+}
+
 /* Light Distribution */
 
 ccl_device int light_distribution_sample(KernelGlobals *kg, float randt)
@@ -832,6 +837,203 @@ ccl_device int light_distribution_sample(KernelGlobals *kg, float randt)
 	return clamp(first-1, 0, kernel_data.integrator.num_distribution-1);
 }
 
+/* Light Tree
+ *
+ * Picks lamps and emissive triangles based on their energy, distance and
+ * orientation to the shading point, see render/light_tree.h. Every node is
+ * LIGHT_TREE_NODE_SIZE float4:
+ *
+ *   bounds min, energy
+ *   bounds max, theta_o
+ *   cone axis, theta_e
+ *   left child or ~distribution index for leaf nodes, right child
+ *
+ * Lamps at infinity have no position, they are the last num_infinite_lights
+ * entries of the light distribution and are picked with the same probability
+ * as without the tree. */
+
+ccl_device float light_tree_node_importance(KernelGlobals *kg, float3 P, int node)
+{
+	float4 data0 = kernel_tex_fetch(__light_tree, node*LIGHT_TREE_NODE_SIZE + 0);
+	float4 data1 = kernel_tex_fetch(__light_tree, node*LIGHT_TREE_NODE_SIZE + 1);
+	float4 data2 = kernel_tex_fetch(__light_tree, node*LIGHT_TREE_NODE_SIZE + 2);
+
+	float energy = data0.w;
+
+	if(energy == 0.0f)
+		return 0.0f;
+
+	float3 bmin = make_float3(data0.x, data0.y, data0.z);
+	float3 bmax = make_float3(data1.x, data1.y, data1.z);
+	float3 V = P - 0.5f*(bmin + bmax);
+	float d2 = len_squared(V);
+	float r2 = 0.25f*len_squared(bmax - bmin);
+
+	/* inside the bounding sphere the distance is clamped to its radius, and
+	 * every emitter may be facing the shading point */
+	if(d2 <= r2)
+		return energy/max(r2, 1e-8f);
+
+	float theta_o = data1.w;
+	float theta_e = data2.w;
+	float orientation = 1.0f;
+
+	if(theta_o < M_PI_F) {
+		/* smallest angle between the emission cone and the bounds as seen
+		 * from the shading point, no light is emitted past theta_e */
+		float3 axis = make_float3(data2.x, data2.y, data2.z);
+		float theta = safe_acosf(dot(axis, V)/sqrtf(d2));
+		float theta_u = asinf(sqrtf(r2/d2));
+		float theta_i = max(theta - theta_o - theta_u, 0.0f);
+
+		if(theta_i >= theta_e)
+			return 0.0f;
+
+		orientation = cosf(theta_i);
+	}
+
+	return energy*orientation/d2;
+}
+
+ccl_device float light_tree_left_probability(KernelGlobals *kg, float3 P, int left, int right)
+{
+	float importance_left = light_tree_node_importance(kg, P, left);
+	float importance_right = light_tree_node_importance(kg, P, right);
+
+	/* shading point is outside the emission cones of both children */
+	if(importance_left + importance_right == 0.0f) {
+		importance_left = kernel_tex_fetch(__light_tree, left*LIGHT_TREE_NODE_SIZE).w;
+		importance_right = kernel_tex_fetch(__light_tree, right*LIGHT_TREE_NODE_SIZE).w;
+	}
+
+	float total = importance_left + importance_right;
+
+	return (total > 0.0f)? importance_left/total: 0.5f;
+}
+
+/* Returns the index in the light distribution, with the probability of
+ * picking it and the energy of the leaf node, which is the area for
+ * triangles. randt is rescaled at every node to pick the next child. */
+ccl_device int light_tree_sample(KernelGlobals *kg, float randt, float3 P, float *pdf, float *energy)
+{
+	int num_infinite = kernel_data.integrator.num_infinite_lights;
+	float infinite_pdf = num_infinite*kernel_data.integrator.pdf_lights;
+
+	if(randt < infinite_pdf) {
+		int index = min((int)(randt/infinite_pdf*num_infinite), num_infinite - 1);
+
+		*pdf = kernel_data.integrator.pdf_lights;
+		*energy = 0.0f;
+
+		return kernel_data.integrator.num_distribution - num_infinite + index;
+	}
+
+	randt = (randt - infinite_pdf)/(1.0f - infinite_pdf);
+	*pdf = 1.0f - infinite_pdf;
+
+	int node = 0;
+
+	for(;;) {
+		float4 data3 = kernel_tex_fetch(__light_tree, node*LIGHT_TREE_NODE_SIZE + 3);
+		int left = __float_as_int(data3.x);
+
+		if(left < 0) {
+			*energy = kernel_tex_fetch(__light_tree, node*LIGHT_TREE_NODE_SIZE).w;
+			return ~left;
+		}
+
+		int right = __float_as_int(data3.y);
+		float prob = light_tree_left_probability(kg, P, left, right);
+
+		if(randt < prob) {
+			randt = randt/prob;
+			*pdf *= prob;
+			node = left;
+		}
+		else {
+			randt = (randt - prob)/(1.0f - prob);
+			*pdf *= 1.0f - prob;
+			node = right;
+		}
+	}
+}
+
+ccl_device_inline bool light_tree_node_contains(KernelGlobals *kg, int node, float3 P)
+{
+	float4 data0 = kernel_tex_fetch(__light_tree, node*LIGHT_TREE_NODE_SIZE + 0);
+	float4 data1 = kernel_tex_fetch(__light_tree, node*LIGHT_TREE_NODE_SIZE + 1);
+
+	float3 bmin = make_float3(data0.x, data0.y, data0.z);
+	float3 bmax = make_float3(data1.x, data1.y, data1.z);
+
+	/* tolerance for intersection points slightly off the triangle */
+	float eps = 1e-5f*(len(bmin) + len(bmax)) + 1e-4f*len(bmax - bmin);
+
+	return P.x >= bmin.x - eps && P.y >= bmin.y - eps && P.z >= bmin.z - eps &&
+	       P.x <= bmax.x + eps && P.y <= bmax.y + eps && P.z <= bmax.z + eps;
+}
+
+/* Probability per unit area of sampling the emissive triangle hit at P_hit
+ * from P, for multiple importance sampling. The leaf of the triangle is found
+ * by descending into all nodes containing P_hit. */
+ccl_device float light_tree_triangle_pdf(KernelGlobals *kg, float3 P, float3 P_hit, int object, int prim)
+{
+	int stack_node[LIGHT_TREE_STACK_SIZE];
+	float stack_pdf[LIGHT_TREE_STACK_SIZE];
+	int stack_ptr = 0;
+
+	int node = 0;
+	float pdf = 1.0f - kernel_data.integrator.num_infinite_lights*kernel_data.integrator.pdf_lights;
+
+	for(;;) {
+		float4 data3 = kernel_tex_fetch(__light_tree, node*LIGHT_TREE_NODE_SIZE + 3);
+		int left = __float_as_int(data3.x);
+
+		if(left < 0) {
+			float4 l = kernel_tex_fetch(__light_distribution, ~left);
+			int lobject = __float_as_int(l.w);
+
+			if(__float_as_int(l.y) == prim && (lobject == object || ~lobject == object)) {
+				float area = kernel_tex_fetch(__light_tree, node*LIGHT_TREE_NODE_SIZE).w;
+				return (area > 0.0f)? pdf/area: 0.0f;
+			}
+		}
+		else {
+			int right = __float_as_int(data3.y);
+			bool visit_left = light_tree_node_contains(kg, left, P_hit);
+			bool visit_right = light_tree_node_contains(kg, right, P_hit);
+
+			if(visit_left || visit_right) {
+				float prob = light_tree_left_probability(kg, P, left, right);
+
+				if(visit_left && visit_right) {
+					kernel_assert(stack_ptr < LIGHT_TREE_STACK_SIZE);
+					stack_node[stack_ptr] = right;
+					stack_pdf[stack_ptr] = pdf*(1.0f - prob);
+					stack_ptr++;
+				}
+
+				if(visit_left) {
+					pdf *= prob;
+					node = left;
+				}
+				else {
+					pdf *= 1.0f - prob;
+					node = right;
+				}
+				continue;
+			}
+		}
+
+		if(stack_ptr == 0)
+			return 0.0f;
+
+		stack_ptr--;
+		node = stack_node[stack_ptr];
+		pdf = stack_pdf[stack_ptr];
+	}
+}
+
 /* Generic Light */
 
 ccl_device bool light_select_reached_max_bounces(KernelGlobals *kg, int index, int bounce)
@@ -843,7 +1045,13 @@ ccl_device bool light_select_reached_max_bounces(KernelGlobals *kg, int index, i
 ccl_device void light_sample(KernelGlobals *kg, float randt, float randu, float randv, float time, float3 P, int bounce, LightSample *ls)
 {
 	/* sample index */
-	int index = light_distribution_sample(kg, randt);
+	int index;
+	float tree_pdf = 0.0f, tree_energy = 0.0f;
+
+	if(kernel_data.integrator.use_light_tree)
+		index = light_tree_sample(kg, randt, P, &tree_pdf, &tree_energy);
+	else
+		index = light_distribution_sample(kg, randt);
 
 	/* fetch light data */
 	float4 l = kernel_tex_fetch(__light_distribution, index);
@@ -857,7 +1065,13 @@ ccl_device void light_sample(KernelGlobals *kg, float randt, float randu, float
 
 		/* compute incoming direction, distance and pdf */
 		ls->D = normalize_len(ls->P - P, &ls->t);
-		ls->pdf = triangle_light_pdf(kg, ls->Ng, -ls->D, ls->t);
+		if(kernel_data.integrator.use_light_tree) {
+			float area_pdf = (tree_energy > 0.0f)? tree_pdf/tree_energy: 0.0f;
+			ls->pdf = triangle_light_pdf_area(kg, ls->Ng, -ls->D, ls->t, area_pdf);
+		}
+		else {
+			ls->pdf = triangle_light_pdf(kg, ls->Ng, -ls->D, ls->t);
+		}
 		ls->shader |= shader_flag;
 	}
 	else {
@@ -869,6 +1083,16 @@ ccl_device void light_sample(KernelGlobals *kg, float randt, float randu, float
 		}
 
 		lamp_light_sample(kg, lamp, randu, randv, P, ls);
+
+		/* lamp evaluation is scaled by the inverse of the flat selection
+		 * probability, lamps at infinity have the same probability with the
+		 * light tree */
+		if(kernel_data.integrator.use_light_tree && ls->t != FLT_MAX) {
+			if(tree_pdf > 0.0f)
+				ls->eval_fac *= kernel_data.integrator.pdf_lights/tree_pdf;
+			else
+				ls->pdf = 0.0f;
+		}
 	}
 }
 
@@ -30,6 +30,7 @@
 #include "kernel_shader.h"
 #include "kernel_light.h"
 #include "kernel_passes.h"
+#include "kernel_adaptive_sampling.h"
 
 #ifdef __SUBSURFACE__
 #include "kernel_subsurface.h"
@@ -430,7 +431,8 @@ ccl_device bool kernel_path_subsurface_scatter(KernelGlobals *kg, ShaderData *sd
 }
 #endif
 
-ccl_device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, Ray ray, ccl_global float *buffer)
+ccl_device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample, Ray ray, ccl_global float *buffer,
+	const Intersection *camera_isect)
 {
 	/* initialize */
 	PathRadiance L;
@@ -467,11 +469,23 @@ ccl_device float4 kernel_path_integrate(KernelGlobals *kg, RNG *rng, int sample,
 			extmax = kernel_data.curve.maximum_width;
 			lcg_state = lcg_state_init(rng, &state, 0x51633e2d);
 		}
+#endif
+
+		bool hit;
 
-		bool hit = scene_intersect(kg, &ray, visibility, &isect, &lcg_state, difl, extmax);
+		if(camera_isect) {
+			/* camera ray was already intersected, by camera packet traversal */
+			isect = *camera_isect;
+			hit = (isect.prim != PRIM_NONE);
+			camera_isect = NULL;
+		}
+		else {
+#ifdef __HAIR__
+			hit = scene_intersect(kg, &ray, visibility, &isect, &lcg_state, difl, extmax);
 #else
-		bool hit = scene_intersect(kg, &ray, visibility, &isect, NULL, 0.0f, 0.0f);
+			hit = scene_intersect(kg, &ray, visibility, &isect, NULL, 0.0f, 0.0f);
 #endif
+		}
 
 #ifdef __KERNEL_DEBUG__
 		if(state.flag & PATH_RAY_CAMERA) {
@@ -832,7 +846,8 @@ ccl_device void kernel_branched_path_subsurface_scatter(KernelGlobals *kg,
 }
 #endif
 
-ccl_device float4 kernel_branched_path_integrate(KernelGlobals *kg, RNG *rng, int sample, Ray ray, ccl_global float *buffer)
+ccl_device float4 kernel_branched_path_integrate(KernelGlobals *kg, RNG *rng, int sample, Ray ray, ccl_global float *buffer,
+	const Intersection *camera_isect)
 {
 	/* initialize */
 	PathRadiance L;
@@ -868,11 +883,23 @@ ccl_device float4 kernel_branched_path_integrate(KernelGlobals *kg, RNG *rng, in
 			extmax = kernel_data.curve.maximum_width;
 			lcg_state = lcg_state_init(rng, &state, 0x51633e2d);
 		}
+#endif
+
+		bool hit;
 
-		bool hit = scene_intersect(kg, &ray, visibility, &isect, &lcg_state, difl, extmax);
+		if(camera_isect) {
+			/* camera ray was already intersected, by camera packet traversal */
+			isect = *camera_isect;
+			hit = (isect.prim != PRIM_NONE);
+			camera_isect = NULL;
+		}
+		else {
+#ifdef __HAIR__
+			hit = scene_intersect(kg, &ray, visibility, &isect, &lcg_state, difl, extmax);
 #else
-		bool hit = scene_intersect(kg, &ray, visibility, &isect, NULL, 0.0f, 0.0f);
+			hit = scene_intersect(kg, &ray, visibility, &isect, NULL, 0.0f, 0.0f);
 #endif
+		}
 
 #ifdef __KERNEL_DEBUG__
 		if(state.flag & PATH_RAY_CAMERA) {
@@ -1155,6 +1182,9 @@ ccl_device void kernel_path_trace(KernelGlobals *kg,
 	rng_state += index;
 	buffer += index*pass_stride;
 
+	if(kernel_adaptive_sampling_use(kg) && kernel_adaptive_sampling_converged(kg, buffer, sample))
+		return;
+
 	/* initialize random numbers and ray */
 	RNG rng;
 	Ray ray;
@@ -1165,13 +1195,16 @@ ccl_device void kernel_path_trace(KernelGlobals *kg,
 	float4 L;
 
 	if(ray.t != 0.0f)
-		L = kernel_path_integrate(kg, &rng, sample, ray, buffer);
+		L = kernel_path_integrate(kg, &rng, sample, ray, buffer, NULL);
 	else
 		L = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
 
 	/* accumulate result in output buffer */
 	kernel_write_pass_float4(buffer, sample, L);
 
+	if(kernel_adaptive_sampling_use(kg))
+		kernel_write_adaptive_sampling_passes(kg, buffer, sample, L);
+
 	path_rng_end(kg, rng_state, rng);
 }
 
@@ -1187,6 +1220,9 @@ ccl_device void kernel_branched_path_trace(KernelGlobals *kg,
 	rng_state += index;
 	buffer += index*pass_stride;
 
+	if(kernel_adaptive_sampling_use(kg) && kernel_adaptive_sampling_converged(kg, buffer, sample))
+		return;
+
 	/* initialize random numbers and ray */
 	RNG rng;
 	Ray ray;
@@ -1197,16 +1233,95 @@ ccl_device void kernel_branched_path_trace(KernelGlobals *kg,
 	float4 L;
 
 	if(ray.t != 0.0f)
-		L = kernel_branched_path_integrate(kg, &rng, sample, ray, buffer);
+		L = kernel_branched_path_integrate(kg, &rng, sample, ray, buffer, NULL);
 	else
 		L = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
 
 	/* accumulate result in output buffer */
 	kernel_write_pass_float4(buffer, sample, L);
 
+	if(kernel_adaptive_sampling_use(kg))
+		kernel_write_adaptive_sampling_passes(kg, buffer, sample, L);
+
 	path_rng_end(kg, rng_state, rng);
 }
 #endif
 
+#ifdef __KERNEL_CPU__
+/* Camera packet mode, for coherent camera rays. A block of up to QBVH_PACKET_SIZE
+ * neighbouring pixels is set up and intersected with the scene together, and
+ * then shaded one after another starting from the found intersections. Only
+ * camera rays are traced as packets, shadow and indirect rays are traced per
+ * path as usual. */
+ccl_device void kernel_path_trace_camera_packet(KernelGlobals *kg,
+	ccl_global float *buffer, ccl_global uint *rng_state,
+	int sample, int x, int y, int w, int h, int offset, int stride)
+{
+#ifdef __QBVH__
+	if(w*h <= QBVH_PACKET_SIZE && scene_intersect_packet_supported(kg)) {
+		int pass_stride = kernel_data.film.pass_stride;
+		int index[QBVH_PACKET_SIZE];
+		RNG rng[QBVH_PACKET_SIZE];
+		Ray ray[QBVH_PACKET_SIZE];
+		Intersection isect[QBVH_PACKET_SIZE];
+		int num = 0;
+		bool use_adaptive_sampling = kernel_adaptive_sampling_use(kg);
+
+		/* initialize random numbers and rays, skipping converged pixels */
+		for(int py = y; py < y + h; py++) {
+			for(int px = x; px < x + w; px++) {
+				index[num] = offset + px + py*stride;
+				if(use_adaptive_sampling && kernel_adaptive_sampling_converged(kg, buffer + index[num]*pass_stride, sample))
+					continue;
+				kernel_path_trace_setup(kg, rng_state + index[num], sample, px, py, &rng[num], &ray[num]);
+				num++;
+			}
+		}
+
+		/* intersect all camera rays together */
+		uint visibility = PATH_RAY_CAMERA | kernel_data.integrator.layer_flag;
+		scene_intersect_packet(kg, ray, isect, num, visibility);
+
+		/* integrate */
+		for(int i = 0; i < num; i++) {
+			ccl_global float *pixel_buffer = buffer + index[i]*pass_stride;
+			float4 L;
+
+			if(ray[i].t == 0.0f)
+				L = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+#ifdef __BRANCHED_PATH__
+			else if(kernel_data.integrator.branched)
+				L = kernel_branched_path_integrate(kg, &rng[i], sample, ray[i], pixel_buffer, &isect[i]);
+#endif
+			else
+				L = kernel_path_integrate(kg, &rng[i], sample, ray[i], pixel_buffer, &isect[i]);
+
+			/* accumulate result in output buffer */
+			kernel_write_pass_float4(pixel_buffer, sample, L);
+
+			if(use_adaptive_sampling)
+				kernel_write_adaptive_sampling_passes(kg, pixel_buffer, sample, L);
+
+			path_rng_end(kg, rng_state + index[i], rng[i]);
+		}
+
+		return;
+	}
+#endif
+
+	/* fall back to tracing pixel by pixel */
+	for(int py = y; py < y + h; py++) {
+		for(int px = x; px < x + w; px++) {
+#ifdef __BRANCHED_PATH__
+			if(kernel_data.integrator.branched)
+				kernel_branched_path_trace(kg, buffer, rng_state, sample, px, py, offset, stride);
+			else
+#endif
+				kernel_path_trace(kg, buffer, rng_state, sample, px, py, offset, stride);
+		}
+	}
+}
+#endif
+
 CCL_NAMESPACE_END
 
@@ -45,6 +45,7 @@ ccl_device_inline void kernel_path_trace_setup(KernelGlobals *kg,
 #endif
 
 	camera_sample(kg, x, y, filter_u, filter_v, lens_u, lens_v, time, ray);
+	kernel_counter_add(kg, camera_rays, 1);
 }
 
 CCL_NAMESPACE_END
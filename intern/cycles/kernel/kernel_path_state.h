@@ -53,6 +53,8 @@ ccl_device_inline void path_state_init(KernelGlobals *kg, ccl_addr_space PathSta
 
 ccl_device_inline void path_state_next(KernelGlobals *kg, ccl_addr_space PathState *state, int label)
 {
+	kernel_counter_add(kg, bounces, 1);
+
 	/* ray through transparent keeps same flags from previous ray and is
 	 * not counted as a regular bounce, transparent has separate max */
 	if(label & LABEL_TRANSPARENT) {
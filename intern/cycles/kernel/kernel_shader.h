@@ -787,6 +787,8 @@ ccl_device float3 shader_holdout_eval(KernelGlobals *kg, ShaderData *sd)
 ccl_device void shader_eval_surface(KernelGlobals *kg, ShaderData *sd,
 	float randb, int path_flag, ShaderContext ctx)
 {
+	kernel_counter_add(kg, shader_evals, 1);
+
 	ccl_fetch(sd, num_closure) = 0;
 	ccl_fetch(sd, randb_closure) = randb;
 
@@ -812,6 +814,8 @@ ccl_device void shader_eval_surface(KernelGlobals *kg, ShaderData *sd,
 
 ccl_device float3 shader_eval_background(KernelGlobals *kg, ShaderData *sd, int path_flag, ShaderContext ctx)
 {
+	kernel_counter_add(kg, shader_evals, 1);
+
 	ccl_fetch(sd, num_closure) = 0;
 	ccl_fetch(sd, randb_closure) = 0.0f;
 
@@ -953,6 +957,8 @@ ccl_device int shader_phase_sample_closure(KernelGlobals *kg, const ShaderData *
 ccl_device void shader_eval_volume(KernelGlobals *kg, ShaderData *sd,
 	VolumeStack *stack, int path_flag, ShaderContext ctx)
 {
+	kernel_counter_add(kg, shader_evals, 1);
+
 	/* reset closures once at the start, we will be accumulating the closures
 	 * for all volumes in the stack into a single array of closures */
 	sd->num_closure = 0;
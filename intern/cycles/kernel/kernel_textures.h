@@ -25,6 +25,7 @@
 /* bvh */
 KERNEL_TEX(float4, texture_float4, __bvh_nodes)
 KERNEL_TEX(float4, texture_float4, __bvh_leaf_nodes)
+KERNEL_TEX(float4, texture_float4, __bvh_time_nodes)
 KERNEL_TEX(float4, texture_float4, __tri_woop)
 KERNEL_TEX(uint, texture_uint, __prim_type)
 KERNEL_TEX(uint, texture_uint, __prim_visibility)
@@ -55,6 +56,7 @@ KERNEL_TEX(uchar4, texture_uchar4, __attributes_uchar4)
 /* lights */
 KERNEL_TEX(float4, texture_float4, __light_distribution)
 KERNEL_TEX(float4, texture_float4, __light_data)
+KERNEL_TEX(float4, texture_float4, __light_tree)
 KERNEL_TEX(float2, texture_float2, __light_background_marginal_cdf)
 KERNEL_TEX(float2, texture_float2, __light_background_conditional_cdf)
 
@@ -66,13 +68,18 @@ KERNEL_TEX(uint4, texture_uint4, __svm_nodes)
 KERNEL_TEX(uint, texture_uint, __shader_flag)
 KERNEL_TEX(uint, texture_uint, __object_flag)
 
+/* volume acceleration grid */
+KERNEL_TEX(float4, texture_float4, __volume_grid)
+KERNEL_TEX(float, texture_float, __volume_grid_cells)
+
 /* lookup tables */
 KERNEL_TEX(float, texture_float, __lookup_table)
 
 /* sobol */
 KERNEL_TEX(uint, texture_uint, __sobol_directions)
 
-/* full-float image */
+/* full-float image, half float and single channel images are only
+ * supported on the CPU and stored in KernelGlobals */
 KERNEL_IMAGE_TEX(float4, texture_image_float4, __tex_image_float_000)
 KERNEL_IMAGE_TEX(float4, texture_image_float4, __tex_image_float_001)
 KERNEL_IMAGE_TEX(float4, texture_image_float4, __tex_image_float_002)
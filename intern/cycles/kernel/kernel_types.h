@@ -34,9 +34,12 @@
 CCL_NAMESPACE_BEGIN
 
 /* constants */
-#define OBJECT_SIZE 		11
+#define OBJECT_SIZE 		8
 #define OBJECT_VECTOR_SIZE	6
+#define VOLUME_GRID_OBJECT_SIZE	4
 #define LIGHT_SIZE			5
+#define LIGHT_TREE_NODE_SIZE	4
+#define LIGHT_TREE_STACK_SIZE	64
 #define FILTER_TABLE_SIZE	256
 #define RAMP_TABLE_SIZE		256
 #define PARTICLE_SIZE 		5
@@ -49,6 +52,10 @@ CCL_NAMESPACE_BEGIN
 
 #define TEX_NUM_FLOAT_IMAGES	5
 
+/* On the CPU every image data type has its own range of slots, starting at
+ * type * TEX_NUM_IMAGES_CPU, see ImageDataType. */
+#define TEX_NUM_IMAGES_CPU		1024
+
 #define SHADER_NONE				(~0)
 #define OBJECT_NONE				(~0)
 #define PRIM_NONE				(~0)
@@ -61,6 +68,9 @@ CCL_NAMESPACE_BEGIN
 #ifdef __KERNEL_SSE2__
 #  define __QBVH__
 #endif
+#ifdef __KERNEL_AVX2__
+#  define __OBVH__
+#endif
 #define __KERNEL_SHADING__
 #define __KERNEL_ADV_SHADING__
 #define __BRANCHED_PATH__
@@ -72,6 +82,7 @@ CCL_NAMESPACE_BEGIN
 #define __VOLUME__
 #define __VOLUME_DECOUPLED__
 #define __VOLUME_SCATTER__
+#define __VOLUME_GRID__
 #define __SHADOW_RECORD_ALL__
 #define __VOLUME_RECORD_ALL__
 #endif
@@ -343,6 +354,8 @@ typedef enum PassType {
 #ifdef __KERNEL_DEBUG__
 	PASS_BVH_TRAVERSAL_STEPS = (1 << 26),
 #endif
+	PASS_ADAPTIVE_AUX_BUFFER = (1 << 27), /* no output, half sample buffer and converged flag */
+	PASS_SAMPLE_COUNT = (1 << 28), /* no output, samples per pixel with adaptive sampling */
 } PassType;
 
 #define PASS_ALL (~0)
@@ -563,6 +576,7 @@ typedef enum AttributeStandard {
 	ATTR_STD_MOTION_VERTEX_POSITION,
 	ATTR_STD_MOTION_VERTEX_NORMAL,
 	ATTR_STD_PARTICLE,
+	ATTR_STD_DUPLI,
 	ATTR_STD_CURVE_INTERCEPT,
 	ATTR_STD_PTEX_FACE_ID,
 	ATTR_STD_PTEX_UV,
@@ -851,6 +865,10 @@ typedef struct KernelFilm {
 	float mist_inv_depth;
 	float mist_falloff;
 
+	int pass_adaptive_aux_buffer;
+	int pass_sample_count;
+	int pass_pad6, pass_pad7;
+
 #ifdef __KERNEL_DEBUG__
 	int pass_bvh_traversal_steps;
 	int pass_pad3, pass_pad4, pass_pad5;
@@ -939,7 +957,14 @@ typedef struct KernelIntegrator {
 	float volume_step_size;
 	int volume_samples;
 
-	int pad;
+	/* adaptive sampling */
+	float adaptive_threshold;
+	int adaptive_min_samples;
+	int adaptive_step;
+
+	/* light tree */
+	int use_light_tree;
+	int num_infinite_lights;
 } KernelIntegrator;
 
 typedef struct KernelBVH {
@@ -950,7 +975,10 @@ typedef struct KernelBVH {
 	int have_curves;
 	int have_instancing;
 	int use_qbvh;
-	int pad1, pad2;
+	int use_obvh;
+	int use_time_bounds;
+	int have_volume_grid;
+	int pad1, pad2, pad3;
 } KernelBVH;
 
 typedef enum CurveFlag {
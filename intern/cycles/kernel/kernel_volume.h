@@ -146,6 +146,60 @@ ccl_device int volume_stack_sampling_method(KernelGlobals *kg, VolumeStack *stac
 	return method;
 }
 
+#ifdef __VOLUME_GRID__
+
+/* Empty space skipping with the acceleration grids of the objects in the
+ * volume stack. Returns if the volume is empty at distance t, and up to which
+ * distance it is empty or occupied. The world volume is never empty. */
+ccl_device bool kernel_volume_grid_empty(KernelGlobals *kg, VolumeStack *stack, Ray *ray, float t, float *t_next)
+{
+	float t_empty = ray->t;
+	float t_occupied = ray->t;
+	bool empty = true;
+
+	for(int i = 0; stack[i].shader != SHADER_NONE; i++) {
+		int object = stack[i].object;
+
+		if(object == OBJECT_NONE) {
+			*t_next = ray->t;
+			return false;
+		}
+
+		bool object_empty;
+		float object_t = volume_grid_traverse(kg, object, ray, t, ray->t, &object_empty);
+
+		if(object_empty) {
+			t_empty = min(t_empty, object_t);
+		}
+		else {
+			t_occupied = min(t_occupied, object_t);
+			empty = false;
+		}
+	}
+
+	*t_next = (empty)? t_empty: t_occupied;
+	return empty;
+}
+
+/* Index of the first step from step i that is not entirely in empty space,
+ * max_steps if the rest of the ray is empty. The grid is only queried again
+ * once stepping passes grid_t. */
+ccl_device int kernel_volume_grid_next_step(KernelGlobals *kg, PathState *state, Ray *ray,
+	float t, int i, float step_size, int max_steps, bool *grid_empty, float *grid_t)
+{
+	if(t >= *grid_t)
+		*grid_empty = kernel_volume_grid_empty(kg, state->volume_stack, ray, t, grid_t);
+
+	if(!*grid_empty)
+		return i;
+	if(*grid_t >= ray->t)
+		return max_steps;
+
+	return max(i, (int)min(*grid_t / step_size, (float)max_steps));
+}
+
+#endif
+
 /* Volume Shadows
  *
  * These functions are used to attenuate shadow rays to lights. Both absorption
@@ -178,7 +232,32 @@ ccl_device void kernel_volume_shadow_heterogeneous(KernelGlobals *kg, PathState
 
 	float3 sum = make_float3(0.0f, 0.0f, 0.0f);
 
+#ifdef __VOLUME_GRID__
+	bool use_grid = kernel_data.bvh.have_volume_grid;
+	bool grid_empty = false;
+	float grid_t = 0.0f;
+#endif
+
 	for(int i = 0; i < max_steps; i++) {
+#ifdef __VOLUME_GRID__
+		if(use_grid) {
+			int next_i = kernel_volume_grid_next_step(kg, state, ray, t, i, step, max_steps, &grid_empty, &grid_t);
+
+			if(next_i > i) {
+				/* skipped steps count towards the maximum like shaded ones */
+				i = next_i - 1;
+				t = min(ray->t, next_i * step);
+
+				if(t == ray->t || next_i == max_steps) {
+					tp = *throughput * make_float3(expf(sum.x), expf(sum.y), expf(sum.z));
+					break;
+				}
+
+				continue;
+			}
+		}
+#endif
+
 		/* advance to new position */
 		float new_t = min(ray->t, (i+1) * step);
 		float dt = new_t - t;
@@ -447,7 +526,30 @@ ccl_device VolumeIntegrateResult kernel_volume_integrate_heterogeneous_distance(
 	sd->randb_closure = rphase*3.0f - channel;
 	bool has_scatter = false;
 
+#ifdef __VOLUME_GRID__
+	bool use_grid = kernel_data.bvh.have_volume_grid;
+	bool grid_empty = false;
+	float grid_t = 0.0f;
+#endif
+
 	for(int i = 0; i < max_steps; i++) {
+#ifdef __VOLUME_GRID__
+		if(use_grid) {
+			int next_i = kernel_volume_grid_next_step(kg, state, ray, t, i, step_size, max_steps, &grid_empty, &grid_t);
+
+			if(next_i > i) {
+				/* skipped steps count towards the maximum like shaded ones */
+				i = next_i - 1;
+				t = min(ray->t, next_i * step_size);
+
+				if(t == ray->t)
+					break;
+
+				continue;
+			}
+		}
+#endif
+
 		/* advance to new position */
 		float new_t = min(ray->t, (i+1) * step_size);
 		float dt = new_t - t;
@@ -653,7 +755,47 @@ ccl_device void kernel_volume_decoupled_record(KernelGlobals *kg, PathState *sta
 
 	VolumeStep *step = segment->steps;
 
+#ifdef __VOLUME_GRID__
+	bool use_grid = heterogeneous && kernel_data.bvh.have_volume_grid;
+	bool grid_empty = false;
+	float grid_t = 0.0f;
+#endif
+
 	for(int i = 0; i < max_steps; i++, step++) {
+#ifdef __VOLUME_GRID__
+		if(use_grid) {
+			int next_i = kernel_volume_grid_next_step(kg, state, ray, t, i, step_size, max_steps, &grid_empty, &grid_t);
+
+			if(next_i > i) {
+				/* record the skipped steps as one empty step */
+				if(is_last_step_empty) {
+					step--;
+				}
+				else {
+					step->sigma_t = make_float3(0.0f, 0.0f, 0.0f);
+					step->sigma_s = make_float3(0.0f, 0.0f, 0.0f);
+					step->closure_flag = 0;
+
+					segment->numsteps++;
+					is_last_step_empty = true;
+				}
+
+				i = next_i - 1;
+				t = min(ray->t, next_i * step_size);
+
+				step->accum_transmittance = accum_transmittance;
+				step->cdf_distance = cdf_distance;
+				step->t = t;
+				step->shade_t = i * step_size + random_jitter_offset;
+
+				if(t == ray->t)
+					break;
+
+				continue;
+			}
+		}
+#endif
+
 		/* advance to new position */
 		float new_t = min(ray->t, (i+1) * step_size);
 		float dt = new_t - t;
@@ -29,6 +29,50 @@ CCL_NAMESPACE_BEGIN
 
 /* Memory Copy */
 
+template<typename T>
+static void kernel_tex_image_assign(texture_image<T> *tex, device_ptr mem, size_t width, size_t height, size_t depth, InterpolationType interpolation, TextureCache *cache, TextureCacheHandle *handle)
+{
+	tex->data = (T*)mem;
+	tex->dimensions_set(width, height, depth);
+	tex->interpolation = interpolation;
+	tex->cache = cache;
+	tex->cache_handle = handle;
+}
+
+/* Image textures are named "__tex_image_<type>_<slot>", with the slot
+ * flattened over all image data types, see kernel_tex_image_interp_cpu(). */
+static void kernel_tex_image_set(KernelGlobals *kg, const char *name, device_ptr mem, size_t width, size_t height, size_t depth, InterpolationType interpolation, TextureCache *cache, TextureCacheHandle *handle)
+{
+	const char *number = strrchr(name, '_');
+	int slot = (number)? atoi(number + 1): -1;
+
+	if(slot < 0 || slot >= IMAGE_DATA_NUM_TYPES*TEX_NUM_IMAGES_CPU)
+		return;
+
+	int index = slot % TEX_NUM_IMAGES_CPU;
+
+	switch(slot / TEX_NUM_IMAGES_CPU) {
+		case IMAGE_DATA_TYPE_FLOAT4:
+			kernel_tex_image_assign(&kg->texture_float_images[index], mem, width, height, depth, interpolation, cache, handle);
+			break;
+		case IMAGE_DATA_TYPE_BYTE4:
+			kernel_tex_image_assign(&kg->texture_byte_images[index], mem, width, height, depth, interpolation, cache, handle);
+			break;
+		case IMAGE_DATA_TYPE_HALF4:
+			kernel_tex_image_assign(&kg->texture_half4_images[index], mem, width, height, depth, interpolation, cache, handle);
+			break;
+		case IMAGE_DATA_TYPE_FLOAT:
+			kernel_tex_image_assign(&kg->texture_float1_images[index], mem, width, height, depth, interpolation, cache, handle);
+			break;
+		case IMAGE_DATA_TYPE_BYTE:
+			kernel_tex_image_assign(&kg->texture_byte1_images[index], mem, width, height, depth, interpolation, cache, handle);
+			break;
+		case IMAGE_DATA_TYPE_HALF:
+			kernel_tex_image_assign(&kg->texture_half1_images[index], mem, width, height, depth, interpolation, cache, handle);
+			break;
+	}
+}
+
 void kernel_const_copy(KernelGlobals *kg, const char *name, void *host, size_t size)
 {
 	if(strcmp(name, "__data") == 0)
@@ -50,40 +94,21 @@ void kernel_tex_copy(KernelGlobals *kg, const char *name, device_ptr mem, size_t
 #define KERNEL_IMAGE_TEX(type, ttype, tname)
 #include "kernel_textures.h"
 
-	else if(strstr(name, "__tex_image_float")) {
-		texture_image_float4 *tex = NULL;
-		int id = atoi(name + strlen("__tex_image_float_"));
-		int array_index = id;
-
-		if(array_index >= 0 && array_index < MAX_FLOAT_IMAGES) {
-			tex = &kg->texture_float_images[array_index];
-		}
-
-		if(tex) {
-			tex->data = (float4*)mem;
-			tex->dimensions_set(width, height, depth);
-			tex->interpolation = interpolation;
-		}
-	}
 	else if(strstr(name, "__tex_image")) {
-		texture_image_uchar4 *tex = NULL;
-		int id = atoi(name + strlen("__tex_image_"));
-		int array_index = id - MAX_FLOAT_IMAGES;
-
-		if(array_index >= 0 && array_index < MAX_BYTE_IMAGES) {
-			tex = &kg->texture_byte_images[array_index];
-		}
-
-		if(tex) {
-			tex->data = (uchar4*)mem;
-			tex->dimensions_set(width, height, depth);
-			tex->interpolation = interpolation;
-		}
+		kernel_tex_image_set(kg, name, mem, width, height, depth, interpolation, NULL, NULL);
 	}
 	else
 		assert(0);
 }
 
+void kernel_tex_cache_set(KernelGlobals *kg, const char *name, TextureCache *cache, TextureCacheHandle *handle, InterpolationType interpolation)
+{
+	if(strstr(name, "__tex_image"))
+		kernel_tex_image_set(kg, name, 0, 0, 0, 0, interpolation, cache, handle);
+	else
+		assert(0);
+}
+
 /* On x86-64, we can assume SSE2, so avoid the extra kernel and compile this one with SSE2 intrinsics */
 #if defined(__x86_64__) || defined(_M_X64)
 #define __KERNEL_SSE2__
@@ -106,6 +131,11 @@ void kernel_cpu_path_trace(KernelGlobals *kg, float *buffer, unsigned int *rng_s
 		kernel_path_trace(kg, buffer, rng_state, sample, x, y, offset, stride);
 }
 
+void kernel_cpu_path_trace_camera_packet(KernelGlobals *kg, float *buffer, unsigned int *rng_state, int sample, int x, int y, int w, int h, int offset, int stride)
+{
+	kernel_path_trace_camera_packet(kg, buffer, rng_state, sample, x, y, w, h, offset, stride);
+}
+
 /* Film */
 
 void kernel_cpu_convert_to_byte(KernelGlobals *kg, uchar4 *rgba, float *buffer, float sample_scale, int x, int y, int offset, int stride)
@@ -128,5 +158,17 @@ void kernel_cpu_shader(KernelGlobals *kg, uint4 *input, float4 *output, int type
 		kernel_shader_evaluate(kg, input, output, (ShaderEvalType)type, i, sample);
 }
 
+/* Adaptive Sampling */
+
+bool kernel_cpu_adaptive_sampling_filter(KernelGlobals *kg, float *buffer, int x, int y, int w, int h, int offset, int stride)
+{
+	return kernel_adaptive_sampling_filter(kg, buffer, x, y, w, h, offset, stride);
+}
+
+uint64_t kernel_cpu_adaptive_sampling_post_adjust(KernelGlobals *kg, float *buffer, int sample, int x, int y, int w, int h, int offset, int stride)
+{
+	return kernel_adaptive_sampling_post_adjust(kg, buffer, sample, x, y, w, h, offset, stride);
+}
+
 CCL_NAMESPACE_END
 
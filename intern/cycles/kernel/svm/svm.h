@@ -142,6 +142,7 @@ CCL_NAMESPACE_END
 #include "svm_noise.h"
 #include "svm_texture.h"
 
+#include "svm_color_util.h"
 #include "svm_math_util.h"
 
 #include "svm_attribute.h"
@@ -387,6 +388,9 @@ ccl_device_noinline void svm_eval_nodes(KernelGlobals *kg, ShaderData *sd, Shade
 			case NODE_MATH:
 				svm_node_math(kg, sd, stack, node.y, node.z, node.w, &offset);
 				break;
+			case NODE_MATH_CHAIN:
+				svm_node_math_chain(kg, sd, stack, node.y, node.z, node.w, &offset);
+				break;
 			case NODE_VECTOR_MATH:
 				svm_node_vector_math(kg, sd, stack, node.y, node.z, node.w, &offset);
 				break;
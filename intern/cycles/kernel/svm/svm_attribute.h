@@ -25,7 +25,7 @@ ccl_device void svm_node_attr_init(KernelGlobals *kg, ShaderData *sd,
 	if(ccl_fetch(sd, object) != OBJECT_NONE) {
 		/* find attribute by unique id */
 		uint id = node.y;
-		uint attr_offset = ccl_fetch(sd, object)*kernel_data.bvh.attributes_map_stride;
+		uint attr_offset = object_attribute_map_offset(kg, ccl_fetch(sd, object));
 #ifdef __HAIR__
 		attr_offset = (ccl_fetch(sd, type) & PRIMITIVE_ALL_CURVE)? attr_offset + ATTR_PRIM_CURVE: attr_offset;
 #endif
@@ -130,6 +130,17 @@ ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y,
 
 #else
 
+/* Byte images are clamped after unpremultiplying alpha. */
+ccl_device_inline bool svm_image_is_byte(int id)
+{
+#ifdef __KERNEL_CPU__
+	int type = id / TEX_NUM_IMAGES_CPU;
+	return (type == IMAGE_DATA_TYPE_BYTE4 || type == IMAGE_DATA_TYPE_BYTE);
+#else
+	return (id >= TEX_NUM_FLOAT_IMAGES);
+#endif
+}
+
 ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y, uint srgb, uint use_alpha)
 {
 #ifdef __KERNEL_CPU__
@@ -319,7 +330,7 @@ ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y,
 
 	if(use_alpha && alpha != 1.0f && alpha != 0.0f) {
 		r_ssef = r_ssef / ssef(alpha);
-		if(id >= TEX_NUM_FLOAT_IMAGES)
+		if(svm_image_is_byte(id))
 			r_ssef = min(r_ssef, ssef(1.0f));
 		r.w = alpha;
 	}
@@ -335,7 +346,7 @@ ccl_device float4 svm_image_texture(KernelGlobals *kg, int id, float x, float y,
 		r.y *= invw;
 		r.z *= invw;
 
-		if(id >= TEX_NUM_FLOAT_IMAGES) {
+		if(svm_image_is_byte(id)) {
 			r.x = min(r.x, 1.0f);
 			r.y = min(r.y, 1.0f);
 			r.z = min(r.z, 1.0f);
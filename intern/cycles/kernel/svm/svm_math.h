@@ -30,6 +30,39 @@ ccl_device void svm_node_math(KernelGlobals *kg, ShaderData *sd, float *stack, u
 	stack_store_float(stack, node1.y, f);
 }
 
+/* Chain of math nodes each with one constant operand, evaluated without
+ * going through the stack. Steps are packed two per node. */
+
+ccl_device_inline float svm_math_chain_step(float f, uint flag, float value)
+{
+	NodeMath type = (NodeMath)(flag & NODE_MATH_CHAIN_TYPE_MASK);
+
+	if(flag & NODE_MATH_CHAIN_VALUE_FIRST)
+		f = svm_math(type, value, f);
+	else
+		f = svm_math(type, f, value);
+
+	if(flag & NODE_MATH_CHAIN_CLAMP)
+		f = saturate(f);
+
+	return f;
+}
+
+ccl_device void svm_node_math_chain(KernelGlobals *kg, ShaderData *sd, float *stack, uint f_offset, uint out_offset, uint num_steps, int *offset)
+{
+	float f = stack_load_float(stack, f_offset);
+
+	for(uint i = 0; i < num_steps; i += 2) {
+		uint4 node = read_node(kg, offset);
+
+		f = svm_math_chain_step(f, node.x, __uint_as_float(node.y));
+		if(i + 1 < num_steps)
+			f = svm_math_chain_step(f, node.z, __uint_as_float(node.w));
+	}
+
+	stack_store_float(stack, out_offset, f);
+}
+
 ccl_device void svm_node_vector_math(KernelGlobals *kg, ShaderData *sd, float *stack, uint itype, uint v1_offset, uint v2_offset, int *offset)
 {
 	NodeVectorMath type = (NodeVectorMath)itype;
@@ -119,7 +119,8 @@ typedef enum NodeType {
 	NODE_TANGENT,
 	NODE_NORMAL_MAP,
 	NODE_HAIR_INFO,
-	NODE_UVMAP
+	NODE_UVMAP,
+	NODE_MATH_CHAIN
 } NodeType;
 
 typedef enum NodeAttributeType {
@@ -241,6 +242,11 @@ typedef enum NodeMath {
 	NODE_MATH_CLAMP /* used for the clamp UI option */
 } NodeMath;
 
+/* flags of a math chain step, stored above the NodeMath type */
+#define NODE_MATH_CHAIN_TYPE_MASK    0xff
+#define NODE_MATH_CHAIN_VALUE_FIRST  (1 << 8)
+#define NODE_MATH_CHAIN_CLAMP        (1 << 9)
+
 typedef enum NodeVectorMath {
 	NODE_VECTOR_MATH_ADD,
 	NODE_VECTOR_MATH_SUBTRACT,
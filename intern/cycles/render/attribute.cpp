@@ -214,6 +214,8 @@ const char *Attribute::standard_name(AttributeStandard std)
 			return "motion_N";
 		case ATTR_STD_PARTICLE:
 			return "particle";
+		case ATTR_STD_DUPLI:
+			return "dupli";
 		case ATTR_STD_CURVE_INTERCEPT:
 			return "curve_intercept";
 		case ATTR_STD_PTEX_FACE_ID:
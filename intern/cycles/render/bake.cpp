@@ -17,6 +17,8 @@
 #include "bake.h"
 #include "integrator.h"
 
+#include "util_foreach.h"
+
 CCL_NAMESPACE_BEGIN
 
 BakeData::BakeData(const int object, const size_t tri_offset, const size_t num_pixels):
@@ -121,6 +123,9 @@ void BakeManager::set_baking(const bool value)
 
 BakeData *BakeManager::init(const int object, const size_t tri_offset, const size_t num_pixels)
 {
+	if(m_bake_data)
+		delete m_bake_data;
+
 	m_bake_data = new BakeData(object, tri_offset, num_pixels);
 	return m_bake_data;
 }
@@ -138,59 +143,93 @@ bool BakeManager::bake(Device *device, DeviceScene *dscene, Scene *scene, Progre
 	progress.reset_sample();
 	this->num_parts = 0;
 
-	/* calculate the total parts for the progress bar */
-	for(size_t shader_offset = 0; shader_offset < num_pixels; shader_offset += m_shader_limit) {
-		size_t shader_size = (size_t)fminf(num_pixels - shader_offset, m_shader_limit);
+	/* find the ranges of pixels to evaluate, one per device task. ranges
+	 * of pixels not belonging to the object are skipped, when many objects
+	 * are baked to one image these make up most of the pixel array */
+	vector<int2> ranges;
+
+	for(size_t i = 0; i < num_pixels;) {
+		if(!bake_data->is_valid(i)) {
+			i++;
+			continue;
+		}
 
+		size_t last_valid = i;
+
+		for(size_t j = i + 1; j < num_pixels && j - i < m_shader_limit; j++) {
+			if(bake_data->is_valid(j))
+				last_valid = j;
+			else if(j - last_valid > BAKE_MAX_GAP)
+				break;
+		}
+
+		ranges.push_back(make_int2((int)i, (int)(last_valid + 1 - i)));
+		i = last_valid + 1;
+	}
+
+	/* calculate the total parts for the progress bar */
+	foreach(const int2& range, ranges) {
 		DeviceTask task(DeviceTask::SHADER);
-		task.shader_w = shader_size;
+		task.shader_w = range.y;
 
 		this->num_parts += device->get_split_task_count(task);
 	}
 
 	this->num_samples = is_aa_pass(shader_type)? scene->integrator->aa_samples : 1;
 
-	for(size_t shader_offset = 0; shader_offset < num_pixels; shader_offset += m_shader_limit) {
-		size_t shader_size = (size_t)fminf(num_pixels - shader_offset, m_shader_limit);
+	/* needs to be up to data for attribute access */
+	device->const_copy_to("__data", &dscene->data, sizeof(dscene->data));
+
+	/* ranges are dispatched in batches sharing one input and output buffer,
+	 * with a single wait per batch */
+	for(size_t first = 0; first < ranges.size();) {
+		size_t last = first;
+		size_t batch_size = 0;
+
+		while(last < ranges.size() && last - first < BAKE_BATCH_TASKS)
+			batch_size += ranges[last++].y;
 
 		/* setup input for device task */
 		device_vector<uint4> d_input;
-		uint4 *d_input_data = d_input.resize(shader_size * 2);
+		uint4 *d_input_data = d_input.resize(batch_size * 2);
 		size_t d_input_size = 0;
 
-		for(size_t i = shader_offset; i < (shader_offset + shader_size); i++) {
-			d_input_data[d_input_size++] = bake_data->data(i);
-			d_input_data[d_input_size++] = bake_data->differentials(i);
-		}
-
-		if(d_input_size == 0) {
-			m_is_baking = false;
-			return false;
+		for(size_t r = first; r < last; r++) {
+			for(int i = ranges[r].x; i < ranges[r].x + ranges[r].y; i++) {
+				d_input_data[d_input_size++] = bake_data->data(i);
+				d_input_data[d_input_size++] = bake_data->differentials(i);
+			}
 		}
 
-		/* run device task */
+		/* run device tasks */
 		device_vector<float4> d_output;
-		d_output.resize(shader_size);
-
-		/* needs to be up to data for attribute access */
-		device->const_copy_to("__data", &dscene->data, sizeof(dscene->data));
+		d_output.resize(batch_size);
 
 		device->mem_alloc(d_input, MEM_READ_ONLY);
 		device->mem_copy_to(d_input);
 		device->mem_alloc(d_output, MEM_WRITE_ONLY);
 
-		DeviceTask task(DeviceTask::SHADER);
-		task.shader_input = d_input.device_pointer;
-		task.shader_output = d_output.device_pointer;
-		task.shader_eval_type = shader_type;
-		task.shader_x = 0;
-		task.offset = shader_offset;
-		task.shader_w = d_output.size();
-		task.num_samples = this->num_samples;
-		task.get_cancel = function_bind(&Progress::get_cancel, &progress);
-		task.update_progress_sample = function_bind(&Progress::increment_sample_update, &progress);
-
-		device->task_add(task);
+		int shader_x = 0;
+
+		for(size_t r = first; r < last; r++) {
+			DeviceTask task(DeviceTask::SHADER);
+			task.shader_input = d_input.device_pointer;
+			task.shader_output = d_output.device_pointer;
+			task.shader_eval_type = shader_type;
+			task.shader_x = shader_x;
+			/* the kernel seeds random numbers with offset plus index in the
+			 * buffer, which gives the pixel index regardless of batching */
+			task.offset = ranges[r].x - shader_x;
+			task.shader_w = ranges[r].y;
+			task.num_samples = this->num_samples;
+			task.get_cancel = function_bind(&Progress::get_cancel, &progress);
+			task.update_progress_sample = function_bind(&Progress::increment_sample_update, &progress);
+
+			device->task_add(task);
+
+			shader_x += ranges[r].y;
+		}
+
 		device->task_wait();
 
 		if(progress.get_cancel()) {
@@ -210,16 +249,20 @@ bool BakeManager::bake(Device *device, DeviceScene *dscene, Scene *scene, Progre
 		float4 *offset = (float4*)d_output.data_pointer;
 
 		size_t depth = 4;
-		for(size_t i=shader_offset; i < (shader_offset + shader_size); i++) {
-			size_t index = i * depth;
-			float4 out = offset[k++];
-
-			if(bake_data->is_valid(i)) {
-				for(size_t j=0; j < 4; j++) {
-					result[index + j] = out[j];
+		for(size_t r = first; r < last; r++) {
+			for(int i = ranges[r].x; i < ranges[r].x + ranges[r].y; i++) {
+				size_t index = i * depth;
+				float4 out = offset[k++];
+
+				if(bake_data->is_valid(i)) {
+					for(size_t j=0; j < 4; j++) {
+						result[index + j] = out[j];
+					}
 				}
 			}
 		}
+
+		first = last;
 	}
 
 	m_is_baking = false;
@@ -25,6 +25,14 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Number of device tasks dispatched together, sharing one input and output
+ * buffer. Each task evaluates at most the shader limit number of pixels. */
+#define BAKE_BATCH_TASKS 16
+
+/* Runs of invalid pixels up to this length are passed to the kernel, which
+ * skips them, rather than starting a new task. */
+#define BAKE_MAX_GAP 256
+
 class BakeData {
 public:
 	BakeData(const int object, const size_t tri_offset, const size_t num_pixels);
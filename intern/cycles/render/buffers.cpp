@@ -15,6 +15,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "buffers.h"
 #include "device.h"
@@ -22,7 +23,6 @@
 #include "util_debug.h"
 #include "util_foreach.h"
 #include "util_hash.h"
-#include "util_image.h"
 #include "util_math.h"
 #include "util_opengl.h"
 #include "util_time.h"
@@ -93,6 +93,10 @@ RenderTile::RenderTile()
 	rng_state = 0;
 
 	buffers = NULL;
+
+	tile_index = 0;
+	work_id = -1;
+	stolen = false;
 }
 
 /* Render Buffers */
@@ -156,6 +160,23 @@ bool RenderBuffers::copy_from_device()
 	return true;
 }
 
+void RenderBuffers::add(RenderBuffers *other)
+{
+	assert(!params.modified(other->params));
+
+	if(!copy_from_device() || !other->copy_from_device())
+		return;
+
+	float *data = (float*)buffer.data_pointer;
+	float *other_data = (float*)other->buffer.data_pointer;
+	size_t size = buffer.size();
+
+	for(size_t i = 0; i < size; i++)
+		data[i] += other_data[i];
+
+	device->mem_copy_to(buffer);
+}
+
 bool RenderBuffers::get_pass_rect(PassType type, float exposure, int sample, int components, float *pixels)
 {
 	int pass_offset = 0;
@@ -422,5 +443,218 @@ device_memory& DisplayBuffer::rgba_data()
 		return rgba_byte;
 }
 
-CCL_NAMESPACE_END
+/* Tile Output */
+
+/* name and channels of passes in the output file, passes without a name
+ * are only used internally */
+static const char *tile_output_pass_name(PassType type)
+{
+	switch(type) {
+		case PASS_COMBINED: return "";
+		case PASS_DEPTH: return "Depth";
+		case PASS_NORMAL: return "Normal";
+		case PASS_UV: return "UV";
+		case PASS_OBJECT_ID: return "IndexOB";
+		case PASS_MATERIAL_ID: return "IndexMA";
+		case PASS_DIFFUSE_COLOR: return "DiffCol";
+		case PASS_GLOSSY_COLOR: return "GlossCol";
+		case PASS_TRANSMISSION_COLOR: return "TransCol";
+		case PASS_SUBSURFACE_COLOR: return "SubsurfaceCol";
+		case PASS_DIFFUSE_INDIRECT: return "DiffInd";
+		case PASS_GLOSSY_INDIRECT: return "GlossInd";
+		case PASS_TRANSMISSION_INDIRECT: return "TransInd";
+		case PASS_SUBSURFACE_INDIRECT: return "SubsurfaceInd";
+		case PASS_DIFFUSE_DIRECT: return "DiffDir";
+		case PASS_GLOSSY_DIRECT: return "GlossDir";
+		case PASS_TRANSMISSION_DIRECT: return "TransDir";
+		case PASS_SUBSURFACE_DIRECT: return "SubsurfaceDir";
+		case PASS_EMISSION: return "Emit";
+		case PASS_BACKGROUND: return "Env";
+		case PASS_AO: return "AO";
+		case PASS_SHADOW: return "Shadow";
+		case PASS_MOTION: return "Vector";
+		case PASS_MIST: return "Mist";
+		default: return NULL;
+	}
+}
+
+static const char *tile_output_pass_channels(const Pass& pass)
+{
+	if(pass.type == PASS_COMBINED)
+		return "RGBA";
+	else if(pass.type == PASS_MOTION)
+		return "XYZW";
+	else if(pass.type == PASS_NORMAL)
+		return "XYZ";
+	else if(pass.type == PASS_UV)
+		return "UVA";
+	else if(pass.type == PASS_DEPTH)
+		return "Z";
+	else if(pass.components == 1)
+		return "X";
+	else
+		return "RGB";
+}
+
+TileOutput::TileOutput(const string& filepath_)
+: filepath(filepath_), out(NULL)
+{
+	num_tiles_x = 0;
+	num_channels = 0;
+}
+
+TileOutput::~TileOutput()
+{
+	close();
+}
+
+bool TileOutput::supported(const string& filepath)
+{
+	return filepath.size() > 4 && string_iequals(filepath.substr(filepath.size() - 4), ".exr");
+}
+
+bool TileOutput::open(const BufferParams& params_, int2 tile_size_)
+{
+	close();
+
+	params = params_;
+	tile_size = tile_size_;
+	num_tiles_x = (params.width + tile_size.x - 1)/tile_size.x;
+
+	vector<string> channelnames;
+
+	foreach(const Pass& pass, params.passes) {
+		const char *name = tile_output_pass_name(pass.type);
+
+		if(!name)
+			continue;
+
+		for(const char *c = tile_output_pass_channels(pass); *c; c++) {
+			/* combined is written as plain RGBA, for viewers that don't
+			 * know about layers */
+			if(name[0])
+				channelnames.push_back(string_printf("%s.%c", name, *c));
+			else
+				channelnames.push_back(string(1, *c));
+		}
+	}
+
+	num_channels = channelnames.size();
+
+	out = ImageOutput::create(filepath);
+
+	if(!out)
+		return false;
+
+	if(!out->supports("tiles")) {
+		delete out;
+		out = NULL;
+		return false;
+	}
 
+	ImageSpec spec(params.width, params.height, num_channels, TypeDesc::FLOAT);
+	spec.channelnames = channelnames;
+	spec.alpha_channel = (num_channels >= 4 && channelnames[3] == "A")? 3: -1;
+	spec.tile_width = tile_size.x;
+	spec.tile_height = tile_size.y;
+	spec.attribute("compression", "zip");
+	/* tiles are written in the order they finish */
+	spec.attribute("openexr:lineOrder", "randomY");
+
+	if(!out->open(filepath, spec)) {
+		delete out;
+		out = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+bool TileOutput::write(RenderTile& rtile, float exposure)
+{
+	RenderBuffers *buffers = rtile.buffers;
+
+	if(!out || !buffers->copy_from_device())
+		return false;
+
+	BufferParams& tile_params = buffers->params;
+	int x = tile_params.full_x - params.full_x;
+	int y = tile_params.full_y - params.full_y;
+	int w = tile_params.width;
+	int h = tile_params.height;
+
+	/* interleave all passes of the tile */
+	vector<float> pixels(w*h*num_channels);
+	vector<float> pass_pixels(w*h*4);
+	int channel = 0;
+
+	foreach(const Pass& pass, params.passes) {
+		if(!tile_output_pass_name(pass.type))
+			continue;
+
+		int components = strlen(tile_output_pass_channels(pass));
+
+		if(!buffers->get_pass_rect(pass.type, exposure, rtile.sample, components, &pass_pixels[0]))
+			memset(&pass_pixels[0], 0, pass_pixels.size()*sizeof(float));
+
+		for(int i = 0; i < w*h; i++)
+			for(int c = 0; c < components; c++)
+				pixels[i*num_channels + channel + c] = pass_pixels[i*components + c];
+
+		channel += components;
+	}
+
+	/* copy rows into image tiles, flipping from bottom to top */
+	int tile_x = x/tile_size.x;
+
+	for(int row = 0; row < h; row++) {
+		int image_y = params.height - 1 - (y + row);
+		int tile_y = image_y/tile_size.y;
+
+		PendingTile& tile = pending_tiles[tile_y*num_tiles_x + tile_x];
+
+		if(tile.pixels.empty()) {
+			tile.pixels.resize(tile_size.x*tile_size.y*num_channels, 0.0f);
+			tile.num_pixels = 0;
+		}
+
+		memcpy(&tile.pixels[((image_y - tile_y*tile_size.y)*tile_size.x)*num_channels],
+		       &pixels[row*w*num_channels],
+		       sizeof(float)*w*num_channels);
+		tile.num_pixels += w;
+
+		/* write image tile once all of its pixels are there */
+		int tile_w = min(tile_size.x, params.width - tile_x*tile_size.x);
+		int tile_h = min(tile_size.y, params.height - tile_y*tile_size.y);
+
+		if(tile.num_pixels == tile_w*tile_h) {
+			write_tile(tile_x, tile_y, tile);
+			pending_tiles.erase(tile_y*num_tiles_x + tile_x);
+		}
+	}
+
+	return true;
+}
+
+void TileOutput::write_tile(int tile_x, int tile_y, PendingTile& tile)
+{
+	out->write_tile(tile_x*tile_size.x, tile_y*tile_size.y, 0, TypeDesc::FLOAT, &tile.pixels[0]);
+}
+
+void TileOutput::close()
+{
+	if(!out)
+		return;
+
+	/* tiles of a canceled render are written partially, for a valid file */
+	for(map<int, PendingTile>::iterator it = pending_tiles.begin(); it != pending_tiles.end(); it++)
+		write_tile(it->first % num_tiles_x, it->first / num_tiles_x, it->second);
+
+	pending_tiles.clear();
+
+	out->close();
+	delete out;
+	out = NULL;
+}
+
+CCL_NAMESPACE_END
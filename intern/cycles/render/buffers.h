@@ -24,6 +24,8 @@
 #include "kernel_types.h"
 
 #include "util_half.h"
+#include "util_image.h"
+#include "util_map.h"
 #include "util_string.h"
 #include "util_thread.h"
 #include "util_types.h"
@@ -79,6 +81,10 @@ public:
 	void reset(Device *device, BufferParams& params);
 
 	bool copy_from_device();
+
+	/* add passes of buffers with the same parameters, to combine samples of
+	 * a tile rendered into separate buffers */
+	void add(RenderBuffers *other);
 	bool get_pass_rect(PassType type, float exposure, int sample, int components, float *pixels);
 
 protected:
@@ -144,9 +150,52 @@ public:
 
 	RenderBuffers *buffers;
 
+	/* work item of the tile manager with work stealing */
+	int tile_index;
+	int work_id;
+	bool stolen;
+
 	RenderTile();
 };
 
+/* Tile Output
+ *
+ * Writes finished tiles with all passes into a tiled OpenEXR file, so that
+ * tile buffers can be freed right away and the full frame never needs to be
+ * in memory. Image tiles are aligned from the top, render tiles from the
+ * bottom, so parts of image tiles wait until the neighbouring render tiles
+ * are written. */
+
+class TileOutput {
+public:
+	TileOutput(const string& filepath);
+	~TileOutput();
+
+	static bool supported(const string& filepath);
+
+	bool open(const BufferParams& params, int2 tile_size);
+	bool write(RenderTile& rtile, float exposure);
+	void close();
+
+protected:
+	struct PendingTile {
+		vector<float> pixels;
+		int num_pixels;
+	};
+
+	void write_tile(int tile_x, int tile_y, PendingTile& tile);
+
+	string filepath;
+	ImageOutput *out;
+
+	BufferParams params;
+	int2 tile_size;
+	int num_tiles_x;
+	int num_channels;
+
+	map<int, PendingTile> pending_tiles;
+};
+
 CCL_NAMESPACE_END
 
 #endif /* __BUFFERS_H__ */
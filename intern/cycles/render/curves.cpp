@@ -29,7 +29,14 @@ CCL_NAMESPACE_BEGIN
 
 /* Curve functions */
 
-void curvebounds(float *lower, float *upper, float3 *p, int dim)
+static float curve_eval(const float curve_coef[4], float t)
+{
+	return ((curve_coef[3] * t + curve_coef[2]) * t + curve_coef[1]) * t + curve_coef[0];
+}
+
+/* Bounds of the cardinal curve segment between p[1] and p[2] along one axis,
+ * for curve parameters between t0 and t1. */
+void curvebounds(float *lower, float *upper, float3 *p, int dim, float t0, float t1)
 {
 	float *p0 = &p[0].x;
 	float *p1 = &p[1].x;
@@ -51,26 +58,24 @@ void curvebounds(float *lower, float *upper, float3 *p, int dim)
 		discroot = sqrtf(discroot);
 		ta = (-curve_coef[2] - discroot) / (3 * curve_coef[3]);
 		tb = (-curve_coef[2] + discroot) / (3 * curve_coef[3]);
-		ta = (ta > 1.0f || ta < 0.0f) ? -1.0f : ta;
-		tb = (tb > 1.0f || tb < 0.0f) ? -1.0f : tb;
+		ta = (ta > t1 || ta < t0) ? -1.0f : ta;
+		tb = (tb > t1 || tb < t0) ? -1.0f : tb;
 	}
 
-	*upper = max(p1[dim],p2[dim]);
-	*lower = min(p1[dim],p2[dim]);
+	/* end points, exact for the full segment */
+	float st = (t0 == 0.0f)? p1[dim]: curve_eval(curve_coef, t0);
+	float en = (t1 == 1.0f)? p2[dim]: curve_eval(curve_coef, t1);
 
-	float exa = p1[dim];
-	float exb = p2[dim];
+	*upper = max(st, en);
+	*lower = min(st, en);
 
-	if(ta >= 0.0f) {
-		float t2 = ta * ta;
-		float t3 = t2 * ta;
-		exa = curve_coef[3] * t3 + curve_coef[2] * t2 + curve_coef[1] * ta + curve_coef[0];
-	}
-	if(tb >= 0.0f) {
-		float t2 = tb * tb;
-		float t3 = t2 * tb;
-		exb = curve_coef[3] * t3 + curve_coef[2] * t2 + curve_coef[1] * tb + curve_coef[0];
-	}
+	float exa = st;
+	float exb = en;
+
+	if(ta >= 0.0f)
+		exa = curve_eval(curve_coef, ta);
+	if(tb >= 0.0f)
+		exb = curve_eval(curve_coef, tb);
 
 	*upper = max(*upper, max(exa,exb));
 	*lower = min(*lower, min(exa,exb));
@@ -175,7 +180,9 @@ bool CurveSystemManager::modified_mesh(const CurveSystemManager& CurveSystemMana
 		curve_shape == CurveSystemManager.curve_shape &&
 		triangle_method == CurveSystemManager.triangle_method &&
 		resolution == CurveSystemManager.resolution &&
-		use_curves == CurveSystemManager.use_curves);
+		use_curves == CurveSystemManager.use_curves &&
+		subdivisions == CurveSystemManager.subdivisions &&
+		(minimum_width > 0.0f) == (CurveSystemManager.minimum_width > 0.0f));
 }
 
 void CurveSystemManager::tag_update(Scene * /*scene*/)
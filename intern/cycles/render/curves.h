@@ -27,7 +27,7 @@ class DeviceScene;
 class Progress;
 class Scene;
 
-void curvebounds(float *lower, float *upper, float3 *p, int dim);
+void curvebounds(float *lower, float *upper, float3 *p, int dim, float t0 = 0.0f, float t1 = 1.0f);
 
 typedef enum curve_primitives {
 	CURVE_TRIANGLES,
@@ -146,6 +146,14 @@ void Pass::add(PassType type, vector<Pass>& passes)
 		case PASS_LIGHT:
 			/* ignores */
 			break;
+		case PASS_ADAPTIVE_AUX_BUFFER:
+			pass.components = 4;
+			pass.filter = false;
+			break;
+		case PASS_SAMPLE_COUNT:
+			pass.components = 1;
+			pass.filter = false;
+			break;
 #ifdef WITH_CYCLES_DEBUG
 		case PASS_BVH_TRAVERSAL_STEPS:
 			pass.components = 1;
@@ -395,6 +403,13 @@ void Film::device_update(Device *device, DeviceScene *dscene, Scene *scene)
 				kfilm->use_light_pass = 1;
 				break;
 
+			case PASS_ADAPTIVE_AUX_BUFFER:
+				kfilm->pass_adaptive_aux_buffer = kfilm->pass_stride;
+				break;
+			case PASS_SAMPLE_COUNT:
+				kfilm->pass_sample_count = kfilm->pass_stride;
+				break;
+
 #ifdef WITH_CYCLES_DEBUG
 			case PASS_BVH_TRAVERSAL_STEPS:
 				kfilm->pass_bvh_traversal_steps = kfilm->pass_stride;
@@ -242,7 +242,7 @@ void ShaderGraph::relink(vector<ShaderInput*> inputs, vector<ShaderInput*> outpu
 	}
 }
 
-void ShaderGraph::finalize(bool do_bump, bool do_osl)
+void ShaderGraph::finalize(bool do_bump, bool do_osl, bool do_simplify)
 {
 	/* before compiling, the shader graph may undergo a number of modifications.
 	 * currently we set default geometry shader inputs, and create automatic bump
@@ -250,13 +250,17 @@ void ShaderGraph::finalize(bool do_bump, bool do_osl)
 	 * modified afterwards. */
 
 	if(!finalized) {
-		clean();
+		clean(do_simplify);
 		default_inputs(do_osl);
 		refine_bump_nodes();
 
 		if(do_bump)
 			bump_from_displacement();
 
+		/* math chain nodes only exist in SVM */
+		if(do_simplify && !do_osl)
+			fuse_math_chains();
+
 		ShaderInput *surface_in = output()->input("Surface");
 		ShaderInput *volume_in = output()->input("Volume");
 
@@ -522,11 +526,263 @@ void ShaderGraph::break_cycles(ShaderNode *node, vector<bool>& visited, vector<b
 	on_stack[node->id] = false;
 }
 
-void ShaderGraph::clean()
+void ShaderGraph::topological_order(vector<ShaderNode*>& order)
+{
+	/* order nodes so that every node comes after the nodes linked to its
+	 * inputs, nodes that are part of a cycle are left out */
+	vector<int> num_links(num_node_ids, 0);
+	list<ShaderNode*> queue;
+
+	foreach(ShaderNode *node, nodes) {
+		foreach(ShaderInput *input, node->inputs)
+			if(input->link)
+				num_links[node->id]++;
+
+		if(num_links[node->id] == 0)
+			queue.push_back(node);
+	}
+
+	order.clear();
+
+	while(!queue.empty()) {
+		ShaderNode *node = queue.front();
+		queue.pop_front();
+		order.push_back(node);
+
+		foreach(ShaderOutput *output, node->outputs) {
+			foreach(ShaderInput *to, output->links) {
+				if(--num_links[to->parent->id] == 0)
+					queue.push_back(to->parent);
+			}
+		}
+	}
+}
+
+void ShaderGraph::constant_fold()
+{
+	/* replace outputs that evaluate to a constant by the value, set on the
+	 * inputs linked to them. nodes are visited in dependency order so that
+	 * folded values propagate further down the graph in a single pass. the
+	 * nodes left without links are removed by clean() afterwards. */
+	vector<ShaderNode*> order;
+	topological_order(order);
+
+	foreach(ShaderNode *node, order) {
+		foreach(ShaderOutput *output, node->outputs) {
+			if(output->links.empty() || output->type == SHADER_SOCKET_CLOSURE)
+				continue;
+
+			float3 optimized_value = make_float3(0.0f, 0.0f, 0.0f);
+
+			if(!node->constant_fold(output, &optimized_value))
+				continue;
+
+			/* inputs with a default link would get a texture coordinate or
+			 * geometry link instead of the value, leave those linked */
+			vector<ShaderInput*> links(output->links);
+
+			foreach(ShaderInput *to, links) {
+				if(to->default_value == ShaderInput::NONE) {
+					disconnect(to);
+					to->set(optimized_value);
+				}
+			}
+		}
+	}
+}
+
+static bool shader_nodes_equal(ShaderNode *a, ShaderNode *b)
+{
+	if(a->name != b->name || a->bump != b->bump)
+		return false;
+	if(a->inputs.size() != b->inputs.size() || a->outputs.size() != b->outputs.size())
+		return false;
+
+	for(size_t i = 0; i < a->inputs.size(); i++) {
+		ShaderInput *in_a = a->inputs[i];
+		ShaderInput *in_b = b->inputs[i];
+
+		if(in_a->link != in_b->link)
+			return false;
+
+		if(!in_a->link) {
+			if(in_a->value != in_b->value ||
+			   in_a->value_string != in_b->value_string ||
+			   in_a->default_value != in_b->default_value)
+			{
+				return false;
+			}
+		}
+	}
+
+	return a->equals(b);
+}
+
+void ShaderGraph::deduplicate_nodes()
+{
+	/* merge nodes that compute the same values, with the same parameters and
+	 * the same links or values on all inputs. nodes are visited in dependency
+	 * order, so identical subgraphs collapse from their leaves upwards. closure
+	 * nodes are never merged, the SVM compiler expects a closure to be used
+	 * with a single weight. */
+	vector<ShaderNode*> order;
+	topological_order(order);
+
+	map<ustring, vector<ShaderNode*> > candidates;
+
+	foreach(ShaderNode *node, order) {
+		bool has_closure_output = false;
+
+		foreach(ShaderOutput *output, node->outputs)
+			if(output->type == SHADER_SOCKET_CLOSURE)
+				has_closure_output = true;
+
+		if(node->outputs.empty() || has_closure_output)
+			continue;
+
+		vector<ShaderNode*>& same_name = candidates[node->name];
+		ShaderNode *merge_node = NULL;
+
+		foreach(ShaderNode *other, same_name) {
+			if(shader_nodes_equal(node, other)) {
+				merge_node = other;
+				break;
+			}
+		}
+
+		if(!merge_node) {
+			same_name.push_back(node);
+			continue;
+		}
+
+		/* move links to the existing node */
+		for(size_t i = 0; i < node->outputs.size(); i++) {
+			vector<ShaderInput*> links(node->outputs[i]->links);
+
+			foreach(ShaderInput *to, links) {
+				disconnect(to);
+				connect(merge_node->outputs[i], to);
+			}
+		}
+	}
+}
+
+static ShaderInput *math_chain_input(ShaderNode *node)
+{
+	/* math node with one linked input and a constant operand */
+	if(node->special_type != SHADER_SPECIAL_TYPE_MATH)
+		return NULL;
+
+	ShaderInput *value1_in = node->inputs[0];
+	ShaderInput *value2_in = node->inputs[1];
+
+	if(value1_in->link && !value2_in->link)
+		return value1_in;
+	if(!value1_in->link && value2_in->link)
+		return value2_in;
+
+	return NULL;
+}
+
+void ShaderGraph::fuse_math_chains()
+{
+	/* replace chains of math nodes, each with a constant operand and used
+	 * only by the next node, with a single node that keeps the intermediate
+	 * value in a register instead of the SVM stack */
+	vector<ShaderNode*> order;
+	topological_order(order);
+
+	vector<bool> removed(num_node_ids, false);
+	bool any_node_removed = false;
+
+	/* visiting in dependency order, the first node found of a chain is its head */
+	foreach(ShaderNode *node, order) {
+		if(removed[node->id] || !math_chain_input(node))
+			continue;
+
+		vector<MathNode*> chain;
+		ShaderNode *next = node;
+
+		while(true) {
+			chain.push_back(static_cast<MathNode*>(next));
+
+			ShaderOutput *output = next->outputs[0];
+
+			if(output->links.size() != 1)
+				break;
+
+			ShaderInput *to = output->links[0];
+			next = to->parent;
+
+			if(next->bump != node->bump || math_chain_input(next) != to)
+				break;
+		}
+
+		if(chain.size() < 2)
+			continue;
+
+		MathChainNode *chain_node = new MathChainNode();
+		chain_node->bump = node->bump;
+
+		foreach(MathNode *math, chain) {
+			ShaderInput *linked_in = math_chain_input(math);
+			ShaderInput *constant_in = (linked_in == math->inputs[0])? math->inputs[1]: math->inputs[0];
+			MathChainNode::Step step;
+
+			step.type = MathNode::type_enum[math->type];
+			step.value = constant_in->value.x;
+			step.value_first = (linked_in == math->inputs[1]);
+			step.use_clamp = math->use_clamp;
+
+			chain_node->steps.push_back(step);
+			removed[math->id] = true;
+		}
+
+		add(chain_node);
+
+		/* relink inputs and outputs to the chain node */
+		ShaderInput *head_in = math_chain_input(chain.front());
+		ShaderOutput *from = head_in->link;
+		vector<ShaderInput*> links(chain.back()->outputs[0]->links);
+
+		disconnect(head_in);
+		connect(from, chain_node->inputs[0]);
+
+		foreach(ShaderInput *to, links) {
+			disconnect(to);
+			connect(chain_node->outputs[0], to);
+		}
+
+		any_node_removed = true;
+	}
+
+	/* remove fused nodes */
+	if(any_node_removed) {
+		list<ShaderNode*> newnodes;
+
+		foreach(ShaderNode *node, nodes) {
+			if(node->id < (int)removed.size() && removed[node->id])
+				delete node;
+			else
+				newnodes.push_back(node);
+		}
+
+		nodes = newnodes;
+	}
+}
+
+void ShaderGraph::clean(bool do_simplify)
 {
 	/* remove proxy and unnecessary nodes */
 	remove_unneeded_nodes();
 
+	/* fold constants and merge duplicate nodes, nodes left unused are
+	 * removed below */
+	if(do_simplify) {
+		constant_fold();
+		deduplicate_nodes();
+	}
+
 	/* we do two things here: find cycles and break them, and remove unused
 	 * nodes that don't feed into the output. how cycles are broken is
 	 * undefined, they are invalid input, the important thing is to not crash */
@@ -77,6 +77,7 @@ enum ShaderNodeSpecialType {
 	SHADER_SPECIAL_TYPE_PROXY,
 	SHADER_SPECIAL_TYPE_MIX_CLOSURE,
 	SHADER_SPECIAL_TYPE_MIX_RGB, /* Only Mix subtype */
+	SHADER_SPECIAL_TYPE_MATH,
 	SHADER_SPECIAL_TYPE_AUTOCONVERT,
 	SHADER_SPECIAL_TYPE_GEOMETRY,
 	SHADER_SPECIAL_TYPE_SCRIPT,
@@ -200,6 +201,15 @@ public:
 	virtual bool has_spatial_varying() { return false; }
 	virtual bool has_object_dependency() { return false; }
 
+	/* Evaluate output socket to a constant when the inputs it depends on
+	 * are constant, returns false if the node can't be folded. */
+	virtual bool constant_fold(ShaderOutput * /*socket*/, float3 * /*optimized_value*/) { return false; }
+
+	/* Test if the parameters of this node are equal to those of another node
+	 * with the same name, the graph compares the inputs. Nodes which don't
+	 * implement this are never merged. */
+	virtual bool equals(const ShaderNode * /*other*/) { return false; }
+
 	vector<ShaderInput*> inputs;
 	vector<ShaderOutput*> outputs;
 
@@ -271,7 +281,7 @@ public:
 	void relink(vector<ShaderInput*> inputs, vector<ShaderInput*> outputs, ShaderOutput *output);
 
 	void remove_unneeded_nodes();
-	void finalize(bool do_bump = false, bool do_osl = false);
+	void finalize(bool do_bump = false, bool do_osl = false, bool do_simplify = true);
 
 	int get_num_closures();
 
@@ -284,7 +294,11 @@ protected:
 	void copy_nodes(set<ShaderNode*>& nodes, map<ShaderNode*, ShaderNode*>& nnodemap);
 
 	void break_cycles(ShaderNode *node, vector<bool>& visited, vector<bool>& on_stack);
-	void clean();
+	void clean(bool do_simplify);
+	void constant_fold();
+	void deduplicate_nodes();
+	void fuse_math_chains();
+	void topological_order(vector<ShaderNode*>& order);
 	void bump_from_displacement();
 	void refine_bump_nodes();
 	void default_inputs(bool do_osl);
@@ -20,8 +20,11 @@
 
 #include "util_foreach.h"
 #include "util_image.h"
+#include "util_logging.h"
 #include "util_path.h"
 #include "util_progress.h"
+#include "util_texture_cache.h"
+#include "util_time.h"
 
 #ifdef WITH_OSL
 #include <OSL/oslexec.h>
@@ -34,19 +37,31 @@ ImageManager::ImageManager()
 	need_update = true;
 	pack_images = false;
 	osl_texture_system = NULL;
+	texture_cache = NULL;
+	texture_cache_max_size = 0;
+	load_stats.clear();
 	animation_frame = 0;
 
-	tex_num_images = TEX_NUM_IMAGES;
-	tex_num_float_images = TEX_NUM_FLOAT_IMAGES;
-	tex_image_byte_start = TEX_IMAGE_BYTE_START;
+	/* compact image types are only supported on the CPU, see
+	 * set_extended_image_limits() */
+	for(size_t type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		tex_num_images[type] = 0;
+		tex_start_images[type] = 0;
+	}
+
+	tex_num_images[IMAGE_DATA_TYPE_FLOAT4] = TEX_NUM_FLOAT_IMAGES;
+	tex_num_images[IMAGE_DATA_TYPE_BYTE4] = TEX_NUM_IMAGES;
+	tex_start_images[IMAGE_DATA_TYPE_BYTE4] = TEX_IMAGE_BYTE_START;
 }
 
 ImageManager::~ImageManager()
 {
-	for(size_t slot = 0; slot < images.size(); slot++)
-		assert(!images[slot]);
-	for(size_t slot = 0; slot < float_images.size(); slot++)
-		assert(!float_images[slot]);
+	for(size_t type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		for(size_t slot = 0; slot < images[type].size(); slot++)
+			assert(!images[type][slot]);
+	}
+
+	delete texture_cache;
 }
 
 void ImageManager::set_pack_images(bool pack_images_)
@@ -59,15 +74,21 @@ void ImageManager::set_osl_texture_system(void *texture_system)
 	osl_texture_system = texture_system;
 }
 
+void ImageManager::set_texture_cache_max_size(size_t max_size)
+{
+	texture_cache_max_size = max_size;
+}
+
 void ImageManager::set_extended_image_limits(const DeviceInfo& info)
 {
 	if(info.type == DEVICE_CPU) {
-		tex_num_images = TEX_EXTENDED_NUM_IMAGES_CPU;
-		tex_num_float_images = TEX_EXTENDED_NUM_FLOAT_IMAGES;
-		tex_image_byte_start = TEX_EXTENDED_IMAGE_BYTE_START;
+		for(size_t type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+			tex_num_images[type] = TEX_NUM_IMAGES_CPU;
+			tex_start_images[type] = type * TEX_NUM_IMAGES_CPU;
+		}
 	}
 	else if((info.type == DEVICE_CUDA || info.type == DEVICE_MULTI) && info.extended_images) {
-		tex_num_images = TEX_EXTENDED_NUM_IMAGES_GPU;
+		tex_num_images[IMAGE_DATA_TYPE_BYTE4] = TEX_EXTENDED_NUM_IMAGES_GPU;
 	}
 }
 
@@ -76,33 +97,46 @@ bool ImageManager::set_animation_frame_update(int frame)
 	if(frame != animation_frame) {
 		animation_frame = frame;
 
-		for(size_t slot = 0; slot < images.size(); slot++)
-			if(images[slot] && images[slot]->animated)
-				return true;
-
-		for(size_t slot = 0; slot < float_images.size(); slot++)
-			if(float_images[slot] && float_images[slot]->animated)
-				return true;
+		for(size_t type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+			for(size_t slot = 0; slot < images[type].size(); slot++) {
+				if(images[type][slot] && images[type][slot]->animated)
+					return true;
+			}
+		}
 	}
-	
+
 	return false;
 }
 
 bool ImageManager::is_float_image(const string& filename, void *builtin_data, bool& is_linear)
 {
-	bool is_float = false;
+	ImageDataType type = get_image_metadata(filename, builtin_data, is_linear);
+	return (type != IMAGE_DATA_TYPE_BYTE4 && type != IMAGE_DATA_TYPE_BYTE);
+}
+
+ImageDataType ImageManager::get_image_metadata(const string& filename, void *builtin_data, bool& is_linear)
+{
+	bool is_float = false, is_half = false;
+	int channels = 4;
 	is_linear = false;
 
 	if(builtin_data) {
 		if(builtin_image_info_cb) {
-			int width, height, depth, channels;
+			int width, height, depth;
 			builtin_image_info_cb(filename, builtin_data, is_float, width, height, depth, channels);
 		}
 
 		if(is_float)
 			is_linear = true;
 
-		return is_float;
+		/* builtin byte images are always passed as RGBA */
+		if(!is_float)
+			return IMAGE_DATA_TYPE_BYTE4;
+
+		if(channels == 1 && tex_num_images[IMAGE_DATA_TYPE_FLOAT] > 0)
+			return IMAGE_DATA_TYPE_FLOAT;
+
+		return IMAGE_DATA_TYPE_FLOAT4;
 	}
 
 	ImageInput *in = ImageInput::create(filename);
@@ -125,6 +159,18 @@ bool ImageManager::is_float_image(const string& filename, void *builtin_data, bo
 				}
 			}
 
+			/* half float images are kept in half float when all channels are */
+			if(spec.format == TypeDesc::HALF) {
+				is_half = true;
+
+				for(size_t channel = 0; channel < spec.channelformats.size(); channel++) {
+					if(spec.channelformats[channel] != TypeDesc::HALF)
+						is_half = false;
+				}
+			}
+
+			channels = spec.nchannels;
+
 			/* basic color space detection, not great but better than nothing
 			 * before we do OpenColorIO integration */
 			if(is_float) {
@@ -148,7 +194,52 @@ bool ImageManager::is_float_image(const string& filename, void *builtin_data, bo
 		delete in;
 	}
 
-	return is_float;
+	ImageDataType type;
+
+	if(is_half)
+		type = (channels == 1)? IMAGE_DATA_TYPE_HALF: IMAGE_DATA_TYPE_HALF4;
+	else if(is_float)
+		type = (channels == 1)? IMAGE_DATA_TYPE_FLOAT: IMAGE_DATA_TYPE_FLOAT4;
+	else
+		type = (channels == 1)? IMAGE_DATA_TYPE_BYTE: IMAGE_DATA_TYPE_BYTE4;
+
+	/* fall back to RGBA on devices without compact image types */
+	if(tex_num_images[type] == 0)
+		type = (is_float)? IMAGE_DATA_TYPE_FLOAT4: IMAGE_DATA_TYPE_BYTE4;
+
+	return type;
+}
+
+int ImageManager::type_index_to_flattened_slot(int slot, ImageDataType type)
+{
+	return slot + tex_start_images[type];
+}
+
+int ImageManager::flattened_slot_to_type_index(int flat_slot, ImageDataType *type)
+{
+	/* slot ranges of the types are ordered by type */
+	for(int i = IMAGE_DATA_NUM_TYPES - 1; i >= 0; i--) {
+		if(tex_num_images[i] > 0 && flat_slot >= tex_start_images[i]) {
+			*type = (ImageDataType)i;
+			return flat_slot - tex_start_images[i];
+		}
+	}
+
+	*type = IMAGE_DATA_TYPE_FLOAT4;
+	return flat_slot;
+}
+
+string ImageManager::name_from_type(int type)
+{
+	switch(type) {
+		case IMAGE_DATA_TYPE_FLOAT4: return "float4";
+		case IMAGE_DATA_TYPE_BYTE4: return "byte4";
+		case IMAGE_DATA_TYPE_HALF4: return "half4";
+		case IMAGE_DATA_TYPE_FLOAT: return "float";
+		case IMAGE_DATA_TYPE_BYTE: return "byte";
+		case IMAGE_DATA_TYPE_HALF: return "half";
+		default: return "unknown";
+	}
 }
 
 static bool image_equals(ImageManager::Image *image, const string& filename, void *builtin_data, InterpolationType interpolation)
@@ -164,159 +255,99 @@ int ImageManager::add_image(const string& filename, void *builtin_data, bool ani
 	Image *img;
 	size_t slot;
 
-	/* load image info and find out if we need a float texture */
-	is_float = (pack_images)? false: is_float_image(filename, builtin_data, is_linear);
-
-	if(is_float) {
-		/* find existing image */
-		for(slot = 0; slot < float_images.size(); slot++) {
-			img = float_images[slot];
-			if(img && image_equals(img, filename, builtin_data, interpolation)) {
-				if(img->frame != frame) {
-					img->frame = frame;
-					img->need_load = true;
-				}
-				if(img->use_alpha != use_alpha) {
-					img->use_alpha = use_alpha;
-					img->need_load = true;
-				}
-				img->users++;
-				return slot;
-			}
-		}
+	/* load image info and find out which data type we need */
+	ImageDataType type = (pack_images)? IMAGE_DATA_TYPE_BYTE4: get_image_metadata(filename, builtin_data, is_linear);
+	is_float = (type != IMAGE_DATA_TYPE_BYTE4 && type != IMAGE_DATA_TYPE_BYTE);
 
-		/* find free slot */
-		for(slot = 0; slot < float_images.size(); slot++) {
-			if(!float_images[slot])
-				break;
-		}
+	/* shaders are compiled in parallel */
+	thread_scoped_lock images_lock(images_mutex);
 
-		if(slot == float_images.size()) {
-			/* max images limit reached */
-			if(float_images.size() == tex_num_float_images) {
-				printf("ImageManager::add_image: float image limit reached %d, skipping '%s'\n",
-				       tex_num_float_images, filename.c_str());
-				return -1;
+	/* find existing image */
+	for(slot = 0; slot < images[type].size(); slot++) {
+		img = images[type][slot];
+		if(img && image_equals(img, filename, builtin_data, interpolation)) {
+			if(img->frame != frame) {
+				img->frame = frame;
+				img->need_load = true;
 			}
-
-			float_images.resize(float_images.size() + 1);
-		}
-
-		/* add new image */
-		img = new Image();
-		img->filename = filename;
-		img->builtin_data = builtin_data;
-		img->need_load = true;
-		img->animated = animated;
-		img->frame = frame;
-		img->interpolation = interpolation;
-		img->users = 1;
-		img->use_alpha = use_alpha;
-
-		float_images[slot] = img;
-	}
-	else {
-		for(slot = 0; slot < images.size(); slot++) {
-			img = images[slot];
-			if(img && image_equals(img, filename, builtin_data, interpolation)) {
-				if(img->frame != frame) {
-					img->frame = frame;
-					img->need_load = true;
-				}
-				if(img->use_alpha != use_alpha) {
-					img->use_alpha = use_alpha;
-					img->need_load = true;
-				}
-				img->users++;
-				return slot+tex_image_byte_start;
+			if(img->use_alpha != use_alpha) {
+				img->use_alpha = use_alpha;
+				img->need_load = true;
 			}
+			img->users++;
+			return type_index_to_flattened_slot(slot, type);
 		}
+	}
 
-		/* find free slot */
-		for(slot = 0; slot < images.size(); slot++) {
-			if(!images[slot])
-				break;
-		}
-
-		if(slot == images.size()) {
-			/* max images limit reached */
-			if(images.size() == tex_num_images) {
-				printf("ImageManager::add_image: byte image limit reached %d, skipping '%s'\n",
-				       tex_num_images, filename.c_str());
-				return -1;
-			}
+	/* find free slot */
+	for(slot = 0; slot < images[type].size(); slot++) {
+		if(!images[type][slot])
+			break;
+	}
 
-			images.resize(images.size() + 1);
+	if(slot == images[type].size()) {
+		/* max images limit reached */
+		if(images[type].size() == tex_num_images[type]) {
+			printf("ImageManager::add_image: %s image limit reached %d, skipping '%s'\n",
+			       name_from_type(type).c_str(), tex_num_images[type], filename.c_str());
+			return -1;
 		}
 
-		/* add new image */
-		img = new Image();
-		img->filename = filename;
-		img->builtin_data = builtin_data;
-		img->need_load = true;
-		img->animated = animated;
-		img->frame = frame;
-		img->interpolation = interpolation;
-		img->users = 1;
-		img->use_alpha = use_alpha;
+		images[type].resize(images[type].size() + 1);
+	}
 
-		images[slot] = img;
+	/* add new image */
+	img = new Image();
+	img->filename = filename;
+	img->builtin_data = builtin_data;
+	img->need_load = true;
+	img->animated = animated;
+	img->frame = frame;
+	img->interpolation = interpolation;
+	img->users = 1;
+	img->use_alpha = use_alpha;
 
-		slot += tex_image_byte_start;
-	}
+	images[type][slot] = img;
 
 	need_update = true;
 
-	return slot;
+	return type_index_to_flattened_slot(slot, type);
 }
 
-void ImageManager::remove_image(int slot)
+void ImageManager::remove_image(int flat_slot)
 {
-	if(slot >= tex_image_byte_start) {
-		slot -= tex_image_byte_start;
+	thread_scoped_lock images_lock(images_mutex);
+	remove_image_slot(flat_slot);
+}
 
-		assert(images[slot] != NULL);
+void ImageManager::remove_image_slot(int flat_slot)
+{
+	ImageDataType type;
+	int slot = flattened_slot_to_type_index(flat_slot, &type);
 
-		/* decrement user count */
-		images[slot]->users--;
-		assert(images[slot]->users >= 0);
+	assert(images[type][slot] != NULL);
 
-		/* don't remove immediately, rather do it all together later on. one of
-		 * the reasons for this is that on shader changes we add and remove nodes
-		 * that use them, but we do not want to reload the image all the time. */
-		if(images[slot]->users == 0)
-			need_update = true;
-	}
-	else {
-		/* decrement user count */
-		float_images[slot]->users--;
-		assert(float_images[slot]->users >= 0);
+	/* decrement user count */
+	images[type][slot]->users--;
+	assert(images[type][slot]->users >= 0);
 
-		/* don't remove immediately, rather do it all together later on. one of
-		 * the reasons for this is that on shader changes we add and remove nodes
-		 * that use them, but we do not want to reload the image all the time. */
-		if(float_images[slot]->users == 0)
-			need_update = true;
-	}
+	/* don't remove immediately, rather do it all together later on. one of
+	 * the reasons for this is that on shader changes we add and remove nodes
+	 * that use them, but we do not want to reload the image all the time. */
+	if(images[type][slot]->users == 0)
+		need_update = true;
 }
 
 void ImageManager::remove_image(const string& filename, void *builtin_data, InterpolationType interpolation)
 {
-	size_t slot;
-
-	for(slot = 0; slot < images.size(); slot++) {
-		if(images[slot] && image_equals(images[slot], filename, builtin_data, interpolation)) {
-			remove_image(slot+tex_image_byte_start);
-			break;
-		}
-	}
-
-	if(slot == images.size()) {
-		/* see if it's in a float texture slot */
-		for(slot = 0; slot < float_images.size(); slot++) {
-			if(float_images[slot] && image_equals(float_images[slot], filename, builtin_data, interpolation)) {
-				remove_image(slot);
-				break;
+	/* nodes removed from graphs while compiling shaders in parallel */
+	thread_scoped_lock images_lock(images_mutex);
+
+	for(size_t type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		for(size_t slot = 0; slot < images[type].size(); slot++) {
+			if(images[type][slot] && image_equals(images[type][slot], filename, builtin_data, interpolation)) {
+				remove_image_slot(type_index_to_flattened_slot(slot, (ImageDataType)type));
+				return;
 			}
 		}
 	}
@@ -328,28 +359,65 @@ void ImageManager::remove_image(const string& filename, void *builtin_data, Inte
  */
 void ImageManager::tag_reload_image(const string& filename, void *builtin_data, InterpolationType interpolation)
 {
-	size_t slot;
-
-	for(slot = 0; slot < images.size(); slot++) {
-		if(images[slot] && image_equals(images[slot], filename, builtin_data, interpolation)) {
-			images[slot]->need_load = true;
-			break;
-		}
-	}
-
-	if(slot == images.size()) {
-		/* see if it's in a float texture slot */
-		for(slot = 0; slot < float_images.size(); slot++) {
-			if(float_images[slot] && image_equals(float_images[slot], filename, builtin_data, interpolation)) {
-				float_images[slot]->need_load = true;
-				break;
+	for(size_t type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		for(size_t slot = 0; slot < images[type].size(); slot++) {
+			if(images[type][slot] && image_equals(images[type][slot], filename, builtin_data, interpolation)) {
+				images[type][slot]->need_load = true;
+				return;
 			}
 		}
 	}
 }
 
-bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
+/* Pixel storage of the image data types, the device type is either one or
+ * four of these. */
+
+template<typename T> struct ImageStorage {};
+
+template<> struct ImageStorage<uchar> {
+	static TypeDesc::BASETYPE file_format() { return TypeDesc::UINT8; }
+	static uchar from_float(float f) { return (uchar)(f * 255.0f); }
+	static float to_float(uchar u) { return u * (1.0f/255.0f); }
+};
+
+template<> struct ImageStorage<float> {
+	static TypeDesc::BASETYPE file_format() { return TypeDesc::FLOAT; }
+	static float from_float(float f) { return f; }
+	static float to_float(float f) { return f; }
+};
+
+template<> struct ImageStorage<half> {
+	static TypeDesc::BASETYPE file_format() { return TypeDesc::HALF; }
+	static half from_float(float f) { return float_to_half(f); }
+	static float to_float(half h) { return half_to_float(h); }
+};
+
+static bool builtin_load_pixels(ImageManager *manager, ImageManager::Image *img, uchar *pixels)
+{
+	if(!manager->builtin_image_pixels_cb)
+		return false;
+	return manager->builtin_image_pixels_cb(img->filename, img->builtin_data, pixels);
+}
+
+static bool builtin_load_pixels(ImageManager *manager, ImageManager::Image *img, float *pixels)
+{
+	if(!manager->builtin_image_float_pixels_cb)
+		return false;
+	return manager->builtin_image_float_pixels_cb(img->filename, img->builtin_data, pixels);
+}
+
+static bool builtin_load_pixels(ImageManager * /*manager*/, ImageManager::Image * /*img*/, half * /*pixels*/)
 {
+	/* builtin images are never stored as half float */
+	return false;
+}
+
+template<typename StorageType, typename DeviceType>
+bool ImageManager::file_load_image(Image *img, device_vector<DeviceType>& tex_img)
+{
+	const TypeDesc::BASETYPE format = ImageStorage<StorageType>::file_format();
+	const int channels = sizeof(DeviceType) / sizeof(StorageType);
+
 	if(img->filename == "")
 		return false;
 
@@ -381,39 +449,58 @@ bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
 	}
 	else {
 		/* load image using builtin images callbacks */
-		if(!builtin_image_info_cb || !builtin_image_pixels_cb)
+		if(!builtin_image_info_cb)
 			return false;
 
 		bool is_float;
 		builtin_image_info_cb(img->filename, img->builtin_data, is_float, width, height, depth, components);
 	}
 
-	/* we only handle certain number of components */
-	if(!(components >= 1 && components <= 4)) {
+	/* single channel types only store single channel images */
+	if(components < 1 || width == 0 || height == 0 || (channels == 1 && components != 1)) {
 		if(in) {
 			in->close();
 			delete in;
 		}
-
 		return false;
 	}
 
-	/* read RGBA pixels */
-	uchar *pixels = (uchar*)tex_img.resize(width, height, depth);
+	/* read pixels */
+	StorageType *pixels = (StorageType*)tex_img.resize(width, height, depth);
+	size_t num_pixels = ((size_t)width) * height * depth;
 	bool cmyk = false;
 
 	if(in) {
+		StorageType *readpixels = pixels;
+		vector<StorageType> tmppixels;
+
+		if(components > 4) {
+			tmppixels.resize(num_pixels*components);
+			readpixels = &tmppixels[0];
+		}
+
 		if(depth <= 1) {
-			int scanlinesize = width*components*sizeof(uchar);
+			int scanlinesize = width*components*sizeof(StorageType);
 
-			in->read_image(TypeDesc::UINT8,
-				(uchar*)pixels + (((size_t)height)-1)*scanlinesize,
+			in->read_image(format,
+				(uchar*)readpixels + (((size_t)height)-1)*scanlinesize,
 				AutoStride,
 				-scanlinesize,
 				AutoStride);
 		}
 		else {
-			in->read_image(TypeDesc::UINT8, (uchar*)pixels);
+			in->read_image(format, (uchar*)readpixels);
+		}
+
+		if(components > 4) {
+			for(size_t i = num_pixels-1, pixel = 0; pixel < num_pixels; pixel++, i--) {
+				pixels[i*4+3] = tmppixels[i*components+3];
+				pixels[i*4+2] = tmppixels[i*components+2];
+				pixels[i*4+1] = tmppixels[i*components+1];
+				pixels[i*4+0] = tmppixels[i*components+0];
+			}
+
+			tmppixels.clear();
 		}
 
 		cmyk = strcmp(in->format_name(), "jpeg") == 0 && components == 4;
@@ -421,18 +508,23 @@ bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
 		in->close();
 		delete in;
 	}
-	else {
-		builtin_image_pixels_cb(img->filename, img->builtin_data, pixels);
+	else if(!builtin_load_pixels(this, img, pixels)) {
+		return false;
 	}
 
-	size_t num_pixels = ((size_t)width) * height * depth;
+	if(channels == 1)
+		return true;
+
+	/* expand to RGBA */
+	const StorageType one = ImageStorage<StorageType>::from_float(1.0f);
+
 	if(cmyk) {
-		/* CMYK */
+		/* CMYK, jpeg files are always read as bytes */
 		for(size_t i = num_pixels-1, pixel = 0; pixel < num_pixels; pixel++, i--) {
-			pixels[i*4+2] = (pixels[i*4+2]*pixels[i*4+3])/255;
-			pixels[i*4+1] = (pixels[i*4+1]*pixels[i*4+3])/255;
-			pixels[i*4+0] = (pixels[i*4+0]*pixels[i*4+3])/255;
-			pixels[i*4+3] = 255;
+			pixels[i*4+2] = (pixels[i*4+2]*pixels[i*4+3])/one;
+			pixels[i*4+1] = (pixels[i*4+1]*pixels[i*4+3])/one;
+			pixels[i*4+0] = (pixels[i*4+0]*pixels[i*4+3])/one;
+			pixels[i*4+3] = one;
 		}
 	}
 	else if(components == 2) {
@@ -447,7 +539,7 @@ bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
 	else if(components == 3) {
 		/* RGB */
 		for(size_t i = num_pixels-1, pixel = 0; pixel < num_pixels; pixel++, i--) {
-			pixels[i*4+3] = 255;
+			pixels[i*4+3] = one;
 			pixels[i*4+2] = pixels[i*3+2];
 			pixels[i*4+1] = pixels[i*3+1];
 			pixels[i*4+0] = pixels[i*3+0];
@@ -456,7 +548,7 @@ bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
 	else if(components == 1) {
 		/* grayscale */
 		for(size_t i = num_pixels-1, pixel = 0; pixel < num_pixels; pixel++, i--) {
-			pixels[i*4+3] = 255;
+			pixels[i*4+3] = one;
 			pixels[i*4+2] = pixels[i];
 			pixels[i*4+1] = pixels[i];
 			pixels[i*4+0] = pixels[i];
@@ -465,357 +557,438 @@ bool ImageManager::file_load_image(Image *img, device_vector<uchar4>& tex_img)
 
 	if(img->use_alpha == false) {
 		for(size_t i = num_pixels-1, pixel = 0; pixel < num_pixels; pixel++, i--) {
-			pixels[i*4+3] = 255;
+			pixels[i*4+3] = one;
 		}
 	}
 
 	return true;
 }
 
-bool ImageManager::file_load_float_image(Image *img, device_vector<float4>& tex_img)
+static string image_texture_name(ImageDataType type, int flat_slot)
 {
-	if(img->filename == "")
-		return false;
-
-	ImageInput *in = NULL;
-	int width, height, depth, components;
-
-	if(!img->builtin_data) {
-		/* load image from file through OIIO */
-		in = ImageInput::create(img->filename);
-
-		if(!in)
-			return false;
-
-		ImageSpec spec = ImageSpec();
-		ImageSpec config = ImageSpec();
+	switch(type) {
+		case IMAGE_DATA_TYPE_FLOAT4:
+			return string_printf("__tex_image_float_%03d", flat_slot);
+		case IMAGE_DATA_TYPE_BYTE4:
+			return string_printf("__tex_image_%03d", flat_slot);
+		case IMAGE_DATA_TYPE_HALF4:
+			return string_printf("__tex_image_half4_%03d", flat_slot);
+		case IMAGE_DATA_TYPE_FLOAT:
+			return string_printf("__tex_image_float1_%03d", flat_slot);
+		case IMAGE_DATA_TYPE_BYTE:
+			return string_printf("__tex_image_byte1_%03d", flat_slot);
+		case IMAGE_DATA_TYPE_HALF:
+			return string_printf("__tex_image_half1_%03d", flat_slot);
+		default:
+			assert(0);
+			return "";
+	}
+}
 
-		if(img->use_alpha == false)
-			config.attribute("oiio:UnassociatedAlpha",1);
+template<typename DeviceType>
+void ImageManager::device_free_pixels(Device *device, device_vector<DeviceType>& tex_img)
+{
+	if(tex_img.device_pointer) {
+		thread_scoped_lock device_lock(device_mutex);
+		device->tex_free(tex_img);
+	}
 
-		if(!in->open(img->filename, spec, config)) {
-			delete in;
-			return false;
-		}
+	tex_img.clear();
+}
 
-		/* we only handle certain number of components */
-		width = spec.width;
-		height = spec.height;
-		depth = spec.depth;
-		components = spec.nchannels;
+void ImageManager::device_free_pixels(Device *device, DeviceScene *dscene, ImageDataType type, int slot)
+{
+	switch(type) {
+		case IMAGE_DATA_TYPE_FLOAT4:
+			device_free_pixels(device, dscene->tex_float_image[slot]);
+			break;
+		case IMAGE_DATA_TYPE_BYTE4:
+			device_free_pixels(device, dscene->tex_image[slot]);
+			break;
+		case IMAGE_DATA_TYPE_HALF4:
+			device_free_pixels(device, dscene->tex_half4_image[slot]);
+			break;
+		case IMAGE_DATA_TYPE_FLOAT:
+			device_free_pixels(device, dscene->tex_float1_image[slot]);
+			break;
+		case IMAGE_DATA_TYPE_BYTE:
+			device_free_pixels(device, dscene->tex_byte1_image[slot]);
+			break;
+		case IMAGE_DATA_TYPE_HALF:
+			device_free_pixels(device, dscene->tex_half1_image[slot]);
+			break;
+		default:
+			assert(0);
 	}
-	else {
-		/* load image using builtin images callbacks */
-		if(!builtin_image_info_cb || !builtin_image_float_pixels_cb)
-			return false;
+}
 
-		bool is_float;
-		builtin_image_info_cb(img->filename, img->builtin_data, is_float, width, height, depth, components);
-	}
+bool ImageManager::device_cache_image(Device *device, DeviceScene *dscene, ImageDataType type, int slot, Image *img)
+{
+	/* files that can't be read are loaded as usual, to get the missing image color */
+	ImageInput *in = ImageInput::create(img->filename);
 
-	if(components < 1 || width == 0 || height == 0) {
-		if(in) {
-			in->close();
-			delete in;
-		}
+	if(!in)
 		return false;
-	}
 
-	/* read RGBA pixels */
-	float *pixels = (float*)tex_img.resize(width, height, depth);
-	bool cmyk = false;
+	ImageSpec spec;
+	bool readable = in->open(img->filename, spec);
 
-	if(in) {
-		float *readpixels = pixels;
-		vector<float> tmppixels;
+	if(readable)
+		in->close();
+	delete in;
 
-		if(components > 4) {
-			tmppixels.resize(((size_t)width)*height*components);
-			readpixels = &tmppixels[0];
-		}
+	if(!readable)
+		return false;
 
-		if(depth <= 1) {
-			int scanlinesize = width*components*sizeof(float);
+	/* the file may have changed since it was last used */
+	texture_cache->invalidate(img->filename);
+	TextureCacheHandle *handle = texture_cache->get_handle(img->filename, img->use_alpha);
+	string name = image_texture_name(type, type_index_to_flattened_slot(slot, type));
 
-			in->read_image(TypeDesc::FLOAT,
-				(uchar*)readpixels + (height-1)*scanlinesize,
-				AutoStride,
-				-scanlinesize,
-				AutoStride);
-		}
-		else {
-			in->read_image(TypeDesc::FLOAT, (uchar*)readpixels);
-		}
+	{
+		thread_scoped_lock device_lock(device_mutex);
 
-		if(components > 4) {
-			size_t dimensions = ((size_t)width)*height;
-			for(size_t i = dimensions-1, pixel = 0; pixel < dimensions; pixel++, i--) {
-				pixels[i*4+3] = tmppixels[i*components+3];
-				pixels[i*4+2] = tmppixels[i*components+2];
-				pixels[i*4+1] = tmppixels[i*components+1];
-				pixels[i*4+0] = tmppixels[i*components+0];
-			}
+		if(!device->tex_cache_alloc(name.c_str(), texture_cache, handle, img->interpolation))
+			return false;
+	}
 
-			tmppixels.clear();
-		}
+	/* free pixels from before the image was cached */
+	device_free_pixels(device, dscene, type, slot);
 
-		cmyk = strcmp(in->format_name(), "jpeg") == 0 && components == 4;
+	return true;
+}
 
-		in->close();
-		delete in;
-	}
-	else {
-		builtin_image_float_pixels_cb(img->filename, img->builtin_data, pixels);
+template<typename StorageType, typename DeviceType>
+void ImageManager::device_load_pixels(Device *device, Image *img, ImageDataType type, int flat_slot, device_vector<DeviceType>& tex_img)
+{
+	if(tex_img.device_pointer) {
+		thread_scoped_lock device_lock(device_mutex);
+		device->tex_free(tex_img);
 	}
 
-	size_t num_pixels = ((size_t)width) * height * depth;
-	if(cmyk) {
-		/* CMYK */
-		for(size_t i = num_pixels-1, pixel = 0; pixel < num_pixels; pixel++, i--) {
-			pixels[i*4+3] = 255;
-			pixels[i*4+2] = (pixels[i*4+2]*pixels[i*4+3])/255;
-			pixels[i*4+1] = (pixels[i*4+1]*pixels[i*4+3])/255;
-			pixels[i*4+0] = (pixels[i*4+0]*pixels[i*4+3])/255;
-		}
-	}
-	else if(components == 2) {
-		/* grayscale + alpha */
-		for(size_t i = num_pixels-1, pixel = 0; pixel < num_pixels; pixel++, i--) {
-			pixels[i*4+3] = pixels[i*2+1];
-			pixels[i*4+2] = pixels[i*2+0];
-			pixels[i*4+1] = pixels[i*2+0];
-			pixels[i*4+0] = pixels[i*2+0];
-		}
-	}
-	else if(components == 3) {
-		/* RGB */
-		for(size_t i = num_pixels-1, pixel = 0; pixel < num_pixels; pixel++, i--) {
-			pixels[i*4+3] = 1.0f;
-			pixels[i*4+2] = pixels[i*3+2];
-			pixels[i*4+1] = pixels[i*3+1];
-			pixels[i*4+0] = pixels[i*3+0];
-		}
+	double decode_time, upload_time = 0.0;
+	bool loaded;
+
+	{
+		scoped_timer timer(&decode_time);
+		loaded = file_load_image<StorageType>(img, tex_img);
 	}
-	else if(components == 1) {
-		/* grayscale */
-		for(size_t i = num_pixels-1, pixel = 0; pixel < num_pixels; pixel++, i--) {
-			pixels[i*4+3] = 1.0f;
-			pixels[i*4+2] = pixels[i];
-			pixels[i*4+1] = pixels[i];
-			pixels[i*4+0] = pixels[i];
-		}
+
+	if(!loaded) {
+		/* on failure to load, we set a 1x1 pixels pink image */
+		StorageType *pixels = (StorageType*)tex_img.resize(1, 1);
+		const int channels = sizeof(DeviceType) / sizeof(StorageType);
+		const float missing[4] = {TEX_IMAGE_MISSING_R,
+		                          TEX_IMAGE_MISSING_G,
+		                          TEX_IMAGE_MISSING_B,
+		                          TEX_IMAGE_MISSING_A};
+
+		for(int i = 0; i < channels; i++)
+			pixels[i] = ImageStorage<StorageType>::from_float(missing[i]);
 	}
 
-	if(img->use_alpha == false) {
-		for(size_t i = num_pixels-1, pixel = 0; pixel < num_pixels; pixel++, i--) {
-			pixels[i*4+3] = 1.0f;
-		}
+	string name = image_texture_name(type, flat_slot);
+
+	if(!pack_images) {
+		scoped_timer timer(&upload_time);
+		thread_scoped_lock device_lock(device_mutex);
+		device->tex_alloc(name.c_str(), tex_img, img->interpolation, true);
 	}
 
-	return true;
+	thread_scoped_lock stats_lock(load_stats_mutex);
+	load_stats.decode_time += decode_time;
+	load_stats.upload_time += upload_time;
 }
 
-void ImageManager::device_load_image(Device *device, DeviceScene *dscene, int slot, Progress *progress)
+void ImageManager::device_load_image(Device *device, DeviceScene *dscene, ImageDataType type, int slot, Progress *progress)
 {
 	if(progress->get_cancel())
 		return;
-	
-	Image *img;
-	bool is_float;
 
-	if(slot >= tex_image_byte_start) {
-		img = images[slot - tex_image_byte_start];
-		is_float = false;
-	}
-	else {
-		img = float_images[slot];
-		is_float = true;
-	}
+	Image *img = images[type][slot];
 
 	if(osl_texture_system && !img->builtin_data)
 		return;
 
-	if(is_float) {
-		string filename = path_filename(float_images[slot]->filename);
-		progress->set_status("Updating Images", "Loading " + filename);
+	/* image files are read on demand through the texture cache if the device
+	 * supports it, instead of being loaded into memory here */
+	if(texture_cache && !img->builtin_data && !pack_images) {
+		if(device_cache_image(device, dscene, type, slot, img)) {
+			img->need_load = false;
+			return;
+		}
+	}
 
-		device_vector<float4>& tex_img = dscene->tex_float_image[slot];
+	string filename = path_filename(img->filename);
+	int num_loaded, num_images;
 
-		if(tex_img.device_pointer) {
-			thread_scoped_lock device_lock(device_mutex);
-			device->tex_free(tex_img);
-		}
+	{
+		thread_scoped_lock stats_lock(load_stats_mutex);
+		num_loaded = ++load_stats.num_loaded;
+		num_images = load_stats.num_images;
+	}
 
-		if(!file_load_float_image(img, tex_img)) {
-			/* on failure to load, we set a 1x1 pixels pink image */
-			float *pixels = (float*)tex_img.resize(1, 1);
+	/* images are loaded in parallel, so report how many were started rather
+	 * than which one is being loaded, single slot updates are not counted */
+	if(num_loaded <= num_images)
+		progress->set_status("Updating Images", string_printf("Loading %d/%d, %s", num_loaded, num_images, filename.c_str()));
+	else
+		progress->set_status("Updating Images", "Loading " + filename);
 
-			pixels[0] = TEX_IMAGE_MISSING_R;
-			pixels[1] = TEX_IMAGE_MISSING_G;
-			pixels[2] = TEX_IMAGE_MISSING_B;
-			pixels[3] = TEX_IMAGE_MISSING_A;
-		}
+	int flat_slot = type_index_to_flattened_slot(slot, type);
 
-		string name;
+	switch(type) {
+		case IMAGE_DATA_TYPE_FLOAT4:
+			device_load_pixels<float>(device, img, type, flat_slot, dscene->tex_float_image[slot]);
+			break;
+		case IMAGE_DATA_TYPE_BYTE4:
+			device_load_pixels<uchar>(device, img, type, flat_slot, dscene->tex_image[slot]);
+			break;
+		case IMAGE_DATA_TYPE_HALF4:
+			device_load_pixels<half>(device, img, type, flat_slot, dscene->tex_half4_image[slot]);
+			break;
+		case IMAGE_DATA_TYPE_FLOAT:
+			device_load_pixels<float>(device, img, type, flat_slot, dscene->tex_float1_image[slot]);
+			break;
+		case IMAGE_DATA_TYPE_BYTE:
+			device_load_pixels<uchar>(device, img, type, flat_slot, dscene->tex_byte1_image[slot]);
+			break;
+		case IMAGE_DATA_TYPE_HALF:
+			device_load_pixels<half>(device, img, type, flat_slot, dscene->tex_half1_image[slot]);
+			break;
+		default:
+			assert(0);
+	}
 
-		if(slot >= 100) name = string_printf("__tex_image_float_%d", slot);
-		else if(slot >= 10) name = string_printf("__tex_image_float_0%d", slot);
-		else name = string_printf("__tex_image_float_00%d", slot);
+	img->need_load = false;
+}
 
-		if(!pack_images) {
-			thread_scoped_lock device_lock(device_mutex);
-			device->tex_alloc(name.c_str(), tex_img, img->interpolation, true);
-		}
+static device_memory& image_device_memory(DeviceScene *dscene, ImageDataType type, int slot)
+{
+	switch(type) {
+		case IMAGE_DATA_TYPE_BYTE4:
+			return dscene->tex_image[slot];
+		case IMAGE_DATA_TYPE_HALF4:
+			return dscene->tex_half4_image[slot];
+		case IMAGE_DATA_TYPE_FLOAT:
+			return dscene->tex_float1_image[slot];
+		case IMAGE_DATA_TYPE_BYTE:
+			return dscene->tex_byte1_image[slot];
+		case IMAGE_DATA_TYPE_HALF:
+			return dscene->tex_half1_image[slot];
+		case IMAGE_DATA_TYPE_FLOAT4:
+		default:
+			return dscene->tex_float_image[slot];
 	}
-	else {
-		string filename = path_filename(images[slot - tex_image_byte_start]->filename);
-		progress->set_status("Updating Images", "Loading " + filename);
+}
 
-		device_vector<uchar4>& tex_img = dscene->tex_image[slot - tex_image_byte_start];
+/* Range of grid cells reached by lookups that read a voxel. Linear and cubic
+ * interpolation read voxel i for lookups in [i-1.5, i+2.5) in voxel units,
+ * and lookups outside the image are clamped to the border voxels. */
+static void image_voxel_cell_range(int num_voxels, int num_cells, vector<int>& cell_begin, vector<int>& cell_end)
+{
+	float scale = (float)num_cells / (float)num_voxels;
 
-		if(tex_img.device_pointer) {
-			thread_scoped_lock device_lock(device_mutex);
-			device->tex_free(tex_img);
-		}
+	cell_begin.resize(num_voxels);
+	cell_end.resize(num_voxels);
 
-		if(!file_load_image(img, tex_img)) {
-			/* on failure to load, we set a 1x1 pixels pink image */
-			uchar *pixels = (uchar*)tex_img.resize(1, 1);
+	for(int i = 0; i < num_voxels; i++) {
+		cell_begin[i] = clamp((int)floorf((i - 1.5f)*scale), 0, num_cells - 1);
+		cell_end[i] = clamp((int)floorf((i + 2.5f)*scale), 0, num_cells - 1) + 1;
+	}
+}
 
-			pixels[0] = (TEX_IMAGE_MISSING_R * 255);
-			pixels[1] = (TEX_IMAGE_MISSING_G * 255);
-			pixels[2] = (TEX_IMAGE_MISSING_B * 255);
-			pixels[3] = (TEX_IMAGE_MISSING_A * 255);
+template<typename StorageType>
+static void image_voxel_maximum(device_memory& mem, int3 grid_res, float *grid)
+{
+	const StorageType *pixels = (const StorageType*)mem.data_pointer;
+	const int width = mem.data_width;
+	const int height = max((int)mem.data_height, 1);
+	const int depth = max((int)mem.data_depth, 1);
+	const int stride = mem.data_elements;
+	/* volume attribute lookups use the color channels only */
+	const int channels = min(stride, 3);
+
+	vector<int> x_begin, x_end, y_begin, y_end, z_begin, z_end;
+	image_voxel_cell_range(width, grid_res.x, x_begin, x_end);
+	image_voxel_cell_range(height, grid_res.y, y_begin, y_end);
+	image_voxel_cell_range(depth, grid_res.z, z_begin, z_end);
+
+	for(int z = 0; z < depth; z++) {
+		for(int y = 0; y < height; y++) {
+			const StorageType *pixel = pixels + ((size_t)z*height + y)*width*stride;
+
+			for(int x = 0; x < width; x++, pixel += stride) {
+				float value = 0.0f;
+
+				for(int c = 0; c < channels; c++)
+					value = max(value, fabsf(ImageStorage<StorageType>::to_float(pixel[c])));
+
+				/* most voxels of simulations are empty */
+				if(value == 0.0f)
+					continue;
+
+				for(int cz = z_begin[z]; cz < z_end[z]; cz++) {
+					for(int cy = y_begin[y]; cy < y_end[y]; cy++) {
+						float *cell = grid + ((size_t)cz*grid_res.y + cy)*grid_res.x;
+
+						for(int cx = x_begin[x]; cx < x_end[x]; cx++)
+							cell[cx] = max(cell[cx], value);
+					}
+				}
+			}
 		}
+	}
+}
 
-		string name;
+int3 ImageManager::get_image_resolution(DeviceScene *dscene, int flat_slot)
+{
+	ImageDataType type;
+	int slot = flattened_slot_to_type_index(flat_slot, &type);
 
-		if(slot >= 100) name = string_printf("__tex_image_%d", slot);
-		else if(slot >= 10) name = string_printf("__tex_image_0%d", slot);
-		else name = string_printf("__tex_image_00%d", slot);
+	if(slot >= images[type].size() || !images[type][slot] || images[type][slot]->need_load)
+		return make_int3(0, 0, 0);
 
-		if(!pack_images) {
-			thread_scoped_lock device_lock(device_mutex);
-			device->tex_alloc(name.c_str(), tex_img, img->interpolation, true);
-		}
-	}
+	device_memory& mem = image_device_memory(dscene, type, slot);
 
-	img->need_load = false;
+	if(!mem.data_pointer)
+		return make_int3(0, 0, 0);
+
+	return make_int3((int)mem.data_width,
+	                 max((int)mem.data_height, 1),
+	                 max((int)mem.data_depth, 1));
 }
 
-void ImageManager::device_free_image(Device *device, DeviceScene *dscene, int slot)
+bool ImageManager::get_image_voxel_maximum(DeviceScene *dscene, int flat_slot, int3 grid_res, float *grid)
 {
-	Image *img;
-	bool is_float;
+	int3 res = get_image_resolution(dscene, flat_slot);
 
-	if(slot >= tex_image_byte_start) {
-		img = images[slot - tex_image_byte_start];
-		is_float = false;
-	}
-	else {
-		img = float_images[slot];
-		is_float = true;
+	if(res.x == 0)
+		return false;
+
+	ImageDataType type;
+	int slot = flattened_slot_to_type_index(flat_slot, &type);
+	device_memory& mem = image_device_memory(dscene, type, slot);
+
+	switch(type) {
+		case IMAGE_DATA_TYPE_BYTE4:
+		case IMAGE_DATA_TYPE_BYTE:
+			image_voxel_maximum<uchar>(mem, grid_res, grid);
+			break;
+		case IMAGE_DATA_TYPE_HALF4:
+		case IMAGE_DATA_TYPE_HALF:
+			image_voxel_maximum<half>(mem, grid_res, grid);
+			break;
+		default:
+			image_voxel_maximum<float>(mem, grid_res, grid);
+			break;
 	}
 
+	return true;
+}
+
+void ImageManager::device_free_image(Device *device, DeviceScene *dscene, ImageDataType type, int slot)
+{
+	Image *img = images[type][slot];
+
 	if(img) {
+		if(texture_cache) {
+			string name = image_texture_name(type, type_index_to_flattened_slot(slot, type));
+			thread_scoped_lock device_lock(device_mutex);
+			device->tex_cache_free(name.c_str());
+		}
+
 		if(osl_texture_system && !img->builtin_data) {
 #ifdef WITH_OSL
-			ustring filename(images[slot]->filename);
+			ustring filename(img->filename);
 			((OSL::TextureSystem*)osl_texture_system)->invalidate(filename);
 #endif
 		}
-		else if(is_float) {
-			device_vector<float4>& tex_img = dscene->tex_float_image[slot];
-
-			if(tex_img.device_pointer) {
-				thread_scoped_lock device_lock(device_mutex);
-				device->tex_free(tex_img);
-			}
-
-			tex_img.clear();
-
-			delete float_images[slot];
-			float_images[slot] = NULL;
-		}
 		else {
-			device_vector<uchar4>& tex_img = dscene->tex_image[slot - tex_image_byte_start];
-
-			if(tex_img.device_pointer) {
-				thread_scoped_lock device_lock(device_mutex);
-				device->tex_free(tex_img);
-			}
-
-			tex_img.clear();
+			device_free_pixels(device, dscene, type, slot);
 
-			delete images[slot - tex_image_byte_start];
-			images[slot - tex_image_byte_start] = NULL;
+			delete images[type][slot];
+			images[type][slot] = NULL;
 		}
 	}
 }
 
 void ImageManager::device_update(Device *device, DeviceScene *dscene, Progress& progress)
 {
+	load_stats.clear();
+
 	if(!need_update)
 		return;
 
-	TaskPool pool;
+	if(texture_cache_max_size && !texture_cache && !osl_texture_system)
+		texture_cache = new TextureCache(texture_cache_max_size);
 
-	for(size_t slot = 0; slot < images.size(); slot++) {
-		if(!images[slot])
-			continue;
+	/* free unused images first and count the ones to load, for progress */
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		for(size_t slot = 0; slot < images[type].size(); slot++) {
+			if(!images[type][slot])
+				continue;
 
-		if(images[slot]->users == 0) {
-			device_free_image(device, dscene, slot + tex_image_byte_start);
-		}
-		else if(images[slot]->need_load) {
-			if(!osl_texture_system || images[slot]->builtin_data) 
-				pool.push(function_bind(&ImageManager::device_load_image, this, device, dscene, slot + tex_image_byte_start, &progress));
+			if(images[type][slot]->users == 0) {
+				device_free_image(device, dscene, (ImageDataType)type, slot);
+			}
+			else if(images[type][slot]->need_load) {
+				if(!osl_texture_system || images[type][slot]->builtin_data)
+					load_stats.num_images++;
+			}
 		}
 	}
 
-	for(size_t slot = 0; slot < float_images.size(); slot++) {
-		if(!float_images[slot])
-			continue;
+	/* decoding and conversion of each image runs as a separate task, only
+	 * the device allocation is serialized by device_mutex */
+	TaskPool pool;
 
-		if(float_images[slot]->users == 0) {
-			device_free_image(device, dscene, slot);
-		}
-		else if(float_images[slot]->need_load) {
-			if(!osl_texture_system || float_images[slot]->builtin_data) 
-				pool.push(function_bind(&ImageManager::device_load_image, this, device, dscene, slot, &progress));
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		for(size_t slot = 0; slot < images[type].size(); slot++) {
+			if(!images[type][slot] || !images[type][slot]->need_load)
+				continue;
+
+			if(!osl_texture_system || images[type][slot]->builtin_data)
+				pool.push(function_bind(&ImageManager::device_load_image, this, device, dscene, (ImageDataType)type, slot, &progress));
 		}
 	}
 
 	pool.wait_work();
 
+	if(progress.get_cancel())
+		return;
+
+	VLOG(1) << "Loaded " << load_stats.num_loaded << " images, "
+	        << load_stats.decode_time << "s decoding and "
+	        << load_stats.upload_time << "s uploading over all threads.";
+
 	if(pack_images)
 		device_pack_images(device, dscene, progress);
 
+	device_memory_report(dscene);
+
 	need_update = false;
 }
 
 void ImageManager::device_update_slot(Device *device,
                                       DeviceScene *dscene,
-                                      int slot,
+                                      int flat_slot,
                                       Progress *progress)
 {
-	Image *image;
-	if(slot >= tex_image_byte_start) {
-		int byte_slot = slot - tex_image_byte_start;
-		assert(images[byte_slot] != NULL);
-		image = images[byte_slot];
-	}
-	else {
-		assert(float_images[slot] != NULL);
-		image = float_images[slot];
-	}
+	ImageDataType type;
+	int slot = flattened_slot_to_type_index(flat_slot, &type);
+
+	Image *image = images[type][slot];
+	assert(image != NULL);
+
 	if(image->users == 0) {
-		device_free_image(device, dscene, slot);
+		device_free_image(device, dscene, type, slot);
 	}
 	else if(image->need_load) {
-		if(!osl_texture_system || float_images[slot]->builtin_data)
+		if(!osl_texture_system || image->builtin_data)
 			device_load_image(device,
 			                  dscene,
+			                  type,
 			                  slot,
 			                  progress);
 	}
@@ -829,21 +1002,24 @@ void ImageManager::device_pack_images(Device *device,
 	 * will do our own interpolation in the kernel */
 	size_t size = 0;
 
-	for(size_t slot = 0; slot < images.size(); slot++) {
-		if(!images[slot])
+	/* only byte images are used when packing */
+	vector<Image*>& byte_images = images[IMAGE_DATA_TYPE_BYTE4];
+
+	for(size_t slot = 0; slot < byte_images.size(); slot++) {
+		if(!byte_images[slot])
 			continue;
 
 		device_vector<uchar4>& tex_img = dscene->tex_image[slot];
 		size += tex_img.size();
 	}
 
-	uint4 *info = dscene->tex_image_packed_info.resize(images.size());
+	uint4 *info = dscene->tex_image_packed_info.resize(byte_images.size());
 	uchar4 *pixels = dscene->tex_image_packed.resize(size);
 
 	size_t offset = 0;
 
-	for(size_t slot = 0; slot < images.size(); slot++) {
-		if(!images[slot])
+	for(size_t slot = 0; slot < byte_images.size(); slot++) {
+		if(!byte_images[slot])
 			continue;
 
 		device_vector<uchar4>& tex_img = dscene->tex_image[slot];
@@ -853,7 +1029,7 @@ void ImageManager::device_pack_images(Device *device,
 		/* The image options are packed
 		   bit 0 -> periodic
 		   bit 1 + 2 -> interpolation type */
-		uint8_t interpolation = (images[slot]->interpolation << 1) + 1;
+		uint8_t interpolation = (byte_images[slot]->interpolation << 1) + 1;
 		info[slot] = make_uint4(tex_img.data_width, tex_img.data_height, offset, interpolation);
 
 		memcpy(pixels+offset, (void*)tex_img.data_pointer, tex_img.memory_size());
@@ -876,23 +1052,72 @@ void ImageManager::device_pack_images(Device *device,
 	}
 }
 
-void ImageManager::device_free_builtin(Device *device, DeviceScene *dscene)
+template<typename DeviceType>
+static void image_memory_add(device_vector<DeviceType>& tex_img, size_t rgba_size, size_t *mem_used, size_t *mem_rgba)
 {
-	for(size_t slot = 0; slot < images.size(); slot++)
-		if(images[slot] && images[slot]->builtin_data)
-			device_free_image(device, dscene, slot + tex_image_byte_start);
+	*mem_used += tex_img.memory_size();
+	*mem_rgba += tex_img.size() * rgba_size;
+}
+
+void ImageManager::device_memory_report(DeviceScene *dscene)
+{
+	/* compare against the memory images would take as float4 or uchar4 */
+	size_t mem_used = 0, mem_rgba = 0;
+	int num_images = 0;
+
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		for(size_t slot = 0; slot < images[type].size(); slot++) {
+			if(!images[type][slot])
+				continue;
+
+			switch(type) {
+				case IMAGE_DATA_TYPE_FLOAT4:
+					image_memory_add(dscene->tex_float_image[slot], sizeof(float4), &mem_used, &mem_rgba);
+					break;
+				case IMAGE_DATA_TYPE_BYTE4:
+					image_memory_add(dscene->tex_image[slot], sizeof(uchar4), &mem_used, &mem_rgba);
+					break;
+				case IMAGE_DATA_TYPE_HALF4:
+					image_memory_add(dscene->tex_half4_image[slot], sizeof(float4), &mem_used, &mem_rgba);
+					break;
+				case IMAGE_DATA_TYPE_FLOAT:
+					image_memory_add(dscene->tex_float1_image[slot], sizeof(float4), &mem_used, &mem_rgba);
+					break;
+				case IMAGE_DATA_TYPE_BYTE:
+					image_memory_add(dscene->tex_byte1_image[slot], sizeof(uchar4), &mem_used, &mem_rgba);
+					break;
+				case IMAGE_DATA_TYPE_HALF:
+					image_memory_add(dscene->tex_half1_image[slot], sizeof(float4), &mem_used, &mem_rgba);
+					break;
+			}
 
-	for(size_t slot = 0; slot < float_images.size(); slot++)
-		if(float_images[slot] && float_images[slot]->builtin_data)
-			device_free_image(device, dscene, slot);
+			num_images++;
+		}
+	}
+
+	VLOG(1) << string_printf("Image textures: %d images, %.2fM in memory, %.2fM saved by compact storage.",
+	                         num_images,
+	                         (double)mem_used / (1024.0 * 1024.0),
+	                         (double)(mem_rgba - mem_used) / (1024.0 * 1024.0));
+}
+
+void ImageManager::device_free_builtin(Device *device, DeviceScene *dscene)
+{
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		for(size_t slot = 0; slot < images[type].size(); slot++) {
+			if(images[type][slot] && images[type][slot]->builtin_data)
+				device_free_image(device, dscene, (ImageDataType)type, slot);
+		}
+	}
 }
 
 void ImageManager::device_free(Device *device, DeviceScene *dscene)
 {
-	for(size_t slot = 0; slot < images.size(); slot++)
-		device_free_image(device, dscene, slot + tex_image_byte_start);
-	for(size_t slot = 0; slot < float_images.size(); slot++)
-		device_free_image(device, dscene, slot);
+	for(int type = 0; type < IMAGE_DATA_NUM_TYPES; type++) {
+		for(size_t slot = 0; slot < images[type].size(); slot++)
+			device_free_image(device, dscene, (ImageDataType)type, slot);
+		images[type].clear();
+	}
 
 	device->tex_free(dscene->tex_image_packed);
 	device->tex_free(dscene->tex_image_packed_info);
@@ -900,8 +1125,8 @@ void ImageManager::device_free(Device *device, DeviceScene *dscene)
 	dscene->tex_image_packed.clear();
 	dscene->tex_image_packed_info.clear();
 
-	images.clear();
-	float_images.clear();
+	if(texture_cache)
+		VLOG(1) << texture_cache->stats();
 }
 
 CCL_NAMESPACE_END
@@ -35,10 +35,7 @@ CCL_NAMESPACE_BEGIN
 /* extended gpu */
 #define TEX_EXTENDED_NUM_IMAGES_GPU		145
 
-/* extended cpu */
-#define TEX_EXTENDED_NUM_FLOAT_IMAGES	1024
-#define TEX_EXTENDED_NUM_IMAGES_CPU		1024
-#define TEX_EXTENDED_IMAGE_BYTE_START	TEX_EXTENDED_NUM_FLOAT_IMAGES
+/* on the cpu every image data type has TEX_NUM_IMAGES_CPU slots */
 
 /* color to use when textures are not found */
 #define TEX_IMAGE_MISSING_R 1
@@ -49,6 +46,7 @@ CCL_NAMESPACE_BEGIN
 class Device;
 class DeviceScene;
 class Progress;
+class TextureCache;
 
 class ImageManager {
 public:
@@ -61,6 +59,7 @@ public:
 	void remove_image(const string& filename, void *builtin_data, InterpolationType interpolation);
 	void tag_reload_image(const string& filename, void *builtin_data, InterpolationType interpolation);
 	bool is_float_image(const string& filename, void *builtin_data, bool& is_linear);
+	ImageDataType get_image_metadata(const string& filename, void *builtin_data, bool& is_linear);
 
 	void device_update(Device *device, DeviceScene *dscene, Progress& progress);
 	void device_update_slot(Device *device, DeviceScene *dscene, int slot, Progress *progress);
@@ -68,10 +67,18 @@ public:
 	void device_free_builtin(Device *device, DeviceScene *dscene);
 
 	void set_osl_texture_system(void *texture_system);
+	void set_texture_cache_max_size(size_t max_size);
 	void set_pack_images(bool pack_images_);
 	void set_extended_image_limits(const DeviceInfo& info);
 	bool set_animation_frame_update(int frame);
 
+	/* Access to the host copy of loaded images, for acceleration structures
+	 * built from voxel data. The resolution is zero if the image is not
+	 * loaded, and the maximum merges the absolute channel values of the
+	 * voxels into every grid cell their interpolation can reach. */
+	int3 get_image_resolution(DeviceScene *dscene, int flat_slot);
+	bool get_image_voxel_maximum(DeviceScene *dscene, int flat_slot, int3 grid_res, float *grid);
+
 	bool need_update;
 
 	function<void(const string &filename, void *data, bool &is_float, int &width, int &height, int &depth, int &channels)> builtin_image_info_cb;
@@ -91,23 +98,59 @@ public:
 		int users;
 	};
 
+	/* Statistics of the last device_update. Decode and upload times are
+	 * summed over all threads, so they can exceed the wall clock time. */
+	struct LoadStats {
+		int num_images;
+		int num_loaded;
+		double decode_time;
+		double upload_time;
+
+		void clear()
+		{
+			num_images = 0;
+			num_loaded = 0;
+			decode_time = 0.0;
+			upload_time = 0.0;
+		}
+	};
+
+	LoadStats load_stats;
+
 private:
-	int tex_num_images;
-	int tex_num_float_images;
-	int tex_image_byte_start;
+	int tex_num_images[IMAGE_DATA_NUM_TYPES];
+	int tex_start_images[IMAGE_DATA_NUM_TYPES];
 	thread_mutex device_mutex;
+	thread_mutex load_stats_mutex;
+	thread_mutex images_mutex;
 	int animation_frame;
 
-	vector<Image*> images;
-	vector<Image*> float_images;
+	vector<Image*> images[IMAGE_DATA_NUM_TYPES];
 	void *osl_texture_system;
+	TextureCache *texture_cache;
+	size_t texture_cache_max_size;
 	bool pack_images;
 
-	bool file_load_image(Image *img, device_vector<uchar4>& tex_img);
-	bool file_load_float_image(Image *img, device_vector<float4>& tex_img);
+	template<typename StorageType, typename DeviceType>
+	bool file_load_image(Image *img, device_vector<DeviceType>& tex_img);
+
+	void remove_image_slot(int flat_slot);
+
+	int type_index_to_flattened_slot(int slot, ImageDataType type);
+	int flattened_slot_to_type_index(int flat_slot, ImageDataType *type);
+	string name_from_type(int type);
+
+	template<typename StorageType, typename DeviceType>
+	void device_load_pixels(Device *device, Image *img, ImageDataType type, int flat_slot, device_vector<DeviceType>& tex_img);
+	template<typename DeviceType>
+	void device_free_pixels(Device *device, device_vector<DeviceType>& tex_img);
+	void device_free_pixels(Device *device, DeviceScene *dscene, ImageDataType type, int slot);
+
+	bool device_cache_image(Device *device, DeviceScene *dscene, ImageDataType type, int slot, Image *img);
+	void device_load_image(Device *device, DeviceScene *dscene, ImageDataType type, int slot, Progress *progess);
+	void device_free_image(Device *device, DeviceScene *dscene, ImageDataType type, int slot);
 
-	void device_load_image(Device *device, DeviceScene *dscene, int slot, Progress *progess);
-	void device_free_image(Device *device, DeviceScene *dscene, int slot);
+	void device_memory_report(DeviceScene *dscene);
 
 	void device_pack_images(Device *device, DeviceScene *dscene, Progress& progess);
 };
@@ -63,10 +63,15 @@ Integrator::Integrator()
 	sample_all_lights_direct = true;
 	sample_all_lights_indirect = true;
 
+	use_light_tree = false;
+
 	method = PATH;
 
 	sampling_pattern = SAMPLING_PATTERN_SOBOL;
 
+	adaptive_threshold = 0.01f;
+	adaptive_min_samples = 0;
+
 	need_update = true;
 }
 
@@ -149,6 +154,19 @@ void Integrator::device_update(Device *device, DeviceScene *dscene, Scene *scene
 	kintegrator->sampling_pattern = sampling_pattern;
 	kintegrator->aa_samples = aa_samples;
 
+	/* adaptive sampling, the convergence test runs every few samples and
+	 * needs an even number of samples to split them in two halves */
+	kintegrator->adaptive_step = 4;
+	kintegrator->adaptive_threshold = adaptive_threshold;
+
+	if(adaptive_min_samples > 0)
+		kintegrator->adaptive_min_samples = adaptive_min_samples;
+	else
+		kintegrator->adaptive_min_samples = (int)ceilf(16.0f / powf(max(adaptive_threshold, 1e-4f), 0.3f));
+
+	kintegrator->adaptive_min_samples = align_up(max(kintegrator->adaptive_min_samples, kintegrator->adaptive_step),
+	                                             kintegrator->adaptive_step);
+
 	/* sobol directions table */
 	int max_samples = 1;
 
@@ -212,8 +230,11 @@ bool Integrator::modified(const Integrator& integrator)
 		volume_samples == integrator.volume_samples &&
 		motion_blur == integrator.motion_blur &&
 		sampling_pattern == integrator.sampling_pattern &&
+		adaptive_threshold == integrator.adaptive_threshold &&
+		adaptive_min_samples == integrator.adaptive_min_samples &&
 		sample_all_lights_direct == integrator.sample_all_lights_direct &&
-		sample_all_lights_indirect == integrator.sample_all_lights_indirect);
+		sample_all_lights_indirect == integrator.sample_all_lights_indirect &&
+		use_light_tree == integrator.use_light_tree);
 }
 
 void Integrator::tag_update(Scene * /*scene*/)
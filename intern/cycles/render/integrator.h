@@ -64,6 +64,10 @@ public:
 	bool sample_all_lights_direct;
 	bool sample_all_lights_indirect;
 
+	/* pick lights based on their distance and orientation with a light tree
+	 * built by the light manager, only used for path tracing */
+	bool use_light_tree;
+
 	enum Method {
 		BRANCHED_PATH = 0,
 		PATH = 1
@@ -73,6 +77,12 @@ public:
 
 	SamplingPattern sampling_pattern;
 
+	/* adaptive sampling stops pixels with an error below the threshold, it
+	 * is enabled by adding the adaptive sampling passes to the render buffers
+	 * and only done by the CPU device */
+	float adaptive_threshold;
+	int adaptive_min_samples;  /* zero for automatic */
+
 	bool need_update;
 
 	Integrator();
@@ -19,6 +19,7 @@
 #include "integrator.h"
 #include "film.h"
 #include "light.h"
+#include "light_tree.h"
 #include "mesh.h"
 #include "object.h"
 #include "scene.h"
@@ -138,6 +139,38 @@ void Light::tag_update(Scene *scene)
 	scene->light_manager->need_update = true;
 }
 
+/* Light Tree */
+
+static LightTreeEmitter light_tree_lamp_emitter(Light *light, int distribution_index, float energy)
+{
+	LightTreeEmitter emitter;
+
+	if(light->type == LIGHT_AREA) {
+		float3 axisu = light->axisu*(light->sizeu*light->size*0.5f);
+		float3 axisv = light->axisv*(light->sizev*light->size*0.5f);
+
+		emitter.bounds.grow(light->co - axisu - axisv);
+		emitter.bounds.grow(light->co - axisu + axisv);
+		emitter.bounds.grow(light->co + axisu - axisv);
+		emitter.bounds.grow(light->co + axisu + axisv);
+
+		/* one sided */
+		if(len_squared(light->dir) > 0.0f)
+			emitter.cone = LightTreeCone(normalize(light->dir), 0.0f, M_PI_2_F);
+	}
+	else {
+		emitter.bounds.grow(light->co, light->size);
+
+		if(light->type == LIGHT_SPOT && len_squared(light->dir) > 0.0f)
+			emitter.cone = LightTreeCone(normalize(light->dir), 0.0f, light->spot_angle*0.5f);
+	}
+
+	emitter.energy = energy;
+	emitter.distribution_index = distribution_index;
+
+	return emitter;
+}
+
 /* Light Manager */
 
 LightManager::LightManager()
@@ -161,6 +194,12 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 
 	bool background_mis = false;
 
+	/* the light tree is only used for path tracing, branched path tracing
+	 * samples all lamps and picks triangles from the distribution instead */
+	bool use_light_tree = scene->integrator->use_light_tree &&
+	                      scene->integrator->method == Integrator::PATH;
+	vector<LightTreeEmitter> emitters;
+
 	foreach(Light *light, scene->lights) {
 		if(!light->is_portal)
 			num_lights++;
@@ -262,6 +301,11 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 				use_light_visibility = true;
 			}
 
+			/* tree bounds are computed without motion, so triangles
+			 * could not be found for multiple importance sampling */
+			if(object->use_motion)
+				use_light_tree = false;
+
 			for(size_t i = 0; i < mesh->triangles.size(); i++) {
 				Shader *shader = scene->shaders[mesh->shader[i]];
 
@@ -270,7 +314,6 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 					distribution[offset].y = __int_as_float(i + mesh->tri_offset);
 					distribution[offset].z = __int_as_float(shader_flag);
 					distribution[offset].w = __int_as_float(object_id);
-					offset++;
 
 					Mesh::Triangle t = mesh->triangles[i];
 					float3 p1 = mesh->verts[t.v[0]];
@@ -283,7 +326,21 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 						p3 = transform_point(&tfm, p3);
 					}
 
-					totarea += triangle_area(p1, p2, p3);
+					float area = triangle_area(p1, p2, p3);
+					totarea += area;
+
+					/* two sided, so emitting in all directions */
+					if(use_light_tree) {
+						LightTreeEmitter emitter;
+						emitter.bounds.grow(p1);
+						emitter.bounds.grow(p2);
+						emitter.bounds.grow(p3);
+						emitter.energy = area;
+						emitter.distribution_index = offset;
+						emitters.push_back(emitter);
+					}
+
+					offset++;
 				}
 			}
 		}
@@ -295,30 +352,48 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 
 	float trianglearea = totarea;
 
-	/* point lights */
+	/* point lights, lamps at infinity go last so the light tree can pick
+	 * them separately */
 	float lightarea = (totarea > 0.0f) ? totarea / num_lights : 1.0f;
 	bool use_lamp_mis = false;
+	int num_infinite_lights = 0;
 
 	int light_index = 0;
-	foreach(Light *light, scene->lights) {
-		if(light->is_portal)
-			continue;
+	for(int infinite = 0; infinite < 2; infinite++) {
+		light_index = 0;
 
-		distribution[offset].x = totarea;
-		distribution[offset].y = __int_as_float(~light_index);
-		distribution[offset].z = 1.0f;
-		distribution[offset].w = light->size;
-		totarea += lightarea;
+		foreach(Light *light, scene->lights) {
+			if(light->is_portal)
+				continue;
 
-		if(light->size > 0.0f && light->use_mis)
-			use_lamp_mis = true;
-		if(light->type == LIGHT_BACKGROUND) {
-			num_background_lights++;
-			background_mis = light->use_mis;
-		}
+			bool is_infinite = (light->type == LIGHT_DISTANT || light->type == LIGHT_BACKGROUND);
 
-		light_index++;
-		offset++;
+			if(is_infinite != (infinite == 1)) {
+				light_index++;
+				continue;
+			}
+
+			distribution[offset].x = totarea;
+			distribution[offset].y = __int_as_float(~light_index);
+			distribution[offset].z = 1.0f;
+			distribution[offset].w = light->size;
+			totarea += lightarea;
+
+			if(light->size > 0.0f && light->use_mis)
+				use_lamp_mis = true;
+			if(light->type == LIGHT_BACKGROUND) {
+				num_background_lights++;
+				background_mis = light->use_mis;
+			}
+
+			if(is_infinite)
+				num_infinite_lights++;
+			else if(use_light_tree)
+				emitters.push_back(light_tree_lamp_emitter(light, offset, lightarea));
+
+			light_index++;
+			offset++;
+		}
 	}
 
 	/* normalize cumulative distribution functions */
@@ -381,6 +456,24 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 		/* CDF */
 		device->tex_alloc("__light_distribution", dscene->light_distribution);
 
+		/* Light tree, lamps at infinity are picked with the same probability
+		 * as from the distribution, so they need no nodes */
+		kintegrator->use_light_tree = false;
+		kintegrator->num_infinite_lights = num_infinite_lights;
+
+		if(use_light_tree && emitters.size()) {
+			LightTree tree(emitters);
+			float4 *nodes = dscene->light_tree.resize(tree.num_nodes()*LIGHT_TREE_NODE_SIZE);
+
+			tree.pack(nodes);
+			device->tex_alloc("__light_tree", dscene->light_tree);
+
+			kintegrator->use_light_tree = true;
+
+			VLOG(1) << "Light tree built with " << emitters.size() << " emitters, "
+			        << tree.num_nodes() << " nodes.";
+		}
+
 		/* Portals */
 		if(num_background_lights > 0 && light_index != scene->lights.size()) {
 			kintegrator->portal_offset = light_index;
@@ -402,6 +495,8 @@ void LightManager::device_update_distribution(Device *device, DeviceScene *dscen
 		kintegrator->pdf_lights = 0.0f;
 		kintegrator->inv_pdf_lights = 0.0f;
 		kintegrator->use_lamp_mis = false;
+		kintegrator->use_light_tree = false;
+		kintegrator->num_infinite_lights = 0;
 		kintegrator->num_portals = 0;
 		kintegrator->portal_offset = 0;
 		kintegrator->portal_pdf = 0.0f;
@@ -757,11 +852,13 @@ void LightManager::device_free(Device *device, DeviceScene *dscene)
 {
 	device->tex_free(dscene->light_distribution);
 	device->tex_free(dscene->light_data);
+	device->tex_free(dscene->light_tree);
 	device->tex_free(dscene->light_background_marginal_cdf);
 	device->tex_free(dscene->light_background_conditional_cdf);
 
 	dscene->light_distribution.clear();
 	dscene->light_data.clear();
+	dscene->light_tree.clear();
 	dscene->light_background_marginal_cdf.clear();
 	dscene->light_background_conditional_cdf.clear();
 }
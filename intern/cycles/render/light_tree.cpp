@@ -0,0 +1,159 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "light_tree.h"
+
+#include "kernel_types.h"
+
+#include "util_algorithm.h"
+#include "util_math.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Cone */
+
+LightTreeCone::LightTreeCone()
+: axis(make_float3(0.0f, 0.0f, 1.0f)), theta_o(M_PI_F), theta_e(M_PI_2_F)
+{
+}
+
+LightTreeCone::LightTreeCone(const float3& axis, float theta_o, float theta_e)
+: axis(axis), theta_o(theta_o), theta_e(theta_e)
+{
+}
+
+LightTreeCone LightTreeCone::merge(const LightTreeCone& a, const LightTreeCone& b)
+{
+	if(b.theta_o > a.theta_o)
+		return merge(b, a);
+
+	float theta_e = max(a.theta_e, b.theta_e);
+	float cos_theta_d = dot(a.axis, b.axis);
+	float theta_d = safe_acosf(cos_theta_d);
+
+	/* b is inside a */
+	if(min(theta_d + b.theta_o, M_PI_F) <= a.theta_o)
+		return LightTreeCone(a.axis, a.theta_o, theta_e);
+
+	float theta_o = 0.5f*(a.theta_o + theta_d + b.theta_o);
+
+	if(theta_o >= M_PI_F)
+		return LightTreeCone(a.axis, M_PI_F, theta_e);
+
+	/* rotate the axis of a towards b, opposite axes have no defined
+	 * rotation so they bound all directions */
+	float3 ortho = b.axis - a.axis*cos_theta_d;
+	float ortho_len = len(ortho);
+
+	if(ortho_len < 1e-6f)
+		return LightTreeCone(a.axis, M_PI_F, theta_e);
+
+	float theta_r = theta_o - a.theta_o;
+	float3 axis = a.axis*cosf(theta_r) + ortho*(sinf(theta_r)/ortho_len);
+
+	return LightTreeCone(normalize(axis), theta_o, theta_e);
+}
+
+/* Tree */
+
+struct LightTreeCentroidCompare {
+	int dim;
+
+	explicit LightTreeCentroidCompare(int dim) : dim(dim) {}
+
+	bool operator()(const LightTreeEmitter& a, const LightTreeEmitter& b) const
+	{
+		return a.bounds.center()[dim] < b.bounds.center()[dim];
+	}
+};
+
+LightTree::LightTree(const vector<LightTreeEmitter>& emitters_)
+: emitters(emitters_)
+{
+	if(emitters.size()) {
+		nodes.reserve(emitters.size()*2 - 1);
+		recursive_build(0, emitters.size());
+	}
+}
+
+int LightTree::recursive_build(int start, int end)
+{
+	int index = nodes.size();
+	nodes.push_back(Node());
+
+	Node node;
+	node.bounds = emitters[start].bounds;
+	node.cone = emitters[start].cone;
+	node.energy = emitters[start].energy;
+	node.left = -1;
+	node.right = -1;
+	node.emitter = -1;
+
+	BoundBox centroid_bounds(emitters[start].bounds.center());
+
+	for(int i = start + 1; i < end; i++) {
+		node.bounds.grow(emitters[i].bounds);
+		node.cone = LightTreeCone::merge(node.cone, emitters[i].cone);
+		node.energy += emitters[i].energy;
+		centroid_bounds.grow(emitters[i].bounds.center());
+	}
+
+	if(end - start == 1) {
+		node.emitter = start;
+	}
+	else {
+		/* median split along the largest axis of the centroids, which keeps
+		 * the tree balanced so its depth fits the kernel traversal stack */
+		float3 size = centroid_bounds.size();
+		int dim = (size.x > size.y)? ((size.x > size.z)? 0: 2): ((size.y > size.z)? 1: 2);
+		int mid = (start + end)/2;
+
+		std::nth_element(emitters.begin() + start,
+		                 emitters.begin() + mid,
+		                 emitters.begin() + end,
+		                 LightTreeCentroidCompare(dim));
+
+		node.left = recursive_build(start, mid);
+		node.right = recursive_build(mid, end);
+	}
+
+	nodes[index] = node;
+
+	return index;
+}
+
+void LightTree::pack(float4 *data) const
+{
+	for(size_t i = 0; i < nodes.size(); i++) {
+		const Node& node = nodes[i];
+		float4 *ndata = data + i*LIGHT_TREE_NODE_SIZE;
+		int left = node.left;
+		int right = node.right;
+
+		if(node.emitter != -1) {
+			left = ~emitters[node.emitter].distribution_index;
+			right = 0;
+		}
+
+		ndata[0] = make_float4(node.bounds.min.x, node.bounds.min.y, node.bounds.min.z, node.energy);
+		ndata[1] = make_float4(node.bounds.max.x, node.bounds.max.y, node.bounds.max.z, node.cone.theta_o);
+		ndata[2] = make_float4(node.cone.axis.x, node.cone.axis.y, node.cone.axis.z, node.cone.theta_e);
+		ndata[3] = make_float4(__int_as_float(left), __int_as_float(right), 0.0f, 0.0f);
+	}
+}
+
+CCL_NAMESPACE_END
+
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LIGHT_TREE_H__
+#define __LIGHT_TREE_H__
+
+/* Light Tree
+ *
+ * Binary tree over lamps and emissive triangles, used to pick a light with a
+ * probability based on its energy, distance and orientation to the shading
+ * point, as in "Importance Sampling of Many Lights with Adaptive Tree
+ * Splitting" by Conty Estevez and Kulla.
+ *
+ * Every node stores the bounds of its emitters, their total energy and a cone
+ * bounding their emission directions: normals are within theta_o of the axis
+ * and light is emitted within theta_e of the normals. Emitters which emit in
+ * all directions have theta_o = pi. */
+
+#include "util_boundbox.h"
+#include "util_types.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+struct LightTreeCone {
+	float3 axis;
+	float theta_o;
+	float theta_e;
+
+	LightTreeCone();
+	LightTreeCone(const float3& axis, float theta_o, float theta_e);
+
+	/* Smallest cone containing both cones. */
+	static LightTreeCone merge(const LightTreeCone& a, const LightTreeCone& b);
+};
+
+struct LightTreeEmitter {
+	BoundBox bounds;
+	LightTreeCone cone;
+	float energy;
+	int distribution_index;
+
+	LightTreeEmitter()
+	: bounds(BoundBox::empty), energy(0.0f), distribution_index(0) {}
+};
+
+class LightTree {
+public:
+	explicit LightTree(const vector<LightTreeEmitter>& emitters);
+
+	size_t num_nodes() const { return nodes.size(); }
+
+	/* Pack into num_nodes()*LIGHT_TREE_NODE_SIZE float4, with the layout
+	 * described in kernel_light.h. */
+	void pack(float4 *data) const;
+
+protected:
+	struct Node {
+		BoundBox bounds;
+		LightTreeCone cone;
+		float energy;
+		/* children, or the emitter for leaf nodes */
+		int left, right;
+		int emitter;
+	};
+
+	int recursive_build(int start, int end);
+
+	vector<LightTreeEmitter> emitters;
+	vector<Node> nodes;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __LIGHT_TREE_H__ */
+
@@ -33,8 +33,11 @@
 #include "util_cache.h"
 #include "util_foreach.h"
 #include "util_logging.h"
+#include "util_md5.h"
 #include "util_progress.h"
 #include "util_set.h"
+#include "util_string.h"
+#include "util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -50,6 +53,11 @@ void Mesh::Triangle::bounds_grow(const float3 *verts, BoundBox& bounds) const
 /* Curve */
 
 void Mesh::Curve::bounds_grow(const int k, const float4 *curve_keys, BoundBox& bounds) const
+{
+	bounds_grow(k, curve_keys, 0.0f, 1.0f, bounds);
+}
+
+void Mesh::Curve::bounds_grow(const int k, const float4 *curve_keys, float t0, float t1, BoundBox& bounds) const
 {
 	float3 P[4];
 
@@ -61,11 +69,20 @@ void Mesh::Curve::bounds_grow(const int k, const float4 *curve_keys, BoundBox& b
 	float3 lower;
 	float3 upper;
 
-	curvebounds(&lower.x, &upper.x, P, 0);
-	curvebounds(&lower.y, &upper.y, P, 1);
-	curvebounds(&lower.z, &upper.z, P, 2);
+	curvebounds(&lower.x, &upper.x, P, 0, t0, t1);
+	curvebounds(&lower.y, &upper.y, P, 1, t0, t1);
+	curvebounds(&lower.z, &upper.z, P, 2, t0, t1);
+
+	/* line segments are intersected as straight lines between the keys */
+	if(t0 != 0.0f || t1 != 1.0f) {
+		lower = min(lower, min(lerp(P[1], P[2], t0), lerp(P[1], P[2], t1)));
+		upper = max(upper, max(lerp(P[1], P[2], t0), lerp(P[1], P[2], t1)));
+	}
 
-	float mr = max(curve_keys[first_key + k].w, curve_keys[first_key + k + 1].w);
+	/* radius is interpolated linearly along the segment */
+	float r0 = curve_keys[first_key + k].w;
+	float r1 = curve_keys[first_key + k + 1].w;
+	float mr = max(r0 + (r1 - r0) * t0, r0 + (r1 - r0) * t1);
 
 	bounds.grow(lower, mr);
 	bounds.grow(upper, mr);
@@ -87,6 +104,7 @@ Mesh::Mesh()
 	use_motion_blur = false;
 
 	bvh = NULL;
+	bvh_shared = false;
 
 	tri_offset = 0;
 	vert_offset = 0;
@@ -94,6 +112,8 @@ Mesh::Mesh()
 	curve_offset = 0;
 	curvekey_offset = 0;
 
+	packed = false;
+
 	attributes.triangle_mesh = this;
 	curve_attributes.curve_mesh = this;
 
@@ -102,7 +122,8 @@ Mesh::Mesh()
 
 Mesh::~Mesh()
 {
-	delete bvh;
+	if(!bvh_shared)
+		delete bvh;
 }
 
 void Mesh::reserve(int numverts, int numtris, int numcurves, int numcurvekeys)
@@ -383,11 +404,8 @@ void Mesh::add_vertex_normals()
 	}
 }
 
-void Mesh::pack_normals(Scene *scene, uint *tri_shader, float4 *vnormal)
+void Mesh::pack_shaders(Scene *scene, uint *tri_shader)
 {
-	Attribute *attr_vN = attributes.find(ATTR_STD_VERTEX_NORMAL);
-
-	float3 *vN = attr_vN->data_float3();
 	uint shader_id = 0;
 	uint last_shader = -1;
 	bool last_smooth = false;
@@ -395,9 +413,6 @@ void Mesh::pack_normals(Scene *scene, uint *tri_shader, float4 *vnormal)
 	size_t triangles_size = triangles.size();
 	uint *shader_ptr = (shader.size())? &shader[0]: NULL;
 
-	bool do_transform = transform_applied;
-	Transform ntfm = transform_normal;
-
 	/* save shader */
 	for(size_t i = 0; i < triangles_size; i++) {
 		if(shader_ptr[i] != last_shader || last_smooth != smooth[i]) {
@@ -408,6 +423,18 @@ void Mesh::pack_normals(Scene *scene, uint *tri_shader, float4 *vnormal)
 
 		tri_shader[i] = shader_id;
 	}
+}
+
+void Mesh::pack_normals(Scene *scene, uint *tri_shader, float4 *vnormal)
+{
+	Attribute *attr_vN = attributes.find(ATTR_STD_VERTEX_NORMAL);
+
+	float3 *vN = attr_vN->data_float3();
+
+	bool do_transform = transform_applied;
+	Transform ntfm = transform_normal;
+
+	pack_shaders(scene, tri_shader);
 
 	size_t verts_size = verts.size();
 
@@ -434,6 +461,11 @@ void Mesh::pack_verts(float4 *tri_verts, float4 *tri_vindex, size_t vert_offset)
 		}
 	}
 
+	pack_vindex(tri_vindex, vert_offset);
+}
+
+void Mesh::pack_vindex(float4 *tri_vindex, size_t vert_offset)
+{
 	size_t triangles_size = triangles.size();
 
 	if(triangles_size) {
@@ -464,6 +496,11 @@ void Mesh::pack_curves(Scene *scene, float4 *curve_key_co, float4 *curve_data, s
 			curve_key_co[i] = keys_ptr[i];
 	}
 
+	pack_curve_segments(scene, curve_data, curvekey_offset);
+}
+
+void Mesh::pack_curve_segments(Scene *scene, float4 *curve_data, size_t curvekey_offset)
+{
 	/* pack curve segments */
 	size_t curve_num = curves.size();
 
@@ -484,14 +521,15 @@ void Mesh::pack_curves(Scene *scene, float4 *curve_key_co, float4 *curve_data, s
 	}
 }
 
-void Mesh::compute_bvh(SceneParams *params, Progress *progress, int n, int total)
+void Mesh::compute_bvh(SceneParams *params, int curve_split_levels, Progress *progress, int n, int total)
 {
 	if(progress->get_cancel())
 		return;
 
 	compute_bounds();
 
-	if(!transform_applied) {
+	/* shared BVH's are only assigned for identical geometry */
+	if(!transform_applied && !bvh_shared) {
 		string msg = "Updating Mesh BVH ";
 		if(name == "")
 			msg += string_printf("%u/%u", (uint)(n+1), (uint)total);
@@ -504,18 +542,39 @@ void Mesh::compute_bvh(SceneParams *params, Progress *progress, int n, int total
 		vector<Object*> objects;
 		objects.push_back(&object);
 
-		if(bvh && !need_update_rebuild) {
+		/* refitting only updates the union of the bounds over all motion
+		 * steps, time bounds need a rebuild */
+		bool use_time_bounds = params->use_bvh_time_bounds && has_motion_blur();
+		bool rebuild = (bvh == NULL || need_update_rebuild || use_time_bounds ||
+		                bvh->params.use_time_bounds != use_time_bounds ||
+		                bvh->params.curve_split_levels != curve_split_levels);
+
+		if(!rebuild) {
 			progress->set_status(msg, "Refitting BVH");
 			bvh->objects = objects;
 			bvh->refit(*progress);
+
+			/* large deformations make refitted nodes overlap a lot, at some
+			 * point building from scratch is cheaper than tracing rays */
+			float cost_ratio = bvh->refit_cost_ratio();
+
+			if(cost_ratio > bvh->params.max_refit_cost_ratio) {
+				VLOG(1) << "Refitted BVH of mesh " << name.c_str()
+				        << " degraded by " << cost_ratio << ", rebuilding.";
+				rebuild = true;
+			}
 		}
-		else {
+
+		if(rebuild) {
 			progress->set_status(msg, "Building BVH");
 
 			BVHParams bparams;
 			bparams.use_cache = params->use_bvh_cache;
 			bparams.use_spatial_split = params->use_bvh_spatial_split;
 			bparams.use_qbvh = params->use_qbvh;
+			bparams.use_obvh = params->use_obvh;
+			bparams.use_time_bounds = use_time_bounds;
+			bparams.curve_split_levels = curve_split_levels;
 
 			delete bvh;
 			bvh = BVH::create(bparams, objects);
@@ -527,6 +586,40 @@ void Mesh::compute_bvh(SceneParams *params, Progress *progress, int n, int total
 	need_update_rebuild = false;
 }
 
+void Mesh::compute_geometry_hash(string *hash, bool topology_only)
+{
+	MD5Hash md5;
+	size_t sizes[4] = {verts.size(), triangles.size(), curve_keys.size(), curves.size()};
+
+	md5.append((const uint8_t*)sizes, sizeof(sizes));
+	md5.append((const uint8_t*)&motion_steps, sizeof(motion_steps));
+	md5.append((const uint8_t*)&use_motion_blur, sizeof(use_motion_blur));
+
+	if(triangles.size())
+		md5.append((const uint8_t*)&triangles[0], sizeof(Triangle)*triangles.size());
+	if(curves.size())
+		md5.append((const uint8_t*)&curves[0], sizeof(Curve)*curves.size());
+
+	if(!topology_only) {
+		if(verts.size())
+			md5.append((const uint8_t*)&verts[0], sizeof(float3)*verts.size());
+		if(curve_keys.size())
+			md5.append((const uint8_t*)&curve_keys[0], sizeof(float4)*curve_keys.size());
+
+		if(use_motion_blur) {
+			Attribute *attr = attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+			if(attr && attr->buffer.size())
+				md5.append((const uint8_t*)attr->data(), attr->buffer.size());
+
+			attr = curve_attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+			if(attr && attr->buffer.size())
+				md5.append((const uint8_t*)attr->data(), attr->buffer.size());
+		}
+	}
+
+	*hash = md5.get_hex();
+}
+
 void Mesh::tag_update(Scene *scene, bool rebuild)
 {
 	need_update = true;
@@ -559,11 +652,14 @@ MeshManager::MeshManager()
 	bvh = NULL;
 	need_update = true;
 	need_flags_update = true;
+	need_volume_grid_update = true;
+	build_stats.clear();
 }
 
 MeshManager::~MeshManager()
 {
 	delete bvh;
+	bvh_cache_free();
 }
 
 void MeshManager::update_osl_attributes(Device *device, Scene *scene, vector<AttributeRequestSet>& mesh_attributes)
@@ -578,6 +674,12 @@ void MeshManager::update_osl_attributes(Device *device, Scene *scene, vector<Att
 
 	og->attribute_map.resize(scene->objects.size()*ATTR_PRIM_TYPES);
 
+	/* lookup of mesh attributes, instead of searching the meshes for every
+	 * instance */
+	map<Mesh*, size_t> mesh_index;
+	for(size_t i = 0; i < scene->meshes.size(); i++)
+		mesh_index[scene->meshes[i]] = i;
+
 	for(size_t i = 0; i < scene->objects.size(); i++) {
 		/* set object name to object index map */
 		Object *object = scene->objects[i];
@@ -598,13 +700,7 @@ void MeshManager::update_osl_attributes(Device *device, Scene *scene, vector<Att
 		}
 
 		/* find mesh attributes */
-		size_t j;
-
-		for(j = 0; j < scene->meshes.size(); j++)
-			if(scene->meshes[j] == object->mesh)
-				break;
-
-		AttributeRequestSet& attributes = mesh_attributes[j];
+		AttributeRequestSet& attributes = mesh_attributes[mesh_index[object->mesh]];
 
 		/* set object attributes */
 		foreach(AttributeRequest& req, attributes.requests) {
@@ -665,7 +761,8 @@ void MeshManager::update_osl_attributes(Device *device, Scene *scene, vector<Att
 void MeshManager::update_svm_attributes(Device *device, DeviceScene *dscene, Scene *scene, vector<AttributeRequestSet>& mesh_attributes)
 {
 	/* for SVM, the attributes_map table is used to lookup the offset of an
-	 * attribute, based on a unique shader attribute id. */
+	 * attribute, based on a unique shader attribute id. the table has one
+	 * entry per mesh, shared by all objects instancing it. */
 
 	/* compute array stride */
 	int attr_map_stride = 0;
@@ -677,23 +774,14 @@ void MeshManager::update_svm_attributes(Device *device, DeviceScene *dscene, Sce
 		return;
 	
 	/* create attribute map */
-	uint4 *attr_map = dscene->attributes_map.resize(attr_map_stride*scene->objects.size());
+	uint4 *attr_map = dscene->attributes_map.resize(attr_map_stride*scene->meshes.size());
 	memset(attr_map, 0, dscene->attributes_map.size()*sizeof(uint));
 
-	for(size_t i = 0; i < scene->objects.size(); i++) {
-		Object *object = scene->objects[i];
-		Mesh *mesh = object->mesh;
-
-		/* find mesh attributes */
-		size_t j;
-
-		for(j = 0; j < scene->meshes.size(); j++)
-			if(scene->meshes[j] == mesh)
-				break;
-
-		AttributeRequestSet& attributes = mesh_attributes[j];
+	for(size_t i = 0; i < scene->meshes.size(); i++) {
+		Mesh *mesh = scene->meshes[i];
+		AttributeRequestSet& attributes = mesh_attributes[i];
 
-		/* set object attributes */
+		/* set mesh attributes */
 		int index = i*attr_map_stride;
 
 		foreach(AttributeRequest& req, attributes.requests) {
@@ -751,6 +839,14 @@ void MeshManager::update_svm_attributes(Device *device, DeviceScene *dscene, Sce
 		index++;
 	}
 
+	/* compare against a map for every object */
+	size_t num_instances = (scene->objects.size() > scene->meshes.size())? scene->objects.size() - scene->meshes.size(): 0;
+
+	VLOG(1) << string_printf("Attribute maps: %d meshes, %.2fM in memory, %.2fM saved by sharing between instances.",
+	                         (int)scene->meshes.size(),
+	                         (double)(dscene->attributes_map.size()*sizeof(uint4)) / (1024.0 * 1024.0),
+	                         (double)(num_instances*attr_map_stride*sizeof(uint4)) / (1024.0 * 1024.0));
+
 	/* copy to device */
 	dscene->data.bvh.attributes_map_stride = attr_map_stride;
 	device->tex_alloc("__attributes_map", dscene->attributes_map);
@@ -883,6 +979,48 @@ static void update_attribute_element_offset(Mesh *mesh,
 	}
 }
 
+struct MeshAttributeArrays {
+	vector<float> attr_float;
+	vector<float4> attr_float3;
+	vector<uchar4> attr_uchar4;
+};
+
+static void update_mesh_attributes(Mesh *mesh,
+                                   AttributeRequestSet *attributes,
+                                   MeshAttributeArrays *arrays,
+                                   size_t attr_float_offset,
+                                   size_t attr_float3_offset,
+                                   size_t attr_uchar4_offset,
+                                   Progress *progress)
+{
+	/* todo: we now store std and name attributes from requests even if
+	 * they actually refer to the same mesh attributes, optimize */
+	foreach(AttributeRequest& req, attributes->requests) {
+		Attribute *triangle_mattr = mesh->attributes.find(req);
+		Attribute *curve_mattr = mesh->curve_attributes.find(req);
+
+		update_attribute_element_offset(mesh,
+		                                arrays->attr_float, attr_float_offset,
+		                                arrays->attr_float3, attr_float3_offset,
+		                                arrays->attr_uchar4, attr_uchar4_offset,
+		                                triangle_mattr,
+		                                req.triangle_type,
+		                                req.triangle_offset,
+		                                req.triangle_element);
+
+		update_attribute_element_offset(mesh,
+		                                arrays->attr_float, attr_float_offset,
+		                                arrays->attr_float3, attr_float3_offset,
+		                                arrays->attr_uchar4, attr_uchar4_offset,
+		                                curve_mattr,
+		                                req.curve_type,
+		                                req.curve_offset,
+		                                req.curve_element);
+
+		if(progress->get_cancel()) return;
+	}
+}
+
 void MeshManager::device_update_attributes(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
 {
 	progress.set_status("Updating Mesh", "Computing attributes");
@@ -913,9 +1051,21 @@ void MeshManager::device_update_attributes(Device *device, DeviceScene *dscene,
 	size_t attr_float_size = 0;
 	size_t attr_float3_size = 0;
 	size_t attr_uchar4_size = 0;
+
+	/* offsets of the attributes of every mesh, so meshes can be filled in
+	 * in parallel */
+	vector<size_t> mesh_attr_float_offset(scene->meshes.size());
+	vector<size_t> mesh_attr_float3_offset(scene->meshes.size());
+	vector<size_t> mesh_attr_uchar4_offset(scene->meshes.size());
+
 	for(size_t i = 0; i < scene->meshes.size(); i++) {
 		Mesh *mesh = scene->meshes[i];
 		AttributeRequestSet& attributes = mesh_attributes[i];
+
+		mesh_attr_float_offset[i] = attr_float_size;
+		mesh_attr_float3_offset[i] = attr_float3_size;
+		mesh_attr_uchar4_offset[i] = attr_uchar4_size;
+
 		foreach(AttributeRequest& req, attributes.requests) {
 			Attribute *triangle_mattr = mesh->attributes.find(req);
 			Attribute *curve_mattr = mesh->curve_attributes.find(req);
@@ -942,46 +1092,32 @@ void MeshManager::device_update_attributes(Device *device, DeviceScene *dscene,
 		}
 	}
 
-	vector<float> attr_float(attr_float_size);
-	vector<float4> attr_float3(attr_float3_size);
-	vector<uchar4> attr_uchar4(attr_uchar4_size);
+	MeshAttributeArrays arrays;
+	arrays.attr_float.resize(attr_float_size);
+	arrays.attr_float3.resize(attr_float3_size);
+	arrays.attr_uchar4.resize(attr_uchar4_size);
 
-	size_t attr_float_offset = 0;
-	size_t attr_float3_offset = 0;
-	size_t attr_uchar4_offset = 0;
+	vector<float>& attr_float = arrays.attr_float;
+	vector<float4>& attr_float3 = arrays.attr_float3;
+	vector<uchar4>& attr_uchar4 = arrays.attr_uchar4;
 
-	/* Fill in attributes. */
-	for(size_t i = 0; i < scene->meshes.size(); i++) {
-		Mesh *mesh = scene->meshes[i];
-		AttributeRequestSet& attributes = mesh_attributes[i];
+	/* Fill in attributes, every mesh writes to its own range. */
+	TaskPool pool;
 
-		/* todo: we now store std and name attributes from requests even if
-		 * they actually refer to the same mesh attributes, optimize */
-		foreach(AttributeRequest& req, attributes.requests) {
-			Attribute *triangle_mattr = mesh->attributes.find(req);
-			Attribute *curve_mattr = mesh->curve_attributes.find(req);
+	for(size_t i = 0; i < scene->meshes.size(); i++) {
+		pool.push(function_bind(&update_mesh_attributes,
+		                        scene->meshes[i],
+		                        &mesh_attributes[i],
+		                        &arrays,
+		                        mesh_attr_float_offset[i],
+		                        mesh_attr_float3_offset[i],
+		                        mesh_attr_uchar4_offset[i],
+		                        &progress));
+	}
 
-			update_attribute_element_offset(mesh,
-			                                attr_float, attr_float_offset,
-			                                attr_float3, attr_float3_offset,
-			                                attr_uchar4, attr_uchar4_offset,
-			                                triangle_mattr,
-			                                req.triangle_type,
-			                                req.triangle_offset,
-			                                req.triangle_element);
-
-			update_attribute_element_offset(mesh,
-			                                attr_float, attr_float_offset,
-			                                attr_float3, attr_float3_offset,
-			                                attr_uchar4, attr_uchar4_offset,
-			                                curve_mattr,
-			                                req.curve_type,
-			                                req.curve_offset,
-			                                req.curve_element);
+	pool.wait_work();
 
-			if(progress.get_cancel()) return;
-		}
-	}
+	if(progress.get_cancel()) return;
 
 	/* create attribute lookup maps */
 	if(scene->shader_manager->use_osl())
@@ -1008,8 +1144,84 @@ void MeshManager::device_update_attributes(Device *device, DeviceScene *dscene,
 	}
 }
 
+/* Pack triangles of a single mesh. Vertices and normals of meshes which did
+ * not change since the previous update are copied from there, prev_vnormal
+ * and prev_verts are NULL otherwise. */
+static void mesh_pack_triangles(Scene *scene,
+                                Mesh *mesh,
+                                const float4 *prev_vnormal,
+                                const float4 *prev_verts,
+                                uint *tri_shader,
+                                float4 *vnormal,
+                                float4 *tri_verts,
+                                float4 *tri_vindex)
+{
+	if(prev_vnormal && prev_verts) {
+		size_t verts_size = mesh->verts.size();
+
+		memcpy(vnormal, prev_vnormal, sizeof(float4)*verts_size);
+		memcpy(tri_verts, prev_verts, sizeof(float4)*verts_size);
+
+		mesh->pack_shaders(scene, tri_shader);
+		mesh->pack_vindex(tri_vindex, mesh->vert_offset);
+	}
+	else {
+		mesh->pack_normals(scene, tri_shader, vnormal);
+		mesh->pack_verts(tri_verts, tri_vindex, mesh->vert_offset);
+	}
+}
+
+static void mesh_pack_curves(Scene *scene,
+                             Mesh *mesh,
+                             const float4 *prev_curve_keys,
+                             float4 *curve_keys,
+                             float4 *curves)
+{
+	if(prev_curve_keys) {
+		memcpy(curve_keys, prev_curve_keys, sizeof(float4)*mesh->curve_keys.size());
+		mesh->pack_curve_segments(scene, curves, mesh->curvekey_offset);
+	}
+	else {
+		mesh->pack_curves(scene, curve_keys, curves, mesh->curvekey_offset);
+	}
+}
+
 void MeshManager::device_update_mesh(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
 {
+	size_t num_meshes = scene->meshes.size();
+
+	/* find meshes which were packed before and did not change since, the
+	 * offsets still point into the previously packed data at this point */
+	vector<const float4*> prev_vnormal(num_meshes, NULL);
+	vector<const float4*> prev_verts(num_meshes, NULL);
+	vector<const float4*> prev_curve_keys(num_meshes, NULL);
+	size_t num_reused = 0;
+
+	for(size_t i = 0; i < num_meshes; i++) {
+		Mesh *mesh = scene->meshes[i];
+
+		if(!mesh->packed || mesh->need_update)
+			continue;
+
+		size_t verts_size = mesh->verts.size();
+		size_t curve_keys_size = mesh->curve_keys.size();
+
+		if(verts_size &&
+		   mesh->vert_offset + verts_size <= packed_tri_vnormal.size() &&
+		   mesh->vert_offset + verts_size <= packed_tri_verts.size())
+		{
+			prev_vnormal[i] = &packed_tri_vnormal[mesh->vert_offset];
+			prev_verts[i] = &packed_tri_verts[mesh->vert_offset];
+			num_reused++;
+		}
+
+		if(curve_keys_size &&
+		   mesh->curvekey_offset + curve_keys_size <= packed_curve_keys.size())
+		{
+			prev_curve_keys[i] = &packed_curve_keys[mesh->curvekey_offset];
+		}
+	}
+
 	/* count and update offsets */
 	size_t vert_size = 0;
 	size_t tri_size = 0;
@@ -1031,6 +1243,11 @@ void MeshManager::device_update_mesh(Device *device, DeviceScene *dscene, Scene
 		curve_size += mesh->curves.size();
 	}
 
+	VLOG(1) << "Reusing packed geometry of " << num_reused << " of " << num_meshes << " meshes.";
+
+	/* meshes are packed in parallel, every mesh writes to its own range */
+	TaskPool pool;
+
 	if(tri_size != 0) {
 		/* normals */
 		progress.set_status("Updating Mesh", "Computing normals");
@@ -1040,13 +1257,53 @@ void MeshManager::device_update_mesh(Device *device, DeviceScene *dscene, Scene
 		float4 *tri_verts = dscene->tri_verts.resize(vert_size);
 		float4 *tri_vindex = dscene->tri_vindex.resize(tri_size);
 
-		foreach(Mesh *mesh, scene->meshes) {
-			mesh->pack_normals(scene, &tri_shader[mesh->tri_offset], &vnormal[mesh->vert_offset]);
-			mesh->pack_verts(&tri_verts[mesh->vert_offset], &tri_vindex[mesh->tri_offset], mesh->vert_offset);
+		for(size_t i = 0; i < num_meshes; i++) {
+			Mesh *mesh = scene->meshes[i];
 
-			if(progress.get_cancel()) return;
+			pool.push(function_bind(&mesh_pack_triangles,
+			                        scene,
+			                        mesh,
+			                        prev_vnormal[i],
+			                        prev_verts[i],
+			                        &tri_shader[mesh->tri_offset],
+			                        &vnormal[mesh->vert_offset],
+			                        &tri_verts[mesh->vert_offset],
+			                        &tri_vindex[mesh->tri_offset]));
+		}
+	}
+
+	if(curve_size != 0) {
+		float4 *curve_keys = dscene->curve_keys.resize(curve_key_size);
+		float4 *curves = dscene->curves.resize(curve_size);
+
+		for(size_t i = 0; i < num_meshes; i++) {
+			Mesh *mesh = scene->meshes[i];
+
+			pool.push(function_bind(&mesh_pack_curves,
+			                        scene,
+			                        mesh,
+			                        prev_curve_keys[i],
+			                        &curve_keys[mesh->curvekey_offset],
+			                        &curves[mesh->curve_offset]));
 		}
+	}
+
+	pool.wait_work();
 
+	/* previously packed data is not needed anymore */
+	packed_tri_vnormal.clear();
+	packed_tri_verts.clear();
+	packed_curve_keys.clear();
+
+	/* packed data is only valid to reuse if packing finished */
+	bool cancel = progress.get_cancel();
+
+	foreach(Mesh *mesh, scene->meshes)
+		mesh->packed = !cancel;
+
+	if(cancel) return;
+
+	if(tri_size != 0) {
 		/* vertex coordinates */
 		progress.set_status("Updating Mesh", "Copying Mesh to device");
 
@@ -1059,14 +1316,6 @@ void MeshManager::device_update_mesh(Device *device, DeviceScene *dscene, Scene
 	if(curve_size != 0) {
 		progress.set_status("Updating Mesh", "Copying Strands to device");
 
-		float4 *curve_keys = dscene->curve_keys.resize(curve_key_size);
-		float4 *curves = dscene->curves.resize(curve_size);
-
-		foreach(Mesh *mesh, scene->meshes) {
-			mesh->pack_curves(scene, &curve_keys[mesh->curvekey_offset], &curves[mesh->curve_offset], mesh->curvekey_offset);
-			if(progress.get_cancel()) return;
-		}
-
 		device->tex_alloc("__curve_keys", dscene->curve_keys);
 		device->tex_alloc("__curves", dscene->curves);
 	}
@@ -1077,14 +1326,26 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 	/* bvh build */
 	progress.set_status("Updating Scene BVH", "Building");
 
-	VLOG(1) << (scene->params.use_qbvh ? "Using QBVH optimization structure"
-	                                   : "Using regular BVH optimization structure");
+	VLOG(1) << (scene->params.use_obvh ? "Using OBVH optimization structure"
+	            : scene->params.use_qbvh ? "Using QBVH optimization structure"
+	                                     : "Using regular BVH optimization structure");
 
 	BVHParams bparams;
 	bparams.top_level = true;
 	bparams.use_qbvh = scene->params.use_qbvh;
+	bparams.use_obvh = scene->params.use_obvh;
 	bparams.use_spatial_split = scene->params.use_bvh_spatial_split;
 	bparams.use_cache = scene->params.use_bvh_cache;
+	bparams.curve_split_levels = curve_split_levels(scene);
+
+	if(scene->params.use_bvh_time_bounds) {
+		foreach(Mesh *mesh, scene->meshes) {
+			if(mesh->has_motion_blur()) {
+				bparams.use_time_bounds = true;
+				break;
+			}
+		}
+	}
 
 	delete bvh;
 	bvh = BVH::create(bparams, scene->objects);
@@ -1105,6 +1366,10 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 		dscene->bvh_leaf_nodes.reference((float4*)&pack.leaf_nodes[0], pack.leaf_nodes.size());
 		device->tex_alloc("__bvh_leaf_nodes", dscene->bvh_leaf_nodes);
 	}
+	if(pack.time_nodes.size()) {
+		dscene->bvh_time_nodes.reference(&pack.time_nodes[0], pack.time_nodes.size());
+		device->tex_alloc("__bvh_time_nodes", dscene->bvh_time_nodes);
+	}
 	if(pack.object_node.size()) {
 		dscene->object_node.reference((uint*)&pack.object_node[0], pack.object_node.size());
 		device->tex_alloc("__object_node", dscene->object_node);
@@ -1132,6 +1397,8 @@ void MeshManager::device_update_bvh(Device *device, DeviceScene *dscene, Scene *
 
 	dscene->data.bvh.root = pack.root_index;
 	dscene->data.bvh.use_qbvh = scene->params.use_qbvh;
+	dscene->data.bvh.use_obvh = scene->params.use_obvh;
+	dscene->data.bvh.use_time_bounds = (pack.time_nodes.size() != 0);
 }
 
 void MeshManager::device_update_flags(Device * /*device*/,
@@ -1207,9 +1474,17 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 {
 	VLOG(1) << "Total " << scene->meshes.size() << " meshes.";
 
+	build_stats.clear();
+
 	if(!need_update)
 		return;
 
+	/* volume grids map world space to voxels through object transforms */
+	need_volume_grid_update = true;
+
+	if(scene->params.use_bvh_cache)
+		Cache::global.set_max_size(scene->params.bvh_cache_max_size);
+
 	/* update normals */
 	foreach(Mesh *mesh, scene->meshes) {
 		foreach(uint shader, mesh->used_shaders) {
@@ -1241,6 +1516,7 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 	}
 
 	/* device update */
+	device_free_keep_packed(device, dscene);
 	device_free(device, dscene);
 
 	device_update_mesh(device, dscene, scene, progress);
@@ -1251,16 +1527,20 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 
 	/* update displacement */
 	bool displacement_done = false;
+	double displacement_start = time_dt();
 
 	foreach(Mesh *mesh, scene->meshes)
 		if(mesh->need_update && displace(device, dscene, scene, mesh, progress))
 			displacement_done = true;
 
+	build_stats.displacement_time = time_dt() - displacement_start;
+
 	/* todo: properly handle cancel halfway displacement */
 	if(progress.get_cancel()) return;
 
 	/* device re-update after displacement */
 	if(displacement_done) {
+		device_free_keep_packed(device, dscene);
 		device_free(device, dscene);
 
 		device_update_mesh(device, dscene, scene, progress);
@@ -1270,30 +1550,45 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 		if(progress.get_cancel()) return;
 	}
 
+	/* reuse bvh from previous updates */
+	vector<string> geometry_hash;
+	double bvh_start = time_dt();
+
+	if(scene->params.use_bvh_reuse) {
+		progress.set_status("Updating Mesh BVH", "Looking for reusable BVH");
+		bvh_cache_acquire(scene, geometry_hash, progress);
+		if(progress.get_cancel()) return;
+	}
+
 	/* update bvh */
 	size_t i = 0, num_bvh = 0;
 
 	foreach(Mesh *mesh, scene->meshes)
-		if(mesh->need_update && !mesh->transform_applied)
+		if(mesh->need_update && !mesh->transform_applied && !mesh->bvh_shared)
 			num_bvh++;
 
 	TaskPool pool;
+	int split_levels = curve_split_levels(scene);
 
 	foreach(Mesh *mesh, scene->meshes) {
 		if(mesh->need_update) {
 			pool.push(function_bind(&Mesh::compute_bvh,
 			                        mesh,
 			                        &scene->params,
+			                        split_levels,
 			                        &progress,
 			                        i,
 			                        num_bvh));
-			if(!mesh->transform_applied) {
+			if(!mesh->transform_applied && !mesh->bvh_shared) {
 				i++;
 			}
 		}
 	}
 
 	pool.wait_work();
+
+	if(scene->params.use_bvh_reuse)
+		bvh_cache_release(scene, geometry_hash);
 	foreach(Shader *shader, scene->shaders)
 		shader->need_update_attributes = false;
 
@@ -1313,6 +1608,8 @@ void MeshManager::device_update(Device *device, DeviceScene *dscene, Scene *scen
 
 	device_update_bvh(device, dscene, scene, progress);
 
+	build_stats.bvh_time = time_dt() - bvh_start;
+
 	need_update = false;
 }
 
@@ -1320,6 +1617,7 @@ void MeshManager::device_free(Device *device, DeviceScene *dscene)
 {
 	device->tex_free(dscene->bvh_nodes);
 	device->tex_free(dscene->bvh_leaf_nodes);
+	device->tex_free(dscene->bvh_time_nodes);
 	device->tex_free(dscene->object_node);
 	device->tex_free(dscene->tri_woop);
 	device->tex_free(dscene->prim_type);
@@ -1336,6 +1634,8 @@ void MeshManager::device_free(Device *device, DeviceScene *dscene)
 	device->tex_free(dscene->attributes_float);
 	device->tex_free(dscene->attributes_float3);
 	device->tex_free(dscene->attributes_uchar4);
+	device->tex_free(dscene->volume_grid);
+	device->tex_free(dscene->volume_grid_cells);
 
 	dscene->bvh_nodes.clear();
 	dscene->object_node.clear();
@@ -1354,6 +1654,10 @@ void MeshManager::device_free(Device *device, DeviceScene *dscene)
 	dscene->attributes_float.clear();
 	dscene->attributes_float3.clear();
 	dscene->attributes_uchar4.clear();
+	dscene->volume_grid.clear();
+	dscene->volume_grid_cells.clear();
+
+	need_volume_grid_update = true;
 
 #ifdef WITH_OSL
 	OSLGlobals *og = (OSLGlobals*)device->osl_memory();
@@ -1366,6 +1670,189 @@ void MeshManager::device_free(Device *device, DeviceScene *dscene)
 #endif
 }
 
+void MeshManager::device_free_keep_packed(Device *device, DeviceScene *dscene)
+{
+	/* free device memory, but keep the packed vertices, normals and curve keys
+	 * in host memory for the next device_update_mesh() */
+	device->tex_free(dscene->tri_vnormal);
+	device->tex_free(dscene->tri_verts);
+	device->tex_free(dscene->curve_keys);
+
+	dscene->tri_vnormal.steal_data(packed_tri_vnormal);
+	dscene->tri_verts.steal_data(packed_tri_verts);
+	dscene->curve_keys.steal_data(packed_curve_keys);
+}
+
+int MeshManager::curve_split_levels(Scene *scene)
+{
+	CurveSystemManager *curve_system_manager = scene->curve_system_manager;
+
+	if(!scene->params.use_bvh_curve_split || !curve_system_manager->use_curves ||
+	   curve_system_manager->primitive == CURVE_TRIANGLES)
+	{
+		return 0;
+	}
+
+	/* minimum width coverage is a random test per intersected primitive,
+	 * so a segment split into k pieces would be hit with 1-(1-p)^k */
+	if(curve_system_manager->minimum_width > 0.0f)
+		return 0;
+
+	/* straight line segments can be split anywhere, cardinal curves are
+	 * intersected as chords between 2^subdivisions points along the segment
+	 * and pieces must not cut through them */
+	if(curve_system_manager->primitive == CURVE_LINE_SEGMENTS)
+		return BVHParams::MAX_CURVE_SPLIT_LEVELS;
+
+	return clamp(curve_system_manager->subdivisions, 0, (int)BVHParams::MAX_CURVE_SPLIT_LEVELS);
+}
+
+void MeshManager::bvh_cache_acquire(Scene *scene, vector<string>& geometry_hash, Progress& progress)
+{
+	size_t num_meshes = scene->meshes.size();
+
+	geometry_hash.clear();
+	geometry_hash.resize(num_meshes);
+
+	/* hash geometry of meshes that need their BVH updated */
+	TaskPool pool;
+
+	for(size_t i = 0; i < num_meshes; i++) {
+		Mesh *mesh = scene->meshes[i];
+
+		if(mesh->need_update && !mesh->transform_applied) {
+			pool.push(function_bind(&Mesh::compute_geometry_hash,
+			                        mesh,
+			                        &geometry_hash[i],
+			                        false));
+		}
+	}
+
+	pool.wait_work();
+
+	if(progress.get_cancel()) return;
+
+	/* share BVH's of identical geometry */
+	size_t num_reused = 0, num_refit = 0;
+
+	for(size_t i = 0; i < num_meshes; i++) {
+		Mesh *mesh = scene->meshes[i];
+
+		if(geometry_hash[i].empty())
+			continue;
+
+		map<string, CachedBVH>::iterator it = bvh_cache.find(geometry_hash[i]);
+
+		if(it != bvh_cache.end()) {
+			if(mesh->bvh != it->second.bvh) {
+				if(!mesh->bvh_shared)
+					delete mesh->bvh;
+
+				mesh->bvh = it->second.bvh;
+				mesh->bvh_shared = true;
+			}
+
+			num_reused++;
+		}
+		else if(mesh->bvh_shared) {
+			/* geometry changed, other meshes may still use this BVH */
+			mesh->bvh = NULL;
+			mesh->bvh_shared = false;
+		}
+	}
+
+	/* BVH's no longer used by any mesh can be refitted for deformed meshes
+	 * with the same topology */
+	set<BVH*> used_bvh;
+
+	foreach(Mesh *mesh, scene->meshes)
+		if(mesh->bvh)
+			used_bvh.insert(mesh->bvh);
+
+	multimap<string, string> unused_bvh;
+
+	for(map<string, CachedBVH>::iterator it = bvh_cache.begin(); it != bvh_cache.end(); it++)
+		if(used_bvh.find(it->second.bvh) == used_bvh.end())
+			unused_bvh.insert(pair<string, string>(it->second.topology_hash, it->first));
+
+	for(size_t i = 0; i < num_meshes && !unused_bvh.empty(); i++) {
+		Mesh *mesh = scene->meshes[i];
+
+		if(geometry_hash[i].empty() || mesh->bvh)
+			continue;
+
+		string topology_hash;
+		mesh->compute_geometry_hash(&topology_hash, true);
+
+		multimap<string, string>::iterator it = unused_bvh.find(topology_hash);
+
+		if(it != unused_bvh.end()) {
+			/* mesh takes ownership and refits */
+			mesh->bvh = bvh_cache[it->second].bvh;
+			mesh->bvh_shared = false;
+			mesh->need_update_rebuild = false;
+
+			bvh_cache.erase(it->second);
+			unused_bvh.erase(it);
+
+			num_refit++;
+		}
+	}
+
+	VLOG(1) << "Reusing " << num_reused << " object BVH's, refitting "
+	        << num_refit << " object BVH's from previous update.";
+}
+
+void MeshManager::bvh_cache_release(Scene *scene, const vector<string>& geometry_hash)
+{
+	/* meshes hand over newly built or refitted BVH's to the cache */
+	size_t num_meshes = scene->meshes.size();
+
+	for(size_t i = 0; i < num_meshes && i < geometry_hash.size(); i++) {
+		Mesh *mesh = scene->meshes[i];
+
+		if(geometry_hash[i].empty() || !mesh->bvh || mesh->bvh_shared || mesh->transform_applied)
+			continue;
+
+		if(bvh_cache.find(geometry_hash[i]) == bvh_cache.end()) {
+			CachedBVH& entry = bvh_cache[geometry_hash[i]];
+			entry.bvh = mesh->bvh;
+			mesh->compute_geometry_hash(&entry.topology_hash, true);
+
+			mesh->bvh_shared = true;
+		}
+	}
+
+	/* free BVH's not used by any mesh anymore, we only keep those of the
+	 * current update around for the next one */
+	set<BVH*> used_bvh;
+
+	foreach(Mesh *mesh, scene->meshes)
+		if(mesh->bvh)
+			used_bvh.insert(mesh->bvh);
+
+	map<string, CachedBVH>::iterator it = bvh_cache.begin();
+
+	while(it != bvh_cache.end()) {
+		if(used_bvh.find(it->second.bvh) == used_bvh.end()) {
+			delete it->second.bvh;
+			bvh_cache.erase(it++);
+		}
+		else
+			it++;
+	}
+
+	VLOG(1) << "Total " << bvh_cache.size() << " object BVH's cached.";
+}
+
+void MeshManager::bvh_cache_free()
+{
+	for(map<string, CachedBVH>::iterator it = bvh_cache.begin(); it != bvh_cache.end(); it++)
+		delete it->second.bvh;
+
+	bvh_cache.clear();
+}
+
 void MeshManager::tag_update(Scene *scene)
 {
 	need_update = true;
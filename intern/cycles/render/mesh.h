@@ -59,6 +59,8 @@ public:
 		int num_segments() { return num_keys - 1; }
 
 		void bounds_grow(const int k, const float4 *curve_keys, BoundBox& bounds) const;
+		/* bounds of the part of segment k between curve parameters t0 and t1 */
+		void bounds_grow(const int k, const float4 *curve_keys, float t0, float t1, BoundBox& bounds) const;
 	};
 
 	/* Displacement */
@@ -108,12 +110,17 @@ public:
 
 	/* BVH */
 	BVH *bvh;
+	bool bvh_shared;  /* bvh is owned by MeshManager::bvh_cache */
 	size_t tri_offset;
 	size_t vert_offset;
 
 	size_t curve_offset;
 	size_t curvekey_offset;
 
+	/* Packed vertices, normals and curve keys are on the device at the
+	 * offsets above and can be reused while the mesh does not change. */
+	bool packed;
+
 	/* Functions */
 	Mesh();
 	~Mesh();
@@ -130,10 +137,14 @@ public:
 	void add_face_normals();
 	void add_vertex_normals();
 
+	void pack_shaders(Scene *scene, uint *shader);
 	void pack_normals(Scene *scene, uint *shader, float4 *vnormal);
 	void pack_verts(float4 *tri_verts, float4 *tri_vindex, size_t vert_offset);
+	void pack_vindex(float4 *tri_vindex, size_t vert_offset);
 	void pack_curves(Scene *scene, float4 *curve_key_co, float4 *curve_data, size_t curvekey_offset);
-	void compute_bvh(SceneParams *params, Progress *progress, int n, int total);
+	void pack_curve_segments(Scene *scene, float4 *curve_data, size_t curvekey_offset);
+	void compute_bvh(SceneParams *params, int curve_split_levels, Progress *progress, int n, int total);
+	void compute_geometry_hash(string *hash, bool topology_only);
 
 	bool need_attribute(Scene *scene, AttributeStandard std);
 	bool need_attribute(Scene *scene, ustring name);
@@ -149,8 +160,40 @@ class MeshManager {
 public:
 	BVH *bvh;
 
+	/* Object BVH's kept between updates, keyed by geometry hash, so they can
+	 * be reused for identical geometry or refitted for deformed geometry in
+	 * the next update, for example the next frame of an animation. */
+	struct CachedBVH {
+		BVH *bvh;
+		string topology_hash;
+	};
+
+	map<string, CachedBVH> bvh_cache;
+
 	bool need_update;
 	bool need_flags_update;
+	bool need_volume_grid_update;
+
+	/* Packed geometry of the previous update, data of unchanged meshes is
+	 * copied from here instead of being packed again. */
+	array<float4> packed_tri_vnormal;
+	array<float4> packed_tri_verts;
+	array<float4> packed_curve_keys;
+
+	/* Statistics of the last device_update. BVH time includes the object
+	 * BVH's and the top level BVH. */
+	struct BuildStats {
+		double displacement_time;
+		double bvh_time;
+
+		void clear()
+		{
+			displacement_time = 0.0;
+			bvh_time = 0.0;
+		}
+	};
+
+	BuildStats build_stats;
 
 	MeshManager();
 	~MeshManager();
@@ -168,7 +211,15 @@ public:
 	void device_update_bvh(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 	void device_update_flags(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 	void device_update_displacement_images(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
+	void device_update_volume_grids(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 	void device_free(Device *device, DeviceScene *dscene);
+	void device_free_keep_packed(Device *device, DeviceScene *dscene);
+
+	int curve_split_levels(Scene *scene);
+
+	void bvh_cache_acquire(Scene *scene, vector<string>& geometry_hash, Progress& progress);
+	void bvh_cache_release(Scene *scene, const vector<string>& geometry_hash);
+	void bvh_cache_free();
 
 	void tag_update(Scene *scene);
 };
@@ -0,0 +1,340 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "attribute.h"
+#include "device.h"
+#include "graph.h"
+#include "image.h"
+#include "mesh.h"
+#include "nodes.h"
+#include "object.h"
+#include "scene.h"
+#include "shader.h"
+
+#include "util_foreach.h"
+#include "util_logging.h"
+#include "util_map.h"
+#include "util_progress.h"
+#include "util_transform.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Volume Acceleration Grid
+ *
+ * Coarse grid over the voxel attributes of a mesh, typically a smoke domain,
+ * storing in every cell the largest voxel value that interpolation can reach
+ * there. Kernels step over cells where all voxel attributes are zero without
+ * evaluating the volume shader. This is only correct when the shader has no
+ * density or emission where the voxel attributes have none, so grids are
+ * only built for meshes whose volume shaders provably have this property.
+ * Other meshes, like those with constant density terms or procedural
+ * volumes, have no grid and are stepped through as before. */
+
+/* Voxels per grid cell along every axis. */
+static const int VOLUME_GRID_CELL_VOXELS = 8;
+
+/* Voxel values below this are considered empty space. */
+static const float VOLUME_GRID_CLIPPING = 1e-6f;
+
+static bool volume_output_zero_in_empty_space(Mesh *mesh, ShaderOutput *output);
+
+/* Input is zero wherever all voxel attributes of the mesh are zero. */
+static bool volume_input_zero_in_empty_space(Mesh *mesh, ShaderInput *input)
+{
+	if(!input->link) {
+		if(input->type == SHADER_SOCKET_FLOAT)
+			return input->value.x == 0.0f;
+		return is_zero(input->value);
+	}
+
+	return volume_output_zero_in_empty_space(mesh, input->link);
+}
+
+/* Conservative, nodes not handled here are assumed to be non-zero. */
+static bool volume_output_zero_in_empty_space(Mesh *mesh, ShaderOutput *output)
+{
+	ShaderNode *node = output->parent;
+
+	if(node->name == ustring("attribute")) {
+		ustring name = ((AttributeNode*)node)->attribute;
+		AttributeStandard std = Attribute::name_standard(name.c_str());
+		Attribute *attr = (std != ATTR_STD_NONE)? mesh->attributes.find(std): mesh->attributes.find(name);
+
+		/* velocity is not part of the grid */
+		return (attr && attr->element == ATTR_ELEMENT_VOXEL && attr->std != ATTR_STD_VOLUME_VELOCITY);
+	}
+	else if(node->name == ustring("convert")) {
+		ConvertNode *convert = (ConvertNode*)node;
+
+		if(convert->from == SHADER_SOCKET_INT || convert->from == SHADER_SOCKET_STRING)
+			return false;
+
+		return volume_input_zero_in_empty_space(mesh, node->inputs[0]);
+	}
+	else if(node->name == ustring("math")) {
+		ustring type = ((MathNode*)node)->type;
+		bool zero1 = volume_input_zero_in_empty_space(mesh, node->input("Value1"));
+		bool zero2 = volume_input_zero_in_empty_space(mesh, node->input("Value2"));
+
+		/* clamping keeps zero */
+		if(type == ustring("Multiply"))
+			return zero1 || zero2;
+		else if(type == ustring("Divide"))
+			return zero1;
+		else if(type == ustring("Add") || type == ustring("Subtract") ||
+		        type == ustring("Minimum") || type == ustring("Maximum"))
+			return zero1 && zero2;
+
+		return false;
+	}
+	else if(node->name == ustring("math_chain")) {
+		foreach(const MathChainNode::Step& step, ((MathChainNode*)node)->steps) {
+			bool keeps_zero;
+
+			switch(step.type) {
+				case NODE_MATH_MULTIPLY:
+					keeps_zero = true;
+					break;
+				case NODE_MATH_DIVIDE:
+					keeps_zero = !step.value_first;
+					break;
+				case NODE_MATH_ADD:
+				case NODE_MATH_SUBTRACT:
+					keeps_zero = (step.value == 0.0f);
+					break;
+				case NODE_MATH_MINIMUM:
+					keeps_zero = (step.value >= 0.0f);
+					break;
+				case NODE_MATH_MAXIMUM:
+					keeps_zero = (step.value <= 0.0f);
+					break;
+				default:
+					keeps_zero = false;
+					break;
+			}
+
+			if(!keeps_zero)
+				return false;
+		}
+
+		return volume_input_zero_in_empty_space(mesh, node->input("Value"));
+	}
+	else if(node->name == ustring("mix")) {
+		ustring type = ((MixNode*)node)->type;
+		bool zero1 = volume_input_zero_in_empty_space(mesh, node->input("Color1"));
+
+		if(type == ustring("Multiply"))
+			return zero1;
+		else if(type == ustring("Mix") || type == ustring("Add") || type == ustring("Subtract"))
+			return zero1 && volume_input_zero_in_empty_space(mesh, node->input("Color2"));
+
+		return false;
+	}
+
+	return false;
+}
+
+/* Volume closure has no density or emission wherever all voxel attributes of
+ * the mesh are zero. */
+static bool volume_closure_zero_in_empty_space(Mesh *mesh, ShaderInput *input)
+{
+	if(!input->link)
+		return true;
+
+	ShaderNode *node = input->link->parent;
+
+	if(node->name == ustring("add_closure") || node->name == ustring("mix_closure")) {
+		return volume_closure_zero_in_empty_space(mesh, node->input("Closure1")) &&
+		       volume_closure_zero_in_empty_space(mesh, node->input("Closure2"));
+	}
+	else if(node->name == ustring("volume")) {
+		/* absorption and scatter */
+		return volume_input_zero_in_empty_space(mesh, node->input("Density")) ||
+		       volume_input_zero_in_empty_space(mesh, node->input("Color"));
+	}
+	else if(node->name == ustring("emission")) {
+		return volume_input_zero_in_empty_space(mesh, node->input("Strength")) ||
+		       volume_input_zero_in_empty_space(mesh, node->input("Color"));
+	}
+
+	return false;
+}
+
+static bool mesh_volume_grid_supported(Scene *scene, Mesh *mesh)
+{
+	foreach(uint shader_id, mesh->used_shaders) {
+		Shader *shader = scene->shaders[shader_id];
+
+		if(!shader->has_volume)
+			continue;
+		if(!volume_closure_zero_in_empty_space(mesh, shader->graph->output()->input("Volume")))
+			return false;
+	}
+
+	return true;
+}
+
+static bool mesh_volume_grid_build(DeviceScene *dscene, Mesh *mesh, int3 *grid_res, vector<float>& cells)
+{
+	/* velocity doesn't contribute density to any shader */
+	vector<VoxelAttribute*> voxel_attributes;
+
+	foreach(Attribute& attr, mesh->attributes.attributes) {
+		if(attr.element == ATTR_ELEMENT_VOXEL && attr.std != ATTR_STD_VOLUME_VELOCITY)
+			voxel_attributes.push_back(attr.data_voxel());
+	}
+
+	if(voxel_attributes.empty())
+		return false;
+
+	/* grid resolution follows the highest resolution voxel attribute */
+	int3 res = make_int3(1, 1, 1);
+
+	foreach(VoxelAttribute *voxel, voxel_attributes) {
+		int3 image_res = voxel->manager->get_image_resolution(dscene, voxel->slot);
+
+		if(image_res.x == 0)
+			return false;
+
+		res.x = max(res.x, (image_res.x + VOLUME_GRID_CELL_VOXELS - 1) / VOLUME_GRID_CELL_VOXELS);
+		res.y = max(res.y, (image_res.y + VOLUME_GRID_CELL_VOXELS - 1) / VOLUME_GRID_CELL_VOXELS);
+		res.z = max(res.z, (image_res.z + VOLUME_GRID_CELL_VOXELS - 1) / VOLUME_GRID_CELL_VOXELS);
+	}
+
+	size_t num_cells = (size_t)res.x*res.y*res.z;
+	size_t offset = cells.size();
+	cells.resize(offset + num_cells, 0.0f);
+	float *grid = &cells[offset];
+
+	foreach(VoxelAttribute *voxel, voxel_attributes) {
+		if(!voxel->manager->get_image_voxel_maximum(dscene, voxel->slot, res, grid)) {
+			cells.resize(offset);
+			return false;
+		}
+	}
+
+	for(size_t i = 0; i < num_cells; i++) {
+		if(grid[i] < VOLUME_GRID_CLIPPING)
+			grid[i] = 0.0f;
+	}
+
+	*grid_res = res;
+	return true;
+}
+
+void MeshManager::device_update_volume_grids(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
+{
+	if(!need_volume_grid_update)
+		return;
+
+	device->tex_free(dscene->volume_grid);
+	device->tex_free(dscene->volume_grid_cells);
+	dscene->volume_grid.clear();
+	dscene->volume_grid_cells.clear();
+	dscene->data.bvh.have_volume_grid = false;
+
+	need_volume_grid_update = false;
+
+	if(!scene->params.use_volume_grid)
+		return;
+
+	/* build grids in mesh texture space, shared by instances */
+	struct MeshVolumeGrid {
+		int3 res;
+		int offset;
+	};
+
+	map<Mesh*, MeshVolumeGrid> mesh_grids;
+	vector<float> cells;
+
+	foreach(Mesh *mesh, scene->meshes) {
+		if(!mesh->has_volume)
+			continue;
+
+		MeshVolumeGrid mesh_grid;
+		mesh_grid.offset = cells.size();
+
+		if(!mesh_volume_grid_supported(scene, mesh) ||
+		   !mesh_volume_grid_build(dscene, mesh, &mesh_grid.res, cells))
+		{
+			mesh_grid.offset = -1;
+		}
+
+		mesh_grids[mesh] = mesh_grid;
+
+		if(progress.get_cancel()) return;
+	}
+
+	if(cells.empty())
+		return;
+
+	/* pack a transform from world space to grid space for every object,
+	 * objects with motion blur have no grid since their transform varies */
+	Scene::MotionType need_motion = scene->need_motion(device->info.advanced_shading);
+	bool motion_blur = need_motion == Scene::MOTION_BLUR;
+	size_t num_objects = scene->objects.size();
+	float4 *volume_grid = dscene->volume_grid.resize(num_objects*VOLUME_GRID_OBJECT_SIZE);
+	int num_grid_objects = 0;
+
+	for(size_t i = 0; i < num_objects; i++) {
+		Object *object = scene->objects[i];
+		float4 *record = volume_grid + i*VOLUME_GRID_OBJECT_SIZE;
+		map<Mesh*, MeshVolumeGrid>::iterator it = mesh_grids.find(object->mesh);
+
+		if(it == mesh_grids.end() || it->second.offset == -1 || (motion_blur && object->use_motion)) {
+			memset(record, 0, sizeof(float4)*VOLUME_GRID_OBJECT_SIZE);
+			record[3].w = __int_as_float(-1);
+			continue;
+		}
+
+		const MeshVolumeGrid& mesh_grid = it->second;
+		Mesh *mesh = object->mesh;
+
+		/* same mapping as the voxel attribute lookups in the kernel */
+		Transform tfm = transform_inverse(object->tfm);
+		Attribute *attr = mesh->attributes.find(ATTR_STD_GENERATED_TRANSFORM);
+
+		if(attr)
+			tfm = (*attr->data_transform()) * tfm;
+
+		tfm = transform_scale(make_float3(mesh_grid.res.x, mesh_grid.res.y, mesh_grid.res.z)) * tfm;
+
+		memcpy(record, &tfm, sizeof(float4)*3);
+		record[3] = make_float4(__int_as_float(mesh_grid.res.x),
+		                        __int_as_float(mesh_grid.res.y),
+		                        __int_as_float(mesh_grid.res.z),
+		                        __int_as_float(mesh_grid.offset));
+		num_grid_objects++;
+	}
+
+	size_t num_empty = 0;
+	foreach(float cell, cells)
+		if(cell == 0.0f)
+			num_empty++;
+
+	VLOG(1) << "Volume grids: " << num_grid_objects << " objects, "
+	        << cells.size() << " cells, "
+	        << string_printf("%.2f%% empty.", 100.0 * num_empty / cells.size());
+
+	dscene->volume_grid_cells.copy(&cells[0], cells.size());
+
+	device->tex_alloc("__volume_grid", dscene->volume_grid);
+	device->tex_alloc("__volume_grid_cells", dscene->volume_grid_cells);
+
+	dscene->data.bvh.have_volume_grid = true;
+}
+
+CCL_NAMESPACE_END
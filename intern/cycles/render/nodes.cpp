@@ -17,6 +17,7 @@
 #include "image.h"
 #include "nodes.h"
 #include "svm.h"
+#include "svm_color_util.h"
 #include "svm_math_util.h"
 #include "osl.h"
 #include "sky_model.h"
@@ -26,6 +27,14 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Constant Folding */
+
+static bool input_is_constant(const ShaderInput *input)
+{
+	/* not linked, and not getting a default link when finalizing the graph */
+	return !input->link && input->default_value == ShaderInput::NONE;
+}
+
 /* Texture Mapping */
 
 TextureMapping::TextureMapping()
@@ -1411,6 +1420,44 @@ ConvertNode::ConvertNode(ShaderSocketType from_, ShaderSocketType to_, bool auto
 		assert(0);
 }
 
+bool ConvertNode::constant_fold(ShaderOutput * /*socket*/, float3 *optimized_value)
+{
+	ShaderInput *in = inputs[0];
+
+	if(!input_is_constant(in) || from == SHADER_SOCKET_STRING || to == SHADER_SOCKET_STRING)
+		return false;
+
+	/* same conversions as svm_node_convert, int values are stored as float */
+	if(from == SHADER_SOCKET_FLOAT || from == SHADER_SOCKET_INT) {
+		float f = (from == SHADER_SOCKET_INT)? (float)(int)in->value.x: in->value.x;
+
+		if(to == SHADER_SOCKET_INT)
+			*optimized_value = make_float3((float)float_to_int(f), 0.0f, 0.0f);
+		else if(to == SHADER_SOCKET_FLOAT)
+			*optimized_value = make_float3(f, 0.0f, 0.0f);
+		else
+			*optimized_value = make_float3(f, f, f);
+	}
+	else {
+		float f = (from == SHADER_SOCKET_COLOR)? linear_rgb_to_gray(in->value): average(in->value);
+
+		if(to == SHADER_SOCKET_INT)
+			*optimized_value = make_float3((float)(int)f, 0.0f, 0.0f);
+		else if(to == SHADER_SOCKET_FLOAT)
+			*optimized_value = make_float3(f, 0.0f, 0.0f);
+		else
+			*optimized_value = in->value;
+	}
+
+	return true;
+}
+
+bool ConvertNode::equals(const ShaderNode *other)
+{
+	const ConvertNode *convert = static_cast<const ConvertNode*>(other);
+	return from == convert->from && to == convert->to;
+}
+
 void ConvertNode::compile(SVMCompiler& compiler)
 {
 	ShaderInput *in = inputs[0];
@@ -2198,6 +2245,11 @@ void GeometryNode::attributes(Shader *shader, AttributeRequestSet *attributes)
 	ShaderNode::attributes(shader, attributes);
 }
 
+bool GeometryNode::equals(const ShaderNode * /*other*/)
+{
+	return true;
+}
+
 void GeometryNode::compile(SVMCompiler& compiler)
 {
 	ShaderOutput *out;
@@ -2320,9 +2372,22 @@ void TextureCoordinateNode::attributes(Shader *shader, AttributeRequestSet *attr
 		}
 	}
 
+	if(from_dupli) {
+		if(!output("Generated")->links.empty() || !output("UV")->links.empty())
+			attributes->add(ATTR_STD_DUPLI);
+	}
+
 	ShaderNode::attributes(shader, attributes);
 }
 
+bool TextureCoordinateNode::equals(const ShaderNode *other)
+{
+	const TextureCoordinateNode *texco = static_cast<const TextureCoordinateNode*>(other);
+	return from_dupli == texco->from_dupli &&
+	       use_transform == texco->use_transform &&
+	       (!use_transform || ob_tfm == texco->ob_tfm);
+}
+
 void TextureCoordinateNode::compile(SVMCompiler& compiler)
 {
 	ShaderOutput *out;
@@ -2465,6 +2530,11 @@ void UVMapNode::attributes(Shader *shader, AttributeRequestSet *attributes)
 		}
 	}
 
+	if(from_dupli) {
+		if(!output("UV")->links.empty())
+			attributes->add(ATTR_STD_DUPLI);
+	}
+
 	ShaderNode::attributes(shader, attributes);
 }
 
@@ -2879,6 +2949,17 @@ ValueNode::ValueNode()
 	add_output("Value", SHADER_SOCKET_FLOAT);
 }
 
+bool ValueNode::constant_fold(ShaderOutput * /*socket*/, float3 *optimized_value)
+{
+	*optimized_value = make_float3(value, 0.0f, 0.0f);
+	return true;
+}
+
+bool ValueNode::equals(const ShaderNode *other)
+{
+	return value == static_cast<const ValueNode*>(other)->value;
+}
+
 void ValueNode::compile(SVMCompiler& compiler)
 {
 	ShaderOutput *val_out = output("Value");
@@ -2903,6 +2984,17 @@ ColorNode::ColorNode()
 	add_output("Color", SHADER_SOCKET_COLOR);
 }
 
+bool ColorNode::constant_fold(ShaderOutput * /*socket*/, float3 *optimized_value)
+{
+	*optimized_value = value;
+	return true;
+}
+
+bool ColorNode::equals(const ShaderNode *other)
+{
+	return value == static_cast<const ColorNode*>(other)->value;
+}
+
 void ColorNode::compile(SVMCompiler& compiler)
 {
 	ShaderOutput *color_out = output("Color");
@@ -3007,6 +3099,28 @@ InvertNode::InvertNode()
 	add_output("Color",  SHADER_SOCKET_COLOR);
 }
 
+bool InvertNode::constant_fold(ShaderOutput * /*socket*/, float3 *optimized_value)
+{
+	ShaderInput *fac_in = input("Fac");
+	ShaderInput *color_in = input("Color");
+
+	if(!input_is_constant(fac_in) || !input_is_constant(color_in))
+		return false;
+
+	/* same as svm_node_invert */
+	float fac = fac_in->value.x;
+	float3 color = color_in->value;
+	float3 one = make_float3(1.0f, 1.0f, 1.0f);
+
+	*optimized_value = fac*(one - color) + (1.0f - fac)*color;
+	return true;
+}
+
+bool InvertNode::equals(const ShaderNode * /*other*/)
+{
+	return true;
+}
+
 void InvertNode::compile(SVMCompiler& compiler)
 {
 	ShaderInput *fac_in = input("Fac");
@@ -3068,6 +3182,30 @@ static ShaderEnum mix_type_init()
 
 ShaderEnum MixNode::type_enum = mix_type_init();
 
+bool MixNode::constant_fold(ShaderOutput * /*socket*/, float3 *optimized_value)
+{
+	ShaderInput *fac_in = input("Fac");
+	ShaderInput *color1_in = input("Color1");
+	ShaderInput *color2_in = input("Color2");
+
+	if(!input_is_constant(fac_in) || !input_is_constant(color1_in) || !input_is_constant(color2_in))
+		return false;
+
+	float3 color = svm_mix((NodeMix)type_enum[type], fac_in->value.x, color1_in->value, color2_in->value);
+
+	if(use_clamp)
+		color = svm_mix_clamp(color);
+
+	*optimized_value = color;
+	return true;
+}
+
+bool MixNode::equals(const ShaderNode *other)
+{
+	const MixNode *mix = static_cast<const MixNode*>(other);
+	return type == mix->type && use_clamp == mix->use_clamp;
+}
+
 void MixNode::compile(SVMCompiler& compiler)
 {
 	ShaderInput *fac_in = input("Fac");
@@ -3106,6 +3244,24 @@ CombineRGBNode::CombineRGBNode()
 	add_output("Image", SHADER_SOCKET_COLOR);
 }
 
+bool CombineRGBNode::constant_fold(ShaderOutput * /*socket*/, float3 *optimized_value)
+{
+	ShaderInput *red_in = input("R");
+	ShaderInput *green_in = input("G");
+	ShaderInput *blue_in = input("B");
+
+	if(!input_is_constant(red_in) || !input_is_constant(green_in) || !input_is_constant(blue_in))
+		return false;
+
+	*optimized_value = make_float3(red_in->value.x, green_in->value.x, blue_in->value.x);
+	return true;
+}
+
+bool CombineRGBNode::equals(const ShaderNode * /*other*/)
+{
+	return true;
+}
+
 void CombineRGBNode::compile(SVMCompiler& compiler)
 {
 	ShaderInput *red_in = input("R");
@@ -3264,6 +3420,28 @@ SeparateRGBNode::SeparateRGBNode()
 	add_output("B", SHADER_SOCKET_FLOAT);
 }
 
+bool SeparateRGBNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	ShaderInput *color_in = input("Image");
+
+	if(!input_is_constant(color_in))
+		return false;
+
+	for(int channel = 0; channel < 3; channel++) {
+		if(outputs[channel] == socket) {
+			*optimized_value = make_float3(color_in->value[channel], 0.0f, 0.0f);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool SeparateRGBNode::equals(const ShaderNode * /*other*/)
+{
+	return true;
+}
+
 void SeparateRGBNode::compile(SVMCompiler& compiler)
 {
 	ShaderInput *color_in = input("Image");
@@ -3424,6 +3602,11 @@ void AttributeNode::attributes(Shader *shader, AttributeRequestSet *attributes)
 	ShaderNode::attributes(shader, attributes);
 }
 
+bool AttributeNode::equals(const ShaderNode *other)
+{
+	return attribute == static_cast<const AttributeNode*>(other)->attribute;
+}
+
 void AttributeNode::compile(SVMCompiler& compiler)
 {
 	ShaderOutput *color_out = output("Color");
@@ -3718,6 +3901,8 @@ void OutputNode::compile(OSLCompiler& compiler)
 MathNode::MathNode()
 : ShaderNode("math")
 {
+	special_type = SHADER_SPECIAL_TYPE_MATH;
+
 	type = ustring("Add");
 
 	use_clamp = false;
@@ -3756,6 +3941,29 @@ static ShaderEnum math_type_init()
 
 ShaderEnum MathNode::type_enum = math_type_init();
 
+bool MathNode::constant_fold(ShaderOutput * /*socket*/, float3 *optimized_value)
+{
+	ShaderInput *value1_in = input("Value1");
+	ShaderInput *value2_in = input("Value2");
+
+	if(!input_is_constant(value1_in) || !input_is_constant(value2_in))
+		return false;
+
+	float value = svm_math((NodeMath)type_enum[type], value1_in->value.x, value2_in->value.x);
+
+	if(use_clamp)
+		value = saturate(value);
+
+	*optimized_value = make_float3(value, 0.0f, 0.0f);
+	return true;
+}
+
+bool MathNode::equals(const ShaderNode *other)
+{
+	const MathNode *math = static_cast<const MathNode*>(other);
+	return type == math->type && use_clamp == math->use_clamp;
+}
+
 void MathNode::compile(SVMCompiler& compiler)
 {
 	ShaderInput *value1_in = input("Value1");
@@ -3797,6 +4005,53 @@ void MathNode::compile(OSLCompiler& compiler)
 	compiler.add(this, "node_math");
 }
 
+/* Math Chain */
+
+MathChainNode::MathChainNode()
+: ShaderNode("math_chain")
+{
+	add_input("Value", SHADER_SOCKET_FLOAT);
+	add_output("Value", SHADER_SOCKET_FLOAT);
+}
+
+void MathChainNode::compile(SVMCompiler& compiler)
+{
+	ShaderInput *value_in = input("Value");
+	ShaderOutput *value_out = output("Value");
+
+	compiler.stack_assign(value_in);
+	compiler.stack_assign(value_out);
+
+	compiler.add_node(NODE_MATH_CHAIN, value_in->stack_offset, value_out->stack_offset, steps.size());
+
+	/* two steps per node, as pairs of flags and constant operand */
+	int flags[2] = {0, 0};
+	float values[2] = {0.0f, 0.0f};
+
+	for(size_t i = 0; i < steps.size(); i++) {
+		const Step& step = steps[i];
+
+		flags[i & 1] = step.type;
+		if(step.value_first)
+			flags[i & 1] |= NODE_MATH_CHAIN_VALUE_FIRST;
+		if(step.use_clamp)
+			flags[i & 1] |= NODE_MATH_CHAIN_CLAMP;
+		values[i & 1] = step.value;
+
+		if((i & 1) || i + 1 == steps.size()) {
+			compiler.add_node(flags[0], __float_as_int(values[0]), flags[1], __float_as_int(values[1]));
+			flags[1] = 0;
+			values[1] = 0.0f;
+		}
+	}
+}
+
+void MathChainNode::compile(OSLCompiler& /*compiler*/)
+{
+	/* only created by the SVM graph optimizer */
+	assert(0);
+}
+
 /* VectorMath */
 
 VectorMathNode::VectorMathNode()
@@ -3826,6 +4081,36 @@ static ShaderEnum vector_math_type_init()
 
 ShaderEnum VectorMathNode::type_enum = vector_math_type_init();
 
+bool VectorMathNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	ShaderInput *vector1_in = input("Vector1");
+	ShaderInput *vector2_in = input("Vector2");
+
+	if(!input_is_constant(vector1_in) || !input_is_constant(vector2_in))
+		return false;
+
+	float value;
+	float3 vector;
+
+	svm_vector_math(&value,
+	                &vector,
+	                (NodeVectorMath)type_enum[type],
+	                vector1_in->value,
+	                vector2_in->value);
+
+	if(socket == output("Value"))
+		*optimized_value = make_float3(value, 0.0f, 0.0f);
+	else
+		*optimized_value = vector;
+
+	return true;
+}
+
+bool VectorMathNode::equals(const ShaderNode *other)
+{
+	return type == static_cast<const VectorMathNode*>(other)->type;
+}
+
 void VectorMathNode::compile(SVMCompiler& compiler)
 {
 	ShaderInput *vector1_in = input("Vector1");
@@ -4070,6 +4355,44 @@ RGBRampNode::RGBRampNode()
 	interpolate = true;
 }
 
+bool RGBRampNode::constant_fold(ShaderOutput *socket, float3 *optimized_value)
+{
+	ShaderInput *fac_in = input("Fac");
+
+	if(!input_is_constant(fac_in))
+		return false;
+
+	/* same lookup as rgb_ramp_lookup in the kernel */
+	float f = saturate(fac_in->value.x)*(RAMP_TABLE_SIZE-1);
+	int i = clamp(float_to_int(f), 0, RAMP_TABLE_SIZE-1);
+	float t = f - (float)i;
+	float4 color = ramp[i];
+
+	if(interpolate && t > 0.0f)
+		color = (1.0f - t)*color + t*ramp[i+1];
+
+	if(socket == output("Color"))
+		*optimized_value = float4_to_float3(color);
+	else
+		*optimized_value = make_float3(color.w, 0.0f, 0.0f);
+
+	return true;
+}
+
+bool RGBRampNode::equals(const ShaderNode *other)
+{
+	const RGBRampNode *ramp_node = static_cast<const RGBRampNode*>(other);
+
+	if(interpolate != ramp_node->interpolate)
+		return false;
+
+	for(int i = 0; i < RAMP_TABLE_SIZE; i++)
+		if(!(ramp[i] == ramp_node->ramp[i]))
+			return false;
+
+	return true;
+}
+
 void RGBRampNode::compile(SVMCompiler& compiler)
 {
 	ShaderInput *fac_in = input("Fac");
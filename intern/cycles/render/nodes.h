@@ -208,6 +208,9 @@ public:
 	ConvertNode(ShaderSocketType from, ShaderSocketType to, bool autoconvert = false);
 	SHADER_NODE_BASE_CLASS(ConvertNode)
 
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
+
 	ShaderSocketType from, to;
 };
 
@@ -363,6 +366,7 @@ public:
 	SHADER_NODE_CLASS(GeometryNode)
 	void attributes(Shader *shader, AttributeRequestSet *attributes);
 	bool has_spatial_varying() { return true; }
+	bool equals(const ShaderNode *other);
 };
 
 class TextureCoordinateNode : public ShaderNode {
@@ -371,6 +375,7 @@ public:
 	void attributes(Shader *shader, AttributeRequestSet *attributes);
 	bool has_spatial_varying() { return true; }
 	bool has_object_dependency() { return use_transform; }
+	bool equals(const ShaderNode *other);
 
 	bool from_dupli;
 	bool use_transform;
@@ -422,6 +427,9 @@ class ValueNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(ValueNode)
 
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
+
 	float value;
 };
 
@@ -429,6 +437,9 @@ class ColorNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(ColorNode)
 
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
+
 	float3 value;
 };
 
@@ -450,12 +461,18 @@ public:
 class InvertNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(InvertNode)
+
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
 };
 
 class MixNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(MixNode)
 
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
+
 	bool use_clamp;
 
 	ustring type;
@@ -465,6 +482,9 @@ public:
 class CombineRGBNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(CombineRGBNode)
+
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
 };
 
 class CombineHSVNode : public ShaderNode {
@@ -490,6 +510,9 @@ public:
 class SeparateRGBNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(SeparateRGBNode)
+
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
 };
 
 class SeparateHSVNode : public ShaderNode {
@@ -512,6 +535,7 @@ public:
 	SHADER_NODE_CLASS(AttributeNode)
 	void attributes(Shader *shader, AttributeRequestSet *attributes);
 	bool has_spatial_varying() { return true; }
+	bool equals(const ShaderNode *other);
 
 	ustring attribute;
 };
@@ -556,12 +580,31 @@ class MathNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(MathNode)
 
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
+
 	bool use_clamp;
 
 	ustring type;
 	static ShaderEnum type_enum;
 };
 
+/* Chain of math nodes with one constant operand each, fused by the graph
+ * into a single SVM node. Only used for SVM. */
+class MathChainNode : public ShaderNode {
+public:
+	SHADER_NODE_CLASS(MathChainNode)
+
+	struct Step {
+		int type;
+		float value;
+		bool value_first; /* constant is the first operand */
+		bool use_clamp;
+	};
+
+	vector<Step> steps;
+};
+
 class NormalNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(NormalNode)
@@ -573,6 +616,9 @@ class VectorMathNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(VectorMathNode)
 
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
+
 	ustring type;
 	static ShaderEnum type_enum;
 };
@@ -612,6 +658,9 @@ public:
 class RGBRampNode : public ShaderNode {
 public:
 	SHADER_NODE_CLASS(RGBRampNode)
+	bool constant_fold(ShaderOutput *socket, float3 *optimized_value);
+	bool equals(const ShaderNode *other);
+
 	float4 ramp[RAMP_TABLE_SIZE];
 	bool interpolate;
 };
@@ -22,11 +22,14 @@
 #include "object.h"
 #include "particles.h"
 #include "scene.h"
+#include "shader.h"
 
 #include "util_foreach.h"
 #include "util_logging.h"
 #include "util_map.h"
 #include "util_progress.h"
+#include "util_string.h"
+#include "util_task.h"
 #include "util_vector.h"
 
 CCL_NAMESPACE_BEGIN
@@ -91,6 +94,9 @@ void Object::apply_transform(bool apply_to_motion)
 {
 	if(!mesh || tfm == transform_identity())
 		return;
+
+	/* previously packed vertices and normals are not transformed */
+	mesh->packed = false;
 	
 	/* triangles */
 	if(mesh->verts.size()) {
@@ -231,151 +237,336 @@ ObjectManager::~ObjectManager()
 {
 }
 
-void ObjectManager::device_update_transforms(Device *device, DeviceScene *dscene, Scene *scene, uint *object_flag, Progress& progress)
-{
-	float4 *objects;
-	float4 *objects_vector = NULL;
-	int i = 0;
-	map<Mesh*, float> surface_area_map;
+/* State shared by the object transform update tasks. */
+struct ObjectManager::UpdateObjectTransformState {
+	Scene *scene;
+	Scene::MotionType need_motion;
 	map<ParticleSystem*, int> particle_offset;
-	Scene::MotionType need_motion = scene->need_motion(device->info.advanced_shading);
-	bool have_motion = false;
-	bool have_curves = false;
 
-	objects = dscene->objects.resize(OBJECT_SIZE*scene->objects.size());
-	if(need_motion == Scene::MOTION_PASS)
-		objects_vector = dscene->objects_vector.resize(OBJECT_VECTOR_SIZE*scene->objects.size());
+	/* index of meshes in the scene, for the attribute maps shared by instances */
+	map<Mesh*, int> mesh_index;
 
-	/* particle system device offsets
-	 * 0 is dummy particle, index starts at 1
-	 */
-	int numparticles = 1;
-	foreach(ParticleSystem *psys, scene->particle_systems) {
-		particle_offset[psys] = numparticles;
-		numparticles += psys->particles.size();
-	}
+	/* offset of the optional data of every object, or -1 */
+	vector<int> extra_offset;
+	bool need_dupli;
 
-	foreach(Object *ob, scene->objects) {
-		Mesh *mesh = ob->mesh;
-		uint flag = 0;
-
-		/* compute transformations */
-		Transform tfm = ob->tfm;
-		Transform itfm = transform_inverse(tfm);
-
-		/* compute surface area. for uniform scale we can do avoid the many
-		 * transform calls and share computation for instances */
-		/* todo: correct for displacement, and move to a better place */
-		float uniform_scale;
-		float surface_area = 0.0f;
-		float pass_id = ob->pass_id;
-		float random_number = (float)ob->random_id * (1.0f/(float)0xFFFFFFFF);
-		int particle_index = (ob->particle_system)? ob->particle_index + particle_offset[ob->particle_system]: 0;
-
-		if(transform_uniform_scale(tfm, uniform_scale)) {
-			map<Mesh*, float>::iterator it = surface_area_map.find(mesh);
-
-			if(it == surface_area_map.end()) {
-				foreach(Mesh::Triangle& t, mesh->triangles) {
-					float3 p1 = mesh->verts[t.v[0]];
-					float3 p2 = mesh->verts[t.v[1]];
-					float3 p3 = mesh->verts[t.v[2]];
-
-					surface_area += triangle_area(p1, p2, p3);
-				}
+	/* surface area of meshes, shared by instances with uniform scale */
+	map<Mesh*, float> surface_area_map;
+	thread_mutex surface_area_mutex;
 
-				surface_area_map[mesh] = surface_area;
-			}
-			else
-				surface_area = it->second;
+	/* packed object data */
+	float4 *objects;
+	float4 *objects_vector;
+	uint *object_flag;
 
-			surface_area *= uniform_scale;
+	bool have_motion;
+	bool have_curves;
+	thread_mutex flags_mutex;
+
+	Progress *progress;
+};
+
+static float object_surface_area(Mesh *mesh, const Transform *tfm)
+{
+	float surface_area = 0.0f;
+
+	foreach(Mesh::Triangle& t, mesh->triangles) {
+		float3 p1 = mesh->verts[t.v[0]];
+		float3 p2 = mesh->verts[t.v[1]];
+		float3 p3 = mesh->verts[t.v[2]];
+
+		if(tfm) {
+			p1 = transform_point(tfm, p1);
+			p2 = transform_point(tfm, p2);
+			p3 = transform_point(tfm, p3);
 		}
-		else {
-			foreach(Mesh::Triangle& t, mesh->triangles) {
-				float3 p1 = transform_point(&tfm, mesh->verts[t.v[0]]);
-				float3 p2 = transform_point(&tfm, mesh->verts[t.v[1]]);
-				float3 p3 = transform_point(&tfm, mesh->verts[t.v[2]]);
 
-				surface_area += triangle_area(p1, p2, p3);
+		surface_area += triangle_area(p1, p2, p3);
+	}
+
+	return surface_area;
+}
+
+/* Optional per object data, only stored for objects which need it so that
+ * instances without motion or dupli coordinates keep the compact record. */
+
+static bool object_need_motion_transform(Object *ob, Scene::MotionType need_motion)
+{
+#ifdef __OBJECT_MOTION__
+	return (need_motion == Scene::MOTION_BLUR && ob->use_motion);
+#else
+	(void)ob;
+	(void)need_motion;
+	return false;
+#endif
+}
+
+static bool object_need_dupli(Object *ob, bool need_dupli)
+{
+	return (need_dupli && !(is_zero(ob->dupli_generated) && is_zero(ob->dupli_uv)));
+}
+
+static int object_extra_size(Object *ob, Scene::MotionType need_motion, bool need_dupli)
+{
+	int size = 0;
+
+	if(object_need_motion_transform(ob, need_motion))
+		size += 8;
+	if(object_need_dupli(ob, need_dupli))
+		size += 2;
+
+	/* header, also needed for the particle index alone */
+	if(size || ob->particle_system)
+		size += 1;
+
+	return size;
+}
+
+void ObjectManager::device_update_object_transform(UpdateObjectTransformState *state, Object *ob, int object_index)
+{
+	float4 *objects = state->objects;
+	float4 *objects_vector = state->objects_vector;
+	Scene::MotionType need_motion = state->need_motion;
+	Mesh *mesh = ob->mesh;
+	uint flag = 0;
+
+	/* compute transformations */
+	Transform tfm = ob->tfm;
+	Transform itfm = transform_inverse(tfm);
+
+	/* compute surface area. for uniform scale we can do avoid the many
+	 * transform calls and share computation for instances */
+	/* todo: correct for displacement, and move to a better place */
+	float uniform_scale;
+	float surface_area = 0.0f;
+	float pass_id = ob->pass_id;
+	float random_number = (float)ob->random_id * (1.0f/(float)0xFFFFFFFF);
+	int particle_index = 0;
+
+	if(ob->particle_system) {
+		/* lookup without inserting, the map is shared by all tasks */
+		map<ParticleSystem*, int>::const_iterator it = state->particle_offset.find(ob->particle_system);
+		particle_index = ob->particle_index + ((it != state->particle_offset.end())? it->second: 0);
+	}
+
+	if(transform_uniform_scale(tfm, uniform_scale)) {
+		bool found = false;
+
+		{
+			thread_scoped_lock lock(state->surface_area_mutex);
+			map<Mesh*, float>::iterator it = state->surface_area_map.find(mesh);
+
+			if(it != state->surface_area_map.end()) {
+				surface_area = it->second;
+				found = true;
 			}
 		}
 
-		/* pack in texture */
-		int offset = i*OBJECT_SIZE;
-
-		/* OBJECT_TRANSFORM */
-		memcpy(&objects[offset], &tfm, sizeof(float4)*3);
-		/* OBJECT_INVERSE_TRANSFORM */
-		memcpy(&objects[offset+4], &itfm, sizeof(float4)*3);
-		/* OBJECT_PROPERTIES */
-		objects[offset+8] = make_float4(surface_area, pass_id, random_number, __int_as_float(particle_index));
-
-		if(need_motion == Scene::MOTION_PASS) {
-			/* motion transformations, is world/object space depending if mesh
-			 * comes with deformed position in object space, or if we transform
-			 * the shading point in world space */
-			Transform mtfm_pre = ob->motion.pre;
-			Transform mtfm_post = ob->motion.post;
-
-			if(!mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION)) {
-				mtfm_pre = mtfm_pre * itfm;
-				mtfm_post = mtfm_post * itfm;
-			}
-			else {
-				flag |= SD_OBJECT_HAS_VERTEX_MOTION;
-			}
+		/* instances may compute the same area at the same time, which is
+		 * cheaper than holding the lock while computing it */
+		if(!found) {
+			surface_area = object_surface_area(mesh, NULL);
+
+			thread_scoped_lock lock(state->surface_area_mutex);
+			state->surface_area_map[mesh] = surface_area;
+		}
+
+		surface_area *= uniform_scale;
+	}
+	else {
+		surface_area = object_surface_area(mesh, &tfm);
+	}
+
+	/* pack in texture */
+	int offset = object_index*OBJECT_SIZE;
+	int extra = state->extra_offset[object_index];
+	int motion_offset = -1;
+	int dupli_offset = -1;
+
+	/* OBJECT_TRANSFORM */
+	memcpy(&objects[offset], &tfm, sizeof(float4)*3);
+	/* OBJECT_PROPERTIES */
+	objects[offset+3] = make_float4(surface_area, pass_id, random_number, __int_as_float(extra));
+	/* OBJECT_INVERSE_TRANSFORM */
+	memcpy(&objects[offset+4], &itfm, sizeof(float4)*3);
+
+	bool have_motion = false;
+
+	if(need_motion == Scene::MOTION_PASS) {
+		/* motion transformations, is world/object space depending if mesh
+		 * comes with deformed position in object space, or if we transform
+		 * the shading point in world space */
+		Transform mtfm_pre = ob->motion.pre;
+		Transform mtfm_post = ob->motion.post;
 
-			memcpy(&objects_vector[i*OBJECT_VECTOR_SIZE+0], &mtfm_pre, sizeof(float4)*3);
-			memcpy(&objects_vector[i*OBJECT_VECTOR_SIZE+3], &mtfm_post, sizeof(float4)*3);
+		if(!mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION)) {
+			mtfm_pre = mtfm_pre * itfm;
+			mtfm_post = mtfm_post * itfm;
 		}
+		else {
+			flag |= SD_OBJECT_HAS_VERTEX_MOTION;
+		}
+
+		memcpy(&objects_vector[object_index*OBJECT_VECTOR_SIZE+0], &mtfm_pre, sizeof(float4)*3);
+		memcpy(&objects_vector[object_index*OBJECT_VECTOR_SIZE+3], &mtfm_post, sizeof(float4)*3);
+	}
 #ifdef __OBJECT_MOTION__
-		else if(need_motion == Scene::MOTION_BLUR) {
-			if(ob->use_motion) {
-				/* decompose transformations for interpolation */
-				DecompMotionTransform decomp;
-
-				transform_motion_decompose(&decomp, &ob->motion, &ob->tfm);
-				memcpy(&objects[offset], &decomp, sizeof(float4)*8);
-				flag |= SD_OBJECT_MOTION;
-				have_motion = true;
-			}
+	else if(need_motion == Scene::MOTION_BLUR) {
+		if(object_need_motion_transform(ob, need_motion)) {
+			/* decompose transformations for interpolation */
+			DecompMotionTransform decomp;
+
+			motion_offset = extra + 1;
+			transform_motion_decompose(&decomp, &ob->motion, &ob->tfm);
+			memcpy(&objects[motion_offset], &decomp, sizeof(float4)*8);
+			flag |= SD_OBJECT_MOTION;
+			have_motion = true;
 		}
+	}
 #endif
 
-		if(mesh->use_motion_blur)
-			have_motion = true;
+	if(mesh->use_motion_blur)
+		have_motion = true;
+
+	/* OBJECT_MESH_INFO, attribute map and motion info */
+	int totalsteps = mesh->motion_steps;
+	int numsteps = (totalsteps - 1)/2;
+	int numverts = mesh->verts.size();
+	int numkeys = mesh->curve_keys.size();
+	int mesh_index = state->mesh_index.find(mesh)->second;
+
+	objects[offset+7] = make_float4(__int_as_float(mesh_index), __int_as_float(numkeys), __int_as_float(numsteps), __int_as_float(numverts));
+
+	/* optional data, the header is followed by the motion transform and
+	 * dupli coords, in the same order as counted in device_update_transforms */
+	if(extra != -1) {
+		if(object_need_dupli(ob, state->need_dupli)) {
+			dupli_offset = extra + 1 + ((motion_offset != -1)? 8: 0);
+			objects[dupli_offset] = make_float4(ob->dupli_generated[0], ob->dupli_generated[1], ob->dupli_generated[2], 0.0f);
+			objects[dupli_offset+1] = make_float4(ob->dupli_uv[0], ob->dupli_uv[1], 0.0f, 0.0f);
+		}
 
-		/* dupli object coords and motion info */
-		int totalsteps = mesh->motion_steps;
-		int numsteps = (totalsteps - 1)/2;
-		int numverts = mesh->verts.size();
-		int numkeys = mesh->curve_keys.size();
+		objects[extra] = make_float4(__int_as_float(motion_offset), __int_as_float(dupli_offset), __int_as_float(particle_index), 0.0f);
+	}
 
-		objects[offset+9] = make_float4(ob->dupli_generated[0], ob->dupli_generated[1], ob->dupli_generated[2], __int_as_float(numkeys));
-		objects[offset+10] = make_float4(ob->dupli_uv[0], ob->dupli_uv[1], __int_as_float(numsteps), __int_as_float(numverts));
+	/* object flag */
+	if(ob->use_holdout)
+		flag |= SD_HOLDOUT_MASK;
+	state->object_flag[object_index] = flag;
 
-		/* object flag */
-		if(ob->use_holdout)
-			flag |= SD_HOLDOUT_MASK;
-		object_flag[i] = flag;
+	/* have curves */
+	bool have_curves = (mesh->curves.size() != 0);
 
-		/* have curves */
-		if(mesh->curves.size())
-			have_curves = true;
+	if(have_motion || have_curves) {
+		thread_scoped_lock lock(state->flags_mutex);
+		state->have_motion |= have_motion;
+		state->have_curves |= have_curves;
+	}
+}
 
-		i++;
+void ObjectManager::device_update_object_transform_task(UpdateObjectTransformState *state, int start, int end)
+{
+	for(int i = start; i < end; i++) {
+		if(state->progress->get_cancel())
+			return;
+
+		device_update_object_transform(state, state->scene->objects[i], i);
+	}
+}
+
+void ObjectManager::device_update_transforms(Device *device, DeviceScene *dscene, Scene *scene, uint *object_flag, Progress& progress)
+{
+	UpdateObjectTransformState state;
+	state.scene = scene;
+	state.need_motion = scene->need_motion(device->info.advanced_shading);
+	state.objects_vector = NULL;
+	state.object_flag = object_flag;
+	state.have_motion = false;
+	state.have_curves = false;
+	state.progress = &progress;
+
+	/* dupli coords are only stored if a shader uses them, OSL shaders can
+	 * look them up by name so they are always stored there */
+	state.need_dupli = scene->shader_manager->use_osl();
+	foreach(Shader *shader, scene->shaders)
+		if(shader->attributes.find(ATTR_STD_DUPLI))
+			state.need_dupli = true;
+
+	for(size_t i = 0; i < scene->meshes.size(); i++)
+		state.mesh_index[scene->meshes[i]] = i;
+
+	/* optional data is packed after the object records */
+	int num_objects = scene->objects.size();
+	int num_extra = 0;
+	int num_extra_objects = 0;
+
+	state.extra_offset.resize(num_objects);
+
+	for(int i = 0; i < num_objects; i++) {
+		int extra_size = object_extra_size(scene->objects[i], state.need_motion, state.need_dupli);
+
+		if(extra_size) {
+			state.extra_offset[i] = OBJECT_SIZE*num_objects + num_extra;
+			num_extra += extra_size;
+			num_extra_objects++;
+		}
+		else {
+			state.extra_offset[i] = -1;
+		}
+	}
+
+	state.objects = dscene->objects.resize(OBJECT_SIZE*num_objects + num_extra);
+	if(state.need_motion == Scene::MOTION_PASS)
+		state.objects_vector = dscene->objects_vector.resize(OBJECT_VECTOR_SIZE*num_objects);
+
+	/* particle system device offsets
+	 * 0 is dummy particle, index starts at 1
+	 */
+	int numparticles = 1;
+	foreach(ParticleSystem *psys, scene->particle_systems) {
+		state.particle_offset[psys] = numparticles;
+		numparticles += psys->particles.size();
+	}
 
-		if(progress.get_cancel()) return;
+	/* objects are updated in chunks, so scenes with many small objects don't
+	 * spend more time in task scheduling than in the actual update */
+	int num_chunks = max(TaskScheduler::num_threads(), 1) * 8;
+	int chunk_size = max((num_objects + num_chunks - 1) / num_chunks, 1);
+
+	TaskPool pool;
+
+	for(int start = 0; start < num_objects; start += chunk_size) {
+		int end = min(start + chunk_size, num_objects);
+		pool.push(function_bind(&ObjectManager::device_update_object_transform_task,
+		                        this,
+		                        &state,
+		                        start,
+		                        end));
 	}
 
+	pool.wait_work();
+
+	if(progress.get_cancel()) return;
+
 	device->tex_alloc("__objects", dscene->objects);
-	if(need_motion == Scene::MOTION_PASS)
+	if(state.need_motion == Scene::MOTION_PASS)
 		device->tex_alloc("__objects_vector", dscene->objects_vector);
 
-	dscene->data.bvh.have_motion = have_motion;
-	dscene->data.bvh.have_curves = have_curves;
+	dscene->data.bvh.have_motion = state.have_motion;
+	dscene->data.bvh.have_curves = state.have_curves;
 	dscene->data.bvh.have_instancing = true;
+
+	/* compare against a full record of 11 float4 for every object, with room
+	 * for the motion transform and dupli coords */
+	size_t mem_used = dscene->objects.size()*sizeof(float4);
+	size_t mem_full = (size_t)num_objects*11*sizeof(float4);
+
+	VLOG(1) << string_printf("Objects: %d objects, %d meshes, %d with extra data, %.2fM in memory, %.2fM saved by compact instancing.",
+	                         num_objects,
+	                         (int)scene->meshes.size(),
+	                         num_extra_objects,
+	                         (double)mem_used / (1024.0 * 1024.0),
+	                         (double)((mem_full > mem_used)? mem_full - mem_used: 0) / (1024.0 * 1024.0));
 }
 
 void ObjectManager::device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress)
@@ -401,7 +592,8 @@ void ObjectManager::device_update(Device *device, DeviceScene *dscene, Scene *sc
 
 	/* prepare for static BVH building */
 	/* todo: do before to support getting object level coords? */
-	if(scene->params.bvh_type == SceneParams::BVH_STATIC) {
+	/* object BVH's can't be reused if transforms are baked into meshes */
+	if(scene->params.bvh_type == SceneParams::BVH_STATIC && !scene->params.use_bvh_reuse) {
 		progress.set_status("Updating Objects", "Applying Static Transformations");
 		apply_static_transforms(dscene, scene, object_flag, progress);
 	}
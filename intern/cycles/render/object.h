@@ -83,6 +83,12 @@ public:
 	void tag_update(Scene *scene);
 
 	void apply_static_transforms(DeviceScene *dscene, Scene *scene, uint *object_flag, Progress& progress);
+
+protected:
+	struct UpdateObjectTransformState;
+
+	void device_update_object_transform(UpdateObjectTransformState *state, Object *ob, int object_index);
+	void device_update_object_transform_task(UpdateObjectTransformState *state, int start, int end);
 };
 
 CCL_NAMESPACE_END
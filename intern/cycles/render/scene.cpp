@@ -34,11 +34,12 @@
 #include "tables.h"
 
 #include "util_foreach.h"
+#include "util_logging.h"
 #include "util_progress.h"
+#include "util_time.h"
 
 #ifdef WITH_CYCLES_DEBUG
 #  include "util_guarded_allocator.h"
-#  include "util_logging.h"
 #endif
 
 CCL_NAMESPACE_BEGIN
@@ -70,6 +71,10 @@ Scene::Scene(const SceneParams& params_, const DeviceInfo& device_info_)
 
 	/* Extended image limits for CPU and GPUs */
 	image_manager->set_extended_image_limits(device_info_);
+
+	/* Image files read on demand, only supported by the CPU device */
+	if(params.use_texture_cache)
+		image_manager->set_texture_cache_max_size(params.texture_cache_max_size);
 }
 
 Scene::~Scene()
@@ -137,6 +142,86 @@ void Scene::free_memory(bool final)
 	}
 }
 
+SceneUpdateStats::SceneUpdateStats()
+{
+	clear();
+}
+
+void SceneUpdateStats::clear()
+{
+	steps.clear();
+	step_start = 0.0;
+	in_step = false;
+}
+
+void SceneUpdateStats::begin_step(const string& name)
+{
+	end_step();
+
+	Step step;
+	step.name = name;
+	step.time = 0.0;
+	steps.push_back(step);
+
+	step_start = time_dt();
+	in_step = true;
+}
+
+void SceneUpdateStats::end_step()
+{
+	if(in_step) {
+		steps.back().time = time_dt() - step_start;
+		in_step = false;
+	}
+}
+
+void SceneUpdateStats::step_info(const string& info)
+{
+	if(in_step)
+		steps.back().info = info;
+}
+
+string SceneUpdateStats::full_report() const
+{
+	/* steps may run more than once, e.g. lookup tables */
+	double total = 0.0;
+	string report = "Scene update times:\n";
+
+	foreach(const Step& step, steps) {
+		report += string_printf("  %-20s %.4fs", step.name.c_str(), step.time);
+		if(!step.info.empty())
+			report += " (" + step.info + ")";
+		report += "\n";
+
+		total += step.time;
+	}
+
+	report += string_printf("  %-20s %.4fs", "Total", total);
+
+	return report;
+}
+
+double SceneUpdateStats::get_step_time(const string& name) const
+{
+	double time = 0.0;
+
+	foreach(const Step& step, steps)
+		if(step.name == name)
+			time += step.time;
+
+	return time;
+}
+
+double SceneUpdateStats::get_total_time() const
+{
+	double time = 0.0;
+
+	foreach(const Step& step, steps)
+		time += step.time;
+
+	return time;
+}
+
 void Scene::device_update(Device *device_, Progress& progress)
 {
 	if(!device)
@@ -151,100 +236,153 @@ void Scene::device_update(Device *device_, Progress& progress)
 	 * - Light manager needs lookup tables and final mesh data to compute emission CDF.
 	 * - Film needs light manager to run for use_light_visibility
 	 * - Lookup tables are done a second time to handle film tables
+	 * - Volume grids are built from voxel data of images after they are loaded
 	 */
 	
 	image_manager->set_pack_images(device->info.pack_images);
 
+	update_stats.clear();
+
+	/* volume grids are only built for meshes with voxel driven shaders */
+	if(shader_manager->need_update)
+		mesh_manager->need_volume_grid_update = true;
+
+	update_stats.begin_step("Shaders");
 	progress.set_status("Updating Shaders");
 	shader_manager->device_update(device, &dscene, this, progress);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Background");
 	progress.set_status("Updating Background");
 	background->device_update(device, &dscene, this);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Camera");
 	progress.set_status("Updating Camera");
 	camera->device_update(device, &dscene, this);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Objects");
 	progress.set_status("Updating Objects");
 	object_manager->device_update(device, &dscene, this, progress);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Meshes Flags");
 	progress.set_status("Updating Meshes Flags");
 	mesh_manager->device_update_flags(device, &dscene, this, progress);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Meshes");
 	progress.set_status("Updating Meshes");
 	mesh_manager->device_update(device, &dscene, this, progress);
 
+	if(mesh_manager->build_stats.bvh_time > 0.0) {
+		const MeshManager::BuildStats& build_stats = mesh_manager->build_stats;
+		update_stats.step_info(string_printf("%.4fs displacement, %.4fs BVH",
+		                                     build_stats.displacement_time,
+		                                     build_stats.bvh_time));
+	}
+
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Objects Flags");
 	progress.set_status("Updating Objects Flags");
 	object_manager->device_update_flags(device, &dscene, this, progress);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	/* volume grids are built from the voxel data of reloaded images too */
+	if(image_manager->need_update)
+		mesh_manager->need_volume_grid_update = true;
+
+	update_stats.begin_step("Images");
 	progress.set_status("Updating Images");
 	image_manager->device_update(device, &dscene, progress);
 
+	if(image_manager->load_stats.num_loaded) {
+		const ImageManager::LoadStats& image_stats = image_manager->load_stats;
+		update_stats.step_info(string_printf("%d images, %.4fs decoding, %.4fs uploading",
+		                                     image_stats.num_loaded,
+		                                     image_stats.decode_time,
+		                                     image_stats.upload_time));
+	}
+
+	if(progress.get_cancel() || device->have_error()) return;
+
+	update_stats.begin_step("Volume Grids");
+	progress.set_status("Updating Volume Grids");
+	mesh_manager->device_update_volume_grids(device, &dscene, this, progress);
+
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Camera Volume");
 	progress.set_status("Updating Camera Volume");
 	camera->device_update_volume(device, &dscene, this);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Hair Systems");
 	progress.set_status("Updating Hair Systems");
 	curve_system_manager->device_update(device, &dscene, this, progress);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Lookup Tables");
 	progress.set_status("Updating Lookup Tables");
 	lookup_tables->device_update(device, &dscene);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Lights");
 	progress.set_status("Updating Lights");
 	light_manager->device_update(device, &dscene, this, progress);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Particle Systems");
 	progress.set_status("Updating Particle Systems");
 	particle_system_manager->device_update(device, &dscene, this, progress);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Film");
 	progress.set_status("Updating Film");
 	film->device_update(device, &dscene, this);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Integrator");
 	progress.set_status("Updating Integrator");
 	integrator->device_update(device, &dscene, this);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Lookup Tables");
 	progress.set_status("Updating Lookup Tables");
 	lookup_tables->device_update(device, &dscene);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
+	update_stats.begin_step("Baking");
 	progress.set_status("Updating Baking");
 	bake_manager->device_update(device, &dscene, this, progress);
 
 	if(progress.get_cancel() || device->have_error()) return;
 
 	if(device->have_error() == false) {
+		update_stats.begin_step("Device");
 		progress.set_status("Updating Device", "Writing constant memory");
 		device->const_copy_to("__data", &dscene.data, sizeof(dscene.data));
 	}
 
+	update_stats.end_step();
+	VLOG(1) << update_stats.full_report();
+
 #ifdef WITH_CYCLES_DEBUG
 	VLOG(1) << "System memory statistics after full device sync:\n"
 	        << "  Usage: " << util_guarded_get_mem_used() << "\n"
@@ -63,6 +63,7 @@ public:
 	/* BVH */
 	device_vector<float4> bvh_nodes;
 	device_vector<float4> bvh_leaf_nodes;
+	device_vector<float4> bvh_time_nodes;
 	device_vector<uint> object_node;
 	device_vector<float4> tri_woop;
 	device_vector<uint> prim_type;
@@ -92,6 +93,7 @@ public:
 	/* lights */
 	device_vector<float4> light_distribution;
 	device_vector<float4> light_data;
+	device_vector<float4> light_tree;
 	device_vector<float2> light_background_marginal_cdf;
 	device_vector<float2> light_background_conditional_cdf;
 
@@ -103,6 +105,10 @@ public:
 	device_vector<uint> shader_flag;
 	device_vector<uint> object_flag;
 
+	/* volume acceleration grid */
+	device_vector<float4> volume_grid;
+	device_vector<float> volume_grid_cells;
+
 	/* lookup tables */
 	device_vector<float> lookup_table;
 
@@ -110,8 +116,12 @@ public:
 	device_vector<uint> sobol_directions;
 
 	/* cpu images */
-	device_vector<uchar4> tex_image[TEX_EXTENDED_NUM_IMAGES_CPU];
-	device_vector<float4> tex_float_image[TEX_EXTENDED_NUM_FLOAT_IMAGES];
+	device_vector<uchar4> tex_image[TEX_NUM_IMAGES_CPU];
+	device_vector<float4> tex_float_image[TEX_NUM_IMAGES_CPU];
+	device_vector<half4> tex_half4_image[TEX_NUM_IMAGES_CPU];
+	device_vector<float> tex_float1_image[TEX_NUM_IMAGES_CPU];
+	device_vector<uchar> tex_byte1_image[TEX_NUM_IMAGES_CPU];
+	device_vector<half> tex_half1_image[TEX_NUM_IMAGES_CPU];
 
 	/* opencl images */
 	device_vector<uchar4> tex_image_packed;
@@ -127,8 +137,17 @@ public:
 	ShadingSystem shadingsystem;
 	enum BVHType { BVH_DYNAMIC, BVH_STATIC } bvh_type;
 	bool use_bvh_cache;
+	uint64_t bvh_cache_max_size;
 	bool use_bvh_spatial_split;
 	bool use_qbvh;
+	bool use_obvh;
+	bool use_bvh_time_bounds;
+	bool use_bvh_curve_split;
+	bool use_bvh_reuse;
+	bool use_shader_optimization;
+	bool use_volume_grid;
+	bool use_texture_cache;
+	uint64_t texture_cache_max_size;
 	bool persistent_data;
 
 	SceneParams()
@@ -136,8 +155,17 @@ public:
 		shadingsystem = SHADINGSYSTEM_SVM;
 		bvh_type = BVH_DYNAMIC;
 		use_bvh_cache = false;
+		bvh_cache_max_size = 0;
 		use_bvh_spatial_split = false;
 		use_qbvh = false;
+		use_obvh = false;
+		use_bvh_time_bounds = true;
+		use_bvh_curve_split = true;
+		use_bvh_reuse = false;
+		use_shader_optimization = true;
+		use_volume_grid = true;
+		use_texture_cache = false;
+		texture_cache_max_size = 0;
 		persistent_data = false;
 	}
 
@@ -145,11 +173,55 @@ public:
 	{ return !(shadingsystem == params.shadingsystem
 		&& bvh_type == params.bvh_type
 		&& use_bvh_cache == params.use_bvh_cache
+		&& bvh_cache_max_size == params.bvh_cache_max_size
 		&& use_bvh_spatial_split == params.use_bvh_spatial_split
 		&& use_qbvh == params.use_qbvh
+		&& use_obvh == params.use_obvh
+		&& use_bvh_time_bounds == params.use_bvh_time_bounds
+		&& use_bvh_curve_split == params.use_bvh_curve_split
+		&& use_bvh_reuse == params.use_bvh_reuse
+		&& use_shader_optimization == params.use_shader_optimization
+		&& use_volume_grid == params.use_volume_grid
+		&& use_texture_cache == params.use_texture_cache
+		&& texture_cache_max_size == params.texture_cache_max_size
 		&& persistent_data == params.persistent_data); }
 };
 
+/* Scene Update Statistics
+ *
+ * Wall clock time spent in every step of the last device update. */
+
+class SceneUpdateStats {
+public:
+	SceneUpdateStats();
+
+	void clear();
+
+	/* end the current step, if any, and start timing the next one */
+	void begin_step(const string& name);
+	void end_step();
+
+	/* extra information appended to the current step in the report */
+	void step_info(const string& info);
+
+	string full_report() const;
+
+	/* time of all steps with the given name, and of all steps */
+	double get_step_time(const string& name) const;
+	double get_total_time() const;
+
+protected:
+	struct Step {
+		string name;
+		string info;
+		double time;
+	};
+
+	vector<Step> steps;
+	double step_start;
+	bool in_step;
+};
+
 /* Scene */
 
 class Scene {
@@ -191,6 +263,9 @@ public:
 	/* parameters */
 	SceneParams params;
 
+	/* timing of the last device update */
+	SceneUpdateStats update_stats;
+
 	/* mutex must be locked manually by callers */
 	thread_mutex mutex;
 
@@ -28,8 +28,10 @@
 
 #include "util_foreach.h"
 #include "util_function.h"
+#include "util_logging.h"
 #include "util_math.h"
 #include "util_opengl.h"
+#include "util_path.h"
 #include "util_task.h"
 #include "util_time.h"
 
@@ -52,10 +54,19 @@ Session::Session(const SessionParams& params_)
 
 	device = Device::create(params.device, stats, params.background);
 
+	tile_output = NULL;
+
 	if(params.background && params.output_path.empty()) {
 		buffers = NULL;
 		display = NULL;
 	}
+	else if(params.background && !params.progressive_refine && TileOutput::supported(params.output_path)) {
+		/* finished tiles are written to the output file and freed, the full
+		 * frame buffer is never allocated */
+		buffers = NULL;
+		display = NULL;
+		tile_output = new TileOutput(params.output_path);
+	}
 	else {
 		buffers = new RenderBuffers(device);
 		display = new DisplayBuffer(device, params.display_buffer_linear);
@@ -101,7 +112,12 @@ Session::~Session()
 		wait();
 	}
 
-	if(!params.output_path.empty()) {
+	if(tile_output) {
+		/* write out tiles still waiting for their neighbours */
+		progress.set_status("Writing Image", params.output_path);
+		delete tile_output;
+	}
+	else if(!params.output_path.empty()) {
 		/* tonemap and write out image if requested */
 		delete display;
 
@@ -371,15 +387,24 @@ bool Session::acquire_tile(Device *tile_device, RenderTile& rtile)
 	rtile.y = tile_manager.state.buffer.full_y + tile.y;
 	rtile.w = tile.w;
 	rtile.h = tile.h;
-	rtile.start_sample = tile_manager.state.sample;
-	rtile.num_samples = tile_manager.state.num_samples;
+	rtile.start_sample = tile.start_sample;
+	rtile.num_samples = tile.num_samples;
+	rtile.sample = tile.start_sample;
 	rtile.resolution = tile_manager.state.resolution_divider;
+	rtile.tile_index = tile.index;
+	rtile.work_id = tile.work_id;
+	rtile.stolen = tile.stolen;
+
+	/* register the tile before its samples can be stolen, so thieves always
+	 * accumulate into the same entry */
+	if(tile_manager.use_work_stealing && !rtile.stolen)
+		steal_tiles.insert(std::make_pair(rtile.tile_index, StealTile()));
 
 	tile_lock.unlock();
 
 	/* in case of a permanent buffer, return it, otherwise we will allocate
 	 * a new temporary buffer */
-	if(!(params.background && params.output_path.empty())) {
+	if(buffers) {
 		tile_manager.state.buffer.get_offset_stride(rtile.offset, rtile.stride);
 
 		rtile.buffer = buffers->buffer.device_pointer;
@@ -434,6 +459,19 @@ bool Session::acquire_tile(Device *tile_device, RenderTile& rtile)
 	rtile.rng_state = tilebuffers->rng_state.device_pointer;
 	rtile.buffers = tilebuffers;
 
+	if(tile_manager.use_work_stealing) {
+		/* samples stolen from this tile are accumulated into its buffers, the
+		 * thief only renders into buffers of its own */
+		if(rtile.stolen)
+			return true;
+
+		tile_lock.lock();
+
+		steal_tiles[rtile.tile_index].rtile = rtile;
+
+		tile_lock.unlock();
+	}
+
 	/* this will tag tile as IN PROGRESS in blender-side render pipeline,
 	 * which is needed to highlight currently rendering tile before first
 	 * sample was processed for it
@@ -443,12 +481,23 @@ bool Session::acquire_tile(Device *tile_device, RenderTile& rtile)
 	return true;
 }
 
+bool Session::acquire_tile_sample(RenderTile& rtile, int sample)
+{
+	if(!tile_manager.use_work_stealing)
+		return true;
+
+	thread_scoped_lock tile_lock(tile_mutex);
+
+	return tile_manager.next_tile_sample(rtile.work_id, sample);
+}
+
 void Session::update_tile_sample(RenderTile& rtile)
 {
 	thread_scoped_lock tile_lock(tile_mutex);
 
 	if(update_render_tile_cb) {
-		if(params.progressive_refine == false) {
+		/* buffers of stolen samples only hold part of the tile */
+		if(params.progressive_refine == false && !rtile.stolen) {
 			/* todo: optimize this by making it thread safe and removing lock */
 
 			update_render_tile_cb(rtile);
@@ -458,14 +507,49 @@ void Session::update_tile_sample(RenderTile& rtile)
 	update_status_time();
 }
 
+void Session::release_steal_tile(RenderTile& rtile)
+{
+	StealTile& steal_tile = steal_tiles[rtile.tile_index];
+
+	steal_tile.num_samples += rtile.sample - rtile.start_sample;
+
+	if(rtile.stolen)
+		steal_tile.stolen_buffers.push_back(rtile.buffers);
+
+	if(!tile_manager.release_tile(rtile.work_id))
+		return;
+
+	/* all samples of the tile are done, accumulate and write it */
+	RenderTile& main_rtile = steal_tile.rtile;
+
+	foreach(RenderBuffers *stolen_buffers, steal_tile.stolen_buffers) {
+		main_rtile.buffers->add(stolen_buffers);
+		delete stolen_buffers;
+	}
+
+	main_rtile.sample = main_rtile.start_sample + steal_tile.num_samples;
+
+	write_tile(main_rtile);
+
+	delete main_rtile.buffers;
+
+	steal_tiles.erase(rtile.tile_index);
+}
+
 void Session::release_tile(RenderTile& rtile)
 {
 	thread_scoped_lock tile_lock(tile_mutex);
 
-	if(write_render_tile_cb) {
+	if(tile_manager.use_work_stealing) {
+		release_steal_tile(rtile);
+		update_status_time();
+		return;
+	}
+
+	if(write_render_tile_cb || tile_output) {
 		if(params.progressive_refine == false) {
 			/* todo: optimize this by making it thread safe and removing lock */
-			write_render_tile_cb(rtile);
+			write_tile(rtile);
 
 			delete rtile.buffers;
 		}
@@ -474,6 +558,26 @@ void Session::release_tile(RenderTile& rtile)
 	update_status_time();
 }
 
+void Session::write_tile(RenderTile& rtile)
+{
+	if(tile_output && !tile_output->write(rtile, scene->film->exposure))
+		progress.set_error("Failed to write tile to " + params.output_path);
+
+	if(write_render_tile_cb)
+		write_render_tile_cb(rtile);
+}
+
+void Session::requeue_tile(RenderTile& rtile)
+{
+	thread_scoped_lock tile_lock(tile_mutex);
+
+	tile_manager.requeue_tile(rtile.tile_index);
+
+	/* temporary buffers are allocated again for the next device */
+	if(!buffers && !params.progressive_refine)
+		delete rtile.buffers;
+}
+
 void Session::run_cpu()
 {
 	bool tiles_written = false;
@@ -573,6 +677,25 @@ void Session::run_cpu()
 
 		device->task_wait();
 
+		/* tiles of lost network render servers are rendered again by the
+		 * remaining devices, as long as they make progress */
+		while(params.background && !no_tiles &&
+		      !progress.get_cancel() && device->error_message().empty())
+		{
+			thread_scoped_lock buffers_lock(buffers_mutex);
+
+			if(!tile_manager.have_requeued_tiles())
+				break;
+
+			int num_rendered_tiles = tile_manager.state.num_rendered_tiles;
+
+			path_trace();
+			device->task_wait();
+
+			if(tile_manager.state.num_rendered_tiles == num_rendered_tiles)
+				break;
+		}
+
 		{
 			thread_scoped_lock reset_lock(delayed_reset.mutex);
 			thread_scoped_lock buffers_lock(buffers_mutex);
@@ -667,6 +790,58 @@ void Session::run()
 		progress.set_status("Cancel", progress.get_cancel_message());
 	else
 		progress.set_update();
+
+	if(progress.get_skipped_samples()) {
+		VLOG(1) << "Adaptive sampling skipped " << progress.get_skipped_samples()
+		        << " pixel samples.";
+	}
+
+	/* utilization of the render threads, time spent rendering tiles
+	 * compared to the total render time */
+	vector<double> thread_render_time = progress.get_thread_render_time();
+
+	if(thread_render_time.size()) {
+		int tile;
+		double total_time, render_time, tile_time;
+		progress.get_tile(tile, total_time, render_time, tile_time);
+
+		if(render_time > 0.0) {
+			double min_utilization = 1.0, sum_utilization = 0.0;
+
+			for(size_t i = 0; i < thread_render_time.size(); i++) {
+				double utilization = min(thread_render_time[i]/render_time, 1.0);
+
+				VLOG(2) << "Render thread " << i << " utilization "
+				        << utilization*100.0 << "%.";
+
+				min_utilization = min(min_utilization, utilization);
+				sum_utilization += utilization;
+			}
+
+			VLOG(1) << "Render thread utilization: average "
+			        << sum_utilization*100.0/thread_render_time.size() << "%, minimum "
+			        << min_utilization*100.0 << "%.";
+		}
+	}
+
+	/* kernel counters since the last reset of the stats */
+	{
+		thread_scoped_lock lock(stats.kernel_mutex);
+		const KernelCounters& counters = stats.kernel_counters;
+
+		if(counters.total_rays()) {
+			VLOG(1) << "Kernel counters: "
+			        << counters.camera_rays << " camera rays, "
+			        << counters.intersect_rays << " intersect rays, "
+			        << counters.shadow_rays << " shadow rays, "
+			        << counters.subsurface_rays << " subsurface rays, "
+			        << counters.volume_rays << " volume rays, "
+			        << counters.bvh_nodes << " BVH nodes, "
+			        << counters.bvh_primitives << " primitives, "
+			        << counters.shader_evals << " shader evaluations, "
+			        << counters.bounces << " bounces.";
+		}
+	}
 }
 
 bool Session::draw(BufferParams& buffer_params, DeviceDrawParams &draw_params)
@@ -687,8 +862,31 @@ void Session::reset_(BufferParams& buffer_params, int samples)
 		}
 	}
 
+	/* work stealing needs temporary tile buffers to accumulate stolen
+	 * samples, and can't stop pixels early with adaptive sampling */
+	bool use_adaptive_sampling = false;
+
+	foreach(Pass& pass, buffer_params.passes)
+		if(pass.type == PASS_ADAPTIVE_AUX_BUFFER)
+			use_adaptive_sampling = true;
+
+	tile_manager.use_work_stealing = params.use_work_stealing &&
+	                                 params.background &&
+	                                 !params.progressive_refine &&
+	                                 !buffers &&
+	                                 params.device.type == DEVICE_CPU &&
+	                                 !use_adaptive_sampling;
 	tile_manager.reset(buffer_params, samples);
 
+	{
+		thread_scoped_lock tile_lock(tile_mutex);
+
+		steal_tiles.clear();
+	}
+
+	if(tile_output && !tile_output->open(tile_manager.params, params.tile_size))
+		progress.set_error("Failed to open output file " + params.output_path);
+
 	start_time = time_dt();
 	preview_time = 0.0;
 	paused_time = 0.0;
@@ -835,6 +1033,16 @@ void Session::update_status_time(bool show_pause, bool show_done)
 
 			substatus += string_printf(", Sample %d/%d", sample, num_samples);
 		}
+
+		uint64_t skipped_samples = progress.get_skipped_samples();
+
+		if(skipped_samples) {
+			BufferParams& buffer = tile_manager.state.buffer;
+			uint64_t num_pixel_samples = (uint64_t)buffer.width*buffer.height*tile_manager.num_samples;
+
+			substatus += string_printf(", Adaptive Sampling Skipped %.1f%%",
+			                           100.0*(double)skipped_samples/(double)num_pixel_samples);
+		}
 	}
 	else if(tile_manager.num_samples == USHRT_MAX)
 		substatus = string_printf("Path Tracing Sample %d", sample+1);
@@ -878,11 +1086,16 @@ void Session::path_trace()
 	
 	task.acquire_tile = function_bind(&Session::acquire_tile, this, _1, _2);
 	task.release_tile = function_bind(&Session::release_tile, this, _1);
+	task.requeue_tile = function_bind(&Session::requeue_tile, this, _1);
 	task.get_cancel = function_bind(&Progress::get_cancel, &this->progress);
+	task.add_skipped_samples = function_bind(&Progress::add_skipped_samples, &this->progress, _1);
 	task.update_tile_sample = function_bind(&Session::update_tile_sample, this, _1);
+	task.acquire_tile_sample = function_bind(&Session::acquire_tile_sample, this, _1, _2);
+	task.add_render_time = function_bind(&Progress::add_thread_render_time, &this->progress, _1, _2);
 	task.update_progress_sample = function_bind(&Session::update_progress_sample, this);
 	task.need_finish_queue = params.progressive_refine;
 	task.integrator_branched = scene->integrator->method == Integrator::BRANCHED_PATH;
+	task.use_camera_packets = params.use_camera_packets;
 	task.requested_tile_size = params.tile_size;
 
 	device->task_add(task);
@@ -963,6 +1176,53 @@ void Session::device_free()
 	 */
 }
 
+static string kernel_counters_json(const KernelCounters& counters)
+{
+	return string_printf(
+	        "{\"camera_rays\": %llu, \"intersect_rays\": %llu, \"shadow_rays\": %llu, "
+	        "\"subsurface_rays\": %llu, \"volume_rays\": %llu, \"bvh_nodes\": %llu, "
+	        "\"bvh_primitives\": %llu, \"shader_evals\": %llu, \"bounces\": %llu}",
+	        (unsigned long long)counters.camera_rays,
+	        (unsigned long long)counters.intersect_rays,
+	        (unsigned long long)counters.shadow_rays,
+	        (unsigned long long)counters.subsurface_rays,
+	        (unsigned long long)counters.volume_rays,
+	        (unsigned long long)counters.bvh_nodes,
+	        (unsigned long long)counters.bvh_primitives,
+	        (unsigned long long)counters.shader_evals,
+	        (unsigned long long)counters.bounces);
+}
+
+bool Session::write_kernel_stats(const string& filepath, int frame, double render_time)
+{
+	thread_scoped_lock lock(stats.kernel_mutex);
+
+	string json = string_printf(
+	        "{\n  \"frame\": %d,\n  \"render_time\": %f,\n  \"mem_peak\": %llu,\n",
+	        frame, render_time, (unsigned long long)stats.mem_peak);
+	json += "  \"counters\": " + kernel_counters_json(stats.kernel_counters) + ",\n";
+	json += "  \"tiles\": [";
+
+	for(size_t i = 0; i < stats.kernel_tiles.size(); i++) {
+		const TileCounters& tile = stats.kernel_tiles[i];
+
+		json += (i == 0)? "\n": ",\n";
+		json += string_printf(
+		        "    {\"x\": %d, \"y\": %d, \"w\": %d, \"h\": %d, \"samples\": %d, \"time\": %f, \"counters\": ",
+		        tile.x, tile.y, tile.w, tile.h, tile.num_samples, tile.time);
+		json += kernel_counters_json(tile.counters) + "}";
+	}
+
+	json += "\n  ]\n}\n";
+
+	if(!path_write_text(filepath, json)) {
+		VLOG(1) << "Failed to write kernel stats to " << filepath << ".";
+		return false;
+	}
+
+	return true;
+}
+
 int Session::get_max_closure_count()
 {
 	int max_closures = 0;
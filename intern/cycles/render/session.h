@@ -22,6 +22,7 @@
 #include "shader.h"
 #include "tile.h"
 
+#include "util_map.h"
 #include "util_progress.h"
 #include "util_stats.h"
 #include "util_thread.h"
@@ -37,6 +38,7 @@ class DisplayBuffer;
 class Progress;
 class RenderBuffers;
 class Scene;
+class TileOutput;
 
 /* Session Parameters */
 
@@ -56,6 +58,8 @@ public:
 	int threads;
 
 	bool display_buffer_linear;
+	bool use_camera_packets;
+	bool use_work_stealing;
 
 	double cancel_timeout;
 	double reset_timeout;
@@ -78,6 +82,8 @@ public:
 		threads = 0;
 
 		display_buffer_linear = false;
+		use_camera_packets = false;
+		use_work_stealing = false;
 
 		cancel_timeout = 0.1;
 		reset_timeout = 0.1;
@@ -101,6 +107,8 @@ public:
 		&& start_resolution == params.start_resolution
 		&& threads == params.threads
 		&& display_buffer_linear == params.display_buffer_linear
+		&& use_camera_packets == params.use_camera_packets
+		&& use_work_stealing == params.use_work_stealing
 		&& cancel_timeout == params.cancel_timeout
 		&& reset_timeout == params.reset_timeout
 		&& text_timeout == params.text_timeout
@@ -121,6 +129,7 @@ public:
 	Scene *scene;
 	RenderBuffers *buffers;
 	DisplayBuffer *display;
+	TileOutput *tile_output;
 	Progress progress;
 	SessionParams params;
 	TileManager tile_manager;
@@ -146,6 +155,10 @@ public:
 
 	void device_free();
 
+	/* write kernel counters of the tiles rendered since the last reset of
+	 * the stats to a JSON file */
+	bool write_kernel_stats(const string& filepath, int frame, double render_time);
+
 protected:
 	struct DelayedReset {
 		thread_mutex mutex;
@@ -171,8 +184,11 @@ protected:
 	void reset_gpu(BufferParams& params, int samples);
 
 	bool acquire_tile(Device *tile_device, RenderTile& tile);
+	bool acquire_tile_sample(RenderTile& tile, int sample);
 	void update_tile_sample(RenderTile& tile);
 	void release_tile(RenderTile& tile);
+	void write_tile(RenderTile& tile);
+	void requeue_tile(RenderTile& tile);
 
 	void update_progress_sample();
 
@@ -206,6 +222,19 @@ protected:
 
 	vector<RenderBuffers *> tile_buffers;
 
+	/* work stealing, tiles with samples rendered by multiple threads are
+	 * written once all their buffers are accumulated */
+	struct StealTile {
+		StealTile() : num_samples(0) {}
+
+		RenderTile rtile;
+		int num_samples;
+		vector<RenderBuffers *> stolen_buffers;
+	};
+
+	map<int, StealTile> steal_tiles;
+	void release_steal_tile(RenderTile& tile);
+
 	DeviceRequestedFeatures get_requested_device_features();
 
 	/* ** Split kernel routines ** */
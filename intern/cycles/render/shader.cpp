@@ -156,6 +156,10 @@ Shader::Shader()
 
 	used = false;
 
+	svm_jump[0] = make_int4(0, 0, 0, 0);
+	svm_jump[1] = make_int4(0, 0, 0, 0);
+	svm_compile_flags = 0;
+
 	need_update = true;
 	need_update_attributes = true;
 }
@@ -220,6 +224,10 @@ void Shader::tag_update(Scene *scene)
 		scene->mesh_manager->need_update = true;
 	}
 
+	/* dupli coords are only stored for objects if a shader uses them */
+	if(attributes.find(ATTR_STD_DUPLI) != prev_attributes.find(ATTR_STD_DUPLI))
+		scene->object_manager->need_update = true;
+
 	if(has_volume != prev_has_volume) {
 		scene->mesh_manager->need_flags_update = true;
 		scene->object_manager->need_flags_update = true;
@@ -268,7 +276,10 @@ ShaderManager *ShaderManager::create(Scene *scene, int shadingsystem)
 
 uint ShaderManager::get_attribute_id(ustring name)
 {
-	/* get a unique id for each name, for SVM attribute lookup */
+	/* get a unique id for each name, for SVM attribute lookup. shaders are
+	 * compiled in parallel, so this needs a lock */
+	thread_scoped_lock lock(attribute_id_mutex);
+
 	AttributeIDMap::iterator it = unique_attribute_id.find(name);
 
 	if(it != unique_attribute_id.end())
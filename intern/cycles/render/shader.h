@@ -38,6 +38,7 @@
 #include "util_string.h"
 #include "util_thread.h"
 #include "util_types.h"
+#include "util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -114,6 +115,13 @@ public:
 	/* determined before compiling */
 	bool used;
 
+	/* compiled SVM program, with the surface, volume and displacement jump
+	 * offsets relative to its start, without and with bump. kept between
+	 * device updates to skip compiling shaders that did not change */
+	vector<int4> svm_nodes;
+	int4 svm_jump[2];
+	uint svm_compile_flags;
+
 #ifdef WITH_OSL
 	/* osl shading state references */
 	OSL::ShadingAttribStateRef osl_surface_ref;
@@ -173,6 +181,7 @@ protected:
 
 	typedef unordered_map<ustring, uint, ustringHash> AttributeIDMap;
 	AttributeIDMap unique_attribute_id;
+	thread_mutex attribute_id_mutex;
 
 	thread_mutex lookup_table_mutex;
 	static vector<float> beckmann_table;
@@ -27,6 +27,8 @@
 #include "util_logging.h"
 #include "util_foreach.h"
 #include "util_progress.h"
+#include "util_task.h"
+#include "util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -57,30 +59,75 @@ void SVMShaderManager::device_update(Device *device, DeviceScene *dscene, Scene
 	/* determine which shaders are in use */
 	device_update_shaders_used(scene);
 
-	/* svm_nodes */
-	vector<int4> svm_nodes;
+	/* compile shaders in parallel, each into its own program. the program of
+	 * the previous update is reused if the shader did not change, the shader
+	 * update tag is only cleared after a successful update */
+	scoped_timer timer;
+	TaskPool pool;
+	int num_compiled = 0;
 	size_t i;
 
-	for(i = 0; i < scene->shaders.size(); i++) {
-		svm_nodes.push_back(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
-		svm_nodes.push_back(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
-	}
-	
 	for(i = 0; i < scene->shaders.size(); i++) {
 		Shader *shader = scene->shaders[i];
-
-		if(progress.get_cancel()) return;
+		bool background = ((int)i == scene->default_background);
+		uint flags = (shader->used? SVM_COMPILE_USED: 0) |
+		             (background? SVM_COMPILE_BACKGROUND: 0) |
+		             (scene->params.use_shader_optimization? SVM_COMPILE_OPTIMIZE: 0);
 
 		assert(shader->graph);
 
 		if(shader->use_mis && shader->has_surface_emission)
 			scene->light_manager->need_update = true;
 
-		SVMCompiler compiler(scene->shader_manager, scene->image_manager);
-		compiler.background = ((int)i == scene->default_background);
-		compiler.compile(shader, svm_nodes, i);
+		if(!shader->need_update && shader->svm_nodes.size() && shader->svm_compile_flags == flags)
+			continue;
+
+		shader->svm_compile_flags = flags;
+		num_compiled++;
+
+		pool.push(function_bind(&SVMShaderManager::device_update_shader,
+		                        this,
+		                        scene,
+		                        shader,
+		                        &progress,
+		                        background));
 	}
 
+	pool.wait_work();
+
+	if(progress.get_cancel()) return;
+
+	/* svm_nodes, programs are appended in shader order so the result does
+	 * not depend on which thread finished first */
+	vector<int4> svm_nodes;
+	size_t num_nodes = scene->shaders.size()*2;
+
+	for(i = 0; i < scene->shaders.size(); i++)
+		num_nodes += scene->shaders[i]->svm_nodes.size();
+
+	svm_nodes.reserve(num_nodes);
+	svm_nodes.resize(scene->shaders.size()*2);
+
+	for(i = 0; i < scene->shaders.size(); i++) {
+		Shader *shader = scene->shaders[i];
+		int offset = svm_nodes.size();
+
+		for(int bump = 0; bump < 2; bump++) {
+			const int4& jump = shader->svm_jump[bump];
+			svm_nodes[i*2 + bump] = make_int4(NODE_SHADER_JUMP,
+			                                  offset + jump.y,
+			                                  offset + jump.z,
+			                                  offset + jump.w);
+		}
+
+		svm_nodes.insert(svm_nodes.end(), shader->svm_nodes.begin(), shader->svm_nodes.end());
+	}
+
+	VLOG(1) << "Compiled " << num_compiled << " of " << scene->shaders.size()
+	        << " shaders in " << timer.get_time() << " seconds.";
+	VLOG(1) << "SVM program length " << svm_nodes.size() << " nodes"
+	        << (scene->params.use_shader_optimization? ", optimized.": ".");
+
 	dscene->svm_nodes.copy((uint4*)&svm_nodes[0], svm_nodes.size());
 	device->tex_alloc("__svm_nodes", dscene->svm_nodes);
 
@@ -94,6 +141,20 @@ void SVMShaderManager::device_update(Device *device, DeviceScene *dscene, Scene
 	need_update = false;
 }
 
+void SVMShaderManager::device_update_shader(Scene *scene, Shader *shader, Progress *progress, bool background)
+{
+	if(progress->get_cancel()) {
+		/* compile again on the next update */
+		shader->svm_nodes.clear();
+		return;
+	}
+
+	SVMCompiler compiler(scene->shader_manager, scene->image_manager);
+	compiler.background = background;
+	compiler.optimize = scene->params.use_shader_optimization;
+	compiler.compile(shader, shader->svm_nodes, shader->svm_jump);
+}
+
 void SVMShaderManager::device_free(Device *device, DeviceScene *dscene, Scene *scene)
 {
 	device_free_common(device, dscene, scene);
@@ -113,6 +174,7 @@ SVMCompiler::SVMCompiler(ShaderManager *shader_manager_, ImageManager *image_man
 	current_shader = NULL;
 	current_graph = NULL;
 	background = false;
+	optimize = true;
 	mix_weight_offset = SVM_STACK_INVALID;
 	compile_failed = false;
 }
@@ -691,7 +753,7 @@ void SVMCompiler::compile_type(Shader *shader, ShaderGraph *graph, ShaderType ty
 	add_node(NODE_END, 0, 0, 0);
 }
 
-void SVMCompiler::compile(Shader *shader, vector<int4>& global_svm_nodes, int index)
+void SVMCompiler::compile(Shader *shader, vector<int4>& shader_svm_nodes, int4 jump[2])
 {
 	/* copy graph for shader with bump mapping */
 	ShaderNode *node = shader->graph->output();
@@ -701,9 +763,9 @@ void SVMCompiler::compile(Shader *shader, vector<int4>& global_svm_nodes, int in
 			shader->graph_bump = shader->graph->copy();
 
 	/* finalize */
-	shader->graph->finalize(false, false);
+	shader->graph->finalize(false, false, optimize);
 	if(shader->graph_bump)
-		shader->graph_bump->finalize(true, false);
+		shader->graph_bump->finalize(true, false, optimize);
 
 	current_shader = shader;
 
@@ -717,29 +779,33 @@ void SVMCompiler::compile(Shader *shader, vector<int4>& global_svm_nodes, int in
 	shader->has_heterogeneous_volume = false;
 	shader->has_object_dependency = false;
 
+	/* program offsets are relative to the start of this shader, the shader
+	 * manager offsets them when merging all programs */
+	shader_svm_nodes.clear();
+
 	/* generate surface shader */
 	compile_type(shader, shader->graph, SHADER_TYPE_SURFACE);
-	global_svm_nodes[index*2 + 0].y = global_svm_nodes.size();
-	global_svm_nodes[index*2 + 1].y = global_svm_nodes.size();
-	global_svm_nodes.insert(global_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
+	jump[0].y = shader_svm_nodes.size();
+	jump[1].y = shader_svm_nodes.size();
+	shader_svm_nodes.insert(shader_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
 
 	if(shader->graph_bump) {
 		compile_type(shader, shader->graph_bump, SHADER_TYPE_SURFACE);
-		global_svm_nodes[index*2 + 1].y = global_svm_nodes.size();
-		global_svm_nodes.insert(global_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
+		jump[1].y = shader_svm_nodes.size();
+		shader_svm_nodes.insert(shader_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
 	}
 
 	/* generate volume shader */
 	compile_type(shader, shader->graph, SHADER_TYPE_VOLUME);
-	global_svm_nodes[index*2 + 0].z = global_svm_nodes.size();
-	global_svm_nodes[index*2 + 1].z = global_svm_nodes.size();
-	global_svm_nodes.insert(global_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
+	jump[0].z = shader_svm_nodes.size();
+	jump[1].z = shader_svm_nodes.size();
+	shader_svm_nodes.insert(shader_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
 
 	/* generate displacement shader */
 	compile_type(shader, shader->graph, SHADER_TYPE_DISPLACEMENT);
-	global_svm_nodes[index*2 + 0].w = global_svm_nodes.size();
-	global_svm_nodes[index*2 + 1].w = global_svm_nodes.size();
-	global_svm_nodes.insert(global_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
+	jump[0].w = shader_svm_nodes.size();
+	jump[1].w = shader_svm_nodes.size();
+	shader_svm_nodes.insert(shader_svm_nodes.end(), svm_nodes.begin(), svm_nodes.end());
 }
 
 CCL_NAMESPACE_END
@@ -37,6 +37,13 @@ class ShaderOutput;
 
 /* Shader Manager */
 
+/* Settings a compiled SVM program depends on besides the shader itself. */
+enum SVMCompileFlag {
+	SVM_COMPILE_USED = (1 << 0),
+	SVM_COMPILE_BACKGROUND = (1 << 1),
+	SVM_COMPILE_OPTIMIZE = (1 << 2),
+};
+
 class SVMShaderManager : public ShaderManager {
 public:
 	SVMShaderManager();
@@ -46,6 +53,9 @@ public:
 
 	void device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress& progress);
 	void device_free(Device *device, DeviceScene *dscene, Scene *scene);
+
+protected:
+	void device_update_shader(Scene *scene, Shader *shader, Progress *progress, bool background);
 };
 
 /* Graph Compiler */
@@ -53,7 +63,7 @@ public:
 class SVMCompiler {
 public:
 	SVMCompiler(ShaderManager *shader_manager, ImageManager *image_manager);
-	void compile(Shader *shader, vector<int4>& svm_nodes, int index);
+	void compile(Shader *shader, vector<int4>& svm_nodes, int4 jump[2]);
 
 	void stack_assign(ShaderOutput *output);
 	void stack_assign(ShaderInput *input);
@@ -76,6 +86,7 @@ public:
 	ImageManager *image_manager;
 	ShaderManager *shader_manager;
 	bool background;
+	bool optimize; /* fold constants, merge and fuse nodes */
 
 protected:
 	/* stack */
@@ -32,6 +32,7 @@ TileManager::TileManager(bool progressive_, int num_samples_, int2 tile_size_, i
 	num_devices = num_devices_;
 	preserve_tile_device = preserve_tile_device_;
 	background = background_;
+	use_work_stealing = false;
 
 	BufferParams buffer_params;
 	reset(buffer_params, 0);
@@ -66,6 +67,8 @@ void TileManager::reset(BufferParams& params_, int num_samples_)
 	state.num_samples = 0;
 	state.resolution_divider = divider;
 	state.tiles.clear();
+	state.work.clear();
+	state.next_work_id = 0;
 }
 
 void TileManager::set_samples(int num_samples_)
@@ -243,11 +246,127 @@ bool TileManager::next_tile(Tile& tile, int device)
 	if(tile_it != state.tiles.end()) {
 		tile_it->rendering = true;
 		tile = *tile_it;
+		tile.start_sample = state.sample;
+		tile.num_samples = state.num_samples;
 		state.num_rendered_tiles++;
 
+		if(use_work_stealing) {
+			tile.work_id = state.next_work_id++;
+			state.work.push_back(TileWork(tile.work_id, tile, tile.start_sample,
+			                              tile.start_sample + tile.num_samples));
+		}
+
 		return true;
 	}
 
+	if(use_work_stealing)
+		return steal_tile(tile, device);
+
+	return false;
+}
+
+bool TileManager::steal_tile(Tile& tile, int device)
+{
+	list<TileWork>::iterator iter, best = state.work.end();
+	int logical_device = preserve_tile_device? device: 0;
+	int64_t best_pixel_samples = 0;
+
+	for(iter = state.work.begin(); iter != state.work.end(); iter++) {
+		if(iter->tile.device != logical_device)
+			continue;
+
+		/* samples not started yet, stealing needs to leave at least one */
+		int num_left = iter->end_sample - (iter->sample + 1);
+
+		if(num_left < 2)
+			continue;
+
+		int64_t pixel_samples = (int64_t)num_left*iter->tile.w*iter->tile.h;
+
+		if(pixel_samples > best_pixel_samples) {
+			best = iter;
+			best_pixel_samples = pixel_samples;
+		}
+	}
+
+	if(best == state.work.end())
+		return false;
+
+	int num_left = best->end_sample - (best->sample + 1);
+	int split_sample = best->end_sample - num_left/2;
+
+	tile = best->tile;
+	tile.start_sample = split_sample;
+	tile.num_samples = best->end_sample - split_sample;
+	tile.work_id = state.next_work_id++;
+	tile.stolen = true;
+
+	best->end_sample = split_sample;
+
+	state.work.push_back(TileWork(tile.work_id, tile, tile.start_sample,
+	                              tile.start_sample + tile.num_samples));
+
+	return true;
+}
+
+bool TileManager::next_tile_sample(int work_id, int sample)
+{
+	list<TileWork>::iterator iter;
+
+	for(iter = state.work.begin(); iter != state.work.end(); iter++) {
+		if(iter->id == work_id) {
+			if(sample >= iter->end_sample)
+				return false;
+
+			iter->sample = sample;
+			return true;
+		}
+	}
+
+	return true;
+}
+
+bool TileManager::release_tile(int work_id)
+{
+	list<TileWork>::iterator iter;
+	int tile_index = -1;
+
+	for(iter = state.work.begin(); iter != state.work.end(); iter++) {
+		if(iter->id == work_id) {
+			tile_index = iter->tile.index;
+			state.work.erase(iter);
+			break;
+		}
+	}
+
+	for(iter = state.work.begin(); iter != state.work.end(); iter++)
+		if(iter->tile.index == tile_index)
+			return false;
+
+	return true;
+}
+
+void TileManager::requeue_tile(int index)
+{
+	list<Tile>::iterator iter;
+
+	for(iter = state.tiles.begin(); iter != state.tiles.end(); iter++) {
+		if(iter->index == index && iter->rendering) {
+			iter->rendering = false;
+			state.num_rendered_tiles--;
+			break;
+		}
+	}
+}
+
+bool TileManager::have_requeued_tiles()
+{
+	list<Tile>::iterator iter;
+
+	for(iter = state.tiles.begin(); iter != state.tiles.end(); iter++)
+		if(!iter->rendering)
+			return true;
+
 	return false;
 }
 
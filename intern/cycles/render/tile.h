@@ -33,11 +33,35 @@ public:
 	int device;
 	bool rendering;
 
+	/* samples to render, set by next_tile() */
+	int start_sample, num_samples;
+
+	/* work item with work stealing, stolen tiles only render part of the
+	 * samples of a tile which is also rendered by another thread */
+	int work_id;
+	bool stolen;
+
 	Tile()
 	{}
 
 	Tile(int index_, int x_, int y_, int w_, int h_, int device_)
-	: index(index_), x(x_), y(y_), w(w_), h(h_), device(device_), rendering(false) {}
+	: index(index_), x(x_), y(y_), w(w_), h(h_), device(device_), rendering(false),
+	  start_sample(0), num_samples(0), work_id(-1), stolen(false) {}
+};
+
+/* Range of samples of a tile being rendered by one thread */
+
+class TileWork {
+public:
+	int id;
+	Tile tile;
+	/* sample being rendered, and end of the range which is lowered when
+	 * another thread steals samples */
+	int sample;
+	int end_sample;
+
+	TileWork(int id_, const Tile& tile_, int start_sample, int end_sample_)
+	: id(id_), tile(tile_), sample(start_sample - 1), end_sample(end_sample_) {}
 };
 
 /* Tile order */
@@ -65,10 +89,20 @@ public:
 		int num_tiles;
 		int num_rendered_tiles;
 		list<Tile> tiles;
+		list<TileWork> work;
+		int next_work_id;
 	} state;
 
 	int num_samples;
 
+	/* Work stealing
+	 *
+	 * Once every tile is rendering, a thread asking for a new tile takes half
+	 * of the samples left of the tile with the most work left instead, so all
+	 * threads stay busy until the end of the frame. Stolen samples must be
+	 * rendered into separate buffers and added to the tile buffers. */
+	bool use_work_stealing;
+
 	TileManager(bool progressive, int num_samples, int2 tile_size, int start_resolution,
 	            bool preserve_tile_device, bool background, TileOrder tile_order, int num_devices = 1);
 	~TileManager();
@@ -78,6 +112,16 @@ public:
 	bool next();
 	bool next_tile(Tile& tile, int device = 0);
 	bool done();
+
+	/* With work stealing, check if a sample of a work item should still be
+	 * rendered before rendering it, it may have been stolen. Release returns
+	 * true when all samples of the tile are done. */
+	bool next_tile_sample(int work_id, int sample);
+	bool release_tile(int work_id);
+
+	/* Make a tile available again, for tiles of a device that failed. */
+	void requeue_tile(int index);
+	bool have_requeued_tiles();
 	
 	void set_tile_order(TileOrder tile_order_) { tile_order = tile_order_; }
 protected:
@@ -120,6 +164,9 @@ protected:
 
 	/* returns first unhandled tile for viewport render */
 	list<Tile>::iterator next_viewport_tile(int device);
+
+	/* takes half of the samples left from the tile with the most work left */
+	bool steal_tile(Tile& tile, int device);
 };
 
 CCL_NAMESPACE_END
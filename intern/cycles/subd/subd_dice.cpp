@@ -24,36 +24,60 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Subd Params */
+
+float3 SubdParams::project(const float3& P) const
+{
+	if(!camera)
+		return P;
+
+	return transform_perspective(&camera->worldtoraster, transform_point(&objecttoworld, P));
+}
+
 /* EdgeDice Base */
 
-EdgeDice::EdgeDice(const SubdParams& params_)
+EdgeDice::EdgeDice(const SubdParams& params_, size_t vert_offset_, size_t tri_offset_)
 : params(params_)
 {
-	mesh_P = NULL;
-	mesh_N = NULL;
-	vert_offset = 0;
+	Mesh *mesh = params.mesh;
 
-	params.mesh->attributes.add(ATTR_STD_VERTEX_NORMAL);
+	vert_offset = vert_offset_;
+	tri_offset = tri_offset_;
 
-	if(params.ptex) {
-		params.mesh->attributes.add(ATTR_STD_PTEX_UV);
-		params.mesh->attributes.add(ATTR_STD_PTEX_FACE_ID);
-	}
+	/* attributes don't exist yet when only computing grid sizes */
+	Attribute *attr_vN = mesh->attributes.find(ATTR_STD_VERTEX_NORMAL);
+	Attribute *attr_ptex_uv = mesh->attributes.find(ATTR_STD_PTEX_UV);
+	Attribute *attr_ptex_face_id = mesh->attributes.find(ATTR_STD_PTEX_FACE_ID);
+
+	mesh_P = (mesh->verts.size())? &mesh->verts[0]: NULL;
+	mesh_N = (attr_vN && mesh->verts.size())? attr_vN->data_float3(): NULL;
+	mesh_ptex_uv = (attr_ptex_uv && mesh->verts.size())? attr_ptex_uv->data_float3(): NULL;
+	mesh_ptex_face_id = (attr_ptex_face_id && mesh->triangles.size())? attr_ptex_face_id->data_float(): NULL;
 }
 
-void EdgeDice::reserve(int num_verts, int num_tris)
+void EdgeDice::allocate(const SubdParams& params, size_t num_verts, size_t num_tris)
 {
+	/* allocate space at the end of the mesh, done before dicing patches in
+	 * parallel since it resizes the mesh arrays and attributes */
 	Mesh *mesh = params.mesh;
+	size_t vert_offset = mesh->verts.size();
+	size_t tri_offset = mesh->triangles.size();
 
-	vert_offset = mesh->verts.size();
-	tri_offset = mesh->triangles.size();
+	mesh->attributes.add(ATTR_STD_VERTEX_NORMAL);
 
-	mesh->reserve(vert_offset + num_verts, tri_offset + num_tris, 0, 0);
+	if(params.ptex) {
+		mesh->attributes.add(ATTR_STD_PTEX_UV);
+		mesh->attributes.add(ATTR_STD_PTEX_FACE_ID);
+	}
 
-	Attribute *attr_vN = mesh->attributes.add(ATTR_STD_VERTEX_NORMAL);
+	mesh->reserve(vert_offset + num_verts, tri_offset + num_tris, 0, 0);
 
-	mesh_P = &mesh->verts[0];
-	mesh_N = attr_vN->data_float3();
+	/* same for all triangles, and smooth flags are packed bits that threads
+	 * can't write to without races */
+	for(size_t i = tri_offset; i < tri_offset + num_tris; i++) {
+		mesh->shader[i] = params.shader;
+		mesh->smooth[i] = params.smooth;
+	}
 }
 
 int EdgeDice::add_vert(Patch *patch, float2 uv)
@@ -68,28 +92,23 @@ int EdgeDice::add_vert(Patch *patch, float2 uv)
 	mesh_P[vert_offset] = P;
 	mesh_N[vert_offset] = N;
 
-	if(params.ptex) {
-		Attribute *attr_ptex_uv = params.mesh->attributes.add(ATTR_STD_PTEX_UV);
-		params.mesh->attributes.reserve();
-
-		float3 *ptex_uv = attr_ptex_uv->data_float3();
-		ptex_uv[vert_offset] = make_float3(uv.x, uv.y, 0.0f);
-	}
+	if(params.ptex)
+		mesh_ptex_uv[vert_offset] = make_float3(uv.x, uv.y, 0.0f);
 
 	return vert_offset++;
 }
 
 void EdgeDice::add_triangle(Patch *patch, int v0, int v1, int v2)
 {
-	params.mesh->add_triangle(v0, v1, v2, params.shader, params.smooth);
+	assert(tri_offset < params.mesh->triangles.size());
 
-	if(params.ptex) {
-		Attribute *attr_ptex_face_id = params.mesh->attributes.add(ATTR_STD_PTEX_FACE_ID);
-		params.mesh->attributes.reserve();
+	Mesh::Triangle& tri = params.mesh->triangles[tri_offset];
+	tri.v[0] = v0;
+	tri.v[1] = v1;
+	tri.v[2] = v2;
 
-		float *ptex_face_id = attr_ptex_face_id->data_float();
-		ptex_face_id[tri_offset] = (float)patch->ptex_face_id();
-	}
+	if(params.ptex)
+		mesh_ptex_face_id[tri_offset] = (float)patch->ptex_face_id();
 
 	tri_offset++;
 }
@@ -133,17 +152,23 @@ void EdgeDice::stitch_triangles(Patch *patch, vector<int>& outer, vector<int>& i
 
 /* QuadDice */
 
-QuadDice::QuadDice(const SubdParams& params_)
-: EdgeDice(params_)
+QuadDice::QuadDice(const SubdParams& params_, size_t vert_offset_, size_t tri_offset_)
+: EdgeDice(params_, vert_offset_, tri_offset_)
 {
 }
 
-void QuadDice::reserve(EdgeFactors& ef, int Mu, int Mv)
+int QuadDice::num_verts(EdgeFactors& ef, int Mu, int Mv)
 {
 	/* XXX need to make this also work for edge factor 0 and 1 */
-	int num_verts = (ef.tu0 + ef.tu1 + ef.tv0 + ef.tv1) + (Mu - 1)*(Mv - 1);
-	int num_tris = 0;
-	EdgeDice::reserve(num_verts, num_tris);
+	return (ef.tu0 + ef.tu1 + ef.tv0 + ef.tv1) + (Mu - 1)*(Mv - 1);
+}
+
+int QuadDice::num_triangles(EdgeFactors& ef, int Mu, int Mv)
+{
+	/* inner grid, and each side stitched to the inner grid */
+	return 2*(Mu - 2)*(Mv - 2) +
+	       (ef.tu0 + ef.tu1 + 2*(Mu - 2)) +
+	       (ef.tv0 + ef.tv1 + 2*(Mv - 2));
 }
 
 float2 QuadDice::map_uv(SubPatch& sub, float u, float v)
@@ -160,10 +185,8 @@ float3 QuadDice::eval_projected(SubPatch& sub, float u, float v)
 	float3 P;
 
 	sub.patch->eval(&P, NULL, NULL, uv.x, uv.y);
-	if(params.camera)
-		P = transform_perspective(&params.camera->worldtoraster, P);
 
-	return P;
+	return params.project(P);
 }
 
 int QuadDice::add_vert(SubPatch& sub, float u, float v)
@@ -299,19 +322,23 @@ void QuadDice::add_grid(SubPatch& sub, int Mu, int Mv, int offset)
 	}
 }
 
-void QuadDice::dice(SubPatch& sub, EdgeFactors& ef)
+void QuadDice::grid_size(SubPatch& sub, EdgeFactors& ef, int *Mu, int *Mv)
 {
 	/* compute inner grid size with scale factor */
-	int Mu = max(ef.tu0, ef.tu1);
-	int Mv = max(ef.tv0, ef.tv1);
+	int mu = max(ef.tu0, ef.tu1);
+	int mv = max(ef.tv0, ef.tv1);
 
-	float S = scale_factor(sub, ef, Mu, Mv);
-	Mu = max((int)ceil(S*Mu), 2); // XXX handle 0 & 1?
-	Mv = max((int)ceil(S*Mv), 2); // XXX handle 0 & 1?
+	float S = scale_factor(sub, ef, mu, mv);
+
+	/* bound the grid for patches with a degenerate projection, that are
+	 * close to or behind the camera */
+	*Mu = clamp((int)ceil(min(S*mu, (float)DICE_MAX_GRID_SIZE)), 2, DICE_MAX_GRID_SIZE); // XXX handle 0 & 1?
+	*Mv = clamp((int)ceil(min(S*mv, (float)DICE_MAX_GRID_SIZE)), 2, DICE_MAX_GRID_SIZE); // XXX handle 0 & 1?
+}
 
-	/* reserve space for new verts */
-	int offset = params.mesh->verts.size();
-	reserve(ef, Mu, Mv);
+void QuadDice::dice(SubPatch& sub, EdgeFactors& ef, int Mu, int Mv)
+{
+	int offset = vert_offset;
 
 	/* corners and inner grid */
 	add_corners(sub);
@@ -335,18 +362,19 @@ void QuadDice::dice(SubPatch& sub, EdgeFactors& ef)
 	add_side_v(sub, outer, inner, Mu, Mv, ef.tv1, 1, offset);
 	stitch_triangles(sub.patch, outer, inner);
 
-	assert(vert_offset == params.mesh->verts.size());
+	assert(vert_offset == offset + num_verts(ef, Mu, Mv));
 }
 
 /* TriangleDice */
 
-TriangleDice::TriangleDice(const SubdParams& params_)
-: EdgeDice(params_)
+TriangleDice::TriangleDice(const SubdParams& params_, size_t vert_offset_, size_t tri_offset_)
+: EdgeDice(params_, vert_offset_, tri_offset_)
 {
 }
 
-void TriangleDice::reserve(EdgeFactors& ef, int M)
+int TriangleDice::num_verts(EdgeFactors& ef)
 {
+	int M = max(ef.tu, max(ef.tv, ef.tw));
 	int num_verts = ef.tu + ef.tv + ef.tw;
 
 	for(int m = M-2; m > 0; m -= 2)
@@ -354,8 +382,27 @@ void TriangleDice::reserve(EdgeFactors& ef, int M)
 	
 	if(!(M & 1))
 		num_verts++;
-	
-	EdgeDice::reserve(num_verts, 0);
+
+	return num_verts;
+}
+
+int TriangleDice::num_triangles(EdgeFactors& ef)
+{
+	/* same steps as add_grid, stitching each ring of the grid to the next
+	 * inner one, and filling up the last part */
+	int M = max(ef.tu, max(ef.tv, ef.tw));
+	int outer_u = ef.tu, outer_v = ef.tv, outer_w = ef.tw;
+	int num_tris = 0;
+	int m;
+
+	for(m = M-2; m > 0; m -= 2) {
+		num_tris += (outer_u + m) + (outer_v + m) + (outer_w + m);
+		outer_u = outer_v = outer_w = m;
+	}
+
+	num_tris += (m == -1)? 1: 6;
+
+	return num_tris;
 }
 
 float2 TriangleDice::map_uv(SubPatch& sub, float2 uv)
@@ -470,11 +517,11 @@ void TriangleDice::dice(SubPatch& sub, EdgeFactors& ef)
 {
 	/* todo: handle 2 1 1 resolution */
 	int M = max(ef.tu, max(ef.tv, ef.tw));
+	int offset = vert_offset;
 
-	reserve(ef, M);
 	add_grid(sub, ef, M);
 
-	assert(vert_offset == params.mesh->verts.size());
+	assert(vert_offset == offset + num_verts(ef));
 }
 
 CCL_NAMESPACE_END
@@ -22,6 +22,7 @@
  * DiagSplit. For more algorithm details, see the DiagSplit paper or the
  * ARB_tessellation_shader OpenGL extension, Section 2.X.2. */
 
+#include "util_transform.h"
 #include "util_types.h"
 #include "util_vector.h"
 
@@ -31,6 +32,9 @@ class Camera;
 class Mesh;
 class Patch;
 
+/* upper bound of the inner grid size of a quad subpatch */
+#define DICE_MAX_GRID_SIZE 1024
+
 struct SubdParams {
 	Mesh *mesh;
 	int shader;
@@ -40,7 +44,11 @@ struct SubdParams {
 	int test_steps;
 	int split_threshold;
 	float dicing_rate;
+
+	/* with a camera, the dicing rate is in pixels and edge factors adapt to
+	 * the projected size of patches, using the object to world transform */
 	Camera *camera;
+	Transform objecttoworld;
 
 	SubdParams(Mesh *mesh_, int shader_, bool smooth_ = true, bool ptex_ = false)
 	{
@@ -53,23 +61,31 @@ struct SubdParams {
 		split_threshold = 1;
 		dicing_rate = 0.1f;
 		camera = NULL;
+		objecttoworld = transform_identity();
 	}
 
+	float3 project(const float3& P) const;
+
 };
 
 /* EdgeDice Base */
 
+/* Verts and triangles are written into space allocated in the mesh in
+ * advance, so that patches can be diced in parallel. */
+
 class EdgeDice {
 public:
 	SubdParams params;
 	float3 *mesh_P;
 	float3 *mesh_N;
+	float3 *mesh_ptex_uv;
+	float *mesh_ptex_face_id;
 	size_t vert_offset;
 	size_t tri_offset;
 
-	EdgeDice(const SubdParams& params);
+	EdgeDice(const SubdParams& params, size_t vert_offset, size_t tri_offset);
 
-	void reserve(int num_verts, int num_tris);
+	static void allocate(const SubdParams& params, size_t num_verts, size_t num_tris);
 
 	int add_vert(Patch *patch, float2 uv);
 	void add_triangle(Patch *patch, int v0, int v1, int v2);
@@ -108,9 +124,11 @@ public:
 		int tv1;
 	};
 
-	QuadDice(const SubdParams& params);
+	QuadDice(const SubdParams& params, size_t vert_offset, size_t tri_offset);
+
+	static int num_verts(EdgeFactors& ef, int Mu, int Mv);
+	static int num_triangles(EdgeFactors& ef, int Mu, int Mv);
 
-	void reserve(EdgeFactors& ef, int Mu, int Mv);
 	float3 eval_projected(SubPatch& sub, float u, float v);
 
 	float2 map_uv(SubPatch& sub, float u, float v);
@@ -129,8 +147,9 @@ public:
 
 	float quad_area(const float3& a, const float3& b, const float3& c, const float3& d);
 	float scale_factor(SubPatch& sub, EdgeFactors& ef, int Mu, int Mv);
+	void grid_size(SubPatch& sub, EdgeFactors& ef, int *Mu, int *Mv);
 
-	void dice(SubPatch& sub, EdgeFactors& ef);
+	void dice(SubPatch& sub, EdgeFactors& ef, int Mu, int Mv);
 };
 
 /* Triangle EdgeDice
@@ -162,9 +181,10 @@ public:
 		int tw;
 	};
 
-	TriangleDice(const SubdParams& params);
+	TriangleDice(const SubdParams& params, size_t vert_offset, size_t tri_offset);
 
-	void reserve(EdgeFactors& ef, int M);
+	static int num_verts(EdgeFactors& ef);
+	static int num_triangles(EdgeFactors& ef);
 
 	float2 map_uv(SubPatch& sub, float2 uv);
 	int add_vert(SubPatch& sub, float2 uv);
@@ -264,9 +264,13 @@ void OpenSubdMesh::tessellate(DiagSplit *split)
 	/* split & dice patches */
 	OpenSubdPatch patch(farmesh, vbuf_base);
 
+	/* the patch evaluation buffers are shared by all faces, so faces are
+	 * split and diced one at a time */
 	for(int f = 0; f < num_ptex_faces; f++) {
 		patch.face_id = f;
 		split->split_quad(&patch);
+		split->dice();
+		split->clear();
 	}
 
 	/* clean up */
@@ -376,39 +380,45 @@ bool SubdMesh::finish()
 void SubdMesh::tessellate(DiagSplit *split)
 {
 	int num_faces = faces.size();
-		        
-	for(int f = 0; f < num_faces; f++) {
-		SubdFace *face = faces[f];
-		Patch *patch;
-		float3 *hull;
-
-		if(face->numverts == 3) {
-			LinearTrianglePatch *lpatch = new LinearTrianglePatch();
-			hull = lpatch->hull;
-			patch = lpatch;
-		}
-		else if(face->numverts == 4) {
-			LinearQuadPatch *lpatch = new LinearQuadPatch();
-			hull = lpatch->hull;
-			patch = lpatch;
-		}
-		else {
-			assert(0); /* n-gons should have been split already */
-			continue;
-		}
 
-		for(int i = 0; i < face->numverts; i++)
-			hull[i] = verts[face->verts[i]]->co;
-
-		if(face->numverts == 4)
-			swap(hull[2], hull[3]);
+	/* patches are created in batches, that are split and diced in parallel */
+	for(int batch_start = 0; batch_start < num_faces; batch_start += DSPLIT_BATCH_SIZE) {
+		int batch_end = min(batch_start + DSPLIT_BATCH_SIZE, num_faces);
+		vector<Patch*> patches;
+
+		for(int f = batch_start; f < batch_end; f++) {
+			SubdFace *face = faces[f];
+			Patch *patch;
+			float3 *hull;
+
+			if(face->numverts == 3) {
+				LinearTrianglePatch *lpatch = new LinearTrianglePatch();
+				hull = lpatch->hull;
+				patch = lpatch;
+			}
+			else if(face->numverts == 4) {
+				LinearQuadPatch *lpatch = new LinearQuadPatch();
+				hull = lpatch->hull;
+				patch = lpatch;
+			}
+			else {
+				assert(0); /* n-gons should have been split already */
+				continue;
+			}
+
+			for(int i = 0; i < face->numverts; i++)
+				hull[i] = verts[face->verts[i]]->co;
+
+			if(face->numverts == 4)
+				swap(hull[2], hull[3]);
+
+			patches.push_back(patch);
+		}
 
-		if(patch->is_triangle())
-			split->split_triangle(patch);
-		else
-			split->split_quad(patch);
+		DiagSplit::tessellate(split->params, patches);
 
-		delete patch;
+		foreach(Patch *patch, patches)
+			delete patch;
 	}
 }
 
@@ -22,7 +22,9 @@
 #include "subd_split.h"
 
 #include "util_debug.h"
+#include "util_foreach.h"
 #include "util_math.h"
+#include "util_task.h"
 #include "util_types.h"
 
 CCL_NAMESPACE_BEGIN
@@ -32,6 +34,8 @@ CCL_NAMESPACE_BEGIN
 DiagSplit::DiagSplit(const SubdParams& params_)
 : params(params_)
 {
+	num_verts = 0;
+	num_triangles = 0;
 }
 
 void DiagSplit::dispatch(QuadDice::SubPatch& sub, QuadDice::EdgeFactors& ef)
@@ -51,10 +55,8 @@ float3 DiagSplit::project(Patch *patch, float2 uv)
 	float3 P;
 
 	patch->eval(&P, NULL, NULL, uv.x, uv.y);
-	if(params.camera)
-		P = transform_perspective(&params.camera->worldtoraster, P);
 
-	return P;
+	return params.project(P);
 }
 
 int DiagSplit::T(Patch *patch, float2 Pstart, float2 Pend)
@@ -77,13 +79,13 @@ int DiagSplit::T(Patch *patch, float2 Pstart, float2 Pend)
 		Plast = P;
 	}
 
-	int tmin = (int)ceil(Lsum/params.dicing_rate);
-	int tmax = (int)ceil((params.test_steps-1)*Lmax/params.dicing_rate); // XXX paper says N instead of N-1, seems wrong?
+	float tmin = ceilf(Lsum/params.dicing_rate);
+	float tmax = ceilf((params.test_steps-1)*Lmax/params.dicing_rate); // XXX paper says N instead of N-1, seems wrong?
 
 	if(tmax - tmin > params.split_threshold)
 		return DSPLIT_NON_UNIFORM;
 	
-	return tmax;
+	return (int)min(tmax, (float)DSPLIT_MAX_T);
 }
 
 void DiagSplit::partition_edge(Patch *patch, float2 *P, int *t0, int *t1, float2 Pstart, float2 Pend, int t)
@@ -107,7 +109,7 @@ void DiagSplit::split(TriangleDice::SubPatch& sub, TriangleDice::EdgeFactors& ef
 	assert(ef.tv == T(sub.patch, sub.Pw, sub.Pu));
 	assert(ef.tw == T(sub.patch, sub.Pu, sub.Pv));
 
-	if(depth == 0) {
+	if(depth == 0 || depth >= DSPLIT_MAX_DEPTH) {
 		dispatch(sub, ef);
 		return;
 	}
@@ -187,6 +189,11 @@ void DiagSplit::split(TriangleDice::SubPatch& sub, TriangleDice::EdgeFactors& ef
 
 void DiagSplit::split(QuadDice::SubPatch& sub, QuadDice::EdgeFactors& ef, int depth)
 {
+	if(depth >= DSPLIT_MAX_DEPTH) {
+		dispatch(sub, ef);
+		return;
+	}
+
 	if((ef.tu0 == DSPLIT_NON_UNIFORM || ef.tu1 == DSPLIT_NON_UNIFORM)) {
 		/* partition edges */
 		QuadDice::EdgeFactors ef0, ef1;
@@ -255,12 +262,11 @@ void DiagSplit::split_triangle(Patch *patch)
 	ef_split.tv = T(patch, sub_split.Pw, sub_split.Pu);
 	ef_split.tw = T(patch, sub_split.Pu, sub_split.Pv);
 
-	split(sub_split, ef_split);
+	size_t start = subpatches_triangle.size();
 
-	TriangleDice dice(params);
+	split(sub_split, ef_split);
 
-	for(size_t i = 0; i < subpatches_triangle.size(); i++) {
-		TriangleDice::SubPatch& sub = subpatches_triangle[i];
+	for(size_t i = start; i < subpatches_triangle.size(); i++) {
 		TriangleDice::EdgeFactors& ef = edgefactors_triangle[i];
 
 		ef.tu = 4;
@@ -271,11 +277,9 @@ void DiagSplit::split_triangle(Patch *patch)
 		ef.tv = max(ef.tv, 1);
 		ef.tw = max(ef.tw, 1);
 
-		dice.dice(sub, ef);
+		num_verts += TriangleDice::num_verts(ef);
+		num_triangles += TriangleDice::num_triangles(ef);
 	}
-
-	subpatches_triangle.clear();
-	edgefactors_triangle.clear();
 }
 
 void DiagSplit::split_quad(Patch *patch)
@@ -294,24 +298,144 @@ void DiagSplit::split_quad(Patch *patch)
 	ef_split.tv0 = T(patch, sub_split.P00, sub_split.P01);
 	ef_split.tv1 = T(patch, sub_split.P10, sub_split.P11);
 
+	size_t start = subpatches_quad.size();
+
 	split(sub_split, ef_split);
 
-	QuadDice dice(params);
+	/* the inner grid size is computed here already to know the number of
+	 * verts and triangles, the dicer does not write to the mesh for this */
+	QuadDice dice(params, 0, 0);
 
-	for(size_t i = 0; i < subpatches_quad.size(); i++) {
+	for(size_t i = start; i < subpatches_quad.size(); i++) {
 		QuadDice::SubPatch& sub = subpatches_quad[i];
 		QuadDice::EdgeFactors& ef = edgefactors_quad[i];
+		int Mu, Mv;
 
 		ef.tu0 = max(ef.tu0, 1);
 		ef.tu1 = max(ef.tu1, 1);
 		ef.tv0 = max(ef.tv0, 1);
 		ef.tv1 = max(ef.tv1, 1);
 
-		dice.dice(sub, ef);
+		dice.grid_size(sub, ef, &Mu, &Mv);
+		gridsize_quad.push_back(make_int2(Mu, Mv));
+
+		num_verts += QuadDice::num_verts(ef, Mu, Mv);
+		num_triangles += QuadDice::num_triangles(ef, Mu, Mv);
 	}
+}
 
+void DiagSplit::dice(size_t vert_offset, size_t tri_offset)
+{
+	if(subpatches_quad.size()) {
+		QuadDice dice(params, vert_offset, tri_offset);
+
+		for(size_t i = 0; i < subpatches_quad.size(); i++) {
+			int2 gridsize = gridsize_quad[i];
+			dice.dice(subpatches_quad[i], edgefactors_quad[i], gridsize.x, gridsize.y);
+		}
+
+		vert_offset = dice.vert_offset;
+		tri_offset = dice.tri_offset;
+	}
+
+	if(subpatches_triangle.size()) {
+		TriangleDice dice(params, vert_offset, tri_offset);
+
+		for(size_t i = 0; i < subpatches_triangle.size(); i++)
+			dice.dice(subpatches_triangle[i], edgefactors_triangle[i]);
+	}
+}
+
+void DiagSplit::dice()
+{
+	Mesh *mesh = params.mesh;
+	size_t vert_offset = mesh->verts.size();
+	size_t tri_offset = mesh->triangles.size();
+
+	EdgeDice::allocate(params, num_verts, num_triangles);
+	dice(vert_offset, tri_offset);
+}
+
+void DiagSplit::clear()
+{
 	subpatches_quad.clear();
 	edgefactors_quad.clear();
+	gridsize_quad.clear();
+	subpatches_triangle.clear();
+	edgefactors_triangle.clear();
+
+	num_verts = 0;
+	num_triangles = 0;
+}
+
+/* Parallel Tessellation */
+
+#define DSPLIT_CHUNK_SIZE 64
+
+static void diagsplit_split_task(DiagSplit *split, const vector<Patch*> *patches, size_t start, size_t end)
+{
+	for(size_t i = start; i < end; i++) {
+		Patch *patch = (*patches)[i];
+
+		if(patch->is_triangle())
+			split->split_triangle(patch);
+		else
+			split->split_quad(patch);
+	}
+}
+
+static void diagsplit_dice_task(DiagSplit *split, size_t vert_offset, size_t tri_offset)
+{
+	split->dice(vert_offset, tri_offset);
+}
+
+void DiagSplit::tessellate(const SubdParams& params, const vector<Patch*>& patches)
+{
+	/* patches are split in fixed size chunks on the task pool. then space for
+	 * all verts and triangles is allocated at once, and each chunk dices its
+	 * subpatches directly into the mesh, at offsets that only depend on the
+	 * chunk order, so the result is the same for any number of threads */
+	size_t num_patches = patches.size();
+	size_t num_chunks = (num_patches + DSPLIT_CHUNK_SIZE - 1)/DSPLIT_CHUNK_SIZE;
+
+	if(num_chunks == 0)
+		return;
+
+	vector<DiagSplit> splits(num_chunks, DiagSplit(params));
+	TaskPool pool;
+
+	for(size_t i = 0; i < num_chunks; i++) {
+		size_t start = i*DSPLIT_CHUNK_SIZE;
+		size_t end = (i == num_chunks - 1)? num_patches: start + DSPLIT_CHUNK_SIZE;
+
+		pool.push(function_bind(&diagsplit_split_task, &splits[i], &patches, start, end));
+	}
+
+	pool.wait_work();
+
+	/* allocate space in the mesh */
+	Mesh *mesh = params.mesh;
+	size_t vert_offset = mesh->verts.size();
+	size_t tri_offset = mesh->triangles.size();
+	size_t num_verts = 0;
+	size_t num_triangles = 0;
+
+	foreach(DiagSplit& split, splits) {
+		num_verts += split.num_verts;
+		num_triangles += split.num_triangles;
+	}
+
+	EdgeDice::allocate(params, num_verts, num_triangles);
+
+	/* dice */
+	foreach(DiagSplit& split, splits) {
+		pool.push(function_bind(&diagsplit_dice_task, &split, vert_offset, tri_offset));
+
+		vert_offset += split.num_verts;
+		tri_offset += split.num_triangles;
+	}
+
+	pool.wait_work();
 }
 
 CCL_NAMESPACE_END
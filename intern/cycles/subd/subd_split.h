@@ -34,13 +34,27 @@ class Patch;
 
 #define DSPLIT_NON_UNIFORM -1
 
+/* bounds for patches with a degenerate projection, close to or behind the
+ * camera, that would otherwise be split and diced without limit */
+#define DSPLIT_MAX_DEPTH 16
+#define DSPLIT_MAX_T 1024
+
+/* number of patches split and diced together, bounds the memory used by
+ * subpatches waiting to be diced */
+#define DSPLIT_BATCH_SIZE 4096
+
 class DiagSplit {
 public:
 	vector<QuadDice::SubPatch> subpatches_quad;
 	vector<QuadDice::EdgeFactors> edgefactors_quad;
+	vector<int2> gridsize_quad;
 	vector<TriangleDice::SubPatch> subpatches_triangle;
 	vector<TriangleDice::EdgeFactors> edgefactors_triangle;
 
+	/* verts and triangles the subpatches are diced into */
+	size_t num_verts;
+	size_t num_triangles;
+
 	SubdParams params;
 
 	DiagSplit(const SubdParams& params);
@@ -58,6 +72,15 @@ public:
 
 	void split_triangle(Patch *patch);
 	void split_quad(Patch *patch);
+
+	/* dice subpatches into space allocated in the mesh already */
+	void dice(size_t vert_offset, size_t tri_offset);
+	/* allocate space at the end of the mesh and dice subpatches into it */
+	void dice();
+	void clear();
+
+	/* split and dice patches in parallel, patches are not modified */
+	static void tessellate(const SubdParams& params, const vector<Patch*>& patches);
 };
 
 CCL_NAMESPACE_END
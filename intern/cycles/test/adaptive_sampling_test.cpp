@@ -0,0 +1,131 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "kernel.h"
+#include "kernel_compat_cpu.h"
+#include "kernel_types.h"
+#include "kernel_globals.h"
+
+#include "film.h"
+
+#include "util_foreach.h"
+#include "util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Pass offsets the same way Film::device_update() lays them out. */
+void film_setup(KernelFilm *kfilm, const vector<Pass>& passes, vector<int>& offsets)
+{
+	kfilm->pass_flag = 0;
+	kfilm->pass_stride = 0;
+
+	foreach(const Pass& pass, passes) {
+		kfilm->pass_flag |= pass.type;
+		offsets.push_back(kfilm->pass_stride);
+
+		switch(pass.type) {
+			case PASS_COMBINED:
+				kfilm->pass_combined = kfilm->pass_stride;
+				break;
+			case PASS_DEPTH:
+				kfilm->pass_depth = kfilm->pass_stride;
+				break;
+			case PASS_OBJECT_ID:
+				kfilm->pass_object_id = kfilm->pass_stride;
+				break;
+			case PASS_MATERIAL_ID:
+				kfilm->pass_material_id = kfilm->pass_stride;
+				break;
+			case PASS_ADAPTIVE_AUX_BUFFER:
+				kfilm->pass_adaptive_aux_buffer = kfilm->pass_stride;
+				break;
+			case PASS_SAMPLE_COUNT:
+				kfilm->pass_sample_count = kfilm->pass_stride;
+				break;
+			default:
+				break;
+		}
+
+		kfilm->pass_stride += pass.components;
+	}
+
+	kfilm->pass_stride = align_up(kfilm->pass_stride, 4);
+}
+
+}  /* namespace */
+
+TEST(adaptive_sampling, post_adjust_filtered_passes)
+{
+	vector<Pass> passes;
+	Pass::add(PASS_COMBINED, passes);
+	Pass::add(PASS_NORMAL, passes);
+	Pass::add(PASS_DEPTH, passes);
+	Pass::add(PASS_MIST, passes);
+	Pass::add(PASS_OBJECT_ID, passes);
+	Pass::add(PASS_MATERIAL_ID, passes);
+	Pass::add(PASS_ADAPTIVE_AUX_BUFFER, passes);
+	Pass::add(PASS_SAMPLE_COUNT, passes);
+
+	/* large because of the image slots, keep it off the stack */
+	KernelGlobals *kg = new KernelGlobals();
+	memset(&kg->__data, 0, sizeof(kg->__data));
+
+	vector<int> offsets;
+	film_setup(&kg->__data.film, passes, offsets);
+
+	const int pass_stride = kg->__data.film.pass_stride;
+	const int num_samples = 16;
+
+	/* first pixel stopped after 4 samples, second one got all samples */
+	vector<float> buffer(2*pass_stride);
+	for(int i = 0; i < 2*pass_stride; i++)
+		buffer[i] = 1.0f + (float)(i % pass_stride);
+
+	buffer[kg->__data.film.pass_sample_count] = 4.0f;
+	buffer[pass_stride + kg->__data.film.pass_sample_count] = (float)num_samples;
+
+	vector<float> expected = buffer;
+
+	uint64_t skipped = kernel_cpu_adaptive_sampling_post_adjust(kg, &buffer[0], num_samples,
+	                                                            0, 0, 2, 1, 0, 2);
+	EXPECT_EQ((uint64_t)(num_samples - 4), skipped);
+
+	for(size_t p = 0; p < passes.size(); p++) {
+		const Pass& pass = passes[p];
+
+		for(int c = 0; c < pass.components; c++) {
+			int i = offsets[p] + c;
+
+			if(pass.type == PASS_SAMPLE_COUNT)
+				EXPECT_EQ((float)num_samples, buffer[i]);
+			else if(pass.filter)
+				EXPECT_FLOAT_EQ(expected[i]*(num_samples/4.0f), buffer[i]) << "pass type " << pass.type;
+			else
+				EXPECT_EQ(expected[i], buffer[i]) << "pass type " << pass.type;
+
+			/* pixel with all samples is left alone */
+			EXPECT_EQ(expected[pass_stride + i], buffer[pass_stride + i]);
+		}
+	}
+
+	delete kg;
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2011-2016 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include <boost/filesystem.hpp>
+
+#include "bvh.h"
+#include "bvh_params.h"
+#include "mesh.h"
+#include "object.h"
+
+#include "util_path.h"
+#include "util_progress.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Grid of triangles, without motion blur so the packed BVH has no time
+ * nodes and no instances. */
+void mesh_create_grid(Mesh *mesh, int res)
+{
+	for(int y = 0; y <= res; y++)
+		for(int x = 0; x <= res; x++)
+			mesh->verts.push_back(make_float3((float)x, (float)y, 0.1f*((x*7 + y*3) % 5)));
+
+	for(int y = 0; y < res; y++) {
+		for(int x = 0; x < res; x++) {
+			int v = y*(res + 1) + x;
+			mesh->add_triangle(v, v + 1, v + res + 2, 0, false);
+			mesh->add_triangle(v, v + res + 2, v + res + 1, 0, false);
+		}
+	}
+
+	mesh->compute_bounds();
+}
+
+template<typename T> void expect_array_eq(const array<T>& a, const array<T>& b)
+{
+	ASSERT_EQ(a.size(), b.size());
+	if(a.size())
+		EXPECT_EQ(0, memcmp(&a[0], &b[0], a.size()*sizeof(T)));
+}
+
+void expect_pack_eq(const PackedBVH& a, const PackedBVH& b)
+{
+	EXPECT_EQ(a.root_index, b.root_index);
+	EXPECT_EQ(a.SAH, b.SAH);
+	expect_array_eq(a.nodes, b.nodes);
+	expect_array_eq(a.leaf_nodes, b.leaf_nodes);
+	expect_array_eq(a.time_nodes, b.time_nodes);
+	expect_array_eq(a.object_node, b.object_node);
+	expect_array_eq(a.tri_woop, b.tri_woop);
+	expect_array_eq(a.prim_type, b.prim_type);
+	expect_array_eq(a.prim_visibility, b.prim_visibility);
+	expect_array_eq(a.prim_index, b.prim_index);
+	expect_array_eq(a.prim_object, b.prim_object);
+}
+
+void test_bvh_cache(bool use_qbvh)
+{
+	boost::filesystem::path user_path = boost::filesystem::temp_directory_path() /
+		boost::filesystem::unique_path("cycles_bvh_cache_%%%%%%%%");
+	path_init("", user_path.string());
+
+	Mesh mesh;
+	mesh_create_grid(&mesh, 16);
+
+	/* same setup as the object BVH of a mesh */
+	Object object;
+	object.mesh = &mesh;
+
+	vector<Object*> objects;
+	objects.push_back(&object);
+
+	BVHParams params;
+	params.use_cache = true;
+	params.use_qbvh = use_qbvh;
+
+	/* build and write to the cache */
+	Progress progress;
+	BVH *bvh = BVH::create(params, objects);
+	bvh->build(progress);
+
+	ASSERT_NE((size_t)0, bvh->pack.nodes.size());
+	EXPECT_EQ((size_t)0, bvh->pack.time_nodes.size());
+	EXPECT_EQ((size_t)0, bvh->pack.object_node.size());
+	EXPECT_NE("", bvh->cache_filename);
+
+	/* read back, a cancelled build only returns nodes found in the cache */
+	Progress cancelled_progress;
+	cancelled_progress.set_cancel("Test");
+
+	BVH *cached_bvh = BVH::create(params, objects);
+	cached_bvh->build(cancelled_progress);
+
+	EXPECT_EQ(bvh->cache_filename, cached_bvh->cache_filename);
+	expect_pack_eq(bvh->pack, cached_bvh->pack);
+
+	delete cached_bvh;
+	delete bvh;
+
+	boost::filesystem::remove_all(user_path);
+}
+
+}  /* namespace */
+
+TEST(bvh_cache, static_mesh_regular)
+{
+	test_bvh_cache(false);
+}
+
+TEST(bvh_cache, static_mesh_qbvh)
+{
+	test_bvh_cache(true);
+}
+
+CCL_NAMESPACE_END
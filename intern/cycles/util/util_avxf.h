@@ -0,0 +1,103 @@
+/*
+ * Copyright 2011-2015 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTIL_AVXF_H__
+#define __UTIL_AVXF_H__
+
+CCL_NAMESPACE_BEGIN
+
+#ifdef __KERNEL_AVX__
+
+/*! 8-wide AVX float type.
+ *
+ * Only the subset of operations needed for OBVH traversal is implemented,
+ * extend as needed following util_ssef.h. */
+struct avxf
+{
+	enum   { size = 8 };  // number of SIMD elements
+	union { __m256 m256; float f[8]; int i[8]; }; // data
+
+	////////////////////////////////////////////////////////////////////////////////
+	/// Constructors, Assignment & Cast Operators
+	////////////////////////////////////////////////////////////////////////////////
+
+	__forceinline avxf          () {}
+	__forceinline avxf          (const avxf& other) { m256 = other.m256; }
+	__forceinline avxf& operator=(const avxf& other) { m256 = other.m256; return *this; }
+
+	__forceinline avxf(const __m256 a) : m256(a) {}
+	__forceinline operator const __m256&(void) const { return m256; }
+	__forceinline operator       __m256&(void)       { return m256; }
+
+	__forceinline avxf          (float a) : m256(_mm256_set1_ps(a)) {}
+
+	////////////////////////////////////////////////////////////////////////////////
+	/// Loads and Stores
+	////////////////////////////////////////////////////////////////////////////////
+
+	static __forceinline avxf load(const void* const a) { return _mm256_load_ps((float*)a); }
+	static __forceinline avxf loadu(const void* const a) { return _mm256_loadu_ps((float*)a); }
+
+	////////////////////////////////////////////////////////////////////////////////
+	/// Array Access
+	////////////////////////////////////////////////////////////////////////////////
+
+	__forceinline const float& operator [](const size_t i) const { assert(i < 8); return f[i]; }
+	__forceinline       float& operator [](const size_t i)       { assert(i < 8); return f[i]; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// Binary Operators
+////////////////////////////////////////////////////////////////////////////////
+
+__forceinline const avxf operator +(const avxf& a, const avxf& b) { return _mm256_add_ps(a.m256, b.m256); }
+__forceinline const avxf operator -(const avxf& a, const avxf& b) { return _mm256_sub_ps(a.m256, b.m256); }
+__forceinline const avxf operator *(const avxf& a, const avxf& b) { return _mm256_mul_ps(a.m256, b.m256); }
+__forceinline const avxf operator *(const float a, const avxf& b) { return avxf(a) * b; }
+__forceinline const avxf operator *(const avxf& a, const float b) { return a * avxf(b); }
+
+__forceinline const avxf min(const avxf& a, const avxf& b) { return _mm256_min_ps(a.m256, b.m256); }
+__forceinline const avxf max(const avxf& a, const avxf& b) { return _mm256_max_ps(a.m256, b.m256); }
+
+__forceinline const avxf min4(const avxf& a, const avxf& b, const avxf& c, const avxf& d) { return min(min(a, b), min(c, d)); }
+__forceinline const avxf max4(const avxf& a, const avxf& b, const avxf& c, const avxf& d) { return max(max(a, b), max(c, d)); }
+
+////////////////////////////////////////////////////////////////////////////////
+/// Ternary Operators
+////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__KERNEL_AVX2__)
+__forceinline const avxf madd(const avxf& a, const avxf& b, const avxf& c) { return _mm256_fmadd_ps(a, b, c); }
+__forceinline const avxf msub(const avxf& a, const avxf& b, const avxf& c) { return _mm256_fmsub_ps(a, b, c); }
+#else
+__forceinline const avxf madd(const avxf& a, const avxf& b, const avxf& c) { return a*b+c; }
+__forceinline const avxf msub(const avxf& a, const avxf& b, const avxf& c) { return a*b-c; }
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// Comparison Operators
+////////////////////////////////////////////////////////////////////////////////
+
+/* Comparisons return a lane mask with one bit per element, as used by the
+ * traversal code, rather than a separate boolean vector type. */
+__forceinline int operator <=(const avxf& a, const avxf& b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.m256, b.m256, _CMP_LE_OQ)); }
+__forceinline int operator < (const avxf& a, const avxf& b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.m256, b.m256, _CMP_LT_OQ)); }
+
+#endif
+
+CCL_NAMESPACE_END
+
+#endif
@@ -16,6 +16,7 @@
 
 #include <stdio.h>
 
+#include "util_algorithm.h"
 #include "util_cache.h"
 #include "util_debug.h"
 #include "util_foreach.h"
@@ -27,21 +28,45 @@
 #include <boost/filesystem.hpp> 
 #include <boost/algorithm/string.hpp>
 
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include <ctime>
+
 CCL_NAMESPACE_BEGIN
 
+/* File Header */
+
+struct CacheFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t data_size;
+};
+
+static const char cache_file_magic[4] = {'C', 'C', 'L', 'C'};
+
 /* CacheData */
 
 CacheData::CacheData(const string& name_)
 {
 	name = name_;
-	f = NULL;
 	have_filename = false;
+
+	map_handle = NULL;
+	map_data = NULL;
+	map_size = 0;
+	map_offset = 0;
 }
 
 CacheData::~CacheData()
 {
-	if(f)
-		fclose(f);
+	unmap_file();
 }
 
 const string& CacheData::get_filename()
@@ -60,10 +85,107 @@ const string& CacheData::get_filename()
 	return filename;
 }
 
+bool CacheData::map_file(const string& filepath)
+{
+	unmap_file();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ,
+	                          FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+	                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+
+	if(mapping == NULL)
+		return false;
+
+	void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if(data == NULL) {
+		CloseHandle(mapping);
+		return false;
+	}
+
+	map_handle = mapping;
+	map_size = (size_t)size.QuadPart;
+#else
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if(fd == -1)
+		return false;
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(data == MAP_FAILED)
+		return false;
+
+	map_size = (size_t)st.st_size;
+#endif
+
+	map_data = (const uint8_t*)data;
+	map_offset = 0;
+
+	return true;
+}
+
+void CacheData::unmap_file()
+{
+	if(!map_data)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(map_data);
+	CloseHandle((HANDLE)map_handle);
+#else
+	munmap((void*)map_data, map_size);
+#endif
+
+	map_handle = NULL;
+	map_data = NULL;
+	map_size = 0;
+	map_offset = 0;
+}
+
+bool CacheData::read_data(void *data, size_t size)
+{
+	if(!map_data || size > map_size - map_offset)
+		return false;
+
+	memcpy(data, map_data + map_offset, size);
+	map_offset += size;
+
+	return true;
+}
+
 /* Cache */
 
 Cache Cache::global;
 
+Cache::Cache()
+{
+	max_size = 0;
+}
+
+void Cache::set_max_size(uint64_t max_size_)
+{
+	max_size = max_size_;
+}
+
 string Cache::data_filename(CacheData& key)
 {
 	return path_user_get(path_join("cache", key.get_filename()));
@@ -73,42 +195,169 @@ void Cache::insert(CacheData& key, CacheData& value)
 {
 	string filename = data_filename(key);
 	path_create_directories(filename);
-	FILE *f = path_fopen(filename, "wb");
+
+	/* write to a temporary file first, so that other processes using the
+	 * same cache never read a partially written file */
+	string tmp_filename = filename + "." +
+		boost::filesystem::unique_path("%%%%%%%%").string() + ".tmp";
+	FILE *f = path_fopen(tmp_filename, "wb");
 
 	if(!f) {
-		fprintf(stderr, "Failed to open file %s for writing.\n", filename.c_str());
+		fprintf(stderr, "Failed to open file %s for writing.\n", tmp_filename.c_str());
 		return;
 	}
 
+	CacheFileHeader header;
+	memcpy(header.magic, cache_file_magic, sizeof(header.magic));
+	header.version = CACHE_FILE_VERSION;
+	header.data_size = 0;
+
+	foreach(CacheBuffer& buffer, value.buffers)
+		header.data_size += sizeof(buffer.size) + buffer.size;
+
+	bool success = (fwrite(&header, sizeof(header), 1, f) == 1);
+
 	foreach(CacheBuffer& buffer, value.buffers) {
+		if(!success)
+			break;
 		if(!fwrite(&buffer.size, sizeof(buffer.size), 1, f))
-			fprintf(stderr, "Failed to write to file %s.\n", filename.c_str());
+			success = false;
 		if(buffer.size)
 			if(!fwrite(buffer.data, buffer.size, 1, f))
-				fprintf(stderr, "Failed to write to file %s.\n", filename.c_str());
+				success = false;
 	}
 	
-	fclose(f);
+	if(fclose(f) != 0)
+		success = false;
+
+	boost::system::error_code ec;
+
+	if(!success) {
+		fprintf(stderr, "Failed to write to file %s.\n", tmp_filename.c_str());
+		boost::filesystem::remove(tmp_filename, ec);
+		return;
+	}
+
+	/* rename replaces existing files atomically */
+	boost::filesystem::rename(tmp_filename, filename, ec);
+
+	if(ec) {
+		fprintf(stderr, "Failed to rename file %s.\n", tmp_filename.c_str());
+		boost::filesystem::remove(tmp_filename, ec);
+		return;
+	}
+
+	remove_least_recently_used(filename);
 }
 
 bool Cache::lookup(CacheData& key, CacheData& value)
 {
 	string filename = data_filename(key);
-	FILE *f = path_fopen(filename, "rb");
 
-	if(!f)
+	if(!value.map_file(filename))
 		return false;
-	
+
+	CacheFileHeader header;
+
+	if(!value.read_data(&header, sizeof(header)) ||
+	   memcmp(header.magic, cache_file_magic, sizeof(header.magic)) != 0 ||
+	   header.version != CACHE_FILE_VERSION ||
+	   header.data_size != value.map_size - sizeof(header))
+	{
+		/* written by another version or corrupted */
+		value.unmap_file();
+
+		boost::system::error_code ec;
+		boost::filesystem::remove(filename, ec);
+
+		return false;
+	}
+
 	value.name = key.name;
-	value.f = f;
+
+	/* modification time is used to find least recently used files */
+	boost::system::error_code ec;
+	boost::filesystem::last_write_time(filename, std::time(NULL), ec);
 
 	return true;
 }
 
+void Cache::remove(CacheData& key, CacheData& value)
+{
+	value.unmap_file();
+
+	boost::system::error_code ec;
+	boost::filesystem::remove(data_filename(key), ec);
+}
+
 void Cache::clear_except(const string& name, const set<string>& except)
 {
 	path_cache_clear_except(name, except);
 }
 
-CCL_NAMESPACE_END
+struct CacheFileInfo {
+	std::time_t time;
+	uint64_t size;
+	boost::filesystem::path path;
+
+	bool operator<(const CacheFileInfo& other) const
+	{
+		return time < other.time;
+	}
+};
+
+void Cache::remove_least_recently_used(const string& keep_filename)
+{
+	if(max_size == 0)
+		return;
+
+	boost::system::error_code ec;
+	boost::filesystem::path dir = path_user_get("cache");
+	boost::filesystem::directory_iterator it(dir, ec), it_end;
+
+	if(ec)
+		return;
+
+	vector<CacheFileInfo> files;
+	uint64_t total_size = 0;
+
+	for(; it != it_end; it.increment(ec)) {
+		if(ec)
+			break;
+
+		const boost::filesystem::path& path = it->path();
+
+		/* temporary files from other processes are still being written */
+		if(!boost::filesystem::is_regular_file(path, ec) || path.extension() == ".tmp")
+			continue;
 
+		CacheFileInfo info;
+		info.path = path;
+		info.size = boost::filesystem::file_size(path, ec);
+		info.time = boost::filesystem::last_write_time(path, ec);
+
+		if(ec)
+			continue;
+
+		files.push_back(info);
+		total_size += info.size;
+	}
+
+	if(total_size <= max_size)
+		return;
+
+	sort(files.begin(), files.end());
+
+	foreach(const CacheFileInfo& info, files) {
+		if(total_size <= max_size)
+			break;
+		if(info.path.string() == keep_filename)
+			continue;
+
+		/* another process may have removed it already */
+		if(boost::filesystem::remove(info.path, ec) && !ec)
+			total_size -= info.size;
+	}
+}
+
+CCL_NAMESPACE_END
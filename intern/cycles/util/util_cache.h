@@ -28,6 +28,12 @@
  * invalidate cache entries, at the cost of extra computation. If everything
  * is stored in a global cache, computations can perhaps even be shared between
  * different scenes where it may be hard to detect duplicate work.
+ *
+ * Files start with a header containing the cache format version, files from
+ * other versions are ignored. Files are written to a temporary file and then
+ * renamed, so other processes sharing the cache never see partial files. The
+ * total size of the cache is bounded, least recently used files are removed
+ * first. Files are memory mapped for reading.
  */
 
 #include "util_set.h"
@@ -36,6 +42,9 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Increase when the file layout changes. */
+#define CACHE_FILE_VERSION 1
+
 class CacheBuffer {
 public:
 	const void *data;
@@ -51,7 +60,6 @@ public:
 	string name;
 	string filename;
 	bool have_filename;
-	FILE *f;
 
 	CacheData(const string& name = "");
 	~CacheData();
@@ -100,17 +108,18 @@ public:
 	{
 		size_t size;
 
-		if(!fread(&size, sizeof(size), 1, f)) {
+		if(!read_data(&size, sizeof(size))) {
 			fprintf(stderr, "Failed to read vector size from cache.\n");
 			return false;
 		}
 
-		if((size == 0) || (size % sizeof(T)) != 0)
+		if((size % sizeof(T)) != 0)
 			return false;
 
+		/* optional arrays are written empty */
 		data.resize(size/sizeof(T));
 
-		if(!fread(&data[0], size, 1, f)) {
+		if(size && !read_data(&data[0], size)) {
 			fprintf(stderr, "Failed to read vector data from cache (%lu).\n", (unsigned long)size);
 			return false;
 		}
@@ -121,11 +130,11 @@ public:
 	{
 		size_t size;
 
-		if(!fread(&size, sizeof(size), 1, f)) {
+		if(!read_data(&size, sizeof(size))) {
 			fprintf(stderr, "Failed to read int size from cache.\n");
 			return false;
 		}
-		if(!fread(&data, sizeof(data), 1, f)) {
+		if(!read_data(&data, sizeof(data))) {
 			fprintf(stderr, "Failed to read int from cache.\n");
 			return false;
 		}
@@ -136,11 +145,11 @@ public:
 	{
 		size_t size;
 
-		if(!fread(&size, sizeof(size), 1, f)) {
+		if(!read_data(&size, sizeof(size))) {
 			fprintf(stderr, "Failed to read float size from cache.\n");
 			return false;
 		}
-		if(!fread(&data, sizeof(data), 1, f)) {
+		if(!read_data(&data, sizeof(data))) {
 			fprintf(stderr, "Failed to read float from cache.\n");
 			return false;
 		}
@@ -151,29 +160,52 @@ public:
 	{
 		size_t size;
 
-		if(!fread(&size, sizeof(size), 1, f)) {
+		if(!read_data(&size, sizeof(size))) {
 			fprintf(stderr, "Failed to read size_t size from cache.\n");
 			return false;
 		}
-		if(!fread(&data, sizeof(data), 1, f)) {
+		if(!read_data(&data, sizeof(data))) {
 			fprintf(stderr, "Failed to read size_t from cache.\n");
 			return false;
 		}
 		return true;
 	}
+
+protected:
+	friend class Cache;
+
+	/* memory mapped file contents */
+	bool map_file(const string& filepath);
+	void unmap_file();
+	bool read_data(void *data, size_t size);
+
+	void *map_handle;
+	const uint8_t *map_data;
+	size_t map_size;
+	size_t map_offset;
 };
 
 class Cache {
 public:
 	static Cache global;
 
+	Cache();
+
 	void insert(CacheData& key, CacheData& value);
 	bool lookup(CacheData& key, CacheData& value);
+	/* Remove a file that was found but could not be read. */
+	void remove(CacheData& key, CacheData& value);
 
 	void clear_except(const string& name, const set<string>& except);
 
+	/* Maximum total size of cache files in bytes, 0 means unlimited. */
+	void set_max_size(uint64_t max_size);
+
 protected:
 	string data_filename(CacheData& key);
+	void remove_least_recently_used(const string& keep_filename);
+
+	uint64_t max_size;
 };
 
 CCL_NAMESPACE_END
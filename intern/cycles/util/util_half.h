@@ -85,6 +85,48 @@ ccl_device_inline void float4_store_half(half *h, float4 f, float scale)
 #endif
 }
 
+ccl_device_inline float half_to_float(half h)
+{
+	union { uint i; float f; } out;
+	uint sign = ((uint)h & 0x8000) << 16;
+	uint exponent = ((uint)h >> 10) & 0x1F;
+	uint mantissa = (uint)h & 0x3FF;
+
+	if(exponent == 0) {
+		/* zero and denormals */
+		out.f = (float)mantissa * (1.0f/16777216.0f);
+		out.i |= sign;
+	}
+	else if(exponent == 0x1F) {
+		/* infinity and nan */
+		out.i = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else {
+		out.i = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+
+	return out.f;
+}
+
+/* Truncating conversion, values too small for a normalized half are flushed
+ * to zero and values too large become infinity. */
+ccl_device_inline half float_to_half(float f)
+{
+	union { uint i; float f; } in;
+	in.f = f;
+
+	uint sign = (in.i >> 16) & 0x8000;
+	int exponent = (int)((in.i >> 23) & 0xFF) - 127 + 15;
+	uint mantissa = in.i & 0x7FFFFF;
+
+	if(exponent <= 0)
+		return (half)sign;
+	else if(exponent >= 0x1F)
+		return (half)(sign | 0x7C00);
+
+	return (half)(sign | (exponent << 10) | (mantissa >> 13));
+}
+
 #endif
 
 #endif
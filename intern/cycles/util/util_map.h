@@ -37,6 +37,7 @@
 CCL_NAMESPACE_BEGIN
 
 using std::map;
+using std::multimap;
 using std::pair;
 
 #if defined(CYCLES_NO_UNORDERED_MAP)
@@ -278,7 +278,7 @@ void path_cache_clear_except(const string& name, const set<string>& except)
 
 			if(boost::starts_with(filename, name))
 				if(except.find(filename) == except.end())
-					boost::filesystem::remove(to_boost(filename));
+					boost::filesystem::remove(it->path());
 		}
 	}
 
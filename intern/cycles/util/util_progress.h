@@ -27,6 +27,7 @@
 #include "util_string.h"
 #include "util_time.h"
 #include "util_thread.h"
+#include "util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -36,6 +37,7 @@ public:
 	{
 		tile = 0;
 		sample = 0;
+		skipped_samples = 0;
 		start_time = time_dt();
 		total_time = 0.0f;
 		render_time = 0.0f;
@@ -73,6 +75,8 @@ public:
 	{
 		tile = 0;
 		sample = 0;
+		skipped_samples = 0;
+		thread_render_time.clear();
 		start_time = time_dt();
 		render_start_time = time_dt();
 		total_time = 0.0f;
@@ -178,6 +182,8 @@ public:
 		thread_scoped_lock lock(progress_mutex);
 
 		sample = 0;
+		skipped_samples = 0;
+		thread_render_time.clear();
 	}
 
 	void increment_sample()
@@ -198,6 +204,41 @@ public:
 		return sample;
 	}
 
+	/* pixel samples not rendered because adaptive sampling found the pixel
+	 * converged */
+	void add_skipped_samples(uint64_t num_samples)
+	{
+		thread_scoped_lock lock(progress_mutex);
+
+		skipped_samples += num_samples;
+	}
+
+	uint64_t get_skipped_samples()
+	{
+		thread_scoped_lock lock(progress_mutex);
+
+		return skipped_samples;
+	}
+
+	/* time every render thread spent rendering tiles, compared against the
+	 * total render time to get the utilization of the threads */
+	void add_thread_render_time(int thread, double time)
+	{
+		thread_scoped_lock lock(progress_mutex);
+
+		if(thread >= (int)thread_render_time.size())
+			thread_render_time.resize(thread + 1, 0.0);
+
+		thread_render_time[thread] += time;
+	}
+
+	vector<double> get_thread_render_time()
+	{
+		thread_scoped_lock lock(progress_mutex);
+
+		return thread_render_time;
+	}
+
 	/* status messages */
 
 	void set_status(const string& status_, const string& substatus_ = "")
@@ -288,6 +329,8 @@ protected:
 
 	int tile;    /* counter for rendered tiles */
 	int sample;  /* counter of rendered samples, global for all tiles */
+	uint64_t skipped_samples;  /* counter of pixel samples skipped by adaptive sampling */
+	vector<double> thread_render_time;  /* render time of every thread */
 
 	double start_time, render_start_time;
 	double total_time, render_time;
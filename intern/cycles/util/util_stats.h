@@ -18,12 +18,89 @@
 #define __UTIL_STATS_H__
 
 #include "util_atomic.h"
+#include "util_thread.h"
+#include "util_types.h"
+#include "util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* Counters of the work done by the render kernels. Every CPU thread counts
+ * in its own KernelGlobals without atomics, the counts of each tile are then
+ * added to the device Stats. */
+
+struct KernelCounters {
+	KernelCounters() { reset(); }
+
+	void reset()
+	{
+		camera_rays = 0;
+		intersect_rays = 0;
+		shadow_rays = 0;
+		subsurface_rays = 0;
+		volume_rays = 0;
+		bvh_nodes = 0;
+		bvh_primitives = 0;
+		shader_evals = 0;
+		bounces = 0;
+	}
+
+	void add(const KernelCounters& other)
+	{
+		camera_rays += other.camera_rays;
+		intersect_rays += other.intersect_rays;
+		shadow_rays += other.shadow_rays;
+		subsurface_rays += other.subsurface_rays;
+		volume_rays += other.volume_rays;
+		bvh_nodes += other.bvh_nodes;
+		bvh_primitives += other.bvh_primitives;
+		shader_evals += other.shader_evals;
+		bounces += other.bounces;
+	}
+
+	void sub(const KernelCounters& other)
+	{
+		camera_rays -= other.camera_rays;
+		intersect_rays -= other.intersect_rays;
+		shadow_rays -= other.shadow_rays;
+		subsurface_rays -= other.subsurface_rays;
+		volume_rays -= other.volume_rays;
+		bvh_nodes -= other.bvh_nodes;
+		bvh_primitives -= other.bvh_primitives;
+		shader_evals -= other.shader_evals;
+		bounces -= other.bounces;
+	}
+
+	/* all rays traced through the BVH, camera rays are included in the
+	 * closest hit intersect rays */
+	uint64_t total_rays() const
+	{
+		return intersect_rays + shadow_rays + subsurface_rays + volume_rays;
+	}
+
+	uint64_t camera_rays;
+	uint64_t intersect_rays;
+	uint64_t shadow_rays;
+	uint64_t subsurface_rays;
+	uint64_t volume_rays;
+	uint64_t bvh_nodes;
+	uint64_t bvh_primitives;
+	uint64_t shader_evals;
+	uint64_t bounces;
+};
+
+/* Kernel counters and render time of one rendered tile, a tile may be
+ * recorded more than once when its samples are split between threads. */
+
+struct TileCounters {
+	int x, y, w, h;
+	int num_samples;
+	double time;
+	KernelCounters counters;
+};
+
 class Stats {
 public:
-	Stats() : mem_used(0), mem_peak(0) {}
+	Stats() : mem_used(0), mem_peak(0), kernel_record_tiles(false) {}
 
 	void mem_alloc(size_t size) {
 		atomic_add_z(&mem_used, size);
@@ -35,8 +112,31 @@ public:
 		atomic_sub_z(&mem_used, size);
 	}
 
+	void kernel_tile_done(const TileCounters& tile)
+	{
+		thread_scoped_lock lock(kernel_mutex);
+		kernel_counters.add(tile.counters);
+		if(kernel_record_tiles)
+			kernel_tiles.push_back(tile);
+	}
+
+	void kernel_reset()
+	{
+		thread_scoped_lock lock(kernel_mutex);
+		kernel_counters.reset();
+		kernel_tiles.clear();
+	}
+
 	size_t mem_used;
 	size_t mem_peak;
+
+	/* kernel counters of all tiles rendered since the last reset, lock the
+	 * mutex to read them while rendering. Tiles are only recorded on request,
+	 * to not grow without bounds in interactive renders. */
+	KernelCounters kernel_counters;
+	vector<TileCounters> kernel_tiles;
+	bool kernel_record_tiles;
+	thread_mutex kernel_mutex;
 };
 
 CCL_NAMESPACE_END
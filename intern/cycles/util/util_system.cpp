@@ -23,10 +23,13 @@
 #include <intrin.h>
 #endif
 #include <windows.h>
+#include <psapi.h>
 #elif defined(__APPLE__)
+#include <sys/resource.h>
 #include <sys/sysctl.h>
 #include <sys/types.h>
 #else
+#include <sys/resource.h>
 #include <unistd.h>
 #endif
 
@@ -265,5 +268,25 @@ bool system_cpu_support_avx2()
 
 #endif
 
+size_t system_process_peak_memory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#  ifdef __APPLE__
+	/* bytes on OS X, kilobytes elsewhere */
+	return (size_t)usage.ru_maxrss;
+#  else
+	return (size_t)usage.ru_maxrss * 1024;
+#  endif
+#endif
+}
+
 CCL_NAMESPACE_END
 
@@ -30,6 +30,9 @@ bool system_cpu_support_sse41();
 bool system_cpu_support_avx();
 bool system_cpu_support_avx2();
 
+/* Peak resident memory of this process in bytes, 0 if unknown. */
+size_t system_process_peak_memory();
+
 CCL_NAMESPACE_END
 
 #endif /* __UTIL_SYSTEM_H__ */
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2011-2015 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util_foreach.h"
+#include "util_map.h"
+#include "util_texture_cache.h"
+#include "util_thread.h"
+
+#include <OpenImageIO/texture.h>
+
+CCL_NAMESPACE_BEGIN
+
+OIIO_NAMESPACE_USING
+
+struct TextureCacheHandle {
+	TextureSystem::TextureHandle *handle;
+	bool use_alpha;
+};
+
+struct TextureCacheHandles {
+	thread_mutex mutex;
+	map<string, TextureCacheHandle*> by_name;
+};
+
+TextureCache::TextureCache(size_t max_memory)
+{
+	/* Own texture system rather than the shared one, so the memory limit
+	 * only applies to this cache. */
+	TextureSystem *ts = TextureSystem::create(false);
+
+	/* lookups use the full resolution level only, see lookup() */
+	ts->attribute("automip", 0);
+	ts->attribute("autotile", 64);
+	ts->attribute("gray_to_rgb", 1);
+	ts->attribute("max_memory_MB", (float)((double)max_memory / (1024.0 * 1024.0)));
+
+	texture_system = ts;
+	handles = new TextureCacheHandles();
+}
+
+TextureCache::~TextureCache()
+{
+	typedef map<string, TextureCacheHandle*> HandleMap;
+
+	foreach(HandleMap::value_type& it, handles->by_name)
+		delete it.second;
+
+	delete handles;
+
+	TextureSystem::destroy((TextureSystem*)texture_system);
+}
+
+TextureCacheHandle *TextureCache::get_handle(const string& filename, bool use_alpha)
+{
+	/* same file may be used with and without alpha */
+	thread_scoped_lock lock(handles->mutex);
+	TextureCacheHandle *&handle = handles->by_name[string_printf("%s:%d", filename.c_str(), (int)use_alpha)];
+
+	if(!handle) {
+		TextureSystem *ts = (TextureSystem*)texture_system;
+
+		handle = new TextureCacheHandle();
+		handle->handle = ts->get_texture_handle(ustring(filename));
+		handle->use_alpha = use_alpha;
+	}
+
+	return handle;
+}
+
+void TextureCache::invalidate(const string& filename)
+{
+	((TextureSystem*)texture_system)->invalidate(ustring(filename));
+}
+
+float4 TextureCache::lookup(TextureCacheHandle *handle,
+                            float x, float y,
+                            int interpolation,
+                            bool periodic)
+{
+	TextureSystem *ts = (TextureSystem*)texture_system;
+	TextureOpt options;
+
+	switch(interpolation) {
+		case INTERPOLATION_CLOSEST:
+			options.interpmode = TextureOpt::InterpClosest;
+			break;
+		case INTERPOLATION_CUBIC:
+			options.interpmode = TextureOpt::InterpBicubic;
+			break;
+		case INTERPOLATION_SMART:
+			options.interpmode = TextureOpt::InterpSmartBicubic;
+			break;
+		default:
+			options.interpmode = TextureOpt::InterpBilinear;
+			break;
+	}
+
+	options.swrap = options.twrap = (periodic)? TextureOpt::WrapPeriodic: TextureOpt::WrapClamp;
+	/* missing alpha channel is opaque */
+	options.fill = 1.0f;
+
+	float result[4];
+
+	/* Zero derivatives, so the highest resolution mip level of files which
+	 * have mipmaps is used. OpenImageIO stores images top to bottom. */
+#if OIIO_VERSION < 10500
+	options.nchannels = 4;
+	bool status = ts->texture(handle->handle, ts->get_perthread_info(), options,
+	                          x, 1.0f - y, 0.0f, 0.0f, 0.0f, 0.0f,
+	                          result);
+#else
+	bool status = ts->texture(handle->handle, ts->get_perthread_info(), options,
+	                          x, 1.0f - y, 0.0f, 0.0f, 0.0f, 0.0f,
+	                          4, result);
+#endif
+
+	if(!status)
+		return make_float4(1.0f, 0.0f, 1.0f, 1.0f);
+
+	if(!handle->use_alpha)
+		result[3] = 1.0f;
+
+	return make_float4(result[0], result[1], result[2], result[3]);
+}
+
+string TextureCache::stats() const
+{
+	TextureSystem *ts = (TextureSystem*)texture_system;
+	long long memory_used = 0, bytes_read = 0, tile_lookups = 0;
+	int tile_misses = 0, files = 0;
+
+	ts->getattribute("stat:cache_memory_used", TypeDesc::LONGLONG, &memory_used);
+	ts->getattribute("stat:bytes_read", TypeDesc::LONGLONG, &bytes_read);
+	ts->getattribute("stat:find_tile_calls", TypeDesc::LONGLONG, &tile_lookups);
+	ts->getattribute("stat:find_tile_cache_misses", TypeDesc::INT, &tile_misses);
+	ts->getattribute("stat:open_files_created", TypeDesc::INT, &files);
+
+	long long tile_hits = tile_lookups - tile_misses;
+	double hit_rate = (tile_lookups)? 100.0 * (double)tile_hits / (double)tile_lookups: 0.0;
+
+	return string_printf("Texture cache: %d files, %.2fM in memory, %.2fM read from disk, "
+	                     "%lld tile hits, %d tile misses (%.2f%% hit rate)",
+	                     files,
+	                     (double)memory_used / (1024.0 * 1024.0),
+	                     (double)bytes_read / (1024.0 * 1024.0),
+	                     tile_hits, tile_misses, hit_rate);
+}
+
+CCL_NAMESPACE_END
+
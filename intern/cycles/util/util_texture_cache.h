@@ -0,0 +1,68 @@
+/*
+ * Copyright 2011-2015 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTIL_TEXTURE_CACHE_H__
+#define __UTIL_TEXTURE_CACHE_H__
+
+/* Texture Cache
+ *
+ * Image files are not loaded into memory up front, but read in tiles on first
+ * lookup. The memory used by tiles is bounded, least recently used tiles are
+ * freed first.
+ *
+ * Lookups always read the full resolution image. SVM has no texture
+ * coordinate differentials to pick a mip level from, so mip selection is not
+ * done and no mipmaps are generated.
+ *
+ * This is a thin wrapper around the OpenImageIO texture system, which the
+ * kernel can use without including OpenImageIO headers. */
+
+#include "util_string.h"
+#include "util_types.h"
+
+CCL_NAMESPACE_BEGIN
+
+struct TextureCacheHandle;
+struct TextureCacheHandles;
+
+class TextureCache {
+public:
+	explicit TextureCache(size_t max_memory);
+	~TextureCache();
+
+	/* Handles are owned by the cache and stay valid until it is destroyed. */
+	TextureCacheHandle *get_handle(const string& filename, bool use_alpha);
+	void invalidate(const string& filename);
+
+	/* Lookup at normalized image coordinates with the bottom row at y = 0,
+	 * like images loaded into memory. Missing files give the pink color. */
+	float4 lookup(TextureCacheHandle *handle,
+	              float x, float y,
+	              int interpolation,
+	              bool periodic);
+
+	/* Human readable summary of memory usage and tile hits and misses. */
+	string stats() const;
+
+protected:
+	void *texture_system;
+	TextureCacheHandles *handles;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_TEXTURE_CACHE_H__ */
+
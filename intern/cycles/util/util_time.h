@@ -17,6 +17,8 @@
 #ifndef __UTIL_TIME_H__
 #define __UTIL_TIME_H__
 
+#include <stddef.h>
+
 CCL_NAMESPACE_BEGIN
 
 /* Give current time in seconds in double precision, with good accuracy. */
@@ -27,6 +29,37 @@ double time_dt();
 
 void time_sleep(double t);
 
+/* Measure the time spent in a scope, optionally storing it in value when
+ * the scope is left. */
+
+class scoped_timer {
+public:
+	explicit scoped_timer(double *value = NULL) : value_(value)
+	{
+		time_start_ = time_dt();
+	}
+
+	~scoped_timer()
+	{
+		if(value_ != NULL)
+			*value_ = get_time();
+	}
+
+	double get_start() const
+	{
+		return time_start_;
+	}
+
+	double get_time() const
+	{
+		return time_dt() - time_start_;
+	}
+
+protected:
+	double *value_;
+	double time_start_;
+};
+
 CCL_NAMESPACE_END
 
 #endif
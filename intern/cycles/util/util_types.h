@@ -470,6 +470,19 @@ enum InterpolationType {
 	INTERPOLATION_SMART = 3,
 };
 
+/* Image data types, compact types with one channel or half floats are
+ * only supported on the CPU */
+enum ImageDataType {
+	IMAGE_DATA_TYPE_FLOAT4 = 0,
+	IMAGE_DATA_TYPE_BYTE4 = 1,
+	IMAGE_DATA_TYPE_HALF4 = 2,
+	IMAGE_DATA_TYPE_FLOAT = 3,
+	IMAGE_DATA_TYPE_BYTE = 4,
+	IMAGE_DATA_TYPE_HALF = 5,
+
+	IMAGE_DATA_NUM_TYPES
+};
+
 /* macros */
 
 /* hints for branch prediction, only use in code that runs a _lot_ */
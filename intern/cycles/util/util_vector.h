@@ -188,6 +188,18 @@ public:
 		return datasize;
 	}
 
+	void swap(array& from)
+	{
+		T *tmp_data = data;
+		size_t tmp_datasize = datasize;
+
+		data = from.data;
+		datasize = from.datasize;
+
+		from.data = tmp_data;
+		from.datasize = tmp_datasize;
+	}
+
 	T& operator[](size_t i) const
 	{
 		return data[i];
@@ -1125,6 +1125,9 @@ static int bake_exec(bContext *C, wmOperator *op)
 		}
 	}
 
+	/* the engine is reused for all objects, free it when they are all baked */
+	RE_bake_engine_free(re);
+
 	RE_SetReports(re, NULL);
 
 
@@ -1176,10 +1179,12 @@ static void bake_startjob(void *bkv, short *UNUSED(stop), short *do_update, floa
 			        bkr->uv_layer);
 
 			if (bkr->result == OPERATOR_CANCELLED)
-				return;
+				break;
 		}
 	}
 
+	RE_bake_engine_free(bkr->render);
+
 	RE_SetReports(bkr->render, NULL);
 }
 
@@ -74,6 +74,8 @@ bool RE_bake_engine(
         struct Render *re, struct Object *object, const int object_id, const BakePixel pixel_array[],
         const size_t num_pixels, const int depth, const ScenePassType pass_type, float result[]);
 
+void RE_bake_engine_free(struct Render *re);
+
 /* bake.c */
 int RE_pass_depth(const ScenePassType pass_type);
 bool RE_bake_internal(
@@ -471,7 +471,6 @@ bool RE_bake_engine(
 {
 	RenderEngineType *type = RE_engines_find(re->r.engine);
 	RenderEngine *engine;
-	bool persistent_data = (re->r.mode & R_PERSISTENT_DATA) != 0;
 
 	/* set render info */
 	re->i.cfra = re->scene->r.cfra;
@@ -498,10 +497,13 @@ bool RE_bake_engine(
 	engine->tile_x = re->r.tilex;
 	engine->tile_y = re->r.tiley;
 
-	/* update is only called so we create the engine.session */
-	if (type->update)
+	/* update is only called so we create the engine.session, the engine
+	 * keeps it for all objects baked until RE_bake_engine_free */
+	if (type->update && !(engine->flag & RE_ENGINE_BAKING))
 		type->update(engine, re->main, re->scene);
 
+	engine->flag |= RE_ENGINE_BAKING;
+
 	if (type->bake)
 		type->bake(engine, re->scene, object, pass_type, object_id, pixel_array, num_pixels, depth, result);
 
@@ -512,10 +514,8 @@ bool RE_bake_engine(
 	BLI_rw_mutex_lock(&re->partsmutex, THREAD_LOCK_WRITE);
 
 	/* re->engine becomes zero if user changed active render engine during render */
-	if (!persistent_data || !re->engine) {
+	if (!re->engine)
 		RE_engine_free(engine);
-		re->engine = NULL;
-	}
 
 	RE_parts_free(re);
 	BLI_rw_mutex_unlock(&re->partsmutex);
@@ -526,6 +526,27 @@ bool RE_bake_engine(
 	return true;
 }
 
+/* Free the engine used for baking, once all objects and passes are baked */
+void RE_bake_engine_free(Render *re)
+{
+	RenderEngine *engine = re->engine;
+	bool persistent_data = (re->r.mode & R_PERSISTENT_DATA) != 0;
+
+	if (!engine)
+		return;
+
+	BLI_rw_mutex_lock(&re->partsmutex, THREAD_LOCK_WRITE);
+
+	engine->flag &= ~RE_ENGINE_BAKING;
+
+	if (!persistent_data) {
+		RE_engine_free(engine);
+		re->engine = NULL;
+	}
+
+	BLI_rw_mutex_unlock(&re->partsmutex);
+}
+
 void RE_engine_frame_set(RenderEngine *engine, int frame, float subframe)
 {
 	Render *re = engine->re;
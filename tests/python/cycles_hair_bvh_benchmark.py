@@ -0,0 +1,181 @@
+# Apache License, Version 2.0
+
+"""
+Benchmark for Cycles hair BVH splits, renders a groomed furball with long,
+curly hair, with and without splitting curve segments into pieces with
+tighter bounds, and reports camera rays per second.
+
+With --test a smaller furball is rendered with and without splits, and the
+script fails when the two renders differ.
+
+Example Usage:
+
+./blender.bin --background --factory-startup \
+    --python tests/python/cycles_hair_bvh_benchmark.py -- \
+    --hairs=20000 --samples=16
+
+./blender.bin --background --factory-startup \
+    --python tests/python/cycles_hair_bvh_benchmark.py -- --test
+"""
+
+import argparse
+import math
+import os
+import sys
+import tempfile
+import time
+
+import bpy
+
+
+def create_scene(num_hairs, primitive, seed, resolution_x, resolution_y):
+    bpy.ops.wm.read_factory_settings(use_empty=True)
+    scene = bpy.context.scene
+    scene.render.engine = 'CYCLES'
+    scene.render.resolution_x = resolution_x
+    scene.render.resolution_y = resolution_y
+    scene.render.resolution_percentage = 100
+    scene.cycles.progressive = 'PATH'
+    scene.cycles.max_bounces = 4
+    scene.cycles.use_animated_seed = False
+    scene.cycles_curves.primitive = primitive
+    scene.cycles_curves.shape = 'THICK'
+
+    bpy.ops.mesh.primitive_ico_sphere_add(subdivisions=4, size=1.0)
+    ob = bpy.context.object
+
+    material = bpy.data.materials.new("Fur")
+    material.use_nodes = True
+    nodes = material.node_tree.nodes
+    nodes.remove(nodes["Diffuse BSDF"])
+    hair = nodes.new("ShaderNodeBsdfHair")
+    material.node_tree.links.new(hair.outputs["BSDF"], nodes["Material Output"].inputs["Surface"])
+    ob.data.materials.append(material)
+
+    # Long hair, combed sideways by gravity and curled, so most segments are
+    # thin and diagonal to the axes.
+    ob.modifiers.new("Fur", 'PARTICLE_SYSTEM')
+    psys = ob.particle_systems[0]
+    psys.seed = seed
+    settings = psys.settings
+    settings.type = 'HAIR'
+    settings.count = num_hairs
+    settings.hair_length = 1.5
+    settings.hair_step = 8
+    settings.render_step = 4
+    settings.use_advanced_hair = True
+    settings.brownian_factor = 0.05
+    settings.effector_weights.gravity = 1.0
+    settings.kink = 'CURL'
+    settings.kink_amplitude = 0.1
+    settings.kink_frequency = 4.0
+    settings.cycles.root_width = 0.5
+    settings.cycles.tip_width = 0.1
+    settings.material = 1
+
+    camera = bpy.data.cameras.new("Camera")
+    ob = bpy.data.objects.new("Camera", camera)
+    ob.location = (0.0, -6.0, 0.0)
+    ob.rotation_euler = (1.5708, 0.0, 0.0)
+    scene.objects.link(ob)
+    scene.camera = ob
+
+    lamp = bpy.data.lamps.new("Sun", 'SUN')
+    ob = bpy.data.objects.new("Sun", lamp)
+    ob.rotation_euler = (0.8, 0.2, 0.0)
+    scene.objects.link(ob)
+
+    return scene
+
+
+def render(scene, samples, use_curve_splits, filepath=None):
+    scene.cycles.samples = samples
+    scene.cycles.debug_use_bvh_curve_splits = use_curve_splits
+
+    if not filepath:
+        start = time.time()
+        bpy.ops.render.render()
+        return time.time() - start
+
+    scene.render.filepath = filepath
+    scene.render.image_settings.file_format = 'OPEN_EXR'
+    bpy.ops.render.render(write_still=True)
+
+    image = bpy.data.images.load(filepath)
+    pixels = image.pixels[:]
+    bpy.data.images.remove(image)
+    os.remove(filepath)
+
+    return pixels
+
+
+def rms_error(pixels, reference):
+    total = 0.0
+    num = 0
+    for i in range(0, len(pixels), 4):
+        for c in range(3):
+            diff = pixels[i + c] - reference[i + c]
+            total += diff * diff
+            num += 1
+    return math.sqrt(total / num)
+
+
+def create_argparse():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--hairs", type=int, default=20000)
+    parser.add_argument("--samples", type=int, default=16)
+    parser.add_argument("--primitive", default='CURVE_SEGMENTS',
+                        choices=('LINE_SEGMENTS', 'CURVE_SEGMENTS'))
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--test", action="store_true",
+                        help="Compare renders with and without splits and exit")
+    parser.add_argument("--tolerance", type=float, default=0.001,
+                        help="Largest RMS error between the renders in test mode")
+    return parser
+
+
+def run_test(args):
+    # Splits only tighten the bounds of the segments, so the renders must
+    # match.
+    scene = create_scene(2000, args.primitive, args.seed, 160, 120)
+    temp = tempfile.mkdtemp()
+
+    renders = []
+    for use_curve_splits in (False, True):
+        filepath = os.path.join(temp, "split.exr" if use_curve_splits else "unsplit.exr")
+        renders.append(render(scene, 16, use_curve_splits, filepath))
+
+    os.rmdir(temp)
+
+    error = rms_error(renders[1], renders[0])
+    print("\nHair BVH test, RMS error %.6f, tolerance %.6f" % (error, args.tolerance))
+    if error > args.tolerance:
+        print("Hair BVH test FAILED")
+        sys.exit(1)
+
+
+def main():
+    argv = sys.argv[sys.argv.index("--") + 1:] if "--" in sys.argv else []
+    args = create_argparse().parse_args(argv)
+
+    if args.test:
+        run_test(args)
+        return
+
+    scene = create_scene(args.hairs, args.primitive, args.seed, 320, 240)
+    num_rays = scene.render.resolution_x * scene.render.resolution_y * args.samples
+
+    results = []
+    for use_curve_splits in (False, True):
+        render_time = render(scene, args.samples, use_curve_splits)
+        results.append((use_curve_splits, render_time, num_rays / render_time))
+
+    print("\nHair BVH benchmark, %d hairs, %s, %d samples" % (args.hairs, args.primitive, args.samples))
+    for use_curve_splits, render_time, rays_per_second in results:
+        print("  %-12s time %.2fs  camera rays/s %.0f" %
+              ("split" if use_curve_splits else "unsplit", render_time, rays_per_second))
+    print("  Speedup: %.2fx" % (results[0][1] / results[1][1]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,250 @@
+# Apache License, Version 2.0
+
+"""
+Memory report for Cycles instancing, renders a forest of particle instanced
+trees and compares the memory used by the compact object records and shared
+attribute maps with a full record and attribute map for every instance.
+
+The script runs itself inside Blender to build and render the scene, and
+parses the Cycles log of that render.
+
+With --test, run inside Blender, a small forest is rendered with the
+particle instances and with the instances made real objects, and the
+script fails when the two renders differ.
+
+Example Usage:
+
+python3 tests/python/cycles_instancing_benchmark.py \
+    --blender ./blender.bin --trees=1000000
+
+./blender.bin --background --factory-startup \
+    --python tests/python/cycles_instancing_benchmark.py -- --test
+"""
+
+import argparse
+import math
+import os
+import re
+import resource
+import subprocess
+import sys
+import tempfile
+import time
+
+
+REPORT_RE = re.compile(r"(Objects|Attribute maps): (.*), ([0-9.]+)M in memory, ([0-9.]+)M saved by (.*)\.")
+
+
+def create_forest(num_trees, seed, use_dupli=True):
+    import bpy
+
+    bpy.ops.wm.read_factory_settings(use_empty=True)
+    scene = bpy.context.scene
+    scene.render.engine = 'CYCLES'
+    scene.render.resolution_x = 320
+    scene.render.resolution_y = 240
+    scene.render.resolution_percentage = 100
+    scene.cycles.samples = 1
+
+    # Tree made of a trunk and a crown, with a texture using the dupli
+    # coordinates so every instance needs its optional data. Real objects
+    # have no dupli coordinates, so the test uses the object location.
+    bpy.ops.mesh.primitive_cylinder_add(radius=0.1, depth=1.0, location=(0.0, 0.0, -100.0))
+    trunk = bpy.context.object
+    bpy.ops.mesh.primitive_ico_sphere_add(subdivisions=3, size=0.5, location=(0.0, 0.0, -99.0))
+    crown = bpy.context.object
+    bpy.ops.object.select_all(action='DESELECT')
+    trunk.select = True
+    crown.select = True
+    scene.objects.active = trunk
+    bpy.ops.object.join()
+    tree = trunk
+
+    material = bpy.data.materials.new("Tree")
+    material.use_nodes = True
+    nodes = material.node_tree.nodes
+    noise = nodes.new("ShaderNodeTexNoise")
+    if use_dupli:
+        texco = nodes.new("ShaderNodeTexCoord")
+        texco.from_dupli = True
+        material.node_tree.links.new(texco.outputs["Generated"], noise.inputs["Vector"])
+    else:
+        info = nodes.new("ShaderNodeObjectInfo")
+        material.node_tree.links.new(info.outputs["Location"], noise.inputs["Vector"])
+    material.node_tree.links.new(noise.outputs["Color"], nodes["Diffuse BSDF"].inputs["Color"])
+    tree.data.materials.append(material)
+
+    # Ground scattering the trees with a hair particle system.
+    bpy.ops.mesh.primitive_plane_add(radius=100.0)
+    ground = bpy.context.object
+    ground.modifiers.new("Forest", 'PARTICLE_SYSTEM')
+    settings = ground.particle_systems[0].settings
+    settings.type = 'HAIR'
+    settings.count = num_trees
+    settings.render_type = 'OBJECT'
+    settings.dupli_object = tree
+    settings.use_rotation_dupli = True
+    settings.particle_size = 1.0
+    settings.size_random = 0.5
+    ground.particle_systems[0].seed = seed
+
+    camera = bpy.data.cameras.new("Camera")
+    ob = bpy.data.objects.new("Camera", camera)
+    ob.location = (0.0, -120.0, 40.0)
+    ob.rotation_euler = (1.2, 0.0, 0.0)
+    scene.objects.link(ob)
+    scene.camera = ob
+
+    lamp = bpy.data.lamps.new("Sun", 'SUN')
+    ob = bpy.data.objects.new("Sun", lamp)
+    ob.rotation_euler = (0.8, 0.2, 0.0)
+    scene.objects.link(ob)
+
+    return scene
+
+
+def render_pixels(scene, filepath):
+    import bpy
+
+    scene.render.filepath = filepath
+    scene.render.image_settings.file_format = 'OPEN_EXR'
+    bpy.ops.render.render(write_still=True)
+
+    image = bpy.data.images.load(filepath)
+    pixels = image.pixels[:]
+    bpy.data.images.remove(image)
+    os.remove(filepath)
+
+    return pixels
+
+
+def rms_error(pixels, reference):
+    total = 0.0
+    num = 0
+    for i in range(0, len(pixels), 4):
+        for c in range(3):
+            diff = pixels[i + c] - reference[i + c]
+            total += diff * diff
+            num += 1
+    return math.sqrt(total / num)
+
+
+def test_forest(args):
+    import bpy
+
+    scene = create_forest(1000, args.seed, use_dupli=False)
+    scene.render.resolution_x = 160
+    scene.render.resolution_y = 120
+    scene.cycles.samples = 16
+    scene.cycles.use_animated_seed = False
+
+    temp = tempfile.mkdtemp()
+    instanced = render_pixels(scene, os.path.join(temp, "instanced.exr"))
+
+    # Same forest with a full object for every tree.
+    ground = scene.objects["Plane"]
+    scene.update()
+    bpy.ops.object.select_all(action='DESELECT')
+    ground.select = True
+    scene.objects.active = ground
+    bpy.ops.object.duplicates_make_real()
+    ground.modifiers.remove(ground.modifiers["Forest"])
+
+    real = render_pixels(scene, os.path.join(temp, "real.exr"))
+    os.rmdir(temp)
+
+    error = rms_error(instanced, real)
+    print("\nInstancing test, RMS error %.6f, tolerance %.6f" % (error, args.tolerance))
+    if error > args.tolerance:
+        print("Instancing test FAILED")
+        sys.exit(1)
+
+
+def render_forest(argv):
+    import bpy
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--trees", type=int, default=100000)
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--test", action="store_true")
+    parser.add_argument("--tolerance", type=float, default=0.001)
+    args = parser.parse_args(argv)
+
+    if args.test:
+        test_forest(args)
+        return
+
+    create_forest(args.trees, args.seed)
+    bpy.ops.render.render()
+
+
+def run_blender(args):
+    command = [
+        args.blender,
+        "--background", "--factory-startup",
+        "--debug-cycles", "--verbose", "1",
+        "--python", __file__,
+        "--",
+        "--trees", str(args.trees),
+        "--seed", str(args.seed),
+    ]
+
+    start = time.time()
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    render_time = time.time() - start
+    output = result.stdout.decode("utf-8", "replace")
+
+    if result.returncode != 0:
+        print(output)
+        return None
+
+    reports = {}
+    for match in REPORT_RE.finditer(output):
+        reports[match.group(1)] = (match.group(2), float(match.group(3)), float(match.group(4)))
+
+    peak = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss / 1024.0
+    return render_time, peak, reports
+
+
+def create_argparse():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--blender", required=True)
+    parser.add_argument("--trees", type=int, default=100000)
+    parser.add_argument("--seed", type=int, default=0)
+    return parser
+
+
+def main():
+    args = create_argparse().parse_args()
+
+    result = run_blender(args)
+    if not result:
+        print("Render failed")
+        return
+
+    render_time, peak, reports = result
+
+    print("\nInstancing memory report, %d trees" % args.trees)
+    print("  Render time %.2fs, peak memory %.2fM" % (render_time, peak))
+
+    total_compact = 0.0
+    total_full = 0.0
+    for name in ("Objects", "Attribute maps"):
+        if name not in reports:
+            print("  %-15s not found in log" % name)
+            continue
+        info, used, saved = reports[name]
+        total_compact += used
+        total_full += used + saved
+        print("  %-15s %s" % (name, info))
+        print("  %-15s compact %.2fM, full per instance %.2fM" % ("", used, used + saved))
+
+    if total_full > 0.0:
+        print("  Instancing memory reduction: %.1f%%" % (100.0 * (total_full - total_compact) / total_full))
+
+
+if __name__ == "__main__":
+    if "--" in sys.argv:
+        render_forest(sys.argv[sys.argv.index("--") + 1:])
+    else:
+        main()
@@ -0,0 +1,203 @@
+# Apache License, Version 2.0
+
+"""
+Benchmark for the Cycles light tree, renders a scene with many small lamps
+and emissive triangles with and without the light tree, and reports the
+noise against a reference render per unit of render time.
+
+With --test a small scene is rendered with and without the light tree, and
+the script fails when the two renders differ by more than the noise.
+
+Example Usage:
+
+./blender.bin --background --factory-startup \
+    --python tests/python/cycles_light_tree_benchmark.py -- \
+    --lights=256 --samples=64 --reference-samples=4096
+
+./blender.bin --background --factory-startup \
+    --python tests/python/cycles_light_tree_benchmark.py -- --test
+"""
+
+import argparse
+import math
+import os
+import random
+import sys
+import tempfile
+import time
+
+import bpy
+
+
+def create_emission_material(name, color, strength):
+    material = bpy.data.materials.new(name)
+    material.use_nodes = True
+    nodes = material.node_tree.nodes
+    links = material.node_tree.links
+    for node in nodes:
+        if node.type != 'OUTPUT_MATERIAL':
+            nodes.remove(node)
+    emission = nodes.new("ShaderNodeEmission")
+    emission.inputs["Color"].default_value = color + (1.0,)
+    emission.inputs["Strength"].default_value = strength
+    links.new(emission.outputs["Emission"], nodes["Material Output"].inputs["Surface"])
+    return material
+
+
+def create_scene(num_lights, seed, resolution_x, resolution_y):
+    random.seed(seed)
+
+    bpy.ops.wm.read_factory_settings(use_empty=True)
+    scene = bpy.context.scene
+    scene.render.engine = 'CYCLES'
+    scene.render.resolution_x = resolution_x
+    scene.render.resolution_y = resolution_y
+    scene.render.resolution_percentage = 100
+    scene.render.image_settings.file_format = 'OPEN_EXR'
+    scene.cycles.progressive = 'PATH'
+    scene.cycles.max_bounces = 4
+    scene.cycles.use_animated_seed = False
+
+    # Floor and a few occluders for the lamps to light up.
+    bpy.ops.mesh.primitive_plane_add(radius=20.0)
+    for i in range(8):
+        angle = 2.0 * math.pi * i / 8
+        bpy.ops.mesh.primitive_uv_sphere_add(
+            size=1.0,
+            location=(6.0 * math.cos(angle), 6.0 * math.sin(angle), 1.0))
+
+    # Small lamps spread over the floor, each only lighting its surroundings.
+    for i in range(num_lights):
+        lamp = bpy.data.lamps.new("Lamp%d" % i, 'POINT')
+        lamp.shadow_soft_size = 0.05
+        lamp.use_nodes = True
+        emission = lamp.node_tree.nodes["Emission"]
+        emission.inputs["Color"].default_value = (
+            random.uniform(0.2, 1.0), random.uniform(0.2, 1.0), random.uniform(0.2, 1.0), 1.0)
+        emission.inputs["Strength"].default_value = 20.0
+        ob = bpy.data.objects.new("Lamp%d" % i, lamp)
+        ob.location = (random.uniform(-18.0, 18.0), random.uniform(-18.0, 18.0), random.uniform(0.2, 2.0))
+        scene.objects.link(ob)
+
+    # Emissive strips, a mesh light with many triangles.
+    material = create_emission_material("Strip", (1.0, 0.8, 0.6), 5.0)
+    for i in range(max(num_lights // 16, 1)):
+        bpy.ops.mesh.primitive_plane_add(
+            radius=0.1,
+            location=(random.uniform(-18.0, 18.0), random.uniform(-18.0, 18.0), 0.01))
+        bpy.context.object.data.materials.append(material)
+
+    camera = bpy.data.cameras.new("Camera")
+    ob = bpy.data.objects.new("Camera", camera)
+    ob.location = (0.0, -24.0, 14.0)
+    ob.rotation_euler = (math.radians(60.0), 0.0, 0.0)
+    scene.objects.link(ob)
+    scene.camera = ob
+
+    world = bpy.data.worlds.new("World")
+    world.color = (0.0, 0.0, 0.0)
+    scene.world = world
+
+    return scene
+
+
+def render(scene, filepath, samples, use_light_tree):
+    scene.cycles.samples = samples
+    scene.cycles.use_light_tree = use_light_tree
+    scene.render.filepath = filepath
+
+    start = time.time()
+    bpy.ops.render.render(write_still=True)
+    render_time = time.time() - start
+
+    image = bpy.data.images.load(filepath)
+    pixels = image.pixels[:]
+    bpy.data.images.remove(image)
+
+    return pixels, render_time
+
+
+def rms_error(pixels, reference):
+    total = 0.0
+    num = 0
+    for i in range(0, len(pixels), 4):
+        for c in range(3):
+            diff = pixels[i + c] - reference[i + c]
+            total += diff * diff
+            num += 1
+    return math.sqrt(total / num)
+
+
+def create_argparse():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--lights", type=int, default=256)
+    parser.add_argument("--samples", type=int, default=64)
+    parser.add_argument("--reference-samples", type=int, default=4096)
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--test", action="store_true",
+                        help="Compare renders with and without the light tree and exit")
+    parser.add_argument("--tolerance", type=float, default=0.02,
+                        help="Largest RMS error between the renders in test mode")
+    return parser
+
+
+def run_test(args):
+    # Both renders converge to the same image, only the light sampling and
+    # so the noise differs.
+    scene = create_scene(32, args.seed, 160, 120)
+    temp = tempfile.mkdtemp()
+
+    renders = []
+    for use_light_tree in (False, True):
+        filepath = os.path.join(temp, "tree.exr" if use_light_tree else "flat.exr")
+        pixels, render_time = render(scene, filepath, 256, use_light_tree)
+        renders.append(pixels)
+        os.remove(filepath)
+
+    os.rmdir(temp)
+
+    error = rms_error(renders[1], renders[0])
+    print("\nLight tree test, RMS error %.6f, tolerance %.6f" % (error, args.tolerance))
+    if error > args.tolerance:
+        print("Light tree test FAILED")
+        sys.exit(1)
+
+
+def main():
+    argv = sys.argv[sys.argv.index("--") + 1:] if "--" in sys.argv else []
+    args = create_argparse().parse_args(argv)
+
+    if args.test:
+        run_test(args)
+        return
+
+    scene = create_scene(args.lights, args.seed, 320, 240)
+    temp = tempfile.mkdtemp()
+
+    reference, reference_time = render(scene, os.path.join(temp, "reference.exr"),
+                                       args.reference_samples, False)
+
+    results = []
+    for use_light_tree in (False, True):
+        filepath = os.path.join(temp, "tree.exr" if use_light_tree else "flat.exr")
+        pixels, render_time = render(scene, filepath, args.samples, use_light_tree)
+        error = rms_error(pixels, reference)
+        # Noise variance halves with twice the samples, so the inverse of
+        # variance times render time is independent of the sample count.
+        efficiency = 1.0 / max(error * error * render_time, 1e-20)
+        results.append((use_light_tree, error, render_time, efficiency))
+        os.remove(filepath)
+
+    os.remove(os.path.join(temp, "reference.exr"))
+    os.rmdir(temp)
+
+    print("\nLight tree benchmark, %d lamps, %d samples, reference %d samples (%.2fs)" %
+          (args.lights, args.samples, args.reference_samples, reference_time))
+    for use_light_tree, error, render_time, efficiency in results:
+        print("  %-10s RMS error %.6f  time %.2fs  efficiency %.4g" %
+              ("tree" if use_light_tree else "flat", error, render_time, efficiency))
+    print("  Noise reduction per unit of time: %.2fx" % (results[1][3] / results[0][3]))
+
+
+if __name__ == "__main__":
+    main()
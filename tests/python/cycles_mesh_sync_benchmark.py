@@ -0,0 +1,229 @@
+# Apache License, Version 2.0
+
+"""
+Benchmark for Cycles mesh synchronization, renders a heavily subdivided
+mesh with UV maps, vertex colors, tangents and split normals, and reports
+the time spent reading the mesh data from Blender with the bulk sync and
+with the element by element RNA sync.
+
+The script runs itself inside Blender to build and render the scene, and
+parses the Cycles log of that render.
+
+With --test, run inside Blender, a smaller deforming mesh is rendered with
+both syncs, and the script fails when the two renders differ.
+
+Example Usage:
+
+python3 tests/python/cycles_mesh_sync_benchmark.py \
+    --blender ./blender.bin --levels=9
+
+./blender.bin --background --factory-startup \
+    --python tests/python/cycles_mesh_sync_benchmark.py -- --test
+"""
+
+import argparse
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+
+SYNC_RE = re.compile(r"Synchronized (\d+) meshes with (\d+) triangles, ([0-9.e+-]+)s converting, "
+                     r"([0-9.e+-]+)s reading mesh data\.")
+
+
+def create_scene(levels):
+    import bpy
+
+    bpy.ops.wm.read_factory_settings(use_empty=True)
+    scene = bpy.context.scene
+    scene.render.engine = 'CYCLES'
+    scene.render.resolution_x = 64
+    scene.render.resolution_y = 64
+    scene.render.resolution_percentage = 100
+    scene.cycles.samples = 1
+
+    bpy.ops.mesh.primitive_monkey_add()
+    ob = bpy.context.object
+    mesh = ob.data
+    mesh.uv_textures.new("UVMap")
+    mesh.vertex_colors.new("Col")
+    mesh.use_auto_smooth = True
+
+    subsurf = ob.modifiers.new("Subsurf", 'SUBSURF')
+    subsurf.levels = levels
+    subsurf.render_levels = levels
+
+    # Material using every attribute so they all have to be synchronized.
+    material = bpy.data.materials.new("Attributes")
+    material.use_nodes = True
+    nodes = material.node_tree.nodes
+    links = material.node_tree.links
+    color = nodes.new("ShaderNodeAttribute")
+    color.attribute_name = "Col"
+    tangent = nodes.new("ShaderNodeTangent")
+    tangent.direction_type = 'UV_MAP'
+    texco = nodes.new("ShaderNodeTexCoord")
+    mix = nodes.new("ShaderNodeMixRGB")
+    links.new(color.outputs["Color"], mix.inputs[1])
+    links.new(texco.outputs["UV"], mix.inputs[2])
+    links.new(tangent.outputs["Tangent"], mix.inputs["Fac"])
+    links.new(mix.outputs["Color"], nodes["Diffuse BSDF"].inputs["Color"])
+    mesh.materials.append(material)
+
+    camera = bpy.data.cameras.new("Camera")
+    ob = bpy.data.objects.new("Camera", camera)
+    ob.location = (0.0, -4.0, 0.0)
+    ob.rotation_euler = (1.5708, 0.0, 0.0)
+    scene.objects.link(ob)
+    scene.camera = ob
+
+    lamp = bpy.data.lamps.new("Sun", 'SUN')
+    ob = bpy.data.objects.new("Sun", lamp)
+    ob.rotation_euler = (0.8, 0.2, 0.0)
+    scene.objects.link(ob)
+
+    return scene
+
+
+def render_pixels(scene, filepath, use_bulk_sync):
+    import bpy
+
+    scene.cycles.debug_use_mesh_bulk_sync = use_bulk_sync
+    scene.render.filepath = filepath
+    scene.render.image_settings.file_format = 'OPEN_EXR'
+    bpy.ops.render.render(write_still=True)
+
+    image = bpy.data.images.load(filepath)
+    pixels = image.pixels[:]
+    bpy.data.images.remove(image)
+    os.remove(filepath)
+
+    return pixels
+
+
+def rms_error(pixels, reference):
+    total = 0.0
+    num = 0
+    for i in range(0, len(pixels), 4):
+        for c in range(3):
+            diff = pixels[i + c] - reference[i + c]
+            total += diff * diff
+            num += 1
+    return math.sqrt(total / num)
+
+
+def test_scene(args):
+    scene = create_scene(3)
+    scene.render.resolution_x = 160
+    scene.render.resolution_y = 120
+    scene.render.use_motion_blur = True
+    scene.cycles.samples = 16
+    scene.cycles.use_animated_seed = False
+    scene.frame_set(10)
+
+    # Deformation motion blur, so the motion vertices are synced too.
+    ob = scene.objects["Suzanne"]
+    ob.cycles.use_deform_motion = True
+    wave = ob.modifiers.new("Wave", 'WAVE')
+    wave.height = 0.2
+    wave.width = 0.5
+
+    temp = tempfile.mkdtemp()
+    renders = [render_pixels(scene, os.path.join(temp, "%s.exr" % name), use_bulk_sync)
+               for name, use_bulk_sync in (("rna", False), ("bulk", True))]
+    os.rmdir(temp)
+
+    error = rms_error(renders[1], renders[0])
+    print("\nMesh sync test, RMS error %.6f, tolerance %.6f" % (error, args.tolerance))
+    if error > args.tolerance:
+        print("Mesh sync test FAILED")
+        sys.exit(1)
+
+
+def render_scene(argv):
+    import bpy
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--levels", type=int, default=8)
+    parser.add_argument("--rna-sync", action="store_true")
+    parser.add_argument("--test", action="store_true")
+    parser.add_argument("--tolerance", type=float, default=0.001)
+    args = parser.parse_args(argv)
+
+    if args.test:
+        test_scene(args)
+        return
+
+    scene = create_scene(args.levels)
+    scene.cycles.debug_use_mesh_bulk_sync = not args.rna_sync
+    bpy.ops.render.render()
+
+
+def run_blender(args, use_bulk_sync):
+    command = [
+        args.blender,
+        "--background", "--factory-startup",
+        "--debug-cycles", "--verbose", "1",
+        "--python", __file__,
+        "--",
+        "--levels", str(args.levels),
+    ]
+    if not use_bulk_sync:
+        command.append("--rna-sync")
+
+    start = time.time()
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    render_time = time.time() - start
+    output = result.stdout.decode("utf-8", "replace")
+
+    if result.returncode != 0:
+        print(output)
+        return None
+
+    match = SYNC_RE.search(output)
+    if not match:
+        print(output)
+        return None
+
+    return (render_time, int(match.group(1)), int(match.group(2)),
+            float(match.group(3)), float(match.group(4)))
+
+
+def create_argparse():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--blender", required=True)
+    parser.add_argument("--levels", type=int, default=8)
+    return parser
+
+
+def main():
+    args = create_argparse().parse_args()
+
+    results = []
+    for use_bulk_sync in (False, True):
+        result = run_blender(args, use_bulk_sync)
+        if not result:
+            print("Render failed or mesh sync not found in log")
+            return
+        results.append((use_bulk_sync,) + result)
+
+    print("\nMesh sync benchmark, subdivision level %d" % args.levels)
+    for use_bulk_sync, render_time, num_meshes, num_triangles, convert_time, read_time in results:
+        print("  %-4s %d meshes, %d triangles, render time %.2fs" %
+              ("bulk" if use_bulk_sync else "rna", num_meshes, num_triangles, render_time))
+        print("       converting %.2fs, reading %.2fs" % (convert_time, read_time))
+        if read_time > 0.0:
+            print("       reading %.2fM triangles/s" % (num_triangles / read_time / 1e6))
+    if results[1][5] > 0.0:
+        print("  Reading speedup: %.2fx" % (results[0][5] / results[1][5]))
+
+
+if __name__ == "__main__":
+    if "--" in sys.argv:
+        render_scene(sys.argv[sys.argv.index("--") + 1:])
+    else:
+        main()
@@ -0,0 +1,174 @@
+# Apache License, Version 2.0
+
+"""
+Benchmark for Cycles BVH time bounds, renders a crowd of fast deforming
+objects with deformation motion blur, with and without node bounds that move
+with the ray time, and reports camera rays per second.
+
+With --test a small crowd is rendered with and without time bounds, and
+the script fails when the two renders differ.
+
+Example Usage:
+
+./blender.bin --background --factory-startup \
+    --python tests/python/cycles_motion_bvh_benchmark.py -- \
+    --objects=400 --samples=16
+
+./blender.bin --background --factory-startup \
+    --python tests/python/cycles_motion_bvh_benchmark.py -- --test
+"""
+
+import argparse
+import math
+import os
+import random
+import sys
+import tempfile
+import time
+
+import bpy
+
+
+def create_scene(num_objects, seed, resolution_x, resolution_y):
+    random.seed(seed)
+
+    bpy.ops.wm.read_factory_settings(use_empty=True)
+    scene = bpy.context.scene
+    scene.render.engine = 'CYCLES'
+    scene.render.resolution_x = resolution_x
+    scene.render.resolution_y = resolution_y
+    scene.render.resolution_percentage = 100
+    scene.render.use_motion_blur = True
+    scene.render.motion_blur_shutter = 1.0
+    scene.cycles.progressive = 'PATH'
+    scene.cycles.max_bounces = 2
+    scene.cycles.use_animated_seed = False
+    scene.frame_set(10)
+
+    bpy.ops.mesh.primitive_plane_add(radius=50.0)
+
+    # Crowd of subdivided cubes, each flailing with an animated wave so the
+    # triangles sweep through large parts of the scene within the shutter.
+    side = int(math.ceil(math.sqrt(num_objects)))
+    for i in range(num_objects):
+        x = (i % side - side * 0.5) * 2.0
+        y = (i // side - side * 0.5) * 2.0
+        bpy.ops.mesh.primitive_cube_add(radius=0.5, location=(x, y, 1.0))
+        ob = bpy.context.object
+        ob.cycles.use_deform_motion = True
+        ob.cycles.motion_steps = 3
+
+        subsurf = ob.modifiers.new("Subsurf", 'SUBSURF')
+        subsurf.levels = 3
+        subsurf.render_levels = 3
+
+        wave = ob.modifiers.new("Wave", 'WAVE')
+        wave.height = 1.0
+        wave.width = 0.5
+        wave.speed = 0.5 + random.random()
+        wave.time_offset = random.uniform(-10.0, 10.0)
+
+    camera = bpy.data.cameras.new("Camera")
+    ob = bpy.data.objects.new("Camera", camera)
+    ob.location = (0.0, -side * 1.6, side * 1.0)
+    ob.rotation_euler = (math.radians(55.0), 0.0, 0.0)
+    scene.objects.link(ob)
+    scene.camera = ob
+
+    lamp = bpy.data.lamps.new("Sun", 'SUN')
+    ob = bpy.data.objects.new("Sun", lamp)
+    ob.rotation_euler = (0.8, 0.2, 0.0)
+    scene.objects.link(ob)
+
+    return scene
+
+
+def render(scene, samples, use_time_bounds, filepath=None):
+    scene.cycles.samples = samples
+    scene.cycles.debug_use_bvh_time_bounds = use_time_bounds
+
+    if not filepath:
+        start = time.time()
+        bpy.ops.render.render()
+        return time.time() - start
+
+    scene.render.filepath = filepath
+    scene.render.image_settings.file_format = 'OPEN_EXR'
+    bpy.ops.render.render(write_still=True)
+
+    image = bpy.data.images.load(filepath)
+    pixels = image.pixels[:]
+    bpy.data.images.remove(image)
+    os.remove(filepath)
+
+    return pixels
+
+
+def rms_error(pixels, reference):
+    total = 0.0
+    num = 0
+    for i in range(0, len(pixels), 4):
+        for c in range(3):
+            diff = pixels[i + c] - reference[i + c]
+            total += diff * diff
+            num += 1
+    return math.sqrt(total / num)
+
+
+def create_argparse():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--objects", type=int, default=400)
+    parser.add_argument("--samples", type=int, default=16)
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--test", action="store_true",
+                        help="Compare renders with and without time bounds and exit")
+    parser.add_argument("--tolerance", type=float, default=0.001,
+                        help="Largest RMS error between the renders in test mode")
+    return parser
+
+
+def run_test(args):
+    # Time bounds only cull nodes the ray can not hit at its time, so the
+    # renders must match.
+    scene = create_scene(16, args.seed, 160, 120)
+    temp = tempfile.mkdtemp()
+
+    renders = []
+    for use_time_bounds in (False, True):
+        filepath = os.path.join(temp, "bounds.exr" if use_time_bounds else "union.exr")
+        renders.append(render(scene, 16, use_time_bounds, filepath))
+
+    os.rmdir(temp)
+
+    error = rms_error(renders[1], renders[0])
+    print("\nMotion BVH test, RMS error %.6f, tolerance %.6f" % (error, args.tolerance))
+    if error > args.tolerance:
+        print("Motion BVH test FAILED")
+        sys.exit(1)
+
+
+def main():
+    argv = sys.argv[sys.argv.index("--") + 1:] if "--" in sys.argv else []
+    args = create_argparse().parse_args(argv)
+
+    if args.test:
+        run_test(args)
+        return
+
+    scene = create_scene(args.objects, args.seed, 320, 240)
+    num_rays = scene.render.resolution_x * scene.render.resolution_y * args.samples
+
+    results = []
+    for use_time_bounds in (False, True):
+        render_time = render(scene, args.samples, use_time_bounds)
+        results.append((use_time_bounds, render_time, num_rays / render_time))
+
+    print("\nMotion BVH benchmark, %d deforming objects, %d samples" % (args.objects, args.samples))
+    for use_time_bounds, render_time, rays_per_second in results:
+        print("  %-12s time %.2fs  camera rays/s %.0f" %
+              ("time bounds" if use_time_bounds else "union", render_time, rays_per_second))
+    print("  Speedup: %.2fx" % (results[0][1] / results[1][1]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+# Apache License, Version 2.0
+
+"""
+Benchmark for the Cycles network device, renders a scene with the local CPU
+device and with several cycles_server processes on the local machine, and
+compares the render times. Optionally one server is killed during the render
+to test that its tiles are rendered by the remaining servers.
+
+With --test a small scene is generated instead of loading one, and the
+script fails when the network render differs from the CPU render.
+
+Example Usage:
+
+python3 tests/python/cycles_network_benchmark.py \
+    --blender ./blender.bin --server ./cycles_server \
+    --scene scene.blend --servers=4 --kill-after=5
+
+python3 tests/python/cycles_network_benchmark.py \
+    --blender ./blender.bin --server ./cycles_server \
+    --idiff idiff --test --kill-after=2
+"""
+
+import argparse
+import multiprocessing
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+
+BASE_PORT = 5130
+
+
+# Scene setup, run inside Blender before the frame is rendered.
+
+def create_test_scene():
+    import bpy
+
+    bpy.ops.wm.read_factory_settings(use_empty=True)
+    scene = bpy.context.scene
+    scene.render.engine = 'CYCLES'
+    scene.render.resolution_x = 160
+    scene.render.resolution_y = 120
+    scene.render.resolution_percentage = 100
+    scene.render.tile_x = 32
+    scene.render.tile_y = 32
+    scene.cycles.samples = 16
+    scene.cycles.progressive = 'PATH'
+    scene.cycles.max_bounces = 4
+    scene.cycles.use_animated_seed = False
+
+    # Textured spheres so every tile has some shading to do.
+    material = bpy.data.materials.new("Noise")
+    material.use_nodes = True
+    nodes = material.node_tree.nodes
+    noise = nodes.new("ShaderNodeTexNoise")
+    material.node_tree.links.new(noise.outputs["Color"], nodes["Diffuse BSDF"].inputs["Color"])
+    for i in range(9):
+        bpy.ops.mesh.primitive_uv_sphere_add(size=1.0, location=((i % 3 - 1) * 2.2, (i // 3 - 1) * 2.2, 0.0))
+        bpy.context.object.data.materials.append(material)
+
+    camera = bpy.data.cameras.new("Camera")
+    ob = bpy.data.objects.new("Camera", camera)
+    ob.location = (0.0, 0.0, 9.0)
+    scene.objects.link(ob)
+    scene.camera = ob
+
+    lamp = bpy.data.lamps.new("Sun", 'SUN')
+    ob = bpy.data.objects.new("Sun", lamp)
+    ob.rotation_euler = (0.8, 0.2, 0.0)
+    scene.objects.link(ob)
+
+
+def setup_scene(argv):
+    import bpy
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--device", required=True)
+    parser.add_argument("--test", action="store_true")
+    args = parser.parse_args(argv)
+
+    if args.test:
+        create_test_scene()
+    else:
+        bpy.context.scene.render.engine = 'CYCLES'
+    bpy.context.scene.cycles.device = args.device
+
+
+# Benchmark driver, run outside of Blender.
+
+def render(args, device, env, filepath):
+    output = tempfile.mkdtemp()
+    command = [args.blender, "--background", "--factory-startup"]
+    if args.scene:
+        command.append(args.scene)
+    # Blender handles its arguments in order, so the scene is set up before
+    # the frame is rendered, the arguments after -- are for this script.
+    command += [
+        "--python", os.path.realpath(__file__),
+        "--render-output", os.path.join(output, "frame_####"),
+        "--render-format", "PNG",
+        "--render-frame", "1",
+        "--",
+        "--device", device,
+    ]
+    if args.test:
+        command.append("--test")
+
+    start = time.time()
+    result = subprocess.run(command, env=env, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    render_time = time.time() - start
+
+    frames = os.listdir(output)
+    for frame in frames:
+        if filepath:
+            os.rename(os.path.join(output, frame), filepath)
+        else:
+            os.remove(os.path.join(output, frame))
+    os.rmdir(output)
+
+    if result.returncode != 0 or not frames:
+        print(result.stdout.decode("utf-8", "replace"))
+        return None
+
+    return render_time
+
+
+def rms_error(args, reference_image, image):
+    command = (
+        args.idiff,
+        reference_image,
+        image,
+        )
+    try:
+        output = subprocess.check_output(command)
+    except subprocess.CalledProcessError as e:
+        output = e.output
+    for line in output.decode("utf-8").splitlines():
+        line = line.strip()
+        if line.startswith("RMS error"):
+            return float(line.split("=")[1])
+    return None
+
+
+def start_servers(args):
+    threads = max(1, multiprocessing.cpu_count() // args.servers)
+    servers = []
+
+    for i in range(args.servers):
+        command = [args.server, "--port", str(BASE_PORT + i), "--threads", str(threads)]
+        servers.append(subprocess.Popen(command, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL))
+
+    # Give the servers time to start listening.
+    time.sleep(1.0)
+    return servers
+
+
+def stop_servers(servers):
+    for server in servers:
+        if server.poll() is None:
+            server.kill()
+        server.wait()
+
+
+def create_argparse():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--blender", required=True)
+    parser.add_argument("--server", required=True)
+    parser.add_argument("--scene")
+    parser.add_argument("--servers", type=int, default=4)
+    parser.add_argument("--kill-after", type=float, default=0.0,
+                        help="Kill one server after this many seconds, 0 to disable")
+    parser.add_argument("--test", action="store_true",
+                        help="Render a generated scene and compare the network render to the CPU render")
+    parser.add_argument("--idiff", help="idiff executable, required for --test")
+    parser.add_argument("--tolerance", type=float, default=0.001,
+                        help="Largest RMS error between the renders in test mode")
+    return parser
+
+
+def main():
+    parser = create_argparse()
+    args = parser.parse_args()
+
+    if not args.scene and not args.test:
+        parser.error("--scene is required unless --test is used")
+    if args.test and not args.idiff:
+        parser.error("--idiff is required for --test")
+
+    temp = tempfile.mkdtemp() if args.test else None
+    images = [os.path.join(temp, "%s.png" % device) for device in ("cpu", "network")] if temp else [None, None]
+
+    cpu_time = render(args, 'CPU', os.environ.copy(), images[0])
+
+    env = os.environ.copy()
+    env["CYCLES_NETWORK_SERVERS"] = ",".join(
+        "127.0.0.1:%d" % (BASE_PORT + i) for i in range(args.servers))
+
+    servers = start_servers(args)
+    try:
+        if args.kill_after > 0.0:
+            killer = subprocess.Popen([sys.executable, "-c",
+                                       "import os, signal, time; time.sleep(%f); os.kill(%d, signal.SIGKILL)" %
+                                       (args.kill_after, servers[0].pid)])
+        network_time = render(args, 'NETWORK', env, images[1])
+        if args.kill_after > 0.0:
+            killer.wait()
+    finally:
+        stop_servers(servers)
+
+    print("\nNetwork device benchmark, %d local servers" % args.servers)
+    print("  CPU      %s" % ("%.2fs" % cpu_time if cpu_time else "failed"))
+    print("  Network  %s" % ("%.2fs" % network_time if network_time else "failed"))
+    if cpu_time and network_time:
+        print("  Network overhead: %.1f%%" % (100.0 * (network_time - cpu_time) / cpu_time))
+
+    if args.test:
+        error = None
+        if cpu_time and network_time:
+            error = rms_error(args, images[0], images[1])
+
+        for image in images:
+            if os.path.exists(image):
+                os.remove(image)
+        os.rmdir(temp)
+
+        if error is None or error > args.tolerance:
+            print("Network test FAILED")
+            sys.exit(1)
+        print("  RMS error %.6f, tolerance %.6f" % (error, args.tolerance))
+
+
+if __name__ == "__main__":
+    if "--" in sys.argv:
+        setup_scene(sys.argv[sys.argv.index("--") + 1:])
+    else:
+        main()
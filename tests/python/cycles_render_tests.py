@@ -8,22 +8,41 @@ import sys
 import tempfile
 
 
+# Largest RMS error against the reference render with adaptive sampling,
+# individual pixels differ more since they get fewer samples.
+ADAPTIVE_RMS_LIMIT = 0.01
+
+ADAPTIVE_SCRIPT = (
+    "import bpy\n"
+    "cscene = bpy.context.scene.cycles\n"
+    "cscene.device = 'CPU'\n"
+    "cscene.use_progressive_refine = False\n"
+    "cscene.use_adaptive_sampling = True\n"
+    )
+
+
 def render_file(filepath):
-    command = (
+    command = [
         BLENDER,
         "--background",
         "-noaudio",
         "--factory-startup",
         filepath,
         "-E", "CYCLES",
+        ]
+    if ADAPTIVE:
+        command += ["--python", ADAPTIVE_SCRIPT_FILE]
+    command += [
         "-o", TEMP_FILE_MASK,
         "-F", "PNG",
         "-f", "1",
-        )
+        ]
     try:
         output = subprocess.check_output(command)
         if VERBOSE:
             print(output.decode("utf-8"))
+        if ADAPTIVE and b"Adaptive Sampling Skipped" in output:
+            ADAPTIVE_SKIPPED.append(test_get_name(filepath))
         return None
     except subprocess.CalledProcessError as e:
         if os.path.exists(TEMP_FILE):
@@ -48,6 +67,26 @@ def test_get_name(filepath):
     return os.path.splitext(filename)[0]
 
 
+def verify_noise(reference_image):
+    command = (
+        IDIFF,
+        reference_image,
+        TEMP_FILE,
+        )
+    try:
+        output = subprocess.check_output(command)
+    except subprocess.CalledProcessError as e:
+        output = e.output
+    if VERBOSE:
+        print(output.decode("utf-8"))
+    for line in output.decode("utf-8").splitlines():
+        line = line.strip()
+        if line.startswith("RMS error"):
+            rms_error = float(line.split("=")[1])
+            return rms_error <= ADAPTIVE_RMS_LIMIT
+    return False
+
+
 def verify_output(filepath):
     testname = test_get_name(filepath)
     dirpath = os.path.dirname(filepath)
@@ -55,6 +94,8 @@ def verify_output(filepath):
     reference_image = os.path.join(reference_dirpath, testname + ".png")
     if not os.path.exists(reference_image):
         return False
+    if ADAPTIVE:
+        return verify_noise(reference_image)
     command = (
         IDIFF,
         "-fail", "0.01",
@@ -121,6 +162,11 @@ def run_all_tests(dirpath):
         for test in failed_tests:
             print("   ", test)
         return False
+    # Matching the reference renders says nothing if every pixel still got
+    # all samples, make sure adaptive sampling stopped some pixels early.
+    if ADAPTIVE and not ADAPTIVE_SKIPPED:
+        print("\n\nAdaptive sampling did not skip samples in any test!")
+        return False
     return True
 
 
@@ -129,6 +175,7 @@ def create_argparse():
     parser.add_argument("-blender", nargs="+")
     parser.add_argument("-testdir", nargs=1)
     parser.add_argument("-idiff", nargs=1)
+    parser.add_argument("-adaptive", action="store_true")
     return parser
 
 
@@ -138,11 +185,12 @@ def main():
 
     global BLENDER, ROOT, IDIFF
     global TEMP_FILE, TEMP_FILE_MASK, TEST_SCRIPT
-    global VERBOSE
+    global VERBOSE, ADAPTIVE, ADAPTIVE_SCRIPT_FILE, ADAPTIVE_SKIPPED
 
     BLENDER = args.blender[0]
     ROOT = args.testdir[0]
     IDIFF = args.idiff[0]
+    ADAPTIVE = args.adaptive
 
     TEMP = tempfile.mkdtemp()
     TEMP_FILE_MASK = os.path.join(TEMP, "test")
@@ -150,6 +198,12 @@ def main():
 
     TEST_SCRIPT = os.path.join(os.path.dirname(__file__), "runtime_check.py")
 
+    ADAPTIVE_SCRIPT_FILE = os.path.join(TEMP, "adaptive_sampling.py")
+    ADAPTIVE_SKIPPED = []
+    if ADAPTIVE:
+        with open(ADAPTIVE_SCRIPT_FILE, "w") as f:
+            f.write(ADAPTIVE_SCRIPT)
+
     VERBOSE = os.environ.get("BLENDER_VERBOSE") is not None
 
     ok = run_all_tests(ROOT)
@@ -157,6 +211,8 @@ def main():
     # Cleanup temp files and folders
     if os.path.exists(TEMP_FILE):
         os.remove(TEMP_FILE)
+    if os.path.exists(ADAPTIVE_SCRIPT_FILE):
+        os.remove(ADAPTIVE_SCRIPT_FILE)
     os.rmdir(TEMP)
 
     sys.exit(not ok)
@@ -0,0 +1,254 @@
+# Apache License, Version 2.0
+
+"""
+Benchmark for the Cycles SVM shader optimizer, renders spheres with a material
+made of constant math, mix and color ramp nodes, duplicated coordinate subgraphs
+and long chains of math nodes, with and without shader optimization. Reports
+the SVM program length from the Cycles log and the render time.
+
+The script runs itself inside Blender to build and render the scene, and
+parses the Cycles log of that render.
+
+With --test, run inside Blender, a smaller scene is rendered with and
+without shader optimization, and the script fails when the two renders
+differ.
+
+Example Usage:
+
+python3 tests/python/cycles_svm_optimize_benchmark.py \
+    --blender ./blender.bin --chains=16 --samples=32
+
+./blender.bin --background --factory-startup \
+    --python tests/python/cycles_svm_optimize_benchmark.py -- --test
+"""
+
+import argparse
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+
+LENGTH_RE = re.compile(r"SVM program length ([0-9]+) nodes")
+
+
+def create_material(num_chains):
+    import bpy
+
+    material = bpy.data.materials.new("Optimize")
+    material.use_nodes = True
+    nodes = material.node_tree.nodes
+    links = material.node_tree.links
+    diffuse = nodes["Diffuse BSDF"]
+
+    def math(operation, a, b):
+        node = nodes.new("ShaderNodeMath")
+        node.operation = operation
+        for socket, value in zip(node.inputs, (a, b)):
+            if isinstance(value, float):
+                socket.default_value = value
+            else:
+                links.new(value, socket)
+        return node.outputs["Value"]
+
+    # Constant subgraph, folded to a single value.
+    constant = math('MULTIPLY', math('ADD', 0.25, 0.5), 2.0)
+    ramp = nodes.new("ShaderNodeValToRGB")
+    links.new(constant, ramp.inputs["Fac"])
+    mix = nodes.new("ShaderNodeMixRGB")
+    mix.blend_type = 'OVERLAY'
+    mix.inputs["Color2"].default_value = (0.2, 0.4, 0.8, 1.0)
+    links.new(ramp.outputs["Color"], mix.inputs["Color1"])
+    links.new(constant, mix.inputs["Fac"])
+
+    # Identical coordinate subgraphs, merged into one, each followed by a chain
+    # of math nodes with constant operands that is fused into one node.
+    result = None
+    for i in range(num_chains):
+        texco = nodes.new("ShaderNodeTexCoord")
+        dot = nodes.new("ShaderNodeVectorMath")
+        dot.operation = 'DOT_PRODUCT'
+        dot.inputs[1].default_value = (0.3, 0.6, 0.1)
+        links.new(texco.outputs["Object"], dot.inputs[0])
+
+        value = dot.outputs["Value"]
+        value = math('SUBTRACT', value, 0.5)
+        value = math('MULTIPLY', value, 1.0 + i * 0.1)
+        value = math('POWER', value, 2.0)
+        value = math('ADD', value, 0.1)
+        value = math('MINIMUM', value, 1.0)
+
+        result = value if result is None else math('ADD', result, value)
+
+    result = math('DIVIDE', result, float(num_chains))
+    final = nodes.new("ShaderNodeMixRGB")
+    links.new(result, final.inputs["Fac"])
+    links.new(mix.outputs["Color"], final.inputs["Color1"])
+    links.new(final.outputs["Color"], diffuse.inputs["Color"])
+
+    return material
+
+
+def create_scene(num_chains):
+    import bpy
+
+    bpy.ops.wm.read_factory_settings(use_empty=True)
+    scene = bpy.context.scene
+    scene.render.engine = 'CYCLES'
+    scene.render.resolution_x = 320
+    scene.render.resolution_y = 240
+    scene.render.resolution_percentage = 100
+    scene.cycles.progressive = 'PATH'
+    scene.cycles.max_bounces = 4
+    scene.cycles.use_animated_seed = False
+
+    material = create_material(num_chains)
+    for i in range(9):
+        bpy.ops.mesh.primitive_uv_sphere_add(size=1.0, location=((i % 3 - 1) * 2.2, (i // 3 - 1) * 2.2, 0.0))
+        bpy.context.object.data.materials.append(material)
+
+    camera = bpy.data.cameras.new("Camera")
+    ob = bpy.data.objects.new("Camera", camera)
+    ob.location = (0.0, 0.0, 9.0)
+    scene.objects.link(ob)
+    scene.camera = ob
+
+    lamp = bpy.data.lamps.new("Sun", 'SUN')
+    ob = bpy.data.objects.new("Sun", lamp)
+    ob.rotation_euler = (0.8, 0.2, 0.0)
+    scene.objects.link(ob)
+
+    return scene
+
+
+def render_pixels(scene, filepath, optimize):
+    import bpy
+
+    scene.cycles.debug_use_shader_optimization = optimize
+    scene.render.filepath = filepath
+    scene.render.image_settings.file_format = 'OPEN_EXR'
+    bpy.ops.render.render(write_still=True)
+
+    image = bpy.data.images.load(filepath)
+    pixels = image.pixels[:]
+    bpy.data.images.remove(image)
+    os.remove(filepath)
+
+    return pixels
+
+
+def rms_error(pixels, reference):
+    total = 0.0
+    num = 0
+    for i in range(0, len(pixels), 4):
+        for c in range(3):
+            diff = pixels[i + c] - reference[i + c]
+            total += diff * diff
+            num += 1
+    return math.sqrt(total / num)
+
+
+def test_scene(args):
+    # Fused math chains round differently, so allow for small differences.
+    scene = create_scene(4)
+    scene.render.resolution_x = 160
+    scene.render.resolution_y = 120
+    scene.cycles.samples = 16
+
+    temp = tempfile.mkdtemp()
+    renders = [render_pixels(scene, os.path.join(temp, "%s.exr" % name), optimize)
+               for name, optimize in (("unoptimized", False), ("optimized", True))]
+    os.rmdir(temp)
+
+    error = rms_error(renders[1], renders[0])
+    print("\nSVM optimizer test, RMS error %.6f, tolerance %.6f" % (error, args.tolerance))
+    if error > args.tolerance:
+        print("SVM optimizer test FAILED")
+        sys.exit(1)
+
+
+def render_scene(argv):
+    import bpy
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--chains", type=int, default=16)
+    parser.add_argument("--samples", type=int, default=32)
+    parser.add_argument("--optimize", type=int, default=1)
+    parser.add_argument("--test", action="store_true")
+    parser.add_argument("--tolerance", type=float, default=0.005)
+    args = parser.parse_args(argv)
+
+    if args.test:
+        test_scene(args)
+        return
+
+    scene = create_scene(args.chains)
+    scene.cycles.samples = args.samples
+    scene.cycles.debug_use_shader_optimization = bool(args.optimize)
+
+    start = time.time()
+    bpy.ops.render.render()
+    print("Render time %.4f" % (time.time() - start))
+
+
+def run_blender(args, optimize):
+    command = [
+        args.blender,
+        "--background", "--factory-startup",
+        "--debug-cycles", "--verbose", "1",
+        "--python", __file__,
+        "--",
+        "--chains", str(args.chains),
+        "--samples", str(args.samples),
+        "--optimize", str(int(optimize)),
+    ]
+
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    output = result.stdout.decode("utf-8", "replace")
+
+    match = re.search(r"Render time ([0-9.]+)", output)
+    lengths = LENGTH_RE.findall(output)
+
+    if result.returncode != 0 or not match or not lengths:
+        print(output)
+        return None
+
+    # The last shader update is the one used for the render.
+    return int(lengths[-1]), float(match.group(1))
+
+
+def create_argparse():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--blender", required=True)
+    parser.add_argument("--chains", type=int, default=16)
+    parser.add_argument("--samples", type=int, default=32)
+    return parser
+
+
+def main():
+    args = create_argparse().parse_args()
+
+    results = []
+    for optimize in (False, True):
+        result = run_blender(args, optimize)
+        if not result:
+            print("Render failed")
+            return
+        results.append(result)
+
+    print("\nSVM optimizer benchmark, %d math chains, %d samples" % (args.chains, args.samples))
+    for optimize, (length, render_time) in zip((False, True), results):
+        print("  %-12s program length %6d nodes  time %.2fs" %
+              ("optimized" if optimize else "unoptimized", length, render_time))
+    print("  Program length reduction: %.1f%%" % (100.0 * (results[0][0] - results[1][0]) / results[0][0]))
+    print("  Speedup: %.2fx" % (results[0][1] / results[1][1]))
+
+
+if __name__ == "__main__":
+    if "--" in sys.argv:
+        render_scene(sys.argv[sys.argv.index("--") + 1:])
+    else:
+        main()
@@ -0,0 +1,190 @@
+# Apache License, Version 2.0
+
+"""
+Benchmark for the Cycles volume acceleration grid, simulates a smoke plume
+rising in a large domain and renders it with and without skipping the empty
+space of the domain, and reports camera rays per second.
+
+With --test a smaller plume is rendered with and without the grid, and the
+script fails when the two renders differ. This is done once with the smoke
+material as created, which is driven by the voxel attributes only, and once
+with a constant density added, for which no grid must be built.
+
+Example Usage:
+
+./blender.bin --background --factory-startup \
+    --python tests/python/cycles_volume_grid_benchmark.py -- \
+    --resolution=96 --frames=40 --samples=16
+
+./blender.bin --background --factory-startup \
+    --python tests/python/cycles_volume_grid_benchmark.py -- --test
+"""
+
+import argparse
+import math
+import os
+import sys
+import tempfile
+import time
+
+import bpy
+
+
+def create_scene(resolution, frames, resolution_x, resolution_y):
+    bpy.ops.wm.read_factory_settings(use_empty=True)
+    scene = bpy.context.scene
+    scene.render.engine = 'CYCLES'
+    scene.render.resolution_x = resolution_x
+    scene.render.resolution_y = resolution_y
+    scene.render.resolution_percentage = 100
+    scene.cycles.progressive = 'PATH'
+    scene.cycles.max_bounces = 4
+    scene.cycles.volume_step_size = 0.05
+    scene.cycles.use_animated_seed = False
+    scene.frame_start = 1
+    scene.frame_end = frames
+
+    # Small emitter with fire and smoke, the quick effect adds the domain and
+    # a material driven by the density and flame voxel attributes.
+    bpy.ops.mesh.primitive_cube_add(radius=0.25, location=(0.0, 0.0, -1.5))
+    bpy.ops.object.quick_smoke(style='BOTH')
+
+    domain = next(ob for ob in scene.objects if ob.name.startswith("Smoke Domain"))
+    domain.location = (0.0, 0.0, 0.0)
+    domain.scale = (2.0, 2.0, 2.0)
+    settings = domain.modifiers["Smoke"].domain_settings
+    settings.resolution_max = resolution
+    settings.point_cache.frame_end = frames
+
+    # Step through the frames to simulate the plume, it only fills a small
+    # part of the domain.
+    for frame in range(1, frames + 1):
+        scene.frame_set(frame)
+
+    camera = bpy.data.cameras.new("Camera")
+    ob = bpy.data.objects.new("Camera", camera)
+    ob.location = (0.0, -7.0, 0.0)
+    ob.rotation_euler = (1.5708, 0.0, 0.0)
+    scene.objects.link(ob)
+    scene.camera = ob
+
+    lamp = bpy.data.lamps.new("Sun", 'SUN')
+    ob = bpy.data.objects.new("Sun", lamp)
+    ob.rotation_euler = (0.8, 0.2, 0.0)
+    scene.objects.link(ob)
+
+    return scene
+
+
+def render(scene, samples, use_volume_grid, filepath=None):
+    scene.cycles.samples = samples
+    scene.cycles.debug_use_volume_grid = use_volume_grid
+
+    if not filepath:
+        start = time.time()
+        bpy.ops.render.render()
+        return time.time() - start
+
+    scene.render.filepath = filepath
+    scene.render.image_settings.file_format = 'OPEN_EXR'
+    bpy.ops.render.render(write_still=True)
+
+    image = bpy.data.images.load(filepath)
+    pixels = image.pixels[:]
+    bpy.data.images.remove(image)
+    os.remove(filepath)
+
+    return pixels
+
+
+def add_constant_density(scene, density):
+    # Thin haze filling the whole domain, outside of the voxel data.
+    domain = next(ob for ob in scene.objects if ob.name.startswith("Smoke Domain"))
+    tree = domain.active_material.node_tree
+    scatter = next(node for node in tree.nodes if node.type == 'SCATTER_VOLUME')
+
+    node_add = tree.nodes.new(type='ShaderNodeMath')
+    node_add.operation = 'ADD'
+    node_add.inputs[1].default_value = density
+    tree.links.new(scatter.inputs["Density"].links[0].from_socket, node_add.inputs[0])
+    tree.links.new(node_add.outputs["Value"], scatter.inputs["Density"])
+
+
+def rms_error(pixels, reference):
+    total = 0.0
+    num = 0
+    for i in range(0, len(pixels), 4):
+        for c in range(3):
+            diff = pixels[i + c] - reference[i + c]
+            total += diff * diff
+            num += 1
+    return math.sqrt(total / num)
+
+
+def create_argparse():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--resolution", type=int, default=96)
+    parser.add_argument("--frames", type=int, default=40)
+    parser.add_argument("--samples", type=int, default=16)
+    parser.add_argument("--test", action="store_true",
+                        help="Compare renders with and without the grid and exit")
+    parser.add_argument("--tolerance", type=float, default=0.001,
+                        help="Largest RMS error between the renders in test mode")
+    return parser
+
+
+def test_scene(scene, name, tolerance):
+    # The grid only skips space where the volume is empty, so the renders
+    # must match.
+    temp = tempfile.mkdtemp()
+
+    renders = []
+    for use_volume_grid in (False, True):
+        filepath = os.path.join(temp, "grid.exr" if use_volume_grid else "nogrid.exr")
+        renders.append(render(scene, 16, use_volume_grid, filepath))
+
+    os.rmdir(temp)
+
+    error = rms_error(renders[1], renders[0])
+    print("\nVolume grid test, %s, RMS error %.6f, tolerance %.6f" % (name, error, tolerance))
+    return error <= tolerance
+
+
+def run_test(args):
+    scene = create_scene(32, 16, 160, 120)
+    success = test_scene(scene, "voxel density", args.tolerance)
+
+    add_constant_density(scene, 0.1)
+    success = test_scene(scene, "constant density", args.tolerance) and success
+
+    if not success:
+        print("Volume grid test FAILED")
+        sys.exit(1)
+
+
+def main():
+    argv = sys.argv[sys.argv.index("--") + 1:] if "--" in sys.argv else []
+    args = create_argparse().parse_args(argv)
+
+    if args.test:
+        run_test(args)
+        return
+
+    scene = create_scene(args.resolution, args.frames, 320, 240)
+    num_rays = scene.render.resolution_x * scene.render.resolution_y * args.samples
+
+    results = []
+    for use_volume_grid in (False, True):
+        render_time = render(scene, args.samples, use_volume_grid)
+        results.append((use_volume_grid, render_time, num_rays / render_time))
+
+    print("\nVolume grid benchmark, smoke resolution %d, frame %d, %d samples" %
+          (args.resolution, args.frames, args.samples))
+    for use_volume_grid, render_time, rays_per_second in results:
+        print("  %-12s time %.2fs  camera rays/s %.0f" %
+              ("grid" if use_volume_grid else "no grid", render_time, rays_per_second))
+    print("  Speedup: %.2fx" % (results[0][1] / results[1][1]))
+
+
+if __name__ == "__main__":
+    main()